@@ -19,55 +19,54 @@
 
 //*****************************************************************************
 //
-//	The following are enumeration classes for the DFPlayer Mini.
+//	The following are defines for the user requests.
 //
 //*****************************************************************************
 
-//  MP3 folders from 01 to 03.
-//  Folder order must be the same in the SD card.
-enum class MP3_Folder : uint8_t
-{
-    STATUS_INFO = 1,
-    HOURS,
-    MINUTES
-};
+//  Number of user profiles served by the device. It must match
+//  the number of entries in USER_PROFILES.
+#define MAX_USERS               2
 
-//  MP3 files for folder 01 (STATUS_INFO) from 001 to 010.
-//  File order must be the same in the SD card.
-enum class MP3_File : uint8_t
-{
-    // Hi, your device is being updated, please wait.
-    UPDATE_DEVICE = 1,
-    // Your device is ready. You might now ask Google for your next activity.
-    DEVICE_READY,
-    // Hi, your device has not been authenticated yet. 
-    // Please open a terminal and follow the steps indicated.
-    OPEN_TERMINAL,
-    // Your request has been received, I am now locating your next event.
-    REQ_RECEIVED,
-    // Location and time found, please wait while I estimate the 
-    // ideal departure time. 
-    ESTIMATING_DT,
-    // There are no events scheduled on your calendar for the next three hours.
-    NO_EVENTS,
-    // An error has occurred. Please open a terminal to see what caused 
-    // the error and fix it before rebooting your device.
-    APP_FAILED,
-    // Based on your current location, you would be on time for your 
-    // upcoming event by leaving in
-    TIME_LEFT,
-    // The results showed that you have to leave now to be on time 
-    // for your upcoming event.
-    NO_TIME_LEFT,
-    // Based on your current location, if you leave now, you would be late for
-    // your upcoming event by 
-    LATE,
-};
+//  Time window used to count the requests answered per minute, and
+//  max. number of answers kept to count them.
+#define ANSWERS_WINDOW          60000
+#define ANSWERS_LOG_SIZE        16
+
+//  Time window in milliseconds in which a repeated request of a user is
+//  coalesced onto the request in flight. After it, the repeated request 
+//  supersedes the one in flight, which is restarted.
+#define COALESCE_WINDOW         10000
+
+//  Time in milliseconds the cloud can be disconnected before the requests in
+//  flight are answered from the cache (offline answer).
+#define OFFLINE_GRACE_TIME      5000
+//  Max. age in seconds of the calendar snapshot used for an offline answer,
+//  the calendar requests search the next three hours.
+#define OFFLINE_CALENDAR_MAX_AGE    10800
+//  Min. difference in seconds between the departure time of an offline 
+//  answer and the live one, for the live answer to be played as a correction
+//  once the cloud is back.
+#define RECONCILE_TOLERANCE     120
+
+//  Time in milliseconds a whole answer is replayed to a repeated request of
+//  the same user, without any request to the Google APIs (answer memo).
+#define ANSWER_MEMO_TTL         60000
+//  Time bucket of the answer memo in seconds. Within the same bucket, the 
+//  travel estimate of an answer is reused if the next event, the origin cell
+//  and the travel mode did not change, so only the calendar is refreshed.
+#define ANSWER_MEMO_BUCKET      300
+//  Size of the origin cell of the answer memo in degrees (about 1 km).
+#define ANSWER_MEMO_CELL        0.01f
+//  Number of buckets of the answer latency histograms. The first bucket 
+//  goes up to LATENCY_FIRST_BUCKET milliseconds and each next one doubles 
+//  its upper bound, the last one has none.
+#define LATENCY_BUCKETS         8
+#define LATENCY_FIRST_BUCKET    125
 
 //*****************************************************************************
 //
 //	The following are enumeration classes for the application stages and 
-//  event states.
+//  event states, and the events that drive them.
 //
 //*****************************************************************************
 
@@ -75,14 +74,9 @@ enum class App_Stage : uint8_t
 {
     GEOLOCATION,
     OAUTH2,
-    CALENDAR,
-    DISTANCE_MATRIX,
-    DATA_PROCESSING,
     ASSISTANT,
     FAILED
 };
-App_Stage app_stage;
-App_Stage last_app_stage;
 
 enum class Event_State : uint8_t
 {
@@ -90,7 +84,74 @@ enum class Event_State : uint8_t
     WAIT_FOR_RESPONSE,
     COMPLETED
 };
-Event_State event_state;
+
+enum class App_Event : uint8_t
+{
+    START,              //  Cold start, the device location is unknown.
+    LOCATED,            //  Device location found, restored or set manually.
+    READY,              //  Users authorized, or location revalidated.
+    REVALIDATE,         //  Cached location revalidated in the background.
+    FAIL
+};
+
+enum class Event_Signal : uint8_t
+{
+    START,              //  A new event is to be published.
+    PUBLISHED,
+    COMPLETE            //  The stage of the event changed.
+};
+
+enum class Request_Stage : uint8_t
+{
+    IDLE,
+    TOKEN,
+    CALENDAR,
+    DISTANCE_MATRIX,
+    ANSWER
+};
+
+enum class Answer_Source : uint8_t
+{
+    LIVE,
+    CACHED,
+    MEMO
+};
+
+//*****************************************************************************
+//
+//	The following are the transition tables of the application stages and 
+//  event states (see State_Machine).
+//
+//*****************************************************************************
+
+struct App_Stage_Machine
+{
+    static constexpr SM_Table<App_Stage, App_Event, 4, 5> TABLE = make_sm_table<App_Stage, App_Event, 4, 5>({
+        {App_Stage::GEOLOCATION, App_Event::START, App_Stage::GEOLOCATION},
+        {App_Stage::GEOLOCATION, App_Event::LOCATED, App_Stage::OAUTH2},
+        {App_Stage::GEOLOCATION, App_Event::READY, App_Stage::ASSISTANT},
+        {App_Stage::GEOLOCATION, App_Event::FAIL, App_Stage::FAILED},
+        {App_Stage::OAUTH2, App_Event::READY, App_Stage::ASSISTANT},
+        {App_Stage::OAUTH2, App_Event::FAIL, App_Stage::FAILED},
+        {App_Stage::ASSISTANT, App_Event::REVALIDATE, App_Stage::GEOLOCATION}
+    });
+};
+
+struct Event_State_Machine
+{
+    static constexpr SM_Table<Event_State, Event_Signal, 3, 3> TABLE = make_sm_table<Event_State, Event_Signal, 3, 3>({
+        {Event_State::PUBLISHING, Event_Signal::START, Event_State::PUBLISHING},
+        {Event_State::WAIT_FOR_RESPONSE, Event_Signal::START, Event_State::PUBLISHING},
+        {Event_State::COMPLETED, Event_Signal::START, Event_State::PUBLISHING},
+        {Event_State::PUBLISHING, Event_Signal::PUBLISHED, Event_State::WAIT_FOR_RESPONSE},
+        {Event_State::PUBLISHING, Event_Signal::COMPLETE, Event_State::COMPLETED},
+        {Event_State::WAIT_FOR_RESPONSE, Event_Signal::COMPLETE, Event_State::COMPLETED},
+        {Event_State::COMPLETED, Event_Signal::COMPLETE, Event_State::COMPLETED}
+    });
+};
+
+constexpr SM_Table<App_Stage, App_Event, 4, 5> App_Stage_Machine::TABLE;
+constexpr SM_Table<Event_State, Event_Signal, 3, 3> Event_State_Machine::TABLE;
 
 //*****************************************************************************
 //
@@ -100,24 +161,299 @@ Event_State event_state;
 
 //  Digital pin assigned to read the MP3 player state.
 const uint8_t MP3_BUSY_PIN = 2; 
-//  Set your time zone here. You MUST consider Daylight saving time (DST).
-const int8_t TIME_ZONE = +1; 
+//  Set your time zone here, by its tz database name (see TIME_ZONE_RULES in
+//  time_zone.h). Daylight saving time (DST) is applied by the zone rules.
+#define TIME_ZONE_NAME          "Europe/Madrid"
+static_assert(find_time_zone(TIME_ZONE_NAME) < NUM_TIME_ZONES, "TIME_ZONE_NAME is not in TIME_ZONE_RULES.");
+const Time_Zone_Rule &TIME_ZONE = TIME_ZONE_RULES[find_time_zone(TIME_ZONE_NAME)];
 const String CLIENT_SECRET = "<TYPE_YOUR_CLIENT_SECRET_HERE>";
-const String CALENDAR_ID = "<TYPE_YOUR_CALENDAR_ID_HERE>";
 const String CLIENT_ID = "<TYPE_YOUR_CLIENT_ID_HERE>";
 
+//  User profile structure.
+typedef struct user_profile
+{
+    //  Name sent as data of the "google_assistant" event (IFTTT applet).
+    const char *name;
+    //  Google Calendars of the user, comma separated (up to CALENDAR_MAX_IDS).
+    const char *calendar_id;
+    //  Travel preferences.
+    Distance_Matrix_Travel_Mode travel_mode;
+    Distance_Matrix_Transit_Mode transit_mode;
+} User_Profile;
+
+//  Set your user profiles here. The first one is used when the request does
+//  not name a user. Each user authorizes the device with its own account, 
+//  the refresh tokens are stored in separate EEPROM slots.
+//  Travel Mode: DRIVING, TRANSIT.
+//  Transit Mode: BUS, SUBWAY, TRAIN, TRAM, RAIL, NONE.
+const User_Profile USER_PROFILES[] =
+{
+    {"default", "<TYPE_YOUR_CALENDAR_ID_HERE>", 
+     Distance_Matrix_Travel_Mode::TRANSIT, Distance_Matrix_Transit_Mode::BUS},
+    {"guest", "<TYPE_THE_GUEST_CALENDAR_ID_HERE>", 
+     Distance_Matrix_Travel_Mode::DRIVING, Distance_Matrix_Transit_Mode::NONE}
+};
+
+static_assert(sizeof(USER_PROFILES) / sizeof(USER_PROFILES[0]) == MAX_USERS,
+              "USER_PROFILES must have MAX_USERS entries.");
+static_assert(MAX_USERS == BOOT_CACHE_MAX_USERS, 
+              "The boot cache must hold the data of every user, and no more.");
+
+//  Max. number of events received while loop() is held (i.e. playing an
+//  answer). Per user: the response of every calendar of the set and every
+//  departure candidate, an OAuth2.0 response and a google_assistant event.
+//  Then, the location response.
+//  It is an estimate, not a measurement: CALENDAR_RESPONSE_CHUNKS comes from
+//  the field sizes kept by the device, and a calendar with longer fields
+//  (i.e. a long location) still sends them whole, in more chunks. The receive
+//  queue sized from it, 32 x 609 bytes (CLOUD_TOPIC_SIZE + CLOUD_DATA_SIZE),
+//  takes about 19.5 KB. A larger burst is not a hang: the requests of the 
+//  chunks lost fail with an HTTP 413.
+#define RECEIVE_BURST           (MAX_USERS * (CALENDAR_MAX_IDS * CALENDAR_RESPONSE_CHUNKS + \
+                                              DEPARTURE_CANDIDATES + 2) + 1)
+static_assert(CLOUD_RECEIVE_QUEUE_SIZE >= RECEIVE_BURST, 
+              "The receive queue must hold the events received in a burst.");
+static_assert(RECORDER_MAX_PENDING >= RECEIVE_BURST, 
+              "The recorder must replay the events received in a burst.");
+
+//  Answer memo structure. The answer is keyed by the next event, the origin
+//  cell, the travel mode and the time bucket in which it was computed.
+typedef struct answer_memo
+{
+    bool valid;
+    //  Time at which the answer was computed or confirmed, in milliseconds.
+    uint32_t answer_time;
+    //  Key: next event (hash of its start date and time, and location),
+    //  origin cell, travel mode and time bucket.
+    uint32_t event_key;
+    int32_t origin_cell_lat;
+    int32_t origin_cell_lng;
+    Distance_Matrix_Travel_Mode travel_mode;
+    time_t bucket;
+    //  Departure and estimated arrival times as unix timestamps (UTC).
+    time_t departure_time;
+    time_t arrival_time;
+} Answer_Memo;
+
 //*****************************************************************************
 //
-//	The following are global objects for the DFPlayer and Google classes.
+//! @brief Request task.
+//!
+//! This class is the frame of the task that serves a user request, from the
+//! access token to the answer (see Request_Task::resume()). It only holds 
+//! what is kept across the waits, the frames are allocated from a task pool.
 //
 //*****************************************************************************
+class Request_Task
+{
+    public:
+        //  User index in USER_PROFILES.
+        const uint8_t user;
+
+        //  Resume point of the task, and generation being served.
+        uint16_t line;
+        uint8_t generation;
+        //  Google Calendar and Distance Matrix requests in flight.
+        Awaitable calendar;
+        Awaitable distance_matrix;
+
+        //  Class constructor.
+        Request_Task(uint8_t user)
+            : user(user)
+        {
+            line = 0;
+            generation = 0;
+        }
+
+        //  Public member functions.
+        Task_Status resume(void);
+};
+
+//*****************************************************************************
+//
+//! @brief User context.
+//!
+//! This class holds the Google objects and the request state of a user. Each
+//! user has its own webhook event names (user tag), so the requests of 
+//! several users can be in flight at the same time.
+//
+//*****************************************************************************
+class User_Context
+{
+    public:
+        //  User index in USER_PROFILES.
+        const uint8_t user;
 
-DFPlayer_MP3 MP3(Serial1, MP3_BUSY_PIN);
-Google_Calendar Calendar(CALENDAR_ID, TIME_ZONE);
-Google_OAuth2 OAuth2(CLIENT_ID, CLIENT_SECRET);
-Google_Geolocation Geolocation;
-Google_Distance_Matrix Distance_Matrix;
-Google_Distance_Matrix::Distance_Matrix_Event Distance_Matrix_Event;
+        //  Request stage and event state.
+        Request_Stage stage;
+        State_Machine<Event_State_Machine> event_state;
+        //  Time at which the request was received, in milliseconds.
+        uint32_t request_time;
+        //  Generation of the request, it tags the webhook events so the
+        //  responses of an older request are dropped. 0 if none yet.
+        uint8_t generation;
+        //  Set if the last answer came from the cache and must be checked 
+        //  against a live request once the cloud is back, and departure time
+        //  of that answer (0 if no pending events).
+        bool offline_answer;
+        time_t offline_leave_time;
+        //  Set if the request is a silent live check of an offline answer.
+        bool reconciling;
+        //  Last departure answer, replayed to the repeated requests.
+        Answer_Memo memo;
+        //  Cycles spent logging when the request was received.
+        uint32_t log_cycles;
+        //  Task serving the request, nullptr if none.
+        Request_Task *task;
+
+        //  Google objects.
+        Google_OAuth2 oauth2;
+        Google_Calendar calendar;
+        Google_Distance_Matrix distance_matrix;
+        Google_Distance_Matrix::Distance_Matrix_Event distance_matrix_event;
+
+        //  Class constructor.
+        User_Context(uint8_t user)
+            : user(user), event_state(Event_State::COMPLETED), oauth2(CLIENT_ID, CLIENT_SECRET, user), 
+              calendar(USER_PROFILES[user].calendar_id, user), 
+              distance_matrix(user)
+        {
+            stage = Request_Stage::IDLE;
+            request_time = 0;
+            generation = 0;
+            offline_answer = false;
+            offline_leave_time = 0;
+            reconciling = false;
+            memset(&memo, 0, sizeof(memo));
+            log_cycles = 0;
+            task = nullptr;
+            distance_matrix_event.travel_mode = USER_PROFILES[user].travel_mode;
+            distance_matrix_event.transit_mode = USER_PROFILES[user].transit_mode;
+        }
+};
+
+//*****************************************************************************
+//
+//! @brief Application context.
+//!
+//! This class holds all the state of a device: application stage, event 
+//! state, warm boot data, the DFPlayer and Google objects, and the users with
+//! their request queue. The application functions work through it (App). The
+//! services shared with the Google classes are globals of their own: the
+//! webhook cloud (Cloud), the webhook recorder (Recorder), the flight 
+//! recorder (Trace) and the binary log (Binlog).
+//!
+//! The request queue holds the users waiting to be served in arrival order.
+//! A user is queued at most once, so repeated requests are coalesced and a 
+//! user cannot starve the others. A repeated request of a user being served
+//! is coalesced onto it, unless it arrives after COALESCE_WINDOW, then the 
+//! request in flight is superseded by a new generation.
+//
+//*****************************************************************************
+class App_Context
+{
+    public:
+        //  Application stage and event state.
+        State_Machine<App_Stage_Machine> stage;
+        State_Machine<Event_State_Machine> event_state;
+
+        //  Time from reset until the device is ready to answer, in milliseconds.
+        int ready_time;
+        //  Set if the cached location is being revalidated in the background.
+        bool revalidating;
+        //  User being authorized during the OAuth2.0 stage.
+        uint8_t setup_user;
+        //  Last time the waiting message was printed.
+        uint32_t print_time;
+
+        //  DFPlayer, Geolocation and users.
+        DFPlayer_MP3 mp3;
+        Google_Geolocation geolocation;
+        User_Context users[MAX_USERS];
+        Boot_Cache cache;
+
+        //  Users waiting to be served, in arrival order.
+        uint8_t queue[MAX_USERS];
+        uint8_t queue_length;
+        //  Tasks of the requests being served, one per user at most.
+        Task_Pool<Request_Task, MAX_USERS> requests;
+
+        //  Time of the last answers and requests answered per minute.
+        uint32_t answer_time[ANSWERS_LOG_SIZE];
+        uint8_t answer_index;
+        int answers_per_minute;
+
+        //  Requests coalesced and superseded, and response chunks 
+        //  dropped because they belong to a superseded request.
+        int coalesced_requests;
+        int superseded_requests;
+        int stale_responses;
+
+        //  Distance Matrix API elements spent, one per departure time queried.
+        int distance_matrix_elements;
+
+        //  Set while the cloud is connected, and time at which it was lost.
+        bool connected;
+        uint32_t disconnect_time;
+        //  Answers given from the Google APIs (live) and from the cache
+        //  (offline), and offline answers corrected once the cloud was back.
+        int live_answers;
+        int cached_answers;
+        int corrected_answers;
+        //  Answer latency histograms of the answers replayed from the 
+        //  answer memo (hits) and the ones computed (misses).
+        uint16_t memo_hit_latency[LATENCY_BUCKETS];
+        uint16_t memo_miss_latency[LATENCY_BUCKETS];
+        //  Cycles spent logging per request, running average.
+        uint32_t log_cycles;
+
+        //  Set by the button handler, which can run in the system thread.
+        std::atomic<bool> button_pressed;
+
+        //  Class constructor, the users list gets one entry per user index.
+        App_Context() : App_Context(std::make_index_sequence<MAX_USERS>()) {}
+
+    private:
+        //  Class constructor for the user indexes 0 to MAX_USERS - 1.
+        template <size_t... USER>
+        App_Context(std::index_sequence<USER...>)
+            : stage(App_Stage::GEOLOCATION, Trace_Type::APP_STAGE, 0), 
+              event_state(Event_State::PUBLISHING), mp3(Serial1, MP3_BUSY_PIN), users{{USER}...}
+        {
+            ready_time = 0;
+            revalidating = false;
+            setup_user = 0;
+            print_time = 0;
+            queue_length = 0;
+            memset(answer_time, 0, sizeof(answer_time));
+            answer_index = 0;
+            answers_per_minute = 0;
+            coalesced_requests = 0;
+            superseded_requests = 0;
+            stale_responses = 0;
+            distance_matrix_elements = 0;
+            connected = true;
+            disconnect_time = 0;
+            live_answers = 0;
+            cached_answers = 0;
+            corrected_answers = 0;
+            memset(memo_hit_latency, 0, sizeof(memo_hit_latency));
+            memset(memo_miss_latency, 0, sizeof(memo_miss_latency));
+            log_cycles = 0;
+            button_pressed = false;
+        }
+};
+
+//*****************************************************************************
+//
+//	The following are global objects for the application.
+//
+//*****************************************************************************
+
+App_Context App;
+#ifdef BENCH_ENABLED
+Benchmark Bench;
+#endif
 
 //*****************************************************************************
 //
@@ -126,19 +462,63 @@ Google_Distance_Matrix::Distance_Matrix_Event Distance_Matrix_Event;
 //*****************************************************************************
 
 void oauth2_loop(void);
-void calendar_loop(void);
-void calendar_handler(void);
 void geolocation_loop(void);
 void geolocation_handler(void);
-void distance_matrix_loop(void);
-void distance_matrix_handler(void);
-void calc_departure_time(void);
+void calc_departure_time(time_t departure_time, time_t arrival_time);
+void set_origin(float lat, float lng);
+void assistant_loop(void);
 void assistant_handler(const char *event, const char *data);
+void button_handler(system_event_t event, int param);
+uint8_t find_user(const char *name);
+void check_connection(void);
+void answer_offline(User_Context &user);
+void reconcile_answer(User_Context &user);
+Answer_Memo memo_key(User_Context &user);
+void memo_answer(User_Context &user, time_t departure_time, time_t arrival_time);
+bool answer_from_memo(User_Context &user, bool refreshed);
+void queue_request(uint8_t user);
+bool start_request(void);
+void change_request_stage_to(User_Context &user, Request_Stage new_stage);
+bool token_refreshed(User_Context &user);
+void next_generation(User_Context &user);
+void fail_request(User_Context &user);
+void count_answer(User_Context &user, Answer_Source source = Answer_Source::LIVE);
 void init_mp3_player(void);
-void play_status_info(MP3_File mp3_file);
-void play_time(MP3_Folder mp3_folder, uint8_t mp3_file);
+void mp3_loop(void);
+void play_status_info(MP3_File mp3_file, bool wait = true);
+void play_request_info(User_Context &user, MP3_File mp3_file, bool wait = true);
+void play_phrase(const MP3_Phrase &phrase);
 void print_app_error(void);
 void print_event_state(void);
-void change_app_stage_to(App_Stage new_stage);
+void change_app_stage(App_Event event);
+void enter_app_stage(void);
+void subscribe_handlers(void);
+String publish_stats(void);
+String calendar_stats(void);
+String answer_latency(void);
+String log_stats(void);
+String state_dwell(void);
+String task_stats(void);
+String webhook_stats(void);
+App_Event warm_boot(void);
+void serial_loop(void);
+
+//*****************************************************************************
+//
+//! @brief Changes the current stage of the application, from a known stage.
+//!
+//! The transition is checked at compile time, see change_app_stage().
+//!
+//! @return None. 
+//
+//*****************************************************************************
+template <App_Stage FROM, App_Event EVENT>
+void change_app_stage(void)
+{
+    if (App.stage.dispatch<FROM, EVENT>())
+    {
+        enter_app_stage();
+    }
+}
 
 #endif // __APP_H__
\ No newline at end of file
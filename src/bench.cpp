@@ -0,0 +1,679 @@
+#include "Particle.h"
+#include "bench.h"
+#include "oauth2.h"
+#include "calendar.h"
+#include "geolocation.h"
+#include "distance_matrix.h"
+#include "mp3.h"
+#include "utility.h"
+#include "time_zone.h"
+#include "trace.h"
+#include "binlog.h"
+#include "task.h"
+
+#ifdef BENCH_ENABLED
+
+#ifdef BENCH_HOST
+#include <chrono>
+//  Number of iterations per benchmark case.
+#define BENCH_ITERATIONS        10000
+#else
+//  Number of iterations per benchmark case.
+#define BENCH_ITERATIONS        100
+#endif
+//  Number of WiFi access points reported by a scan.
+#define BENCH_NUM_APS           6
+
+//  Webhook events and responses as delivered by the Particle Cloud, the
+//  responses end with WEBHOOK_END_MARKER.
+static const char CALENDAR_EVENT[] = "e00fce681f2a3b4c5d6e7f80/hook-response/calendar_event/0";
+static const char CALENDAR_EVENT_1[] = "e00fce681f2a3b4c5d6e7f80/hook-response/calendar_event/1";
+static const char CALENDAR_DATA[] = "\"p33c8qm0g6sev0g\"~2020-02-14T10:00:00+01:00~2020-02-14T11:00:00+01:00~"
+                                    "Pla\xC3\xA7" "a de Catalunya, 08002 Barcelona, Spain" "\x03";
+static const char CALENDAR_DATA_1[] = " Floor 3, Meeting Room Montju\xC3\xAF" "c" "\x03";
+static const char CALENDAR_SET_EVENT[][64] = {"e00fce681f2a3b4c5d6e7f80/hook-response/calendar_event/0",
+                                              "e00fce681f2a3b4c5d6e7f80/hook-response/calendar_event/c1/0",
+                                              "e00fce681f2a3b4c5d6e7f80/hook-response/calendar_event/c2/0"};
+static const char CALENDAR_SET_DATA[][384] = {"\"p33c8qm0g6sev0g\"~"
+                                              "2020-02-14T09:00:00+01:00~2020-02-14T10:00:00+01:00~Room 1~"
+                                              "2020-02-14T10:30:00+01:00~2020-02-14T11:00:00+01:00~Room 2~"
+                                              "2020-02-14T11:00:00+01:00~2020-02-14T12:00:00+01:00~Room 3~"
+                                              "2020-02-14T12:00:00+01:00~2020-02-14T13:00:00+01:00~Room 4~" "\x03",
+                                              "\"k7a2d9pe1f4utq8\"~"
+                                              "2020-02-14T08:30:00Z~2020-02-14T09:00:00Z~Home~"
+                                              "2020-02-14T09:45:00Z~2020-02-14T10:45:00Z~Gym~"
+                                              "2020-02-14T10:15:00Z~2020-02-14T10:30:00Z~School~"
+                                              "2020-02-14T11:30:00Z~2020-02-14T12:00:00Z~Market~" "\x03",
+                                              "\"b5m0x3wq6r2jzc1\"~"
+                                              "2020-02-14T09:15:00+01:00~2020-02-14T09:30:00+01:00~Office~"
+                                              "2020-02-14T09:30:00+01:00~2020-02-14T10:30:00+01:00~Lab~"
+                                              "2020-02-14T13:00:00+01:00~2020-02-14T13:30:00+01:00~Cafe~"
+                                              "2020-02-14T14:00:00+01:00~2020-02-14T15:00:00+01:00~Hall~" "\x03"};
+static const char CALENDAR_SET_ERROR_EVENT[][64] = {"e00fce681f2a3b4c5d6e7f80/hook-error/calendar_event/0",
+                                                    "e00fce681f2a3b4c5d6e7f80/hook-error/calendar_event/c1/0",
+                                                    "e00fce681f2a3b4c5d6e7f80/hook-error/calendar_event/c2/0"};
+static const char CALENDAR_NOT_MODIFIED_DATA[] = "error status 304 from www.googleapis.com";
+//  Time the calendar requests are made, 2020-02-14T08:00:00Z.
+#define BENCH_REQUEST_TIME          1581667200L
+static const char GEOLOCATION_EVENT[] = "e00fce681f2a3b4c5d6e7f80/hook-response/geolocation/0";
+static const char GEOLOCATION_DATA[] = "41.387015~2.170047~32" "\x03";
+static const char DISTANCE_MATRIX_EVENT[] = "e00fce681f2a3b4c5d6e7f80/hook-response/dist_transit/0";
+static const char DISTANCE_MATRIX_DATA[] = "3.4 mi~1260~OK~OK~1581670800" "\x03";
+//  Response fields, as passed to the field parsers by the webhook stream.
+static const char *GEOLOCATION_FIELDS[] = {"41.387015", "2.170047", "32"};
+static const char *DISTANCE_MATRIX_FIELDS[] = {"3.4 mi", "1260", "OK", "OK"};
+static const char OAUTH2_EVENT[] = "e00fce681f2a3b4c5d6e7f80/hook-response/oauth_ref_token/0";
+static const char OAUTH2_DATA[] = "ya29.a0AfH6SMBx3k9Qz1YtG7pW2nVh4LrEo8cJdKfM5uXsTq0bNiAyCgZeRwHvPlDjUoIm"
+                                  "FtKsB6yQ1xW9zE3rT7nY5uI2oP8aS4dF0gH6jK1lZ3xC9vB7nM5qW2eR4tY8uI0oP6aS"
+                                  "2dF4gH8jK0lZ6xC3vB1nM9qW7eR5tY3uI1oP~3599" "\x03";
+
+//  Space in memory to build the chunked calendar response
+//  (first chunk of max. size followed by the last one).
+static char calendar_chunk[WEBHOOK_CHUNK_SIZE + 1];
+
+//  WiFi access points reported by the scan.
+static WiFiAccessPoint access_points[BENCH_NUM_APS];
+
+//  Objects under test. They are not the ones used by the application,
+//  so running the benchmark does not change the application state.
+static Google_OAuth2 bench_oauth2("1234567890-abcdefghijklmnopqrstuvwxyz012345.apps.googleusercontent.com",
+                                  "AbCdEfGhIjKlMnOpQrStUvWx");
+static Google_Calendar bench_calendar("user@gmail.com");
+static Google_Calendar bench_calendar_set("user@gmail.com, work@company.com, family@group.calendar.google.com");
+static Google_Geolocation bench_geolocation;
+static Google_Distance_Matrix bench_distance_matrix;
+static Google_Distance_Matrix::Distance_Matrix_Event bench_event;
+//  Only the frame decoder is used, nothing is sent to the DFPlayer Mini.
+static DFPlayer_MP3 bench_mp3(Serial1, D2);
+//  Not the application log, its ring is emptied after every record.
+static Binary_Log bench_log;
+//  Log record of an answered request.
+#define BENCH_LOG_FORMAT "Request of %s answered in %lu ms (%s)."
+
+//  Task that waits once for a request, as a request task does for each
+//  Google API.
+class Bench_Task
+{
+    public:
+        uint16_t line;
+        bool pending;
+        Bench_Task() : line(0), pending(true) {}
+        Task_Status resume(void);
+};
+static Task_Pool<Bench_Task, 1> bench_tasks;
+
+//  Results are written here so the compiler does not remove the code.
+static volatile uint32_t bench_sink;
+
+//  Benchmark cases.
+const Benchmark::Bench_Case Benchmark::CASES[] =
+{
+    {"split_string", &Benchmark::split_string},
+    {"unix_time", &Benchmark::unix_time},
+    {"rfc3339_time", &Benchmark::rfc3339_time},
+    {"utc_offset", &Benchmark::utc_offset},
+    {"rfc3339_format", &Benchmark::rfc3339_format},
+    {"calendar_parser", &Benchmark::calendar_parser},
+    {"calendar_parser_chunked", &Benchmark::calendar_parser_chunked},
+    {"calendar_merge", &Benchmark::calendar_merge},
+    {"calendar_not_modified", &Benchmark::calendar_not_modified},
+    {"geolocation_parser", &Benchmark::geolocation_parser},
+    {"distance_matrix_parser", &Benchmark::distance_matrix_parser},
+    {"oauth2_parser", &Benchmark::oauth2_parser},
+    {"geolocation_fields_legacy", &Benchmark::geolocation_fields_legacy},
+    {"geolocation_fields_schema", &Benchmark::geolocation_fields_schema},
+    {"distance_matrix_fields_legacy", &Benchmark::distance_matrix_fields_legacy},
+    {"distance_matrix_fields_schema", &Benchmark::distance_matrix_fields_schema},
+    {"calendar_payload", &Benchmark::calendar_payload},
+    {"geolocation_payload", &Benchmark::geolocation_payload},
+    {"distance_matrix_payload", &Benchmark::distance_matrix_payload},
+    {"oauth2_payload", &Benchmark::oauth2_payload},
+    {"wifi_scan_callback", &Benchmark::wifi_scan_callback},
+    {"mp3_make_frame", &Benchmark::mp3_make_frame},
+    {"mp3_decode_frame", &Benchmark::mp3_decode_frame},
+    {"trace_record", &Benchmark::trace_record},
+    {"log_format", &Benchmark::log_format},
+    {"log_write", &Benchmark::log_write},
+    {"task_resume", &Benchmark::task_resume},
+    {nullptr, nullptr}
+};
+
+//*****************************************************************************
+//
+//! @brief Benchmark class constructor.
+//
+//*****************************************************************************
+Benchmark::Benchmark()
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Prepares the fixtures and registers the "bench" cloud function.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::begin(void)
+{
+    //  First chunk of a calendar response with a long event location.
+    const char *location = "Pla\xC3\xA7" "a de Catalunya, 08002 Barcelona, Spain. ";
+    size_t length = snprintf(calendar_chunk, sizeof(calendar_chunk), "%s", 
+                             "\"p33c8qm0g6sev0g\"~2020-02-14T10:00:00+01:00~2020-02-14T11:00:00+01:00~");
+    while (length < WEBHOOK_CHUNK_SIZE)
+    {
+        calendar_chunk[length] = location[length % strlen(location)];
+        length++;
+    }
+    calendar_chunk[WEBHOOK_CHUNK_SIZE] = '\0';
+    //  The events are merged relative to the time of the request.
+    bench_calendar.request_time = BENCH_REQUEST_TIME;
+    bench_calendar_set.request_time = BENCH_REQUEST_TIME;
+    //  Last responses of the calendar set, reused by calendar_not_modified.
+    for (uint8_t i = 0; i < CALENDAR_MAX_IDS; i++)
+    {
+        bench_calendar_set.parser(CALENDAR_SET_EVENT[i], CALENDAR_SET_DATA[i]);
+    }
+    //  Access points with different MAC addresses, signal strength and channels.
+    for (uint8_t i = 0; i < BENCH_NUM_APS; i++)
+    {
+        uint8_t bssid[6] = {0x00, 0x25, 0x9C, 0xCF, 0x1C, (uint8_t)(0xA0 + i)};
+        memcpy(access_points[i].bssid, bssid, sizeof(bssid));
+        access_points[i].rssi = -45 - (i * 7);
+        access_points[i].channel = 1 + (i * 2);
+    }
+    bench_oauth2.access_token = String(OAUTH2_DATA).substring(0, 160);
+    bench_event.origin_lat = 41.387015;
+    bench_event.origin_lng = 2.170047;
+    bench_event.destination = "Pla\xC3\xA7" "a de Catalunya, 08002 Barcelona, Spain";
+    bench_event.travel_mode = Distance_Matrix_Travel_Mode::TRANSIT;
+    bench_event.transit_mode = Distance_Matrix_Transit_Mode::BUS;
+    //  The candidates are named without subscribing, so the handlers of the
+    //  application are kept.
+    bench_distance_matrix.WEBHOOK_EVENT_NAME = "dist_transit";
+    bench_distance_matrix.name_candidates();
+    bench_distance_matrix.request = bench_event;
+    Particle.function("bench", &Benchmark::command, this);
+}
+
+//*****************************************************************************
+//
+//! @brief Runs the benchmark cases.
+//!
+//! This member function is called by the OS whenever the "bench" cloud
+//! function is invoked.
+//!
+//!	@param[in] name Name of the benchmark case to run, or "all".
+//!
+//! @return The number of benchmark cases run, -1 if the case was not found.
+//
+//*****************************************************************************
+int Benchmark::command(String name)
+{
+    int cnt = 0;
+#ifdef BENCH_HOST
+    Serial.println("\r\nBenchmark                         ns/op  allocs/op       B/op");
+#else
+    Serial.println("\r\nBenchmark                  ns/op");
+#endif
+    for (const Bench_Case *bench_case = CASES; bench_case->name != nullptr; bench_case++)
+    {
+        if (name.equals("all") || name.equals(bench_case->name))
+        {
+            run(*bench_case);
+            cnt++;
+        }
+    }
+    return (cnt > 0) ? cnt : -1;
+}
+
+//*****************************************************************************
+//
+//! @brief Runs a benchmark case and prints the result.
+//!
+//!	@param[in] bench_case Benchmark case to run.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::run(const Bench_Case &bench_case)
+{
+    //  Warm up, so lazy allocations are not timed.
+    (*bench_case.function)();
+#ifdef BENCH_HOST
+    uint32_t allocs = bench_allocs;
+    uint32_t alloc_bytes = bench_alloc_bytes;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (uint16_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        (*bench_case.function)();
+    }
+    std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - start;
+    allocs = bench_allocs - allocs;
+    alloc_bytes = bench_alloc_bytes - alloc_bytes;
+    Serial.println(String::format("%-30s %8lu %10lu %10lu", bench_case.name,
+                                  (unsigned long)(elapsed.count() / BENCH_ITERATIONS),
+                                  (unsigned long)(allocs / BENCH_ITERATIONS),
+                                  (unsigned long)(alloc_bytes / BENCH_ITERATIONS)));
+#else
+    uint32_t start = System.ticks();
+    for (uint16_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        (*bench_case.function)();
+    }
+    uint32_t cycles = System.ticks() - start;
+    uint32_t ns_per_op = ((uint64_t)cycles * 1000) / System.ticksPerMicrosecond() / BENCH_ITERATIONS;
+    Serial.println(String::format("%-24s %8lu", bench_case.name, (unsigned long)ns_per_op));
+#endif
+}
+
+//*****************************************************************************
+//
+//! @brief Splits a webhook event name into its four parts.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::split_string(void)
+{
+    int16_t index = 0, last_index = 0;
+    String str_event = String(CALENDAR_EVENT);
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        bench_sink += ::split_string(str_event, '/', index, last_index).length();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Converts a date and time into a unix timestamp.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::unix_time(void)
+{
+    bench_sink += ::unix_time(2020, 2, 14, 10, bench_sink % 60, 0);
+}
+
+//*****************************************************************************
+//
+//! @brief Converts an RFC3339 timestamp into a unix timestamp.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::rfc3339_time(void)
+{
+    bench_sink += ::rfc3339_time("2020-02-14T10:00:00.000-07:00");
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the UTC offset of a DST time zone at a given instant.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::utc_offset(void)
+{
+    static const Time_Zone_Rule &zone = TIME_ZONE_RULES[find_time_zone("Europe/Madrid")];
+    bench_sink += ::utc_offset(zone, 1581674400L + bench_sink % 60);
+}
+
+//*****************************************************************************
+//
+//! @brief Formats a unix timestamp as an RFC3339 timestamp.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::rfc3339_format(void)
+{
+    bench_sink += ::rfc3339_format(1581674400L + bench_sink % 60, 3600).length();
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a Google Calendar response (single chunk).
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::calendar_parser(void)
+{
+    bench_calendar.reset();
+    bench_sink += bench_calendar.parser(CALENDAR_EVENT, CALENDAR_DATA);
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a Google Calendar response (two chunks, out of order).
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::calendar_parser_chunked(void)
+{
+    bench_calendar.reset();
+    bench_sink += bench_calendar.parser(CALENDAR_EVENT_1, CALENDAR_DATA_1);
+    bench_sink += bench_calendar.parser(CALENDAR_EVENT, calendar_chunk);
+}
+
+//*****************************************************************************
+//
+//! @brief Parses and merges the responses of a calendar set (three
+//!        calendars, full pages).
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::calendar_merge(void)
+{
+    bench_calendar_set.reset();
+    for (uint8_t i = 0; i < CALENDAR_MAX_IDS; i++)
+    {
+        bench_sink += bench_calendar_set.parser(CALENDAR_SET_EVENT[i], CALENDAR_SET_DATA[i]);
+    }
+    bench_sink += bench_calendar_set.events[0].start;
+}
+
+//*****************************************************************************
+//
+//! @brief Reuses the last responses of a calendar set (three calendars
+//!        not modified, HTTP 304).
+//!
+//! It is the conditional request counterpart of calendar_merge.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::calendar_not_modified(void)
+{
+    bench_calendar_set.reset();
+    for (uint8_t i = 0; i < CALENDAR_MAX_IDS; i++)
+    {
+        bench_sink += bench_calendar_set.parser(CALENDAR_SET_ERROR_EVENT[i], CALENDAR_NOT_MODIFIED_DATA);
+    }
+    bench_sink += bench_calendar_set.events[0].start;
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a Google Geolocation response.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::geolocation_parser(void)
+{
+    bench_geolocation.stream.reset();
+    bench_sink += bench_geolocation.parser(GEOLOCATION_EVENT, GEOLOCATION_DATA);
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a Google Distance Matrix response.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::distance_matrix_parser(void)
+{
+    bench_distance_matrix.reset();
+    bench_sink += bench_distance_matrix.parser(DISTANCE_MATRIX_EVENT, DISTANCE_MATRIX_DATA);
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a Google OAuth2.0 refresh token response.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::oauth2_parser(void)
+{
+    bench_oauth2.stream.reset();
+    bench_sink += bench_oauth2.parser(OAUTH2_EVENT, OAUTH2_DATA);
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes the Google Geolocation response fields with atof()/atoi(),
+//!        as the field parser did before the response schemas.
+//!
+//! It is the reference for geolocation_fields_schema.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::geolocation_fields_legacy(void)
+{
+    bench_geolocation.latitud = atof(GEOLOCATION_FIELDS[0]);
+    bench_geolocation.longitud = atof(GEOLOCATION_FIELDS[1]);
+    bench_geolocation.accuracy = atoi(GEOLOCATION_FIELDS[2]);
+    bench_sink += bench_geolocation.accuracy;
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes the Google Geolocation response fields with the response
+//!        schema, range checks included.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::geolocation_fields_schema(void)
+{
+    for (uint8_t i = 0; i < Google_Geolocation::Response_Schema::NUM_FIELDS; i++)
+    {
+        bench_sink += static_cast<uint8_t>(
+            Google_Geolocation::Response_Schema::decode(bench_geolocation, i, GEOLOCATION_FIELDS[i]));
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes the Google Distance Matrix response fields with atoi(),
+//!        as the field parser did before the response schemas.
+//!
+//! It is the reference for distance_matrix_fields_schema.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::distance_matrix_fields_legacy(void)
+{
+    Google_Distance_Matrix::Distance_Matrix_Candidate &candidate = bench_distance_matrix.candidates[0];
+    candidate.distance_to_dest = atoi(DISTANCE_MATRIX_FIELDS[0]);
+    candidate.duration_to_dest = atoi(DISTANCE_MATRIX_FIELDS[1]);
+    candidate.element_status = DISTANCE_MATRIX_FIELDS[2];
+    candidate.top_status = DISTANCE_MATRIX_FIELDS[3];
+    bench_sink += candidate.duration_to_dest;
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes the Google Distance Matrix response fields with the
+//!        response schema, range and length checks included.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::distance_matrix_fields_schema(void)
+{
+    for (uint8_t i = 0; i < Google_Distance_Matrix::Response_Schema::NUM_FIELDS; i++)
+    {
+        bench_sink += static_cast<uint8_t>(
+            Google_Distance_Matrix::Response_Schema::decode(bench_distance_matrix.candidates[0], i,
+                                                            DISTANCE_MATRIX_FIELDS[i]));
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a Google Calendar webhook query.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::calendar_payload(void)
+{
+    bench_sink += bench_calendar.payload(bench_oauth2, bench_calendar.sources[0]).length();
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a Google Geolocation webhook query.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::geolocation_payload(void)
+{
+    bench_sink += bench_geolocation.payload().length();
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a Google Distance Matrix webhook query.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::distance_matrix_payload(void)
+{
+    bench_sink += bench_distance_matrix.payload(bench_event, 0).length();
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a Google OAuth2.0 refresh token webhook query.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::oauth2_payload(void)
+{
+    bench_sink += bench_oauth2.payload(bench_oauth2.EVENT_REFRESH_TOKEN).length();
+}
+
+//*****************************************************************************
+//
+//! @brief Registers the access points reported by a WiFi scan.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::wifi_scan_callback(void)
+{
+    bench_geolocation.clear_access_points();
+    for (uint8_t i = 0; i < BENCH_NUM_APS; i++)
+    {
+        Google_Geolocation::wifi_scan_callback(&access_points[i], &bench_geolocation);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Forms a DFPlayer Mini serial packet, as done by send_cmd().
+//!        The serial transmission and reply window are not measured.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::mp3_make_frame(void)
+{
+    DFPlayer_MP3::Frame frame = DFPlayer_MP3::make_frame(0x0F, 0x0300 | (bench_sink & 0x3F));
+    bench_sink += frame.data[8];
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes a DFPlayer Mini track finished frame, byte by byte as it
+//!        is received, and reads its event.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::mp3_decode_frame(void)
+{
+    static constexpr DFPlayer_MP3::Frame FINISHED_FRAME = DFPlayer_MP3::make_frame(MP3_RET_SD_FINISHED, 0x0003);
+    for (uint8_t i = 0; i < sizeof(FINISHED_FRAME.data); i++)
+    {
+        bench_mp3.decode(FINISHED_FRAME.data[i]);
+    }
+    MP3_Event event;
+    bench_sink += bench_mp3.get_event(event) ? event.param : 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Writes a record in the flight recorder ring (TRACE_ENABLED).
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::trace_record(void)
+{
+    Trace.record(Trace_Type::PUBLISH, 0, bench_sink & 0xFF);
+}
+
+//*****************************************************************************
+//
+//! @brief Formats a log record on the spot, as Serial.printlnf() does before
+//!        printing it.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::log_format(void)
+{
+    String line = String::format(BENCH_LOG_FORMAT, "Alice", (unsigned long)bench_sink, "live");
+    bench_sink += line.length();
+}
+
+//*****************************************************************************
+//
+//! @brief Writes the same log record in the binary log ring.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::log_write(void)
+{
+    bench_log.write(BENCH_LOG_FORMAT, "Alice", (unsigned long)bench_sink, "live");
+    bench_log.used = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Bench task body, it waits until the request is no longer pending.
+//!
+//! @return DONE once the request is completed, WAITING otherwise.
+//
+//*****************************************************************************
+Task_Status Bench_Task::resume(void)
+{
+    TASK_BEGIN(line);
+    TASK_AWAIT(line, Awaitable(pending));
+    TASK_END(line);
+}
+
+//*****************************************************************************
+//
+//! @brief Spawns a task, resumes it while waiting and once completed, and
+//!        releases its frame.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Benchmark::task_resume(void)
+{
+    Bench_Task *task = bench_tasks.spawn();
+    bench_tasks.loop();
+    task->pending = false;
+    bench_tasks.loop();
+}
+
+#endif  //  BENCH_ENABLED
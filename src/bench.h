@@ -0,0 +1,93 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+//  Uncomment this line to enable the benchmarks.
+//  The "bench" cloud function is registered in setup().
+//#define BENCH_ENABLED
+
+//  BENCH_HOST is defined by the host build of the benchmarks (make -C test
+//  bench). The heap allocations are counted by its allocator wrapper.
+#ifdef BENCH_HOST
+extern uint32_t bench_allocs;
+extern uint32_t bench_alloc_bytes;
+#endif
+
+//*****************************************************************************
+//
+//! @brief Benchmark class.
+//!
+//! This class measures the parsers, the webhook query builders and the time
+//! functions used by the application against realistic webhook payloads. It
+//! is invoked through the "bench" cloud function and reports the results in
+//! the serial port.
+//!
+//! On the device, time is measured with the CPU cycle counter 
+//! (System.ticks()). Heap usage is not reported there: the net change of 
+//! mallinfo() is about 0 for the Strings allocated and freed within an 
+//! operation, and their allocations cannot be counted without wrapping the
+//! allocator at link time.
+//!
+//! The same cases also run on a Linux host (make -C test bench), against the
+//! firmware modules built with the host stand-in of Device OS. There, time
+//! is measured with std::chrono::steady_clock, and the allocations (malloc(),
+//! realloc() and operator new) are counted per operation with the bytes
+//! requested (allocs/op and B/op). The host String allocates as the Wiring
+//! one, so the counts hold for the device; the times do not.
+//
+//*****************************************************************************
+class Benchmark
+{
+    private:
+        //  Typedef function pointer for a benchmark case.
+        typedef void (*Bench_Function)(void);
+
+        //  Benchmark case structure.
+        typedef struct bench_case
+        {
+            const char *name;
+            Bench_Function function;
+        } Bench_Case;
+
+        //  Benchmark cases.
+        static const Bench_Case CASES[];
+
+        //  Private member functions.
+        void run(const Bench_Case &bench_case);
+        static void split_string(void);
+        static void unix_time(void);
+        static void rfc3339_time(void);
+        static void utc_offset(void);
+        static void rfc3339_format(void);
+        static void calendar_parser(void);
+        static void calendar_parser_chunked(void);
+        static void calendar_merge(void);
+        static void calendar_not_modified(void);
+        static void geolocation_parser(void);
+        static void distance_matrix_parser(void);
+        static void oauth2_parser(void);
+        static void geolocation_fields_legacy(void);
+        static void geolocation_fields_schema(void);
+        static void distance_matrix_fields_legacy(void);
+        static void distance_matrix_fields_schema(void);
+        static void calendar_payload(void);
+        static void geolocation_payload(void);
+        static void distance_matrix_payload(void);
+        static void oauth2_payload(void);
+        static void wifi_scan_callback(void);
+        static void mp3_make_frame(void);
+        static void mp3_decode_frame(void);
+        static void trace_record(void);
+        static void log_format(void);
+        static void log_write(void);
+        static void task_resume(void);
+
+    public:
+        //  Class constructor.
+        Benchmark();
+
+        //  Public member functions.
+        void begin(void);
+        int command(String name);
+};
+
+#endif  //  __BENCH_H__
@@ -0,0 +1,314 @@
+#include "Particle.h"
+#include "binlog.h"
+
+//  Binary log shared by the application and the Google classes.
+Binary_Log Binlog;
+
+//*****************************************************************************
+//
+//! @brief Binary log class constructor.
+//
+//*****************************************************************************
+Binary_Log::Binary_Log()
+{
+    tail = 0;
+    used = 0;
+    records = 0;
+    dropped = 0;
+    cycles = 0;
+    record_length = 0;
+    overflow = false;
+    line_length = 0;
+    line_offset = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Adds raw bytes to the record being written.
+//!
+//!	@param[in] data Pointer to the bytes to be added.
+//!	@param[in] length Number of bytes.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Binary_Log::put(const void *data, uint8_t length)
+{
+    if (length > (sizeof(record) - record_length))
+    {
+        overflow = true;
+        return;
+    }
+    memcpy(&record[record_length], data, length);
+    record_length += length;
+}
+
+//*****************************************************************************
+//
+//! @brief Adds a string argument to the record being written.
+//!
+//! Only the first BINLOG_STRING_SIZE characters are kept.
+//!
+//!	@param[in] arg Pointer to a char array holding the string.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Binary_Log::put_arg(const char *arg)
+{
+    uint8_t length = (arg != nullptr) ? strnlen(arg, BINLOG_STRING_SIZE) : 0;
+    put(&length, sizeof(length));
+    put(arg, length);
+}
+
+//*****************************************************************************
+//
+//! @brief Adds a string argument to the record being written.
+//!
+//!	@param[in] arg Pointer to a char array holding the string.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Binary_Log::put_arg(char *arg)
+{
+    put_arg((const char *)arg);
+}
+
+//*****************************************************************************
+//
+//! @brief Copies the record written into the ring, or prints it right away
+//!        (BINLOG_IMMEDIATE).
+//!
+//!	@param[in] start Cycle counter when the record was started.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Binary_Log::commit(uint32_t start)
+{
+    record[0] = record_length;
+#ifdef BINLOG_IMMEDIATE
+    if (!overflow)
+    {
+        uint16_t length = format(record);
+        Serial.write((const uint8_t *)line, length);
+        records++;
+    }
+#else
+    if (!overflow && record_length <= (BINLOG_RING_SIZE - used))
+    {
+        //  The record might wrap around the end of the ring.
+        uint16_t head = (tail + used) % BINLOG_RING_SIZE;
+        uint16_t first = BINLOG_RING_SIZE - head;
+        first = (record_length < first) ? record_length : first;
+        memcpy(&ring[head], record, first);
+        memcpy(ring, &record[first], record_length - first);
+        used += record_length;
+        records++;
+    }
+#endif
+    else
+    {
+        dropped++;
+    }
+    cycles += System.ticks() - start;
+}
+
+//*****************************************************************************
+//
+//! @brief Formats a record into the line buffer.
+//!
+//! The format string is walked once; each conversion takes its argument from
+//! the record, as given by the conversion letter and its length modifier.
+//! The line starts with the record time in milliseconds, after the line
+//! breaks the format string starts with.
+//!
+//!	@param[in] data Pointer to the record.
+//!
+//!	@return The number of characters of the line, line break included.
+//
+//*****************************************************************************
+uint16_t Binary_Log::format(const uint8_t *data)
+{
+    uint8_t length = data[0];
+    uint8_t index = 1;
+    uint32_t time;
+    memcpy(&time, &data[index], sizeof(time));
+    index += sizeof(time);
+    const char *format;
+    memcpy(&format, &data[index], sizeof(format));
+    index += sizeof(format);
+    //  Room is kept for the line break.
+    const uint16_t size = BINLOG_LINE_SIZE - 2;
+    uint16_t n = 0;
+    const char *c = format;
+    while (*c == '\r' || *c == '\n')
+    {
+        line[n++] = *c++;
+    }
+    n += snprintf(&line[n], size - n, "[%lu] ", (unsigned long)time);
+    while (*c != '\0' && n < (size - 1))
+    {
+        if (*c != '%')
+        {
+            line[n++] = *c++;
+            continue;
+        }
+        //  Conversion specification, i.e. %-8.2f or %lld.
+        const char *start = c++;
+        while (*c != '\0' && strchr("-+ #0123456789.hljzt", *c) != nullptr)
+        {
+            c++;
+        }
+        char conversion = *c;
+        char spec[16];
+        if (conversion == '\0' || (c - start + 1) >= (int)sizeof(spec))
+        {
+            break;
+        }
+        c++;
+        memcpy(spec, start, c - start);
+        spec[c - start] = '\0';
+        int written = 0;
+        if (conversion == '%')
+        {
+            line[n++] = '%';
+            continue;
+        }
+        else if (conversion == 's')
+        {
+            char value[BINLOG_STRING_SIZE + 1];
+            uint8_t value_length = (index < length) ? data[index++] : 0;
+            if ((index + value_length) > length)
+            {
+                break;
+            }
+            memcpy(value, &data[index], value_length);
+            value[value_length] = '\0';
+            index += value_length;
+            written = snprintf(&line[n], size - n, spec, value);
+        }
+        else if (strchr("fFeEgGaA", conversion) != nullptr)
+        {
+            float value;
+            if ((index + sizeof(value)) > length)
+            {
+                break;
+            }
+            memcpy(&value, &data[index], sizeof(value));
+            index += sizeof(value);
+            written = snprintf(&line[n], size - n, spec, (double)value);
+        }
+        else if (strstr(spec, "ll") != nullptr)
+        {
+            uint64_t value;
+            if ((index + sizeof(value)) > length)
+            {
+                break;
+            }
+            memcpy(&value, &data[index], sizeof(value));
+            index += sizeof(value);
+            written = snprintf(&line[n], size - n, spec, (unsigned long long)value);
+        }
+        else
+        {
+            uint32_t value;
+            if ((index + sizeof(value)) > length)
+            {
+                break;
+            }
+            memcpy(&value, &data[index], sizeof(value));
+            index += sizeof(value);
+            //  The signed values are extended, long might be 64 bits.
+            bool is_signed = (conversion == 'd' || conversion == 'i');
+            if (strchr(spec, 'l') != nullptr)
+            {
+                written = is_signed ? snprintf(&line[n], size - n, spec, (long)(int32_t)value) :
+                                      snprintf(&line[n], size - n, spec, (unsigned long)value);
+            }
+            else
+            {
+                written = snprintf(&line[n], size - n, spec, value);
+            }
+        }
+        //  The line is truncated if the value does not fit.
+        written = (written > 0) ? written : 0;
+        n += (written < (size - n)) ? written : (size - n - 1);
+    }
+    line[n++] = '\r';
+    line[n++] = '\n';
+    return n;
+}
+
+//*****************************************************************************
+//
+//! @brief Prints the oldest records, up to BINLOG_FLUSH_RECORDS.
+//!
+//! It must be called from the application loop. Only what the serial port
+//! can take without blocking is printed, the rest of the line is kept for
+//! the next call.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Binary_Log::loop(void)
+{
+    for (uint8_t i = 0; i < BINLOG_FLUSH_RECORDS && used > 0; i++)
+    {
+        uint8_t length = ring[tail];
+        if (line_length == 0)
+        {
+            //  Copy the oldest record out of the ring, it might wrap around.
+            uint8_t data[UINT8_MAX];
+            for (uint8_t j = 0; j < length; j++)
+            {
+                data[j] = ring[(tail + j) % BINLOG_RING_SIZE];
+            }
+            line_length = format(data);
+            line_offset = 0;
+        }
+        //  Nothing is kept while the serial port is closed.
+        uint16_t count = line_length - line_offset;
+        if (Serial.isConnected())
+        {
+            int space = Serial.availableForWrite();
+            count = (space < count) ? ((space > 0) ? space : 0) : count;
+            Serial.write((const uint8_t *)&line[line_offset], count);
+        }
+        line_offset += count;
+        if (line_offset < line_length)
+        {
+            return;
+        }
+        line_length = 0;
+        tail = (tail + length) % BINLOG_RING_SIZE;
+        used -= length;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the cycles spent writing records since reset.
+//!
+//!	@return A number of CPU cycles (System.ticks()), it wraps around.
+//
+//*****************************************************************************
+uint32_t Binary_Log::get_cycles(void)
+{
+    return cycles;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the log statistics.
+//!
+//!	@return A string object with the records written and dropped, and the
+//!         bytes waiting to be printed. i.e. records: 120, dropped: 0, ...
+//
+//*****************************************************************************
+String Binary_Log::get_stats(void)
+{
+    return String::format("records: %lu, dropped: %lu, queued: %u bytes", (unsigned long)records,
+                          (unsigned long)dropped, used);
+}
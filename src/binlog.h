@@ -0,0 +1,217 @@
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include <type_traits>
+
+//  Log levels.
+#define BINLOG_LEVEL_NONE           0
+#define BINLOG_LEVEL_ERROR          1
+#define BINLOG_LEVEL_INFO           2
+#define BINLOG_LEVEL_DEBUG          3
+
+//  Highest level compiled in. The records of the levels above it are removed
+//  by the preprocessor, their arguments are not even evaluated.
+#define BINLOG_LEVEL                BINLOG_LEVEL_INFO
+
+//  Uncomment this line to format and print every record on the spot, as
+//  Serial.printlnf() does. It is only meant to compare the cycles spent
+//  logging per request ("log_stats" cloud variable).
+//#define BINLOG_IMMEDIATE
+
+//  Size of the log ring in bytes.
+#define BINLOG_RING_SIZE            2048
+//  Max. number of characters copied from a string argument.
+#define BINLOG_STRING_SIZE          127
+//  Max. number of characters of a formatted record.
+#define BINLOG_LINE_SIZE            192
+//  Max. number of records printed per loop() call.
+#define BINLOG_FLUSH_RECORDS        4
+
+//*****************************************************************************
+//
+//! @brief Binary log class.
+//!
+//! This class keeps the log records in a byte ring as the address of their
+//! format string (the format string id, it stays in flash) followed by the
+//! raw arguments, so logging costs a few stores instead of formatting and
+//! waiting for the USB serial port. The records are formatted later from
+//! loop(), and only printed as fast as the serial port can take them without
+//! blocking. A record that does not fit in the ring is dropped.
+//!
+//! The records are written with the BINLOG_ERROR(), BINLOG_INFO() and
+//! BINLOG_DEBUG() macros, checked by the compiler as printf() formats. The
+//! arguments must be integers (up to 64 bits), floating point numbers or C
+//! strings; strings are copied (up to BINLOG_STRING_SIZE characters), so
+//! String::c_str() can be logged. The "*" width and precision are not
+//! supported.
+//!
+//! Record format (native byte order):
+//!     u8 length, u32 time_ms, format address, arguments
+//!     Integer and floating point arguments take 4 bytes, 64-bit integers 8
+//!     bytes, strings a length byte and their characters.
+//
+//*****************************************************************************
+class Binary_Log
+{
+    friend class Benchmark;
+
+    private:
+        //  Record ring, index of the oldest record (tail) and number of bytes
+        //  used.
+        uint8_t ring[BINLOG_RING_SIZE];
+        uint16_t tail;
+        uint16_t used;
+
+        //  Records written and dropped, and cycles spent writing them.
+        uint32_t records;
+        uint32_t dropped;
+        uint32_t cycles;
+
+        //  Record being written, and set if it does not fit in it.
+        uint8_t record[UINT8_MAX];
+        uint8_t record_length;
+        bool overflow;
+
+        //  Oldest record formatted (length 0 if none) and number of 
+        //  characters already printed.
+        char line[BINLOG_LINE_SIZE];
+        uint16_t line_length;
+        uint16_t line_offset;
+
+        //  Private member functions.
+        void put(const void *data, uint8_t length);
+        void put_arg(const char *arg);
+        void put_arg(char *arg);
+        template <typename T>
+        void put_arg(T arg);
+        void put_args(void) {}
+        template <typename T, typename... Args>
+        void put_args(T arg, Args... args);
+        void commit(uint32_t start);
+        uint16_t format(const uint8_t *data);
+
+    public:
+        //  Class constructor.
+        Binary_Log();
+
+        //  Public member functions.
+        template <typename... Args>
+        void write(const char *format, Args... args);
+        void loop(void);
+        uint32_t get_cycles(void);
+        String get_stats(void);
+};
+
+//*****************************************************************************
+//
+//! @brief Checks a log record against its format string, it is never called.
+//
+//*****************************************************************************
+inline void binlog_check_format(const char *format, ...) __attribute__((format(printf, 1, 2)));
+inline void binlog_check_format(const char *format, ...) {}
+
+//  The format check is optimized out, only the write is compiled in.
+#define BINLOG_WRITE(format, ...)                           \
+    do                                                      \
+    {                                                       \
+        if (false)                                          \
+        {                                                   \
+            binlog_check_format(format, ##__VA_ARGS__);     \
+        }                                                   \
+        Binlog.write(format, ##__VA_ARGS__);                \
+    } while (0)
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_ERROR
+#define BINLOG_ERROR(format, ...)   BINLOG_WRITE(format, ##__VA_ARGS__)
+#else
+#define BINLOG_ERROR(format, ...)   do {} while (0)
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_INFO
+#define BINLOG_INFO(format, ...)    BINLOG_WRITE(format, ##__VA_ARGS__)
+#else
+#define BINLOG_INFO(format, ...)    do {} while (0)
+#endif
+
+#if BINLOG_LEVEL >= BINLOG_LEVEL_DEBUG
+#define BINLOG_DEBUG(format, ...)   BINLOG_WRITE(format, ##__VA_ARGS__)
+#else
+#define BINLOG_DEBUG(format, ...)   do {} while (0)
+#endif
+
+//*****************************************************************************
+//
+//! @brief Writes a log record.
+//!
+//!	@param[in] format Format string, it must be a string literal as only its
+//!                   address is kept.
+//!	@param[in] args Arguments of the format string.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename... Args>
+void Binary_Log::write(const char *format, Args... args)
+{
+    uint32_t start = System.ticks();
+    uint32_t time = millis();
+    record_length = 1;
+    overflow = false;
+    put(&time, sizeof(time));
+    put(&format, sizeof(format));
+    put_args(args...);
+    commit(start);
+}
+
+//*****************************************************************************
+//
+//! @brief Adds the arguments to the record being written, one by one.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename T, typename... Args>
+void Binary_Log::put_args(T arg, Args... args)
+{
+    put_arg(arg);
+    put_args(args...);
+}
+
+//*****************************************************************************
+//
+//! @brief Adds a numeric argument to the record being written.
+//!
+//! The 64-bit integers keep their 8 bytes, the other integers are stored in 4
+//! bytes (as the printf() conversions without "ll") and the floating point
+//! numbers as float.
+//!
+//!	@param[in] arg Numeric argument (integer or floating point).
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename T>
+void Binary_Log::put_arg(T arg)
+{
+    static_assert(std::is_arithmetic<T>::value, "Only numbers and C strings can be logged.");
+    if (std::is_floating_point<T>::value)
+    {
+        float value = (float)arg;
+        put(&value, sizeof(value));
+    }
+    else if (std::is_same<T, long long>::value || std::is_same<T, unsigned long long>::value)
+    {
+        uint64_t value = (uint64_t)arg;
+        put(&value, sizeof(value));
+    }
+    else
+    {
+        uint32_t value = (uint32_t)arg;
+        put(&value, sizeof(value));
+    }
+}
+
+//  Binary log shared by the application and the Google classes.
+extern Binary_Log Binlog;
+
+#endif  //  __BINLOG_H__
@@ -0,0 +1,385 @@
+#include "Particle.h"
+#include "boot_cache.h"
+#include "oauth2.h"
+#include "calendar.h"
+#include "http_status.h"
+#include "utility.h"
+
+//  Magic number to identify the boot record in retained memory.
+//  It must be changed whenever the boot record layout changes.
+#define BOOT_CACHE_MAGIC        0x53434234
+//  Max. age of the last known location in seconds (24 hours).
+#define LOCATION_MAX_AGE        86400
+//  Min. lifetime left for an access token to be reused in seconds.
+#define TOKEN_MIN_LIFETIME      60
+//  Max. number of characters stored for each string field.
+#define ACCESS_TOKEN_SIZE       256
+#define EVENT_DATE_TIME_SIZE    32
+#define EVENT_LOCATION_SIZE     128
+
+//  Boot token structure, last access token and its 
+//  absolute expiry time (OAuth2.0).
+typedef struct boot_token
+{
+    uint8_t token_valid;
+    time_t token_expiry;
+    char access_token[ACCESS_TOKEN_SIZE];
+} Boot_Token;
+
+//  Boot calendar structure, last calendar snapshot (Calendar API).
+typedef struct boot_calendar
+{
+    uint8_t calendar_valid;
+    uint8_t event_pending;
+    time_t calendar_time;
+    char event_date_time[EVENT_DATE_TIME_SIZE];
+    char event_location[EVENT_LOCATION_SIZE];
+} Boot_Calendar;
+
+//  Boot travel structure, last trip and average trip duration in seconds
+//  (Distance Matrix API).
+typedef struct boot_travel
+{
+    uint8_t travel_valid;
+    uint32_t destination_hash;
+    uint32_t duration;
+    uint32_t average_duration;
+} Boot_Travel;
+
+//  Boot record structure.
+typedef struct boot_record
+{
+    //  Record identification and integrity.
+    uint32_t magic;
+    uint32_t checksum;
+    //  Last known location (Geolocation API).
+    uint8_t location_valid;
+    float lat;
+    float lng;
+    uint16_t accuracy;
+    time_t location_time;
+    //  Per user access token and calendar snapshot.
+    Boot_Token tokens[BOOT_CACHE_MAX_USERS];
+    Boot_Calendar calendars[BOOT_CACHE_MAX_USERS];
+    //  Per user last trip.
+    Boot_Travel travels[BOOT_CACHE_MAX_USERS];
+} Boot_Record;
+
+//  Boot record stored in retained memory. It is not initialized on purpose,
+//  so the content written before the last reset is preserved.
+retained static Boot_Record boot_record;
+
+//*****************************************************************************
+//
+//! @brief Boot cache class constructor.
+//
+//*****************************************************************************
+Boot_Cache::Boot_Cache()
+{
+    valid = false;
+}
+
+//*****************************************************************************
+//
+//! @brief Validates the boot record found in retained memory.
+//!
+//! If the record is not valid (first power up or layout change), it is cleared
+//! so new data can be saved. Either way, the record can be used from now on.
+//!
+//! @return false if nothing can be reused, true if the record is valid.
+//
+//*****************************************************************************
+bool Boot_Cache::begin(void)
+{
+    bool restored = (boot_record.magic == BOOT_CACHE_MAGIC) &&
+                    (boot_record.checksum == calc_checksum());
+    if (!restored)
+    {
+        invalidate();
+    }
+    valid = true;
+    return restored;
+}
+
+//*****************************************************************************
+//
+//! @brief Clears the boot record.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::invalidate(void)
+{
+    memset(&boot_record, 0, sizeof(boot_record));
+    boot_record.magic = BOOT_CACHE_MAGIC;
+    update_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Calculates the checksum of the boot record (FNV-1a).
+//!
+//! @return An unsigned 32-bit number.
+//
+//*****************************************************************************
+uint32_t Boot_Cache::calc_checksum(void)
+{
+    //  Magic number and checksum are not included in the checksum.
+    const uint8_t *data = (const uint8_t *)&boot_record.location_valid;
+    const uint8_t *end = (const uint8_t *)&boot_record + sizeof(boot_record);
+    uint32_t hash = 2166136261UL;
+    while (data < end)
+    {
+        hash ^= *data++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+//*****************************************************************************
+//
+//! @brief Updates the checksum after the boot record has been modified.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::update_checksum(void)
+{
+    boot_record.checksum = calc_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Saves the last known location.
+//!
+//!	@param[in] lat Latitude coordinate.
+//!	@param[in] lng Longitude coordinate.
+//!	@param[in] accuracy Accuracy of the estimated location, in meters.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::save_location(float lat, float lng, uint16_t accuracy)
+{
+    boot_record.lat = lat;
+    boot_record.lng = lng;
+    boot_record.accuracy = accuracy;
+    boot_record.location_time = Time.now();
+    boot_record.location_valid = 1;
+    update_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Restores the last known location if it is not too old.
+//!
+//!	@param[out] lat Latitude coordinate.
+//!	@param[out] lng Longitude coordinate.
+//!
+//! @return false if not available, true if restored.
+//
+//*****************************************************************************
+bool Boot_Cache::restore_location(float &lat, float &lng)
+{
+    if (!valid || !boot_record.location_valid || !Time.isValid())
+    {
+        return false;
+    }
+    if ((Time.now() - boot_record.location_time) > LOCATION_MAX_AGE)
+    {
+        return false;
+    }
+    lat = boot_record.lat;
+    lng = boot_record.lng;
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Saves the current access token and its absolute expiry time.
+//!
+//! The OAuth2.0 class keeps track of the token lifetime with millis(), which
+//! restarts after a reset. So the remaining lifetime is converted into a
+//! wall-clock timestamp before saving it.
+//!
+//!	@param[in] oauth2 Google_OAuth2 object used to get the access token.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::save_token(Google_OAuth2 &oauth2)
+{
+    if (oauth2.SLOT >= BOOT_CACHE_MAX_USERS)
+    {
+        return;
+    }
+    Boot_Token &token = boot_record.tokens[oauth2.SLOT];
+    //  Tokens that do not fit in the record are not saved,
+    //  a truncated token would be rejected by the Google APIs.
+    if (!Time.isValid() || oauth2.access_token.length() >= ACCESS_TOKEN_SIZE)
+    {
+        token.token_valid = 0;
+        update_checksum();
+        return;
+    }
+    int32_t life_time_left = oauth2.life_time - (int32_t)(millis() - oauth2.time);
+    oauth2.access_token.toCharArray(token.access_token, ACCESS_TOKEN_SIZE);
+    token.token_expiry = Time.now() + (life_time_left / 1000);
+    token.token_valid = 1;
+    update_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Restores the last access token if it has not expired yet.
+//!
+//! The device must have been authenticated (refresh token in EEPROM), so the
+//! access token can still be refreshed later on without user intervention.
+//!
+//!	@param[in] oauth2 Google_OAuth2 object where the access token is restored.
+//!
+//! @return false if not available, true if restored.
+//
+//*****************************************************************************
+bool Boot_Cache::restore_token(Google_OAuth2 &oauth2)
+{
+    if (!valid || oauth2.SLOT >= BOOT_CACHE_MAX_USERS)
+    {
+        return false;
+    }
+    Boot_Token &token = boot_record.tokens[oauth2.SLOT];
+    if (!token.token_valid || !Time.isValid() || !oauth2.authenticated())
+    {
+        return false;
+    }
+    int32_t life_time_left = token.token_expiry - Time.now();
+    if (life_time_left < TOKEN_MIN_LIFETIME)
+    {
+        return false;
+    }
+    oauth2.access_token = String(token.access_token);
+    oauth2.life_time = life_time_left * 1000;
+    oauth2.time = millis();
+    oauth2.change_state(OAuth2_Event::RESTORED);
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Saves the last calendar snapshot.
+//!
+//!	@param[in] calendar Google_Calendar object used to get the event data.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::save_calendar(Google_Calendar &calendar)
+{
+    if (calendar.USER >= BOOT_CACHE_MAX_USERS)
+    {
+        return;
+    }
+    Boot_Calendar &snapshot = boot_record.calendars[calendar.USER];
+    //  Only the next event is saved.
+    calendar.get_event_date_time().toCharArray(snapshot.event_date_time, EVENT_DATE_TIME_SIZE);
+    calendar.get_event_location().toCharArray(snapshot.event_location, EVENT_LOCATION_SIZE);
+    snapshot.event_pending = calendar.event_pending;
+    snapshot.calendar_time = Time.now();
+    snapshot.calendar_valid = 1;
+    update_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Restores the last calendar snapshot if it is not too old.
+//!
+//!	@param[in] calendar Google_Calendar object where the event is restored.
+//!	@param[in] max_age Max. age of the snapshot in seconds.
+//!
+//! @return false if not available, true if restored.
+//
+//*****************************************************************************
+bool Boot_Cache::restore_calendar(Google_Calendar &calendar, uint32_t max_age)
+{
+    if (!valid || calendar.USER >= BOOT_CACHE_MAX_USERS)
+    {
+        return false;
+    }
+    Boot_Calendar &snapshot = boot_record.calendars[calendar.USER];
+    if (!snapshot.calendar_valid || !Time.isValid())
+    {
+        return false;
+    }
+    if ((Time.now() - snapshot.calendar_time) > (time_t)max_age)
+    {
+        return false;
+    }
+    Google_Calendar::Calendar_Event &event = calendar.events[0];
+    strlcpy(event.date_time, snapshot.event_date_time, CALENDAR_DATE_TIME_SIZE);
+    strlcpy(event.location, snapshot.event_location, CALENDAR_LOCATION_SIZE);
+    event.start = rfc3339_time(event.date_time);
+    event.end = 0;
+    calendar.num_events = snapshot.event_pending ? 1 : 0;
+    calendar.event_pending = snapshot.event_pending;
+    calendar.http_status_code = HTTP_OK;
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Saves the travel duration of the last trip of a user.
+//!
+//! Only a hash of the destination is kept. The running average of the trip
+//! durations (1/4 weight for the last trip) is updated as well.
+//!
+//!	@param[in] user User index.
+//!	@param[in] destination String object holding the trip destination.
+//!	@param[in] duration Travel duration in seconds.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void Boot_Cache::save_travel(uint8_t user, const String &destination, uint32_t duration)
+{
+    if (user >= BOOT_CACHE_MAX_USERS)
+    {
+        return;
+    }
+    Boot_Travel &travel = boot_record.travels[user];
+    travel.average_duration = travel.travel_valid ? ((3 * travel.average_duration + duration) / 4) : duration;
+    travel.destination_hash = string_hash(destination.c_str());
+    travel.duration = duration;
+    travel.travel_valid = 1;
+    update_checksum();
+}
+
+//*****************************************************************************
+//
+//! @brief Restores the travel duration of a user to a destination.
+//!
+//! The duration of the last trip is restored if it went to the same 
+//! destination, the average duration of the user trips otherwise.
+//!
+//!	@param[in] user User index.
+//!	@param[in] destination String object holding the trip destination.
+//!	@param[out] duration Travel duration in seconds.
+//!	@param[out] historical Set if the average duration is restored.
+//!
+//! @return false if not available, true if restored.
+//
+//*****************************************************************************
+bool Boot_Cache::restore_travel(uint8_t user, const String &destination, uint32_t &duration, bool &historical)
+{
+    if (!valid || user >= BOOT_CACHE_MAX_USERS)
+    {
+        return false;
+    }
+    Boot_Travel &travel = boot_record.travels[user];
+    if (!travel.travel_valid)
+    {
+        return false;
+    }
+    historical = (travel.destination_hash != string_hash(destination.c_str()));
+    duration = historical ? travel.average_duration : travel.duration;
+    return true;
+}
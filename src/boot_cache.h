@@ -0,0 +1,60 @@
+#ifndef __BOOT_CACHE_H__
+#define __BOOT_CACHE_H__
+
+//  Max. number of users whose token and calendar snapshot are cached. It
+//  must be MAX_USERS (app.h), this header does not include the app.
+#define BOOT_CACHE_MAX_USERS    2
+//  Max. age of the last calendar snapshot reused after a reset, in seconds
+//  (10 minutes).
+#define CALENDAR_MAX_AGE        600
+
+//  Foward declaration.
+class Google_OAuth2;
+class Google_Calendar;
+
+//*****************************************************************************
+//
+//! @brief Boot cache class.
+//!
+//! This class keeps the last known device location, the OAuth2.0 access token
+//! with its absolute expiry time, and the last calendar snapshot in retained
+//! memory. Retained memory survives a reset but not a power loss, so after a
+//! reset the application can reuse whatever is still valid and skip the
+//! Geolocation and OAuth2.0 round-trips (warm boot).
+//!
+//! The access token and the calendar snapshot are kept per user, indexed by
+//! the OAuth2.0 token slot and the calendar user respectively.
+//!
+//! The travel duration of the last trip of each user is kept as well, with
+//! a hash of its destination and a running average of all trips, so a 
+//! request can be answered without the cloud (offline answer).
+//
+//*****************************************************************************
+class Boot_Cache
+{
+    private:
+        //  Retained memory content validation.
+        bool valid;
+
+        //  Private member functions.
+        void update_checksum(void);
+        uint32_t calc_checksum(void);
+
+    public:
+        //  Class constructor.
+        Boot_Cache();
+
+        //  Public member functions.
+        bool begin(void);
+        void invalidate(void);
+        void save_location(float lat, float lng, uint16_t accuracy);
+        bool restore_location(float &lat, float &lng);
+        void save_token(Google_OAuth2 &oauth2);
+        bool restore_token(Google_OAuth2 &oauth2);
+        void save_calendar(Google_Calendar &calendar);
+        bool restore_calendar(Google_Calendar &calendar, uint32_t max_age = CALENDAR_MAX_AGE);
+        void save_travel(uint8_t user, const String &destination, uint32_t duration);
+        bool restore_travel(uint8_t user, const String &destination, uint32_t &duration, bool &historical);
+};
+
+#endif  //  __BOOT_CACHE_H__
@@ -1,36 +1,98 @@
 #include "Particle.h"
 #include "calendar.h"
 #include "utility.h"
+#include "time_zone.h"
 #include "oauth2.h"
 #include "http_status.h"
+#include "cloud.h"
 
 //*****************************************************************************
 //
 //! @brief Google Calendar class constructor.
 //!
-//!	@param[in] calendar_id Calendar identifier used for the API requests. The 
-//!                        primary calendar named "Events" uses your gmail
-//!                        as ID.
-//!	@param[in] time_zone User time zone. It should be the same as the one use
-//!                      in the Google Calendar app.
+//!	@param[in] calendar_ids Comma separated list of calendar identifiers used
+//!                         for the API requests, up to CALENDAR_MAX_IDS. The 
+//!                         primary calendar named "Events" uses your gmail
+//!                         as ID.
+//!	@param[in] user User index, it tags the webhook event name.
 //
 //*****************************************************************************
-Google_Calendar::Google_Calendar(const String &calendar_id, const int8_t &time_zone)
-    : CALENDAR_ID(calendar_id), TIME_ZONE(time_zone)
+Google_Calendar::Google_Calendar(const String &calendar_ids, uint8_t user)
+    : Google_Calendar(calendar_ids, user, std::make_index_sequence<CALENDAR_MAX_IDS>())
 {
-    callback = nullptr; 
+}
+
+//*****************************************************************************
+//
+//! @brief Google Calendar class constructor for the source indexes.
+//!
+//! The sources list gets one entry per index, all of them built for this
+//! calendar set.
+//!
+//!	@param[in] calendar_ids Comma separated list of calendar identifiers.
+//!	@param[in] user User index, it tags the webhook event name.
+//
+//*****************************************************************************
+template <size_t... SOURCE>
+Google_Calendar::Google_Calendar(const String &calendar_ids, uint8_t user, std::index_sequence<SOURCE...>)
+    : USER(user),
+      WEBHOOK_EVENT_NAME(String("calendar_event") + Webhook_Cloud::user_tag(user)),
+      sources{{repeat_for<SOURCE>(*this)}...}
+{
+    source = nullptr;
+    num_sources = 0;
+    generation = 0;
+    stale_count = 0;
+    request_time = 0;
+    fetch_count = 0;
+    not_modified_count = 0;
+    response_bytes = 0;
+    parsed_fields = 0;
+    //  Each calendar gets its own webhook event name, so the responses can be
+    //  told apart. i.e. calendar_event, calendar_event/c1, calendar_event/1/c2.
+    //  The first calendar keeps the base name.
+    int16_t start = 0;
+    while (start <= (int16_t) calendar_ids.length() && num_sources < CALENDAR_MAX_IDS)
+    {
+        int16_t end = calendar_ids.indexOf(',', start);
+        if (end < 0)
+        {
+            end = calendar_ids.length();
+        }
+        String id = calendar_ids.substring(start, end);
+        id.trim();
+        if (id.length() > 0)
+        {
+            Calendar_Source &new_source = sources[num_sources];
+            new_source.id = id;
+            new_source.event_name = WEBHOOK_EVENT_NAME;
+            new_source.num_events = 0;
+            new_source.window = 0;
+            new_source.conditional = false;
+            if (num_sources > 0)
+            {
+                new_source.event_name += "/c" + String(num_sources);
+            }
+            num_sources++;
+        }
+        start = end + 1;
+    }
+    reset();
     event_pending = false;
+    http_status_code = HTTP_OK;
 }
 
 //*****************************************************************************
 //
 //! @brief Subscribes the device to the Google Calendar webhook event.
 //!
-//! This method subscribes the device to a customized webhook response and 
-//! error response event name. The device ID is included in the customized
-//! event name so only THIS device will get the response.
+//! This method attaches the response and error response handlers to the 
+//! webhook cloud, which receives the customized response event names. The 
+//! device ID is included in the customized event name so only THIS device 
+//! will get the response.
 //!
-//!	@param[in] callback Pointer to the application-level response handler.
+//!	@param[in] callback Pointer to the application-level response handler,
+//!                     nullptr if the responses are awaited (see fetch()).
 //!
 //!	@return None.
 //
@@ -38,57 +100,139 @@ Google_Calendar::Google_Calendar(const String &calendar_id, const int8_t &time_z
 void Google_Calendar::subscribe(Event_Callback callback)
 {
     this->callback = callback;
-    String hook_reponse = System.deviceID() + "/hook-response/" + WEBHOOK_EVENT_NAME;
-    String hook_error = System.deviceID() + "/hook-error/" + WEBHOOK_EVENT_NAME;
-    Particle.subscribe(hook_reponse, &Google_Calendar::response_handler, this, MY_DEVICES);
-    Particle.subscribe(hook_error, &Google_Calendar::error_handler, this, MY_DEVICES);
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        attach(sources[i].event_name);
+    }
 }
 
 //*****************************************************************************
 //
-//! @brief Publishes the Google Calendar webhook event.
+//! @brief Publishes the Google Calendar webhook events.
+//!
+//! One event is published per calendar of the set, without waiting for the
+//! responses, so all the requests are in flight at the same time.
+//!
+//! The start of the search window is rounded down to CALENDAR_WINDOW_STEP, 
+//! so the requests made within the same step send the same query. Those
+//! requests send the ETag of the last response as well (conditional request).
 //!
 //!	@param[in] oauth2 Google_OAuth2 object used to get the access token.
+//!	@param[in] generation Generation of the request. The responses of other
+//!                       generations are dropped. 0 if not tagged.
 //!
 //!	@return None.
 //
 //*****************************************************************************
-void Google_Calendar::publish(const Google_OAuth2 &oauth2)
+void Google_Calendar::publish(const Google_OAuth2 &oauth2, uint8_t generation)
+{
+    reset();
+    this->generation = generation;
+    begin_request();
+    request_time = Time.now();
+    time_t window = request_time - (request_time % CALENDAR_WINDOW_STEP);
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        Calendar_Source &request_source = sources[i];
+        //  The ETag is only valid for the query it was returned for.
+        request_source.conditional = (request_source.window == window) && (request_source.etag.length() > 0);
+        request_source.window = window;
+        fetch_count++;
+        Cloud.publish(request_source.event_name, payload(oauth2, request_source), 
+                      Publish_Class::USER, generation);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Publishes the Google Calendar webhook events, to be awaited.
+//!
+//!	@param[in] oauth2 Google_OAuth2 object used to get the access token.
+//!	@param[in] generation Generation of the request, see publish().
+//!
+//!	@return An awaitable, ready once every calendar of the set has responded
+//!         or the request is cancelled.
+//
+//*****************************************************************************
+Awaitable Google_Calendar::fetch(const Google_OAuth2 &oauth2, uint8_t generation)
+{
+    publish(oauth2, generation);
+    return completion();
+}
+
+//*****************************************************************************
+//
+//! @brief Cancels the request in flight.
+//!
+//! The responses of the request are dropped from now on, as the ones of a
+//! superseded request. The request is no longer awaited.
+//!
+//!	@param[in] generation Generation that replaces the request in flight.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Calendar::cancel(uint8_t generation)
+{
+    this->generation = generation;
+    pending = false;
+}
+
+//*****************************************************************************
+//
+//! @brief Prepares the calendar set for a new request.
+//!
+//! The events and the ETag of the last response of each calendar are kept,
+//! they are reused if the calendar was not modified.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Calendar::reset(void)
+{
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        sources[i].stream.reset();
+        sources[i].start = 0;
+        sources[i].end = 0;
+        sources[i].completed = false;
+        sources[i].http_status_code = HTTP_OK;
+    }
+    num_events = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Builds the Google Calendar webhook query.
+//!
+//!	@param[in] oauth2 Google_OAuth2 object used to get the access token.
+//!	@param[in] source Calendar of the set to be queried, with the start of
+//!                   its search window set.
+//!
+//!	@return A string object with the JSON webhook data.
+//
+//*****************************************************************************
+String Google_Calendar::payload(const Google_OAuth2 &oauth2, const Calendar_Source &source)
 {
-    int16_t index = 0, last_index = 0;
     //  The Google Calendar API uses two params to define the time range
     //  for the event search. These params must use an RFC3339 timestamp.
     //  i.e. 2011-06-03T10:00:00-07:00, or 2011-06-03T10:00:00Z (Zulu time zone)
-    //  Parameters
+    //  Both are given in UTC, so no time zone is involved.
     //  1. timeMin: Lower bound for an event's end time to filter by.
-    //  This param is set to the current data time. The Time.format() returns 
-    //  an ISO8601 timestamp which is modified to match the Zulu time zone.
-    String date_time = Time.format();
-    String date = split_string(date_time, 'T', index, last_index);
-    String time = split_string(date_time, date_time.charAt(19), index, last_index);
-    String time_min = date + "T";
-    time_min += time + "Z";
-    //  Get the current time in seconds since Jan 01 1970 (unix timestamp).
-    time_t raw_time = unix_time(Time.year(), Time.month(), Time.day(), 
-                                Time.hour(), Time.minute(), Time.second());
-    //  Change to UTC+0:00 since the raw time already considers the user time zone.
-    Time.zone(+0);
-    index = 0, last_index = 0;
-    //  2. timeMax: Upper bound for an event's end time to filter by.
-    //  Choose the number of hours added to the current time, three by default. 
-    //  This value defines the upper bound limit for the event search.
-    uint8_t hours_added = 3;
-    //  Convert the hours added in seconds (multiply by 3600).
-    date_time = Time.format(raw_time + (hours_added * 3600L));
-    date = split_string(date_time, 'T', index, last_index);
-    time = split_string(date_time, date_time.charAt(19), index, last_index);
-    String time_max = date + "T";
-    time_max += time + "Z";
-    //  Set the user time zone back.
-    Time.zone(TIME_ZONE);
-    String data = String::format("{\"calendar_id\":\"%s\",\"access_token\":\"%s\",\"time_min\":\"%s\",\"time_max\":\"%s\"}",
-                                 CALENDAR_ID.c_str(), oauth2.access_token.c_str(), time_min.c_str(), time_max.c_str());
-    Particle.publish(WEBHOOK_EVENT_NAME, data, PRIVATE);
+    //  This param is set to the start of the search window.
+    String time_min = rfc3339_format(source.window);
+    //  2. timeMax: Upper bound for an event's start time to filter by.
+    //  The window is extended by one step, so it covers CALENDAR_SEARCH_TIME
+    //  from any time within the step. The events out of it are skipped 
+    //  when merged.
+    String time_max = rfc3339_format(source.window + CALENDAR_SEARCH_TIME + CALENDAR_WINDOW_STEP);
+    //  3. etag: Sent in the If-None-Match header, empty if not conditional.
+    //  The ETag is a quoted string (i.e. "p33c8qm0g6sev0g"), escaped for JSON.
+    String etag = source.conditional ? source.etag : String("");
+    etag.replace("\"", "\\\"");
+    return String::format("{\"calendar_id\":\"%s\",\"access_token\":\"%s\",\"time_min\":\"%s\",\"time_max\":\"%s\",\"max_results\":%u,\"etag\":\"%s\"}",
+                          source.id.c_str(), oauth2.access_token.c_str(), time_min.c_str(), time_max.c_str(),
+                          CALENDAR_MAX_EVENTS, etag.c_str());
 }
 
 //*****************************************************************************
@@ -98,84 +242,307 @@ void Google_Calendar::publish(const Google_OAuth2 &oauth2)
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
 //!	@param[in] data Pointer to a char array holding the webhook reponse.
 //!
-//!	@return None.
+//!	@return false if the responses of the calendar set are not complete yet,
+//!         true if completed.
 //
 //*****************************************************************************
-void Google_Calendar::parser(const char *event, const char *data)
+bool Google_Calendar::parser(const char *event, const char *data)
 {
-    int16_t index = 0, last_index = 0;
-    String str_data = String(data);
-    String str_event = String(event);
-    //  Get the hook type.
-    //  i.e. event: deviceID/hook-response/calendar_event/0
-    //  hook: hook-response.
-    split_string(str_event, '/', index, last_index); // skip deviceID.
-    String hook = split_string(str_event, '/', index, last_index);
-    //  Reset the split string indexes.
-    index = 0, last_index = 0;
-    //  For "hook-response", the returned data is divided by '~' and stays
-    //  the same as there is only one webhook event. If no events were found
-    //  within the given time range, then a '~' character is returned.
-    if (hook.equals("hook-response"))
+    //  Drop the responses of an older request before parsing them.
+    if (Webhook_Cloud::event_generation(event) != generation)
+    {
+        stale_count++;
+        return false;
+    }
+    //  Get the calendar of the set.
+    //  i.e. event: deviceID/hook-response/calendar_event/c1/g7/0
+    source = find_source(event);
+    if (source == nullptr || source->completed)
     {
-        if (str_data.equals("~"))
+        return false;
+    }
+    response_bytes += strlen(data);
+    //  For "hook-response", the returned data is divided by '~', the ETag
+    //  of the response and three fields per event (start date and time, 
+    //  end date and time, location). The fields are passed to parse_field()
+    //  as the response chunks arrive. If no events were found within the 
+    //  given time range, then only the ETag is returned.
+    //  A conditional request answered without data was not modified.
+    if (hook_type(event) == Hook_Type::RESPONSE)
+    {
+        if (source->conditional && data[0] == '\0' && source->stream.chunk_index(event) == 0)
+        {
+            not_modified_count++;
+        }
+        else if (!source->stream.feed(event, data))
         {
-            event_pending = false;
+            return false;
         }
-        else
+        if (source->stream.failed())
         {
-            event_date_time = split_string(str_data, '~', index, last_index);;
-            event_location = split_string(str_data, '\0', index, last_index);
-            event_pending = true;
+            source->http_status_code = HTTP_PAYLOAD_TOO_LARGE;
+            http_error = "\r\nError: Response chunks received out of order.";
         }
-        http_status_code = HTTP_OK;
     }
     //  For "hook-error", the returned data is an error message generated by   
     //  the Particle Cloud. From this message only the HTTP status code is taken.
     //  i.e. error status 404 from www.googleapis.com
     //  HTTP status code: 404.
-    else if (hook.equals("hook-error"))
+    //  Only the first chunk holds the HTTP status code.
+    //  A 304 (not modified) is not a failure, the last events are reused.
+    else
     {
-        http_status_code = str_data.substring(13, 16).toInt();
+        if (source->stream.chunk_index(event) != 0)
+        {
+            return false;
+        }
+        source->http_status_code = error_status(data);
+        if (source->http_status_code == HTTP_NOT_MODIFIED)
+        {
+            source->http_status_code = HTTP_OK;
+            not_modified_count++;
+        }
+    }
+    //  The last events of a failed calendar are not valid anymore.
+    if (source->http_status_code != HTTP_OK)
+    {
+        source->etag = "";
+        source->num_events = 0;
     }
+    source->completed = true;
+    //  The request is completed once every calendar has responded.
+    //  It fails if any of them failed, as the merged events could
+    //  miss the next one.
+    http_status_code = HTTP_OK;
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        if (!sources[i].completed)
+        {
+            return false;
+        }
+        if (sources[i].http_status_code != HTTP_OK && http_status_code == HTTP_OK)
+        {
+            http_status_code = sources[i].http_status_code;
+        }
+    }
+    merge_sources();
+    event_pending = (num_events > 0);
+    return true;
 }
 
 //*****************************************************************************
 //
-//! @brief Google Calendar webhook response handler.
+//! @brief Parses a field of the webhook response.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is EQUAL TO 200.
+//! The response is a list of events, so it is not described by a schema
+//! and is decoded here.
 //!
-//!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!	@param[in] field Field position in the response template.
+//!	@param[in] value Pointer to a char array holding the field value.
+//!
+//!	@return Always Schema_Error::NONE, the fields are not validated.
+//
+//*****************************************************************************
+Schema_Error Google_Calendar::parse_field(uint8_t field, const char *value)
+{
+    //  i.e. data: "p33c8qm0g6sev0g"~
+    //             2011-06-03T10:00:00-07:00~2011-06-03T11:00:00-07:00~1600 Amphitheatre Parkway~
+    //             2011-06-03T12:00:00-07:00~2011-06-03T14:00:00-07:00~Shoreline Amphitheatre~
+    parsed_fields++;
+    //  The first field holds the ETag, the events of the last response
+    //  are replaced from here on.
+    if (field == 0)
+    {
+        source->etag = (strlen(value) < CALENDAR_ETAG_SIZE) ? String(value) : String("");
+        source->num_events = 0;
+        return Schema_Error::NONE;
+    }
+    //  The calendar returns up to CALENDAR_MAX_EVENTS.
+    if (source->num_events >= CALENDAR_MAX_EVENTS)
+    {
+        return Schema_Error::NONE;
+    }
+    //  Then three fields per event: start date and time, end date and time,
+    //  and location.
+    uint8_t position = (field - 1) % 3;
+    if (position == 0)
+    {
+        strlcpy(source->date_time, value, CALENDAR_DATE_TIME_SIZE);
+        source->start = rfc3339_time(value);
+    }
+    else if (position == 1)
+    {
+        source->end = rfc3339_time(value);
+    }
+    //  All-day events have no start time and are skipped.
+    else if (source->start != 0)
+    {
+        add_event(value);
+    }
+    return Schema_Error::NONE;
+}
+
+//*****************************************************************************
+//
+//! @brief Adds the event being parsed to the events of its calendar.
+//!
+//!	@param[in] location Pointer to a char array holding the event location.
+//!
+//!	@return None.
 //
 //*****************************************************************************
-void Google_Calendar::response_handler(const char *event, const char *data)
+void Google_Calendar::add_event(const char *location)
 {
-    //  Parse the webhook reponse.
-    parser(event, data);
-    //  Invoke the user subscribed response handler.
-    (*callback)();
+    Calendar_Event &event = source->events[source->num_events++];
+    event.start = source->start;
+    event.end = source->end;
+    strlcpy(event.date_time, source->date_time, CALENDAR_DATE_TIME_SIZE);
+    strlcpy(event.location, location, CALENDAR_LOCATION_SIZE);
 }
 
 //*****************************************************************************
 //
-//! @brief Google Calendar webhook error response handler.
+//! @brief Merges the events of every calendar into the upcoming events.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is DIFFERENT THAN 200.
+//! The events of a reused response can be out of the search time, as its
+//! window started up to CALENDAR_WINDOW_STEP before the request. Those are
+//! skipped.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Calendar::merge_sources(void)
+{
+    num_events = 0;
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        for (uint8_t j = 0; j < sources[i].num_events; j++)
+        {
+            const Calendar_Event &event = sources[i].events[j];
+            if ((event.end != 0 && event.end <= request_time) || 
+                (event.start >= request_time + CALENDAR_SEARCH_TIME))
+            {
+                continue;
+            }
+            if (!merge_event(event))
+            {
+                break;
+            }
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Merges an event into the upcoming events.
+//!
+//! The upcoming events are kept sorted by start time. The events of a 
+//! calendar are sorted as well, so once an event does not fit in the 
+//! upcoming events, neither do the next ones of the same calendar.
+//!
+//!	@param[in] event Event of a calendar of the set.
+//!
+//!	@return false if the event does not fit, true if merged.
+//
+//*****************************************************************************
+bool Google_Calendar::merge_event(const Calendar_Event &event)
+{
+    //  Events with the same start time keep their calendar order.
+    uint8_t position = num_events;
+    while (position > 0 && events[position - 1].start > event.start)
+    {
+        position--;
+    }
+    if (position >= CALENDAR_MAX_EVENTS)
+    {
+        return false;
+    }
+    //  Make room for the event, the last one is dropped if full.
+    uint8_t last = (num_events < CALENDAR_MAX_EVENTS) ? num_events : (CALENDAR_MAX_EVENTS - 1);
+    memmove(&events[position + 1], &events[position], (last - position) * sizeof(Calendar_Event));
+    if (num_events < CALENDAR_MAX_EVENTS)
+    {
+        num_events++;
+    }
+    events[position] = event;
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Finds the calendar of the set a webhook event belongs to.
 //!
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!                  i.e. deviceID/hook-response/calendar_event/c1/0
+//!
+//! @return A pointer to the calendar, nullptr if not found.
+//
+//*****************************************************************************
+Google_Calendar::Calendar_Source *Google_Calendar::find_source(const char *event)
+{
+    char name[CLOUD_EVENT_NAME_SIZE];
+    if (Webhook_Cloud::event_name(event, name) == nullptr)
+    {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < num_sources; i++)
+    {
+        if (sources[i].event_name.equals(name))
+        {
+            return &sources[i];
+        }
+    }
+    return nullptr;
+}
+
+//*****************************************************************************
+//
+//! @brief Completes the response of the calendar set.
+//!
+//! This method is called by the webhook client once every calendar of the
+//! set has responded, before the user subscribed response handler.
+//!
+//!	@return None.
 //
 //*****************************************************************************
-void Google_Calendar::error_handler(const char *event, const char *data)
+void Google_Calendar::on_response(void)
 {
-    //  Parse the webhook error reponse.
-    parser(event, data);
-    //  A string object is built with the HTTP status code 
-    //  and an error message to infrom the user.
+    //  Another calendar of the set might have failed.
+    if (failed())
+    {
+        build_error();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Completes the error response of the calendar set.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Calendar::on_error(void)
+{
+    build_error();
+}
+
+//*****************************************************************************
+//
+//! @brief Builds the error response of the calendar set.
+//!
+//! A string object is built with the HTTP status code of the first calendar
+//! that failed and an error message to infrom the user.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Calendar::build_error(void)
+{
+    //  The error message is already set if the response was dropped.
+    if (http_status_code == HTTP_PAYLOAD_TOO_LARGE)
+    {
+        return;
+    }
     http_error = String::format("\r\nHTTP ERROR - %d", http_status_code);
     if (http_status_code == HTTP_BAD_REQUEST)
     {
@@ -189,8 +556,6 @@ void Google_Calendar::error_handler(const char *event, const char *data)
     {
         http_error += "\r\nError: Invalid calendar id.";
     }
-    //  Invoke the user subscribed response handler.
-    (*callback)();
 }
 
 //*****************************************************************************
@@ -207,50 +572,99 @@ bool Google_Calendar::failed(void)
 
 //*****************************************************************************
 //
-//! @brief Prints the HTTP error response returned by the last event published.
+//! @brief Returns the calendar event status.
 //!
-//! @return None.
+//! @return false if not pending, true if pending.
 //
 //*****************************************************************************
-void Google_Calendar::print_error(void)
+bool Google_Calendar::is_event_pending(void)
 {
-    Serial.println(http_error);
+    return event_pending;
 }
 
 //*****************************************************************************
 //
-//! @brief Returns the calendar event status.
+//! @brief Gets the number of upcoming events from the last request.
 //!
-//! @return false if not pending, true if pending.
+//! @return The number of upcoming events, up to CALENDAR_MAX_EVENTS.
 //
 //*****************************************************************************
-bool Google_Calendar::is_event_pending(void)
+uint8_t Google_Calendar::get_num_events(void)
 {
-    return event_pending;
+    return num_events;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of response chunks dropped as they belong to an 
+//!        older request.
+//!
+//! @return The number of response chunks dropped.
+//
+//*****************************************************************************
+uint16_t Google_Calendar::get_stale_count(void)
+{
+    return stale_count;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the fetch statistics of the calendar set.
+//!
+//! @return A string object with the calendars requested, the ones not 
+//!         modified, and the response bytes received and fields parsed.
+//
+//*****************************************************************************
+String Google_Calendar::get_fetch_stats(void)
+{
+    return String::format("%u fetches, %u not modified, %lu bytes, %lu fields",
+                          fetch_count, not_modified_count, 
+                          (unsigned long) response_bytes, (unsigned long) parsed_fields);
 }
 
 //*****************************************************************************
 //
 //! @brief Gets the event location from the last request.
 //!
+//!	@param[in] index Position of the event in the upcoming events, 
+//!                  0 for the next one.
+//!
 //! @return A string object with the event location using the Google Geocoding 
 //!         address format (i.e. 1600 Amphitheatre Parkway, Mountain View, CA).
 //
 //*****************************************************************************
-String Google_Calendar::get_event_location(void)
+String Google_Calendar::get_event_location(uint8_t index)
 {
-    return event_location;
+    return (index < num_events) ? String(events[index].location) : String("");
 }
 
 //*****************************************************************************
 //
 //! @brief Gets the event start date and time from the last request.
 //!
+//!	@param[in] index Position of the event in the upcoming events, 
+//!                  0 for the next one.
+//!
 //! @return A string object with the event start date and time using the 
 //!         RFC3339 format (i.e. 2011-06-03T10:00:00-07:00).
 //
 //*****************************************************************************
-String Google_Calendar::get_event_date_time(void)
+String Google_Calendar::get_event_date_time(uint8_t index)
+{
+    return (index < num_events) ? String(events[index].date_time) : String("");
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the event start time from the last request.
+//!
+//!	@param[in] index Position of the event in the upcoming events, 
+//!                  0 for the next one.
+//!
+//! @return A unix timestamp (UTC), 0 if there is no such event.
+//
+//*****************************************************************************
+time_t Google_Calendar::get_event_start(uint8_t index)
 {
-    return event_date_time;
+    return (index < num_events) ? events[index].start : 0;
 }
@@ -1,8 +1,33 @@
 #ifndef __CALENDAR_H__
 #define __CALENDAR_H__
 
+#include "webhook_client.h"
+#include "utility.h"
+
+//  Max. number of calendars in a calendar set.
+#define CALENDAR_MAX_IDS            3
+//  Max. number of upcoming events kept after the merge. It is also the
+//  page size requested to each calendar (maxResults in the webhook).
+#define CALENDAR_MAX_EVENTS         4
+//  Max. number of characters of the event fields.
+#define CALENDAR_DATE_TIME_SIZE     32
+#define CALENDAR_LOCATION_SIZE      128
+//  Max. number of characters of a calendar ETag, longer ones are not kept.
+#define CALENDAR_ETAG_SIZE          64
+//  Max. number of chunks of a calendar response: the ETag and the three
+//  fields of every event, each one with its delimiter, and the end marker.
+#define CALENDAR_RESPONSE_CHUNKS    ((CALENDAR_ETAG_SIZE + CALENDAR_MAX_EVENTS *                     \
+                                      (2 * CALENDAR_DATE_TIME_SIZE + CALENDAR_LOCATION_SIZE) + 1 +  \
+                                      WEBHOOK_CHUNK_SIZE - 1) / WEBHOOK_CHUNK_SIZE)
+//  Time searched for the next events in seconds (three hours).
+#define CALENDAR_SEARCH_TIME        10800
+//  Step of the search window start in seconds. The requests made within the
+//  same step send the same query, so they can be conditional (ETag).
+#define CALENDAR_WINDOW_STEP        900
+
 //  Foward declaration.
 class Google_OAuth2;
+class Boot_Cache;
 
 //*****************************************************************************
 //
@@ -11,52 +36,151 @@ class Google_OAuth2;
 //! This class uses the Google Calendar API to read user calendar events only.
 //! It requires an OAuth2.0 access token to perfom the HTTP requests.
 //!
+//! The class reads a calendar set (i.e. work, personal and shared calendars).
+//! One webhook event is published per calendar, all of them at the same time,
+//! so the response time follows the slowest calendar. Each calendar returns
+//! its upcoming events ordered by start time, which are kept with the
+//! calendar as its response arrives. Once every calendar of the set has
+//! responded, the events are merged in a single pass: each one is inserted
+//! in start time order into the first CALENDAR_MAX_EVENTS events, and a
+//! calendar is left as soon as one of its events does not fit. If any
+//! calendar fails, the whole request fails, as the merged events could miss
+//! the next one.
+//!
+//! The memory used does not depend on the size of the responses, as they
+//! are parsed while the chunks arrive. Per user, it is bounded by 
+//! CALENDAR_MAX_IDS x (response stream + CALENDAR_MAX_EVENTS events), plus
+//! the CALENDAR_MAX_EVENTS merged events.
+//!
+//! The requests are conditional. Each calendar keeps the ETag and the events
+//! of its last response, and sends the ETag (If-None-Match) while the search
+//! window is the same. An unchanged calendar is answered with an HTTP 304
+//! and no events, so its last events are merged again without parsing.
+//!
+//! The webhook bookkeeping is shared with the other Google API classes
+//! through the webhook client base class, the request is completed once
+//! every calendar of the set has responded.
+//!
 //! Source: https://developers.google.com/calendar/v3/reference/events/list
 //
 //*****************************************************************************
-class Google_Calendar
+class Google_Calendar : public Webhook_Client<Google_Calendar>
 {
     private:
-        //  Typedef function pointer for the user webhook reponse handler.
-        typedef void (*Event_Callback)(void);
-        Event_Callback callback;
-        
-        //  Google calendar param.
-        const String CALENDAR_ID;
-        const int8_t TIME_ZONE;
-        
-        //  Particle webhook event name.
-        const String WEBHOOK_EVENT_NAME = "calendar_event";
+        //  Boot cache class is added as a friend class, so it can persist
+        //  and restore the last calendar snapshot across resets.
+        friend class Boot_Cache;
+        //  Webhook stream class is added as a friend class,
+        //  so it can pass the response fields to the parser.
+        friend class Webhook_Stream<Google_Calendar>;
+        //  Webhook client class is added as a friend class,
+        //  so it can pass the webhook events to the parser.
+        friend class Webhook_Client<Google_Calendar>;
+        //  Benchmark class is added as a friend class, so it can measure
+        //  the parser and the webhook query builder.
+        friend class Benchmark;
+
+        //  Calendar event structure.
+        typedef struct calendar_event
+        {
+            //  Start and end times as unix timestamps (UTC), used to merge the
+            //  events. The end time is 0 if unknown.
+            time_t start;
+            time_t end;
+            char date_time[CALENDAR_DATE_TIME_SIZE];
+            char location[CALENDAR_LOCATION_SIZE];
+        } Calendar_Event;
+
+        //  Calendar source structure, one per calendar of the set.
+        typedef struct calendar_source
+        {
+            //  Calendar ID and Particle webhook event name (tags included).
+            String id;
+            String event_name;
+            //  Webhook response stream.
+            Webhook_Stream<Google_Calendar> stream;
+            //  Start date and time, and end time of the event being parsed.
+            char date_time[CALENDAR_DATE_TIME_SIZE];
+            time_t start;
+            time_t end;
+            //  Events of the last response, in start time order.
+            Calendar_Event events[CALENDAR_MAX_EVENTS];
+            uint8_t num_events;
+            //  ETag of the last response and start of its search window.
+            //  Set if the request in flight sent the ETag.
+            String etag;
+            time_t window;
+            bool conditional;
+            //  Response status.
+            bool completed;
+            uint16_t http_status_code;
+            //  Constructor.
+            calendar_source(Google_Calendar &calendar) : stream(calendar) {};
+        } Calendar_Source;
+
+        //  User index and Particle webhook base event name (user tag included).
+        const uint8_t USER;
+        const String WEBHOOK_EVENT_NAME;
+
+        //  Calendar set, one source per calendar (see the constructor).
+        Calendar_Source sources[CALENDAR_MAX_IDS];
+        uint8_t num_sources;
+        //  Calendar whose response is being parsed.
+        Calendar_Source *source;
+
+        //  Generation of the last request, and number of response chunks 
+        //  dropped because they belong to an older one.
+        uint8_t generation;
+        uint16_t stale_count;
+        //  Time at which the last request was made, unix timestamp (UTC).
+        time_t request_time;
+
+        //  Calendars requested, calendars not modified (HTTP 304), and 
+        //  response bytes received and fields parsed.
+        uint16_t fetch_count;
+        uint16_t not_modified_count;
+        uint32_t response_bytes;
+        uint32_t parsed_fields;
         
-        //  Calendar API event data.
-        String event_location;
-        String event_date_time;
+        //  Calendar API event data, merged upcoming events.
+        Calendar_Event events[CALENDAR_MAX_EVENTS];
+        uint8_t num_events;
         bool event_pending;
-        
-        //  Http status code and error response returned from webhooks.
-        String http_error;
-        uint16_t http_status_code;
 
         //  Private member functions.
-        void parser(const char *event, const char *data);
+        void reset(void);
+        String payload(const Google_OAuth2 &oauth2, const Calendar_Source &source);
+        bool parser(const char *event, const char *data);
+        Schema_Error parse_field(uint8_t field, const char *value);
+        void add_event(const char *location);
+        void merge_sources(void);
+        bool merge_event(const Calendar_Event &event);
+        void build_error(void);
+        Calendar_Source *find_source(const char *event);
+        void on_response(void);
+        void on_error(void);
 
-    protected:
-        //  Particle webhook event handlers.
-        void response_handler(const char *event, const char *data);
-        void error_handler(const char *event, const char *data);
+        //  Class constructor for the source indexes 0 to CALENDAR_MAX_IDS - 1.
+        template <size_t... SOURCE>
+        Google_Calendar(const String &calendar_ids, uint8_t user, std::index_sequence<SOURCE...>);
 
     public:
         //  Class constructor.
-        Google_Calendar(const String &calendar_id, const int8_t &time_zone);
+        Google_Calendar(const String &calendar_ids, uint8_t user = 0);
         
         //  Public member functions.
-        void subscribe(Event_Callback callback);
-        void publish(const Google_OAuth2 &oauth2);
+        void subscribe(Event_Callback callback = nullptr);
+        void publish(const Google_OAuth2 &oauth2, uint8_t generation = 0);
+        Awaitable fetch(const Google_OAuth2 &oauth2, uint8_t generation = 0);
+        void cancel(uint8_t generation);
         bool is_event_pending(void);
         bool failed(void);
-        void print_error(void);
-        String get_event_location(void);
-        String get_event_date_time(void);
+        uint8_t get_num_events(void);
+        uint16_t get_stale_count(void);
+        String get_fetch_stats(void);
+        String get_event_location(uint8_t index = 0);
+        String get_event_date_time(uint8_t index = 0);
+        time_t get_event_start(uint8_t index = 0);
 };
 
 #endif  //  __CALENDAR_H__
\ No newline at end of file
@@ -0,0 +1,806 @@
+#include "Particle.h"
+#include "cloud.h"
+#include "recorder.h"
+#include "trace.h"
+#include "binlog.h"
+#include "http_status.h"
+
+//  Webhook cloud shared by the Google classes.
+Webhook_Cloud Cloud;
+
+//*****************************************************************************
+//
+//! @brief Webhook cloud class constructor.
+//
+//*****************************************************************************
+Webhook_Cloud::Webhook_Cloud()
+{
+    num_webhooks = 0;
+    num_subscriptions = 0;
+    received_dropped = 0;
+    received_max = 0;
+    lost_webhooks = 0;
+    tokens = PUBLISH_BURST;
+    refill_time = 0;
+    for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+    {
+        queue[i].used = false;
+    }
+    queue_length = 0;
+    sequence = 0;
+    memset(stats, 0, sizeof(stats));
+#ifdef LOCAL_CLOUD_ENABLED
+    connect_time = 0;
+    line_length = 0;
+#endif
+}
+
+//*****************************************************************************
+//
+//! @brief Subscribes the device to the responses of all webhooks.
+//!
+//! The subscription matches the event name prefix, so a single one gets 
+//! the hook-response and hook-error events for this device. This also keeps
+//! the device far from the limit of four subscription handlers.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::begin(void)
+{
+    String hook_prefix = System.deviceID() + "/hook-";
+    Particle.subscribe(hook_prefix, &Webhook_Cloud::receive, this, MY_DEVICES);
+}
+
+//*****************************************************************************
+//
+//! @brief Subscribes the device to an event other than the webhook responses.
+//!
+//! The handler is called from loop(), as the webhook handlers.
+//!
+//!	@param[in] event Event name prefix (i.e. google_assistant).
+//!	@param[in] handler Handler for the event.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::subscribe(const String &event, Webhook_Handler handler)
+{
+    if (num_subscriptions >= CLOUD_MAX_SUBSCRIPTIONS)
+    {
+        return;
+    }
+    Subscription &subscription = subscriptions[num_subscriptions++];
+    strlcpy(subscription.name, event.c_str(), CLOUD_EVENT_NAME_SIZE);
+    subscription.handler = handler;
+    Particle.subscribe(event, &Webhook_Cloud::receive, this, MY_DEVICES);
+}
+
+//*****************************************************************************
+//
+//! @brief Attaches the handlers of a webhook event.
+//!
+//! The handlers are replaced if the webhook is already attached.
+//!
+//!	@param[in] event Webhook event name.
+//!	@param[in] response_handler Handler for the hook-response events.
+//!	@param[in] error_handler Handler for the hook-error events.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::attach(const String &event, Webhook_Handler response_handler, Webhook_Handler error_handler)
+{
+    uint8_t index = find_webhook(event.c_str());
+    Webhook *webhook = (index < num_webhooks) ? &webhooks[index] : nullptr;
+    if (webhook == nullptr)
+    {
+        if (num_webhooks >= CLOUD_MAX_WEBHOOKS)
+        {
+            return;
+        }
+        //  The webhook is counted once named, as receive() looks it up 
+        //  from the system thread.
+        webhook = &webhooks[num_webhooks];
+        strncpy(webhook->name, event.c_str(), CLOUD_EVENT_NAME_SIZE - 1);
+        webhook->name[CLOUD_EVENT_NAME_SIZE - 1] = '\0';
+        webhook->failed_status = 0;
+        webhook->lost_generation = 0;
+        num_webhooks++;
+    }
+    webhook->response_handler = response_handler;
+    webhook->error_handler = error_handler;
+}
+
+//*****************************************************************************
+//
+//! @brief Publishes a webhook event.
+//!
+//! The event is queued and published right away if the rate limit allows it
+//! and the device is connected. Otherwise, it is published from loop().
+//! The event is not published while the recorder is replaying, as the
+//! recorded response is delivered instead.
+//!
+//!	@param[in] event Webhook event name.
+//!	@param[in] data Webhook event data.
+//!	@param[in] priority Priority class of the event.
+//!	@param[in] generation Generation of the request, appended to the event 
+//!                       name as a tag. 0 if not tagged.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::publish(const String &event, const String &data, Publish_Class priority, uint8_t generation)
+{
+    Recorder.published(event, generation);
+    if (Recorder.replaying())
+    {
+        return;
+    }
+    enqueue(event, data, priority, generation);
+    flush();
+}
+
+//*****************************************************************************
+//
+//! @brief Receives an event from the Particle Cloud.
+//!
+//! It is called by the OS, from the system thread if enabled. The event is
+//! only copied into the receive queue, it is dispatched from loop(). If the
+//! queue is full, its webhook is marked as lost.
+//!
+//!	@param[in] event Pointer to a char array holidng the event info.
+//!	@param[in] data Pointer to a char array holding the event data.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::receive(const char *event, const char *data)
+{
+    Received_Event *slot = received.claim();
+    if (slot == nullptr)
+    {
+        //  The request of a lost event is failed from loop(). Only the newest
+        //  generation is kept, the older ones belong to superseded requests.
+        received_dropped++;
+        char name[CLOUD_EVENT_NAME_SIZE];
+        uint8_t index = (event_name(event, name) != nullptr) ? find_webhook(name) : CLOUD_MAX_WEBHOOKS;
+        if (index < CLOUD_MAX_WEBHOOKS)
+        {
+            uint32_t mask = 1UL << index;
+            uint8_t generation = event_generation(event);
+            if (!(lost_webhooks.load() & mask) || 
+                (int8_t)(generation - webhooks[index].lost_generation) > 0)
+            {
+                webhooks[index].lost_generation = generation;
+            }
+            lost_webhooks.fetch_or(mask);
+        }
+        return;
+    }
+    strlcpy(slot->event, event, CLOUD_TOPIC_SIZE);
+    strlcpy(slot->data, (data != nullptr) ? data : "", CLOUD_DATA_SIZE);
+    received.commit();
+    uint8_t size = received.size();
+    if (size > received_max)
+    {
+        received_max = size;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Passes a webhook response or error response to its handler.
+//!
+//! The subscriptions to other events are passed to their handler as well.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/calendar_event/0
+//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::dispatch(const char *event, const char *data)
+{
+    for (uint8_t i = 0; i < num_subscriptions; i++)
+    {
+        if (strncmp(event, subscriptions[i].name, strlen(subscriptions[i].name)) == 0)
+        {
+            subscriptions[i].handler(event, data);
+            return;
+        }
+    }
+    char name[CLOUD_EVENT_NAME_SIZE];
+    const char *chunk = event_name(event, name);
+    if (chunk == nullptr)
+    {
+        return;
+    }
+    bool error = (strstr(event, "/hook-error/") != nullptr);
+    uint8_t index = find_webhook(name);
+    Trace.record(error ? Trace_Type::ERROR : Trace_Type::RESPONSE, index,
+                 (event_generation(event) << 8) | (atoi(chunk + 1) & 0xFF));
+    if (index >= num_webhooks)
+    {
+        return;
+    }
+    Webhook_Handler &handler = error ? webhooks[index].error_handler :
+                                       webhooks[index].response_handler;
+    if (handler)
+    {
+        handler(event, data);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Dispatches the events received, answers the requests failed by 
+//!        the cloud, sends the queued publishes and receives the events sent
+//!        by the local cloud stand-in.
+//!
+//! It must be called from the application loop.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::loop(void)
+{
+    //  Events received from the Particle Cloud, in arrival order.
+    for (Received_Event *slot = received.front(); slot != nullptr; slot = received.front())
+    {
+        dispatch(slot->event, slot->data);
+        received.pop();
+    }
+    answer_lost();
+    answer_failed();
+    //  Publishes held by the rate limit or while disconnected.
+    flush();
+#ifdef LOCAL_CLOUD_ENABLED
+    if (!connect())
+    {
+        return;
+    }
+    while (client.available() > 0)
+    {
+        char c = client.read();
+        if (c == '\n')
+        {
+            line[line_length] = '\0';
+            receive_line();
+            line_length = 0;
+        }
+        else if (line_length < (LOCAL_CLOUD_LINE_SIZE - 1))
+        {
+            line[line_length++] = c;
+        }
+    }
+#endif
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the queueing statistics of the publishes.
+//!
+//! @return A string object with the number of publishes, the average and max.
+//!         queueing delay in milliseconds, and the number of publishes 
+//!         dropped per priority class. Then, the max. number of events 
+//!         held in the receive queue and the ones dropped.
+//!         i.e. "user: 12 4/900 ms 0 dropped, background: 1 0/0 ms 0 dropped,
+//!         received: 3 max 0 dropped"
+//
+//*****************************************************************************
+String Webhook_Cloud::get_publish_stats(void)
+{
+    const char *names[PUBLISH_CLASSES] = {"user", "background"};
+    String text = "";
+    for (uint8_t i = 0; i < PUBLISH_CLASSES; i++)
+    {
+        const Publish_Stats &s = stats[i];
+        uint32_t average = (s.count > 0) ? (s.total_delay / s.count) : 0;
+        text += String::format("%s%s: %u %lu/%lu ms %u dropped", (i > 0) ? ", " : "", names[i],
+                               s.count, (unsigned long)average, (unsigned long)s.max_delay, s.dropped);
+    }
+    text += String::format(", received: %u max %u dropped", received_max, received_dropped);
+    return text;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the name of a webhook attached to the cloud.
+//!
+//!	@param[in] index Webhook index, in attach order.
+//!
+//! @return A pointer to the webhook event name, nullptr if out of range.
+//
+//*****************************************************************************
+const char *Webhook_Cloud::get_webhook_name(uint8_t index)
+{
+    return (index < num_webhooks) ? webhooks[index].name : nullptr;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the webhook event name from the event info.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/calendar_event/1/g7/0
+//!	@param[out] name Buffer of CLOUD_EVENT_NAME_SIZE characters receiving
+//!                  the event name, calendar_event/1 for the example above.
+//!
+//! @return A pointer to the rest of the event info ("/0" for the example
+//!         above), nullptr if the event info is not valid.
+//
+//*****************************************************************************
+const char *Webhook_Cloud::event_name(const char *event, char *name)
+{
+    //  Skip deviceID and hook type.
+    const char *start = strchr(event, '/');
+    start = (start != nullptr) ? strchr(start + 1, '/') : nullptr;
+    if (start == nullptr)
+    {
+        return nullptr;
+    }
+    start++;
+    //  The event name (user tag included) ends before the chunk index.
+    const char *end = strrchr(start, '/');
+    if (end == nullptr)
+    {
+        end = start + strlen(start);
+    }
+    const char *chunk = end;
+    //  The generation tag is not part of the event name.
+    const char *generation = find_generation(start, end);
+    if (generation != nullptr)
+    {
+        end = generation;
+    }
+    uint8_t length = end - start;
+    if (length >= CLOUD_EVENT_NAME_SIZE)
+    {
+        length = CLOUD_EVENT_NAME_SIZE - 1;
+    }
+    memcpy(name, start, length);
+    name[length] = '\0';
+    return chunk;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the generation tag from the webhook event info.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/calendar_event/1/g7/0
+//!
+//! @return The generation, 7 for the example above, 0 if not tagged.
+//
+//*****************************************************************************
+uint8_t Webhook_Cloud::event_generation(const char *event)
+{
+    const char *end = strrchr(event, '/');
+    if (end == nullptr)
+    {
+        return 0;
+    }
+    const char *generation = find_generation(event, end);
+    return (generation != nullptr) ? atoi(generation + 2) : 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the user tag appended to the webhook event names.
+//!
+//! The first user does not use a tag, so a single-user device publishes the
+//! same event names as before.
+//!
+//!	@param[in] user User index.
+//!
+//! @return A string object with the user tag (i.e. "/1"), empty for user 0.
+//
+//*****************************************************************************
+String Webhook_Cloud::user_tag(uint8_t user)
+{
+    return (user == 0) ? String("") : String("/") + String(user);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the generation tag appended to the webhook event names.
+//!
+//!	@param[in] generation Generation of the request, 0 if not tagged.
+//!
+//! @return A string object with the generation tag (i.e. "/g7"), empty for 0.
+//
+//*****************************************************************************
+String Webhook_Cloud::generation_tag(uint8_t generation)
+{
+    return (generation == 0) ? String("") : String("/g") + String(generation);
+}
+
+//*****************************************************************************
+//
+//! @brief Finds the generation tag at the end of a part of the event info.
+//!
+//!	@param[in] start Pointer to the start of the part.
+//!	@param[in] end Pointer to the end of the part (not included).
+//!
+//! @return A pointer to the generation tag ("/g7"), nullptr if not tagged.
+//
+//*****************************************************************************
+const char *Webhook_Cloud::find_generation(const char *start, const char *end)
+{
+    const char *tag = end;
+    while (tag > start && isdigit(*(tag - 1)))
+    {
+        tag--;
+    }
+    //  At least one digit after "/g".
+    if (tag == end || (tag - start) < 2 || *(tag - 1) != 'g' || *(tag - 2) != '/')
+    {
+        return nullptr;
+    }
+    return tag - 2;
+}
+
+//*****************************************************************************
+//
+//! @brief Finds a webhook attached to the cloud.
+//!
+//!	@param[in] name Webhook event name, user tag included.
+//!
+//! @return The webhook index, CLOUD_MAX_WEBHOOKS if not attached.
+//
+//*****************************************************************************
+uint8_t Webhook_Cloud::find_webhook(const char *name)
+{
+    for (uint8_t i = 0; i < num_webhooks; i++)
+    {
+        if (strcmp(webhooks[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+    return CLOUD_MAX_WEBHOOKS;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if the device is connected to the cloud.
+//!
+//! @return false if not connected, true if connected.
+//
+//*****************************************************************************
+bool Webhook_Cloud::connected(void)
+{
+#ifdef LOCAL_CLOUD_ENABLED
+    return connect();
+#else
+    return Particle.connected();
+#endif
+}
+
+//*****************************************************************************
+//
+//! @brief Sends a webhook event to the cloud.
+//!
+//!	@param[in] event Webhook event name.
+//!	@param[in] data Webhook event data.
+//!	@param[in] generation Generation of the request, 0 if not tagged.
+//!
+//! @return false if not sent, true if sent.
+//
+//*****************************************************************************
+bool Webhook_Cloud::send(const String &event, const String &data, uint8_t generation)
+{
+    Trace.record(Trace_Type::PUBLISH, find_webhook(event.c_str()), generation);
+    String tagged_event = event + generation_tag(generation);
+#ifdef LOCAL_CLOUD_ENABLED
+    client.print("P " + tagged_event + " " + data + "\n");
+    return true;
+#else
+    return Particle.publish(tagged_event, data, PRIVATE);
+#endif
+}
+
+//*****************************************************************************
+//
+//! @brief Refills the token bucket, one token per PUBLISH_PERIOD elapsed
+//!        up to PUBLISH_BURST tokens.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::refill(void)
+{
+    uint32_t periods = (millis() - refill_time) / PUBLISH_PERIOD;
+    if (periods == 0)
+    {
+        return;
+    }
+    refill_time += periods * PUBLISH_PERIOD;
+    tokens = ((tokens + periods) >= PUBLISH_BURST) ? PUBLISH_BURST : (tokens + periods);
+}
+
+//*****************************************************************************
+//
+//! @brief Adds a webhook event to the publish queue.
+//!
+//! A queued event with the same name belongs to a superseded request, so it
+//! is replaced and the new one keeps its place in arrival order. It takes 
+//! the priority class of the new publish, and its queueing delay is counted
+//! from the replacement, as it is the new publish that is sent. If the queue
+//! is full, the newest publish of the lowest priority class makes room, as 
+//! long as its priority is lower. Otherwise, the new publish is dropped.
+//!
+//!	@param[in] event Webhook event name.
+//!	@param[in] data Webhook event data.
+//!	@param[in] priority Priority class of the event.
+//!	@param[in] generation Generation of the request, 0 if not tagged.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::enqueue(const String &event, const String &data, Publish_Class priority, uint8_t generation)
+{
+    Queued_Publish *entry = nullptr;
+    for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+    {
+        if (queue[i].used && queue[i].event.equals(event))
+        {
+            queue[i].priority = priority;
+            queue[i].generation = generation;
+            queue[i].queue_time = millis();
+            queue[i].data = data;
+            return;
+        }
+        if (!queue[i].used && entry == nullptr)
+        {
+            entry = &queue[i];
+        }
+    }
+    if (entry == nullptr)
+    {
+        for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+        {
+            if (queue[i].priority > priority && (entry == nullptr || 
+                queue[i].priority > entry->priority ||
+                (queue[i].priority == entry->priority && queue[i].sequence > entry->sequence)))
+            {
+                entry = &queue[i];
+            }
+        }
+        if (entry == nullptr)
+        {
+            drop(event, priority, generation);
+            return;
+        }
+        drop(entry->event, entry->priority, entry->generation);
+        queue_length--;
+    }
+    entry->used = true;
+    entry->priority = priority;
+    entry->generation = generation;
+    entry->sequence = sequence++;
+    entry->queue_time = millis();
+    entry->event = event;
+    entry->data = data;
+    queue_length++;
+}
+
+//*****************************************************************************
+//
+//! @brief Drops a publish as the queue is full.
+//!
+//! The request it belongs to fails with an HTTP 429 (too many requests).
+//!
+//!	@param[in] event Webhook event name.
+//!	@param[in] priority Priority class of the event.
+//!	@param[in] generation Generation of the request, 0 if not tagged.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::drop(const String &event, Publish_Class priority, uint8_t generation)
+{
+    stats[static_cast<uint8_t>(priority)].dropped++;
+    BINLOG_ERROR("Error: Publish queue full, %s dropped.", event.c_str());
+    fail(event.c_str(), generation, HTTP_TOO_MANY_REQUESTS);
+}
+
+//*****************************************************************************
+//
+//! @brief Fails the request in flight of a webhook.
+//!
+//! The webhook is marked, so the request gets an error response from 
+//! loop(). It is not answered here, as the client publishing might not be
+//! done with the request yet. A single failure is held per webhook: the one
+//! of the newest generation, as the older requests are superseded, and the
+//! first one within a generation.
+//!
+//!	@param[in] name Webhook event name, user tag included.
+//!	@param[in] generation Generation of the request, 0 if not tagged.
+//!	@param[in] status HTTP status code of the error response.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::fail(const char *name, uint8_t generation, uint16_t status)
+{
+    uint8_t index = find_webhook(name);
+    if (index >= num_webhooks)
+    {
+        return;
+    }
+    Webhook &webhook = webhooks[index];
+    if (webhook.failed_status == 0 || (int8_t)(generation - webhook.failed_generation) > 0)
+    {
+        webhook.failed_status = status;
+        webhook.failed_generation = generation;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Fails the requests of the webhooks whose response chunks were lost
+//!        as the receive queue was full.
+//!
+//! The request fails with an HTTP 413, as its response is incomplete.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::answer_lost(void)
+{
+    uint32_t mask = lost_webhooks.exchange(0);
+    for (uint8_t i = 0; mask != 0; i++, mask >>= 1)
+    {
+        if (mask & 1)
+        {
+            BINLOG_ERROR("Error: Receive queue full, %s response dropped.", webhooks[i].name);
+            fail(webhooks[i].name, webhooks[i].lost_generation, HTTP_PAYLOAD_TOO_LARGE);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Answers the requests failed by the cloud with a hook-error event.
+//!
+//! The event is dispatched as if it came from the Particle Cloud, with the
+//! generation of the request, so only the request it belongs to fails.
+//! i.e. deviceID/hook-error/calendar_event/1/g7/0
+//!      error status 429 from device
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::answer_failed(void)
+{
+    for (uint8_t i = 0; i < num_webhooks; i++)
+    {
+        if (webhooks[i].failed_status == 0)
+        {
+            continue;
+        }
+        String event = System.deviceID() + "/hook-error/" + webhooks[i].name +
+                       generation_tag(webhooks[i].failed_generation) + "/0";
+        String data = String::format("error status %u from device", webhooks[i].failed_status);
+        webhooks[i].failed_status = 0;
+        dispatch(event.c_str(), data.c_str());
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Sends the queued publishes allowed by the rate limit.
+//!
+//! The publishes are sent in priority order, and in arrival order within a 
+//! priority class, while the device is connected.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::flush(void)
+{
+    refill();
+    while (queue_length > 0 && tokens > 0 && connected())
+    {
+        Queued_Publish *next = nullptr;
+        for (uint8_t i = 0; i < PUBLISH_QUEUE_SIZE; i++)
+        {
+            if (queue[i].used && (next == nullptr || queue[i].priority < next->priority ||
+                (queue[i].priority == next->priority && queue[i].sequence < next->sequence)))
+            {
+                next = &queue[i];
+            }
+        }
+        //  A failed publish takes its token as well, it is retried later.
+        tokens--;
+        if (!send(next->event, next->data, next->generation))
+        {
+            return;
+        }
+        count_delay(next->priority, next->queue_time);
+        next->used = false;
+        //  Release the heap memory of the strings.
+        next->event = "";
+        next->data = "";
+        queue_length--;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Counts the queueing delay of a publish sent.
+//!
+//!	@param[in] priority Priority class of the publish.
+//!	@param[in] queue_time Time at which the publish was queued.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::count_delay(Publish_Class priority, uint32_t queue_time)
+{
+    uint32_t delay_time = millis() - queue_time;
+    Publish_Stats &s = stats[static_cast<uint8_t>(priority)];
+    s.count++;
+    s.total_delay += delay_time;
+    if (delay_time > s.max_delay)
+    {
+        s.max_delay = delay_time;
+    }
+}
+
+#ifdef LOCAL_CLOUD_ENABLED
+//*****************************************************************************
+//
+//! @brief Connects the device to the local cloud stand-in, if not connected.
+//!
+//! @return false if not connected, true if connected.
+//
+//*****************************************************************************
+bool Webhook_Cloud::connect(void)
+{
+    if (client.connected())
+    {
+        return true;
+    }
+    if ((millis() - connect_time) < LOCAL_CLOUD_RETRY_TIME && connect_time != 0)
+    {
+        return false;
+    }
+    connect_time = millis();
+    line_length = 0;
+    if (!client.connect(LOCAL_CLOUD_HOST, LOCAL_CLOUD_PORT))
+    {
+        Serial.println("Error: Unable to connect to the local cloud.");
+        return false;
+    }
+    client.print("D " + System.deviceID() + "\n");
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Handles a line received from the local cloud stand-in.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Cloud::receive_line(void)
+{
+    //  i.e. E deviceID/hook-response/calendar_event/0 <data>
+    if (line[0] != 'E' || line[1] != ' ')
+    {
+        return;
+    }
+    char *topic = &line[2];
+    char *data = strchr(topic, ' ');
+    if (data == nullptr)
+    {
+        return;
+    }
+    *data++ = '\0';
+    dispatch(topic, data);
+}
+#endif
@@ -0,0 +1,251 @@
+#ifndef __CLOUD_H__
+#define __CLOUD_H__
+
+#include <atomic>
+#include "spsc_ring.h"
+
+//  Uncomment this line to use the local cloud stand-in (tools/local_cloud.py)
+//  instead of the Particle Cloud webhooks.
+//#define LOCAL_CLOUD_ENABLED
+
+//  Uncomment this line to run the cloud connection in the system thread
+//  (SYSTEM_THREAD(ENABLED)), so it is not held while an answer is played.
+//#define CLOUD_THREAD_ENABLED
+
+//  Address and port of the host running the local cloud stand-in.
+#define LOCAL_CLOUD_HOST            "192.168.1.100"
+#define LOCAL_CLOUD_PORT            7070
+//  Time between connection attempts to the local cloud in milliseconds.
+#define LOCAL_CLOUD_RETRY_TIME      5000
+//  Max. number of characters of a line received from the local cloud.
+#define LOCAL_CLOUD_LINE_SIZE       640
+
+//  Max. number of webhooks attached to the cloud, up to 32 (one lost bit
+//  each, see Webhook_Cloud::receive()).
+#define CLOUD_MAX_WEBHOOKS          24
+//  Max. number of characters of a webhook event name, user tag included
+//  and generation tag excluded.
+#define CLOUD_EVENT_NAME_SIZE       24
+//  Max. number of subscriptions to events other than the webhook responses.
+#define CLOUD_MAX_SUBSCRIPTIONS     2
+
+//  Number of events received and not dispatched yet that can be held, 
+//  a power of two. It must hold the worst burst of responses (see 
+//  RECEIVE_BURST in app.h). Max. number of characters of the event info and
+//  data of an event received (a webhook response chunk is up to 512 
+//  characters).
+#define CLOUD_RECEIVE_QUEUE_SIZE    32
+#define CLOUD_TOPIC_SIZE            96
+#define CLOUD_DATA_SIZE             513
+
+//  Particle Cloud publish rate limit: one publish per second on average,
+//  with bursts of up to four publishes.
+#define PUBLISH_PERIOD              1000
+#define PUBLISH_BURST               4
+//  Max. number of publishes held while rate limited or disconnected.
+#define PUBLISH_QUEUE_SIZE          8
+//  Number of publish priority classes.
+#define PUBLISH_CLASSES             2
+
+//*****************************************************************************
+//
+//	Enumeration class for the publish priority classes, from the highest
+//  priority to the lowest.
+//
+//*****************************************************************************
+
+enum class Publish_Class : uint8_t
+{
+    USER,           //  Needed to answer a user (calendar, travel time, token).
+    BACKGROUND      //  Refresh of data not waited for (location).
+};
+
+//  Typedef function for the webhook response and error response handlers.
+typedef std::function<void(const char *, const char *)> Webhook_Handler;
+
+//*****************************************************************************
+//
+//! @brief Webhook cloud class.
+//!
+//! This class is the single point used by the Google classes to publish their
+//! webhook events and receive the responses. A single Particle subscription 
+//! gets the responses of all webhooks, which are passed to the handlers 
+//! attached for the exact event name. So several objects of the same class 
+//! (i.e. one per user) can have requests in flight at the same time, using a
+//! user tag in the event name (i.e. calendar_event/1). The Particle webhooks
+//! match the event name prefix, so no new webhooks are required.
+//!
+//! The request a webhook event belongs to can be tagged as well, with a 
+//! generation tag at the end of the event name (i.e. calendar_event/1/g7).
+//! The handlers are attached without it, so the responses of any generation
+//! reach them and the parsers can drop the ones of an old request.
+//!
+//! Responses that do not come from the Particle Cloud (local cloud stand-in,
+//! recorder replay) are passed to the same handlers.
+//!
+//! The Particle Cloud events (webhook responses and other subscriptions) are
+//! not handled where they are received. They are copied into a lock-free
+//! receive queue and dispatched from loop(), so the parsers and the 
+//! application handlers always run in the application thread. With the 
+//! system thread enabled (CLOUD_THREAD_ENABLED), the cloud connection keeps 
+//! receiving while the application is busy (i.e. playing an answer), and no
+//! state is shared with the system thread but the queue.
+//!
+//! All webhook events go through a publish scheduler. A token bucket keeps 
+//! the publishes within the Particle Cloud rate limit, and the publishes 
+//! that exceed it, or are made while disconnected, are held in a bounded 
+//! queue. The queue is flushed from loop() in priority order (then oldest
+//! first) as the tokens are refilled and the device is connected. A queued 
+//! event of a superseded request is replaced by the new one. The queueing 
+//! delay is tracked per priority class. A publish dropped as the queue is
+//! full is answered from loop() with a hook-error event (HTTP 429, too many
+//! requests) sent to the error handler of its webhook, so the request it
+//! belongs to fails instead of waiting for a response that never comes.
+//! Likewise, a response chunk lost as the receive queue is full fails its 
+//! request with an HTTP 413 (the response is incomplete). The receiving 
+//! side sets a lost bit per webhook, so no lost chunk goes unreported
+//! however many are lost.
+//!
+//! If the local cloud is enabled, the events are sent over TCP to the local
+//! cloud stand-in using a line protocol:
+//!     D <device_id>       Device to cloud, sent after connecting.
+//!     P <event> <data>    Device to cloud, webhook event published.
+//!     E <topic> <data>    Cloud to device, i.e. topic:
+//!                         deviceID/hook-response/calendar_event/0
+//
+//*****************************************************************************
+class Webhook_Cloud
+{
+    private:
+        //  Webhook structure.
+        typedef struct webhook
+        {
+            char name[CLOUD_EVENT_NAME_SIZE];
+            Webhook_Handler response_handler;
+            Webhook_Handler error_handler;
+            //  HTTP status code of the request failed by the cloud (a publish
+            //  or a response chunk dropped), 0 if none, and its generation.
+            uint16_t failed_status;
+            uint8_t failed_generation;
+            //  Newest generation of the response chunks lost, see lost_webhooks.
+            uint8_t lost_generation;
+        } Webhook;
+
+        //  Subscription structure.
+        typedef struct subscription
+        {
+            char name[CLOUD_EVENT_NAME_SIZE];
+            Webhook_Handler handler;
+        } Subscription;
+
+        //  Received event structure.
+        typedef struct received_event
+        {
+            char event[CLOUD_TOPIC_SIZE];
+            char data[CLOUD_DATA_SIZE];
+        } Received_Event;
+
+        //  Queued publish structure.
+        typedef struct queued_publish
+        {
+            bool used;
+            Publish_Class priority;
+            uint8_t generation;
+            //  Order of arrival and time at which it was queued.
+            uint32_t sequence;
+            uint32_t queue_time;
+            String event;
+            String data;
+        } Queued_Publish;
+
+        //  Queueing statistics of a priority class.
+        typedef struct publish_stats
+        {
+            uint16_t count;
+            uint16_t dropped;
+            uint32_t total_delay;
+            uint32_t max_delay;
+        } Publish_Stats;
+
+        //  Webhooks attached to the cloud.
+        Webhook webhooks[CLOUD_MAX_WEBHOOKS];
+        uint8_t num_webhooks;
+
+        //  Subscriptions to other events.
+        Subscription subscriptions[CLOUD_MAX_SUBSCRIPTIONS];
+        uint8_t num_subscriptions;
+
+        //  Events received and not dispatched yet (receive queue), from the
+        //  system thread to the application thread. Events dropped as the
+        //  queue was full, and max. number of events held. Both are only 
+        //  written by the receiving side.
+        SPSC_Ring<Received_Event, CLOUD_RECEIVE_QUEUE_SIZE> received;
+        uint16_t received_dropped;
+        uint8_t received_max;
+        //  Webhooks with response chunks dropped as the receive queue was
+        //  full, one bit per webhook, from the system thread to the 
+        //  application thread.
+        std::atomic<uint32_t> lost_webhooks;
+        static_assert(CLOUD_MAX_WEBHOOKS <= 32, "A lost bit is needed per webhook.");
+
+        //  Token bucket, tokens left and last refill time.
+        uint8_t tokens;
+        uint32_t refill_time;
+
+        //  Publish queue and statistics per priority class.
+        Queued_Publish queue[PUBLISH_QUEUE_SIZE];
+        uint8_t queue_length;
+        uint32_t sequence;
+        Publish_Stats stats[PUBLISH_CLASSES];
+
+        //  Private member functions.
+        static const char *find_generation(const char *start, const char *end);
+        uint8_t find_webhook(const char *name);
+        void receive(const char *event, const char *data);
+        bool send(const String &event, const String &data, uint8_t generation);
+        void refill(void);
+        void enqueue(const String &event, const String &data, Publish_Class priority, uint8_t generation);
+        void drop(const String &event, Publish_Class priority, uint8_t generation);
+        void fail(const char *name, uint8_t generation, uint16_t status);
+        void answer_lost(void);
+        void answer_failed(void);
+        void flush(void);
+        void count_delay(Publish_Class priority, uint32_t queue_time);
+
+#ifdef LOCAL_CLOUD_ENABLED
+        //  Local cloud connection.
+        TCPClient client;
+        uint32_t connect_time;
+        char line[LOCAL_CLOUD_LINE_SIZE];
+        uint16_t line_length;
+
+        //  Local cloud member functions.
+        bool connect(void);
+        void receive_line(void);
+#endif
+
+    public:
+        //  Class constructor.
+        Webhook_Cloud();
+
+        //  Public member functions.
+        void begin(void);
+        void attach(const String &event, Webhook_Handler response_handler, Webhook_Handler error_handler);
+        void subscribe(const String &event, Webhook_Handler handler);
+        void publish(const String &event, const String &data, 
+                     Publish_Class priority = Publish_Class::USER, uint8_t generation = 0);
+        void dispatch(const char *event, const char *data);
+        void loop(void);
+        bool connected(void);
+        String get_publish_stats(void);
+        const char *get_webhook_name(uint8_t index);
+        static const char *event_name(const char *event, char *name);
+        static uint8_t event_generation(const char *event);
+        static String user_tag(uint8_t user);
+        static String generation_tag(uint8_t generation);
+};
+
+//  Webhook cloud shared by the Google classes.
+extern Webhook_Cloud Cloud;
+
+#endif  //  __CLOUD_H__
@@ -2,27 +2,65 @@
 #include "distance_matrix.h"
 #include "utility.h"
 #include "http_status.h"
+#include "cloud.h"
 
 //*****************************************************************************
 //
-//! @brief Google Geolocation class constructor.
+//! @brief Google Distance Matrix class constructor.
+//!
+//!	@param[in] user User index, it tags the webhook event name.
 //
 //*****************************************************************************
-Google_Distance_Matrix::Google_Distance_Matrix()
+Google_Distance_Matrix::Google_Distance_Matrix(uint8_t user)
+    : Google_Distance_Matrix(user, std::make_index_sequence<DEPARTURE_CANDIDATES>())
 {
-    callback = nullptr;
+}
+
+//*****************************************************************************
+//
+//! @brief Google Distance Matrix class constructor for the candidate indexes.
+//!
+//! The candidates list gets one entry per index, all of them built for this
+//! object.
+//!
+//!	@param[in] user User index, it tags the webhook event name.
+//
+//*****************************************************************************
+template <size_t... CANDIDATE>
+Google_Distance_Matrix::Google_Distance_Matrix(uint8_t user, std::index_sequence<CANDIDATE...>)
+    : USER_TAG(Webhook_Cloud::user_tag(user)), candidates{{repeat_for<CANDIDATE>(*this)}...}
+{
+    num_candidates = 1;
+    candidate = nullptr;
+    arrive_by = 0;
+    on_time_found = false;
+    on_time_departure = 0;
+    late_departure = 0;
+    rounds = 0;
+    elements = 0;
+    result_found = false;
+    departure_time = 0;
+    duration_to_dest = 0;
+    distance_to_dest = 0;
+    generation = 0;
+    stale_count = 0;
+    http_status_code = HTTP_OK;
 }
 
 //*****************************************************************************
 //
 //! @brief Subscribes the device to a Google Distance Matrix webhook event.
 //!
-//! This method subscribes the device to a customized webhook response and 
-//! error response event name. The device ID is included in the customized
-//! event name so only THIS device will get the response.
+//! This method attaches the response handler to the webhook cloud, which 
+//! receives the customized response event names. The device ID is included
+//! in the customized event name so only THIS device will get the response.
+//! The Distance Matrix API reports its errors in the response (see 
+//! check_status()), the error responses only come from the Particle Cloud
+//! or the webhook cloud (i.e. a publish dropped).
 //!
 //!	@param[in] event Distance Matrix event used to setup the webhook.
-//!	@param[in] callback Pointer to the application-level response handler.
+//!	@param[in] callback Pointer to the application-level response handler,
+//!                     nullptr if the responses are awaited (see query()).
 //!
 //!	@return None.
 //
@@ -40,20 +78,245 @@ void Google_Distance_Matrix::subscribe(const Distance_Matrix_Event &event, Event
     {
         WEBHOOK_EVENT_NAME = WEBHOOK_DISTANCE_TRANSIT;
     }
-    String hook_reponse = System.deviceID() + "/hook-response/" + WEBHOOK_EVENT_NAME;
-    Particle.subscribe(hook_reponse, &Google_Distance_Matrix::response_handler, this, MY_DEVICES);
+    WEBHOOK_EVENT_NAME += USER_TAG;
+    name_candidates();
+    for (uint8_t i = 0; i < DEPARTURE_CANDIDATES; i++)
+    {
+        attach(candidates[i].event_name);
+    }
 }
 
 //*****************************************************************************
 //
-//! @brief Publishes a Google Distance Matrix webhook event.
+//! @brief Names the webhook events of the departure candidates.
+//!
+//! Each candidate gets its own webhook event name, so the responses can be
+//! told apart. i.e. dist_driving, dist_driving/d1, dist_driving/1/d2. The 
+//! first candidate keeps the base name.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Distance_Matrix::name_candidates(void)
+{
+    for (uint8_t i = 0; i < DEPARTURE_CANDIDATES; i++)
+    {
+        candidates[i].event_name = WEBHOOK_EVENT_NAME;
+        if (i > 0)
+        {
+            candidates[i].event_name += "/d" + String(i);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Publishes a Google Distance Matrix request.
+//!
+//! Without an arrival time, the departure time is the current time. With 
+//! one, driving requests search the latest departure time that arrives on
+//! time, and the response handler is called once the search is completed.
+//! Transit requests get the trip that arrives by the arrival time (the 
+//! current time if 0) in a single request.
+//!
+//!	@param[in] event Distance Matrix event used to setup the webhook.
+//!	@param[in] generation Generation of the request. The responses of other
+//!                       generations are dropped. 0 if not tagged.
+//!	@param[in] arrive_by Arrival time as a unix timestamp (UTC), 0 if none.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Distance_Matrix::publish(const Distance_Matrix_Event &event, uint8_t generation, time_t arrive_by)
+{
+    request = event;
+    this->generation = generation;
+    this->arrive_by = arrive_by;
+    begin_request();
+    rounds = 0;
+    elements = 0;
+    result_found = false;
+    on_time_found = false;
+    on_time_departure = 0;
+    late_departure = arrive_by;
+    //  The first round covers from now until the arrival time, evenly.
+    //  i.e. now, now + 1/3 and now + 2/3 of the time left.
+    time_t now = Time.now();
+    num_candidates = 1;
+    if (arrive_by > now && event.travel_mode == Distance_Matrix_Travel_Mode::DRIVING)
+    {
+        num_candidates = DEPARTURE_CANDIDATES;
+    }
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        candidates[i].departure_time = now + ((arrive_by - now) * i) / num_candidates;
+    }
+    //  The transit departure is given by the response.
+    if (event.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT)
+    {
+        candidates[0].departure_time = 0;
+        this->arrive_by = (arrive_by > 0) ? arrive_by : now;
+    }
+    publish_round();
+}
+
+//*****************************************************************************
+//
+//! @brief Publishes a Google Distance Matrix request, to be awaited.
 //!
 //!	@param[in] event Distance Matrix event used to setup the webhook.
+//!	@param[in] generation Generation of the request, see publish().
+//!	@param[in] arrive_by Arrival time as a unix timestamp (UTC), 0 if none.
+//!
+//!	@return An awaitable, ready once the departure search is completed or
+//!         the request is cancelled.
+//
+//*****************************************************************************
+Awaitable Google_Distance_Matrix::query(const Distance_Matrix_Event &event, uint8_t generation, time_t arrive_by)
+{
+    publish(event, generation, arrive_by);
+    return completion();
+}
+
+//*****************************************************************************
+//
+//! @brief Cancels the departure search in flight.
+//!
+//! The responses of the search are dropped from now on, as the ones of a
+//! superseded request, so no further round is published. The search is no
+//! longer awaited.
+//!
+//!	@param[in] generation Generation that replaces the request in flight.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Distance_Matrix::cancel(uint8_t generation)
+{
+    this->generation = generation;
+    pending = false;
+}
+
+//*****************************************************************************
+//
+//! @brief Prepares the departure candidates for a new round.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Distance_Matrix::reset(void)
+{
+    for (uint8_t i = 0; i < DEPARTURE_CANDIDATES; i++)
+    {
+        candidates[i].stream.reset();
+        candidates[i].completed = false;
+        candidates[i].http_status_code = HTTP_OK;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Publishes one webhook event per departure candidate, without 
+//!        waiting for the responses.
 //!
 //!	@return None.
 //
 //*****************************************************************************
-void Google_Distance_Matrix::publish(const Distance_Matrix_Event &event)
+void Google_Distance_Matrix::publish_round(void)
+{
+    reset();
+    rounds++;
+    elements += num_candidates;
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        Cloud.publish(candidates[i].event_name, payload(request, candidates[i].departure_time),
+                      Publish_Class::USER, generation);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Narrows the departure search with the responses of the last round.
+//!
+//! The candidates are sorted by departure time. Each one on time moves the
+//! latest departure known on time, and each one late the earliest departure
+//! known late. If the search is not done, the next round splits the interval
+//! between both evenly.
+//!
+//! A round whose candidates all failed ends the search with the best result
+//! of the previous rounds. The request only fails if no round gave a result.
+//!
+//! @return false if the search is completed, true if another round is needed.
+//
+//*****************************************************************************
+bool Google_Distance_Matrix::next_round(void)
+{
+    //  Failed candidates are skipped.
+    uint16_t error_code = HTTP_OK;
+    bool answered = false;
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        const Distance_Matrix_Candidate &answer = candidates[i];
+        if (answer.http_status_code != HTTP_OK)
+        {
+            error_code = (error_code == HTTP_OK) ? answer.http_status_code : error_code;
+            continue;
+        }
+        bool on_time = (answer.departure_time + (time_t) answer.duration_to_dest) <= arrive_by;
+        if (on_time)
+        {
+            on_time_found = true;
+            on_time_departure = answer.departure_time;
+        }
+        else if (answer.departure_time < late_departure)
+        {
+            late_departure = answer.departure_time;
+        }
+        //  The result is the latest departure on time. Until one is found,
+        //  it is the first candidate of the first round, so a user already
+        //  late gets the duration of leaving now. A later candidate never
+        //  stands in for it, as its departure is not now.
+        if (on_time || (rounds == 1 && i == 0))
+        {
+            result_found = true;
+            departure_time = answer.departure_time;
+            duration_to_dest = answer.duration_to_dest;
+            distance_to_dest = answer.distance_to_dest;
+        }
+        answered = true;
+    }
+    http_status_code = result_found ? HTTP_OK : error_code;
+    if (!answered || !result_found)
+    {
+        return false;
+    }
+    //  Done if there is no search, the user is already late or the latest
+    //  departure is known within the resolution.
+    if (num_candidates == 1 || !on_time_found || rounds >= DEPARTURE_MAX_ROUNDS ||
+        (late_departure - on_time_departure) <= DEPARTURE_RESOLUTION)
+    {
+        return false;
+    }
+    time_t span = late_departure - on_time_departure;
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        candidates[i].departure_time = on_time_departure + (span * (i + 1)) / (num_candidates + 1);
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a Google Distance Matrix webhook query.
+//!
+//!	@param[in] event Distance Matrix event used to setup the webhook.
+//!	@param[in] departure_time Departure time as a unix timestamp (UTC), 
+//!                           driving only.
+//!
+//!	@return A string object with the JSON webhook data.
+//
+//*****************************************************************************
+String Google_Distance_Matrix::payload(const Distance_Matrix_Event &event, time_t departure_time)
 {
     //  Build an string object with the latitude/longitude coordinates.
     String origin = String::format("%.6f,%.6f", event.origin_lat, event.origin_lng);
@@ -62,11 +325,11 @@ void Google_Distance_Matrix::publish(const Distance_Matrix_Event &event)
     String data;
     if (event.travel_mode == Distance_Matrix_Travel_Mode::DRIVING)
     {
-        //  Get the current time in seconds since Jan 01 1970 (unix timestamp).
-        time_t curr_time = unix_time(Time.year(), Time.month(), Time.day(),
-                                     Time.hour(), Time.minute(), Time.second());
-        data = String::format("{\"origin\":\"%s\",\"destination\":\"%s\",\"curr_time\":\"%s\"}",
-                              origin.c_str(), event.destination.c_str(), String(curr_time).c_str());
+        //  The API does not take departure times in the past, so the current
+        //  time is sent as "now".
+        String departure = (departure_time > Time.now()) ? String((unsigned long) departure_time) : String("now");
+        data = String::format("{\"origin\":\"%s\",\"destination\":\"%s\",\"departure_time\":\"%s\"}",
+                              origin.c_str(), event.destination.c_str(), departure.c_str());
     }
     else if (event.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT)
     {
@@ -93,10 +356,11 @@ void Google_Distance_Matrix::publish(const Distance_Matrix_Event &event)
                 transit_mode = "bus";
                 break;
         }
-        data = String::format("{\"origin\":\"%s\",\"destination\":\"%s\",\"transit_mode\":\"%s\"}",
-                              origin.c_str(), event.destination.c_str(), transit_mode.c_str());
+        data = String::format("{\"origin\":\"%s\",\"destination\":\"%s\",\"transit_mode\":\"%s\",\"arrival_time\":\"%lu\"}",
+                              origin.c_str(), event.destination.c_str(), transit_mode.c_str(),
+                              (unsigned long) arrive_by);
     }
-    Particle.publish(WEBHOOK_EVENT_NAME, data, PRIVATE);
+    return data;
 }
 
 //*****************************************************************************
@@ -106,19 +370,81 @@ void Google_Distance_Matrix::publish(const Distance_Matrix_Event &event)
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
 //!	@param[in] data Pointer to a char array holding the webhook reponse.
 //!
+//!	@return false if the response is not complete yet, true if completed.
+//
+//*****************************************************************************
+bool Google_Distance_Matrix::parser(const char *event, const char *data)
+{
+    //  Drop the responses of an older request before parsing them.
+    if (Webhook_Cloud::event_generation(event) != generation)
+    {
+        stale_count++;
+        return false;
+    }
+    //  Get the departure candidate.
+    //  i.e. event: deviceID/hook-response/dist_driving/1/d2/g7/0
+    candidate = find_candidate(event);
+    if (candidate == nullptr || candidate->completed)
+    {
+        return false;
+    }
+    //  For "hook-response", the returned data is divided by '~' and does not
+    //  change as both Distance Matrix webhooks (dist_driving/dist_transit) 
+    //  request the same data. The fields are passed to parse_field() as the
+    //  response chunks arrive.
+    if (hook_type(event) == Hook_Type::RESPONSE)
+    {
+        if (!candidate->stream.feed(event, data))
+        {
+            return false;
+        }
+        check_status(*candidate);
+    }
+    //  For "hook-error", only the HTTP status code is taken from the first
+    //  chunk. i.e. error status 429 from device
+    else
+    {
+        if (candidate->stream.chunk_index(event) != 0)
+        {
+            return false;
+        }
+        candidate->http_status_code = error_status(data);
+    }
+    candidate->completed = true;
+    //  The round is completed once every candidate has responded. Then the
+    //  search either goes on with a new round or is completed.
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        if (!candidates[i].completed)
+        {
+            return false;
+        }
+    }
+    if (next_round())
+    {
+        publish_round();
+        return false;
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks the status of a departure candidate response.
+//!
+//!	@param[in] candidate Departure candidate whose response is completed.
+//!
 //!	@return None.
 //
 //*****************************************************************************
-void Google_Distance_Matrix::parser(const char *event, const char *data)
+void Google_Distance_Matrix::check_status(Distance_Matrix_Candidate &candidate)
 {
-    int16_t index = 0, last_index = 0;
-    String str_data = String(data);
-    //  The returned data is divided by '~' and does not change as both Distance
-    //  Matrix webhooks (dist_driving/dist_transit) request the same data.
-    distance_to_dest = split_string(str_data, '~', index, last_index).toInt();
-    duration_to_dest = split_string(str_data, '~', index, last_index).toInt();
-    String element_status = split_string(str_data, '~', index, last_index);
-    String top_status = split_string(str_data, '\0', index, last_index);
+    if (candidate.stream.failed())
+    {
+        candidate.http_status_code = HTTP_PAYLOAD_TOO_LARGE;
+        http_error = "\r\nError: Response chunks received out of order.";
+        return;
+    }
     //  The Distance Martix API returns an HTTP 200 status code even if 
     //  something goes wrong with the last request. Errors are handle by  
     //  an element- and top-level status code. This is why no error handler 
@@ -129,48 +455,96 @@ void Google_Distance_Matrix::parser(const char *event, const char *data)
     //     particular origin-destination pairing. In this application there
     //     is only one element per request.
     //  Error description is provided in the API source link.
-    if (top_status.equals("OK"))
+    if (candidate.top_status.equals("OK"))
     {
-        if (element_status.equals("OK"))
+        if (candidate.element_status.equals("OK"))
         {
-            http_status_code = HTTP_OK;
+            //  A malformed response is handled as an error response. The
+            //  distance and duration are only sent if both statuses are OK.
+            Schema_Error error = (request.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT) ?
+                                 candidate.stream.validate<Transit_Schema>() :
+                                 candidate.stream.validate<Response_Schema>();
+            if (error != Schema_Error::NONE)
+            {
+                candidate.http_status_code = HTTP_BAD_GATEWAY;
+                http_error = schema_error_message(error, candidate.stream.get_error_field());
+            }
+            else
+            {
+                candidate.http_status_code = HTTP_OK;
+            }
+            //  A trip that is walked has no schedule, it can start at
+            //  any time.
+            if (request.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT && candidate.departure_time == 0)
+            {
+                candidate.departure_time = arrive_by - candidate.duration_to_dest;
+            }
         }
         else
         {
             //  An HTTP error is forced.
-            http_status_code = HTTP_BAD_REQUEST;
+            candidate.http_status_code = HTTP_BAD_REQUEST;
             //  Specify level error.
             http_error = "\r\nError: Element-level error, ";
-            http_error += element_status;
+            http_error += candidate.element_status;
         }
     }
     else
     {
         //  An HTTP error is forced.
-        http_status_code = HTTP_BAD_REQUEST;
+        candidate.http_status_code = HTTP_BAD_REQUEST;
         //  Specify level error.
         http_error = "\r\nError: Top-level error, ";
-        http_error += top_status;
+        http_error += candidate.top_status;
     }
 }
 
 //*****************************************************************************
 //
-//! @brief Google Distance Matrix webhook response handler.
+//! @brief Parses a field of the webhook response.
+//!
+//! The field is decoded as described by the response schema of the travel
+//! mode, into the departure candidate being parsed.
+//!
+//!	@param[in] field Field position in the response template.
+//!	@param[in] value Pointer to a char array holding the field value.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is EQUAL TO 200.
+//!	@return Schema_Error::NONE if decoded, the decoding error otherwise.
+//
+//*****************************************************************************
+Schema_Error Google_Distance_Matrix::parse_field(uint8_t field, const char *value)
+{
+    if (request.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT)
+    {
+        return Transit_Schema::decode(*candidate, field, value);
+    }
+    return Response_Schema::decode(*candidate, field, value);
+}
+
+//*****************************************************************************
+//
+//! @brief Finds the departure candidate a webhook response belongs to.
 //!
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!
+//! @return A pointer to the candidate, nullptr if not found.
 //
 //*****************************************************************************
-void Google_Distance_Matrix::response_handler(const char *event, const char *data)
+Google_Distance_Matrix::Distance_Matrix_Candidate *Google_Distance_Matrix::find_candidate(const char *event)
 {
-    //  Parse the webhook reponse.
-    parser(event, data);
-    //  Invoke the user subscribed response handler.
-    (*callback)();
+    char name[CLOUD_EVENT_NAME_SIZE];
+    if (Webhook_Cloud::event_name(event, name) == nullptr)
+    {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < num_candidates; i++)
+    {
+        if (candidates[i].event_name.equals(name))
+        {
+            return &candidates[i];
+        }
+    }
+    return nullptr;
 }
 
 //*****************************************************************************
@@ -187,14 +561,36 @@ bool Google_Distance_Matrix::failed(void)
 
 //*****************************************************************************
 //
-//! @brief Prints the HTTP error response returned by the last event published.
+//! @brief Gets the departure time the travel duration and distance belong 
+//!        to. It is the latest departure time on time found by the search,
+//!        or the time of the request if there is none.
+//!
+//! @return A unix timestamp (UTC).
+//
+//*****************************************************************************
+time_t Google_Distance_Matrix::get_departure_time(void)
+{
+    return departure_time;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the latest time to leave and still arrive on time.
 //!
-//! @return None.
+//! Transit trips leave at their scheduled departure time. Driving trips can
+//! leave until the arrival time minus the travel duration, with the traffic
+//! expected at the departure time found.
+//!
+//! @return A unix timestamp (UTC), in the past if the user is late.
 //
 //*****************************************************************************
-void Google_Distance_Matrix::print_error(void)
+time_t Google_Distance_Matrix::get_leave_time(void)
 {
-    Serial.println(http_error);
+    if (request.travel_mode == Distance_Matrix_Travel_Mode::TRANSIT || arrive_by == 0)
+    {
+        return departure_time;
+    }
+    return arrive_by - duration_to_dest;
 }
 
 //*****************************************************************************
@@ -220,3 +616,41 @@ uint16_t Google_Distance_Matrix::get_distance_to_dest(void)
 {
     return distance_to_dest;
 }
+
+//*****************************************************************************
+//
+//! @brief Gets the number of rounds of the last request.
+//!
+//! @return The number of rounds, 1 if there was no search.
+//
+//*****************************************************************************
+uint8_t Google_Distance_Matrix::get_rounds(void)
+{
+    return rounds;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of API elements spent by the last request, one
+//!        per departure time queried.
+//!
+//! @return The number of elements.
+//
+//*****************************************************************************
+uint8_t Google_Distance_Matrix::get_elements(void)
+{
+    return elements;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of response chunks dropped as they belong to an 
+//!        older request.
+//!
+//! @return The number of response chunks dropped.
+//
+//*****************************************************************************
+uint16_t Google_Distance_Matrix::get_stale_count(void)
+{
+    return stale_count;
+}
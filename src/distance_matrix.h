@@ -1,6 +1,19 @@
 #ifndef __DISTANCE_MATRIX_H__
 #define __DISTANCE_MATRIX_H__
 
+#include "webhook_client.h"
+#include "utility.h"
+
+//  Number of departure times queried at once by the departure search. The
+//  Distance Matrix API takes a single departure time per request, so one
+//  webhook event is published per departure time.
+#define DEPARTURE_CANDIDATES        3
+//  Max. number of rounds (batches of departure times) of the search.
+#define DEPARTURE_MAX_ROUNDS        3
+//  The search stops once the latest departure time is known within this
+//  time, in seconds.
+#define DEPARTURE_RESOLUTION        300
+
 //*****************************************************************************
 //
 //	The following are enumeration classes for the travel modes and transit
@@ -31,12 +44,41 @@ enum class Distance_Matrix_Transit_Mode : uint8_t
 //! This class uses the Google Distance Matrix API to get the travel duration 
 //! and distance between to points either driving or using public transport.
 //!
+//! The driving duration depends on the traffic at the departure time, so if
+//! an arrival time is given the class searches the latest departure time
+//! that still arrives on time. Each round publishes DEPARTURE_CANDIDATES
+//! departure times at once, all of them in flight at the same time, and the
+//! next round splits the interval between the latest departure on time and
+//! the earliest one late. The search is bounded by DEPARTURE_MAX_ROUNDS and
+//! DEPARTURE_RESOLUTION, and the number of rounds and API elements spent 
+//! (one per departure time) is reported.
+//!
+//! Transit schedules are discrete, so transit requests ask for the trip that
+//! arrives by the arrival time instead, and the scheduled departure time of
+//! the trip is taken from the response. The Distance Matrix API does not 
+//! return it, so the transit webhook uses the Directions API with the same
+//! response fields plus the departure time.
+//!
+//! The webhook bookkeeping is shared with the other Google API classes
+//! through the webhook client base class, the request is completed once
+//! the departure search is completed.
+//!
 //! Source: https://developers.google.com/maps/documentation/distance-matrix/intro
 //
 //*****************************************************************************
-class Google_Distance_Matrix
+class Google_Distance_Matrix : public Webhook_Client<Google_Distance_Matrix>
 {
     private:
+        //  Webhook stream class is added as a friend class,
+        //  so it can pass the response fields to the parser.
+        friend class Webhook_Stream<Google_Distance_Matrix>;
+        //  Webhook client class is added as a friend class,
+        //  so it can pass the webhook events to the parser.
+        friend class Webhook_Client<Google_Distance_Matrix>;
+        //  Benchmark class is added as a friend class, so it can measure
+        //  the parser and the webhook query builder.
+        friend class Benchmark;
+
         //  Distance Matrix event structure.
         struct distance_matrix_event
         {
@@ -57,44 +99,119 @@ class Google_Distance_Matrix
                             transit_mode(Distance_Matrix_Transit_Mode::NONE) {};
         };
 
-        //  Typedef function pointer for the user webhook reponse handler.
-        typedef void (*Event_Callback)(void);
-        Event_Callback callback;
-        
-        //  Particle webhooks event name.
+        //  Departure candidate structure, one per departure time of a round.
+        typedef struct distance_matrix_candidate
+        {
+            //  Particle webhook event name (tags included).
+            String event_name;
+            //  Webhook response stream.
+            Webhook_Stream<Google_Distance_Matrix> stream;
+            //  Departure time as a unix timestamp (UTC). Transit departures
+            //  are scheduled, 0 until the response is received.
+            time_t departure_time;
+            //  Distance Matrix API data.
+            uint32_t duration_to_dest;
+            uint16_t distance_to_dest;
+            String element_status;
+            String top_status;
+            //  Response status.
+            bool completed;
+            uint16_t http_status_code;
+            //  Constructor.
+            distance_matrix_candidate(Google_Distance_Matrix &distance_matrix) 
+                : stream(distance_matrix) {};
+        } Distance_Matrix_Candidate;
+
+        //  Particle webhooks event name and user tag.
         String WEBHOOK_EVENT_NAME;
+        const String USER_TAG;
         const String WEBHOOK_DISTANCE_DRIVING = "dist_driving";
         const String WEBHOOK_DISTANCE_TRANSIT = "dist_transit";
 
-        //  Distance Matrix API data.
+        //  Webhook response schema.
+        //  i.e. data: 12.3 mi~1520~OK~OK
+        typedef Webhook_Schema<Distance_Matrix_Candidate,
+            Number_Field<Distance_Matrix_Candidate, uint16_t, &Distance_Matrix_Candidate::distance_to_dest, 0, 65535, 1, ' '>,
+            Number_Field<Distance_Matrix_Candidate, uint32_t, &Distance_Matrix_Candidate::duration_to_dest, 0, 604800>,
+            Text_Field<Distance_Matrix_Candidate, &Distance_Matrix_Candidate::element_status, 32>,
+            Text_Field<Distance_Matrix_Candidate, &Distance_Matrix_Candidate::top_status, 32>
+        > Response_Schema;
+        //  i.e. data: 12.3 mi~1520~OK~OK~1591012800
+        //  The departure time is empty if the trip is walked.
+        typedef Webhook_Schema<Distance_Matrix_Candidate,
+            Number_Field<Distance_Matrix_Candidate, uint16_t, &Distance_Matrix_Candidate::distance_to_dest, 0, 65535, 1, ' '>,
+            Number_Field<Distance_Matrix_Candidate, uint32_t, &Distance_Matrix_Candidate::duration_to_dest, 0, 604800>,
+            Text_Field<Distance_Matrix_Candidate, &Distance_Matrix_Candidate::element_status, 32>,
+            Text_Field<Distance_Matrix_Candidate, &Distance_Matrix_Candidate::top_status, 32>,
+            Number_Field<Distance_Matrix_Candidate, time_t, &Distance_Matrix_Candidate::departure_time, 0, INT32_MAX, 1, '\0', false>
+        > Transit_Schema;
+
+        //  Departure candidates of the current round, one per departure time
+        //  (see the constructor).
+        Distance_Matrix_Candidate candidates[DEPARTURE_CANDIDATES];
+        uint8_t num_candidates;
+        //  Candidate whose response is being parsed.
+        Distance_Matrix_Candidate *candidate;
+
+        //  Departure search state. The event is kept for the next rounds.
+        distance_matrix_event request;
+        time_t arrive_by;
+        //  Latest departure time known to be on time, if any, and earliest
+        //  one known to be late.
+        bool on_time_found;
+        time_t on_time_departure;
+        time_t late_departure;
+        //  Rounds and API elements spent by the last request.
+        uint8_t rounds;
+        uint8_t elements;
+
+        //  Distance Matrix API data of the departure time found, valid once
+        //  a round gave a usable result.
+        bool result_found;
+        time_t departure_time;
         uint32_t duration_to_dest;
         uint16_t distance_to_dest;
-        
-        //  Http status code and error response returned from webhooks.
-        String http_error;
-        uint16_t http_status_code;
-        
+
+        //  Generation of the last request, and number of response chunks 
+        //  dropped because they belong to an older one.
+        uint8_t generation;
+        uint16_t stale_count;
+
         //  Private member functions.
-        void parser(const char *event, const char *data);
+        void name_candidates(void);
+        void reset(void);
+        void publish_round(void);
+        bool next_round(void);
+        String payload(const distance_matrix_event &event, time_t departure_time);
+        bool parser(const char *event, const char *data);
+        Schema_Error parse_field(uint8_t field, const char *value);
+        void check_status(Distance_Matrix_Candidate &candidate);
+        Distance_Matrix_Candidate *find_candidate(const char *event);
 
-    protected:
-        //  Particle webhooks event handler.
-        void response_handler(const char *event, const char *data);
+        //  Class constructor for the candidate indexes 0 to DEPARTURE_CANDIDATES - 1.
+        template <size_t... CANDIDATE>
+        Google_Distance_Matrix(uint8_t user, std::index_sequence<CANDIDATE...>);
 
     public:
         //  Typedef struct to specify the Particle webhook params.
         typedef struct distance_matrix_event Distance_Matrix_Event;
         
         //  Class constructor.
-        Google_Distance_Matrix();
+        Google_Distance_Matrix(uint8_t user = 0);
 
         //  Public member functions.
-        void subscribe(const Distance_Matrix_Event &event, Event_Callback callback);
-        void publish(const Distance_Matrix_Event &event);
+        void subscribe(const Distance_Matrix_Event &event, Event_Callback callback = nullptr);
+        void publish(const Distance_Matrix_Event &event, uint8_t generation = 0, time_t arrive_by = 0);
+        Awaitable query(const Distance_Matrix_Event &event, uint8_t generation = 0, time_t arrive_by = 0);
+        void cancel(uint8_t generation);
         bool failed(void);
-        void print_error(void);
+        time_t get_departure_time(void);
+        time_t get_leave_time(void);
         uint32_t get_duration_to_dest(void);
         uint16_t get_distance_to_dest(void);
+        uint8_t get_rounds(void);
+        uint8_t get_elements(void);
+        uint16_t get_stale_count(void);
 };
 
 #endif  //  __DISTANCE_MATRIX_H__
\ No newline at end of file
@@ -2,22 +2,7 @@
 #include "geolocation.h"
 #include "utility.h"
 #include "http_status.h"
-
-//  Size of a JSON WiFi access point object in bytes.
-#define WIFI_AP_SIZE            46
-//  Max. number of WiFi access points allowed to store. 
-#define MAX_NUM_APS             6
-//  Size of x number of WiFi access points.
-#define WIFI_AP_BUFF_SIZE       ((WIFI_AP_SIZE * MAX_NUM_APS) + 1)
-
-//  Pointer to the access point memory location.
-static char *wifi_ap_ptr;
-//  Total number of bytes available in the buffer.
-static size_t buff_size;
-//  Current number of access points registered.
-static uint8_t wifi_ap_cnt;
-//  Space in memory to store the access points.
-static char wifi_ap_buff[WIFI_AP_BUFF_SIZE];
+#include "cloud.h"
 
 //*****************************************************************************
 //
@@ -29,16 +14,29 @@ static char wifi_ap_buff[WIFI_AP_BUFF_SIZE];
 //! points, it is recommended to attach an WiFi antenna to the Particle Argon.
 //!
 //!	@param[in] wap Pointer to a WiFi access point struct.
-//!	@param[in] data Pointer to an optional second param (not used).
+//!	@param[in] data Pointer to the Google_Geolocation object running the scan.
+//
+//*****************************************************************************
+void Google_Geolocation::wifi_scan_callback(WiFiAccessPoint *wap, void *data)
+{
+    static_cast<Google_Geolocation *>(data)->add_access_point(*wap);
+}
+
+//*****************************************************************************
+//
+//! @brief Registers a scanned WiFi access point.
+//!
+//!	@param[in] ap WiFi access point struct.
+//!
+//!	@return None.
 //
 //*****************************************************************************
-static void wifi_scan_callback(WiFiAccessPoint *wap, void *data)
+void Google_Geolocation::add_access_point(const WiFiAccessPoint &ap)
 {
     //  Only 6 access points are captured by default. It was considered
     //  enough to get an accuarte location from the Geolocation API.
     if (wifi_ap_cnt < MAX_NUM_APS)
     {
-        WiFiAccessPoint &ap = *wap;
         //  Build a string object with the 
         //  6-byte MAC address of an access point.
         String bssid = String::format("%02X:%02X:%02X:%02X:%02X:%02X",
@@ -68,17 +66,19 @@ static void wifi_scan_callback(WiFiAccessPoint *wap, void *data)
 //
 //*****************************************************************************
 Google_Geolocation::Google_Geolocation()
+    : stream(*this)
 {
-    callback = nullptr;
+    clear_access_points();
 }
 
 //*****************************************************************************
 //
 //! @brief Subscribes the device to the Google Geolocation webhook event.
 //!
-//! This method subscribes the device to a customized webhook response and 
-//! error response event name. The device ID is included in the customized
-//! event name so only THIS device will get the response.
+//! This method attaches the response and error response handlers to the 
+//! webhook cloud, which receives the customized response event names. The 
+//! device ID is included in the customized event name so only THIS device 
+//! will get the response.
 //!
 //!	@param[in] callback Pointer to the user reponse handler function.
 //!
@@ -88,10 +88,7 @@ Google_Geolocation::Google_Geolocation()
 void Google_Geolocation::subscribe(Event_Callback callback)
 {
     this->callback = callback;
-    String hook_reponse = System.deviceID() + "/hook-response/" + WEBHOOK_EVENT_NAME;
-    String hook_error = System.deviceID() + "/hook-error/" + WEBHOOK_EVENT_NAME;
-    Particle.subscribe(hook_reponse, &Google_Geolocation::response_handler, this, MY_DEVICES);
-    Particle.subscribe(hook_error, &Google_Geolocation::error_handler, this, MY_DEVICES);
+    attach(WEBHOOK_EVENT_NAME);
 }
 
 //*****************************************************************************
@@ -106,8 +103,22 @@ void Google_Geolocation::publish(void)
     scan_access_points();
     //  Build the webhook query with the data obtained 
     //  from the scan function and pusblish the event.
-    String data = String::format("{\"a\":[%s}", wifi_ap_buff);
-    Particle.publish(WEBHOOK_EVENT_NAME, data, PRIVATE);
+    String data = payload();
+    stream.reset();
+    begin_request();
+    Cloud.publish(WEBHOOK_EVENT_NAME, data, Publish_Class::BACKGROUND);
+}
+
+//*****************************************************************************
+//
+//! @brief Builds the Google Geolocation webhook query.
+//!
+//!	@return A string object with the JSON webhook data.
+//
+//*****************************************************************************
+String Google_Geolocation::payload(void)
+{
+    return String::format("{\"a\":[%s}", wifi_ap_buff);
 }
 
 //*****************************************************************************
@@ -123,20 +134,32 @@ void Google_Geolocation::publish(void)
 //*****************************************************************************
 void Google_Geolocation::scan_access_points(void)
 {
-    buff_size = WIFI_AP_BUFF_SIZE;
-    wifi_ap_cnt = 0;
-    wifi_ap_ptr = wifi_ap_buff;
-    //  Zero out the buffer.
-    memset(wifi_ap_buff, 0, buff_size);
+    clear_access_points();
     //  Scan for available access points.
     //  After calling the WiFi.scan() function, the
     //  OS holds the application until all available 
     //  access points have been processed.
-    WiFi.scan(wifi_scan_callback);
+    WiFi.scan(wifi_scan_callback, this);
     //  Remove comma from last object and close the array of JSON objects.
     *(--wifi_ap_ptr) = ']';
 }
 
+//*****************************************************************************
+//
+//! @brief Clears the access points registered by the last scan.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_Geolocation::clear_access_points(void)
+{
+    buff_size = WIFI_AP_BUFF_SIZE;
+    wifi_ap_cnt = 0;
+    wifi_ap_ptr = wifi_ap_buff;
+    //  Zero out the buffer.
+    memset(wifi_ap_buff, 0, buff_size);
+}
+
 //*****************************************************************************
 //
 //! @brief Parses the webhook response and error response.
@@ -144,74 +167,68 @@ void Google_Geolocation::scan_access_points(void)
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
 //!	@param[in] data Pointer to a char array holding the webhook reponse.
 //!
-//!	@return None.
+//!	@return false if the response is not complete yet, true if completed.
 //
 //*****************************************************************************
-void Google_Geolocation::parser(const char *event, const char *data)
+bool Google_Geolocation::parser(const char *event, const char *data)
 {
-    int16_t index = 0, last_index = 0;
-    String str_data = String(data);
-    String str_event = String(event);
-    //  Get the hook type.
-    //  i.e. event: deviceID/hook-response/calendar_event/0
-    //  hook: hook-response.
-    split_string(str_event, '/', index, last_index); // skip deviceID.
-    String hook = split_string(str_event, '/', index, last_index);
-    //  Reset the split string indexes.
-    index = 0, last_index = 0;
     //  For "hook-response", the returned data is divided by '~' and stays
-    //  the same as there is only one webhook event.
-    if (hook.equals("hook-response"))
+    //  the same as there is only one webhook event. The fields are passed
+    //  to parse_field() as the response chunks arrive.
+    //  i.e. event: deviceID/hook-response/geolocation/0
+    if (hook_type(event) == Hook_Type::RESPONSE)
     {
-        latitud = split_string(str_data, '~', index, last_index).toFloat();
-        longitud = split_string(str_data, '~', index, last_index).toFloat();
-        accuracy = split_string(str_data, '\0', index, last_index).toInt();
-        http_status_code = HTTP_OK;
+        if (!stream.feed(event, data))
+        {
+            return false;
+        }
+        check_stream(stream, stream.validate<Response_Schema>());
     }
     //  For "hook-error", the returned data is an error message generated by   
     //  the Particle Cloud. From this message only the HTTP status code is taken.
     //  i.e. error status 404 from www.googleapis.com
     //  HTTP status code: 404.
-    else if (hook.equals("hook-error"))
+    //  Only the first chunk holds the HTTP status code.
+    else
     {
-        http_status_code = str_data.substring(13, 16).toInt();
+        if (stream.chunk_index(event) != 0)
+        {
+            return false;
+        }
+        http_status_code = error_status(data);
     }
+    return true;
 }
 
 //*****************************************************************************
 //
-//! @brief Google Geolocation webhook response handler.
+//! @brief Parses a field of the webhook response.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is EQUAL TO 200.
+//! The field is decoded as described by the response schema.
 //!
-//!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!	@param[in] field Field position in the response template.
+//!	@param[in] value Pointer to a char array holding the field value.
+//!
+//!	@return Schema_Error::NONE if decoded, the decoding error otherwise.
 //
 //*****************************************************************************
-void Google_Geolocation::response_handler(const char *event, const char *data)
+Schema_Error Google_Geolocation::parse_field(uint8_t field, const char *value)
 {
-    //  Parse the webhook reponse.
-    parser(event, data);
-    //  Invoke the user subscribed response handler.
-    (*callback)();
+    return Response_Schema::decode(*this, field, value);
 }
 
 //*****************************************************************************
 //
-//! @brief Google Geolocation webhook error response handler.
+//! @brief Builds the HTTP error response of a webhook error response.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is DIFFERENT THAN 200.
+//! This method is called by the webhook client once the error response is
+//! parsed, before the user subscribed response handler.
 //!
-//!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!	@return None.
 //
 //*****************************************************************************
-void Google_Geolocation::error_handler(const char *event, const char *data)
+void Google_Geolocation::on_error(void)
 {
-    //  Parse the webhook error reponse.
-    parser(event, data);
     //  A string object is built with the HTTP status code 
     //  and an error message to infrom the user.
     http_error = String::format("\r\nHTTP ERROR - %d", http_status_code);
@@ -227,8 +244,6 @@ void Google_Geolocation::error_handler(const char *event, const char *data)
     {
         http_error += "\r\nError: The request was valid, but no results were returned.";
     }
-    //  Invoke the user subscribed response handler.
-    (*callback)();
 }
 
 //*****************************************************************************
@@ -243,18 +258,6 @@ bool Google_Geolocation::failed(void)
     return http_status_code != HTTP_OK;
 }
 
-//*****************************************************************************
-//
-//! @brief Prints the HTTP error response returned by the last event published.
-//!
-//! @return None.
-//
-//*****************************************************************************
-void Google_Geolocation::print_error(void)
-{
-    Serial.println(http_error);
-}
-
 //*****************************************************************************
 //
 //! @brief Gets the accuracy of the estimated location, in meters.
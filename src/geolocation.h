@@ -1,6 +1,15 @@
 #ifndef __GEOLOCATION_H__
 #define __GEOLOCATION_H__
 
+#include "webhook_client.h"
+
+//  Size of a JSON WiFi access point object in bytes.
+#define WIFI_AP_SIZE            46
+//  Max. number of WiFi access points allowed to store. 
+#define MAX_NUM_APS             6
+//  Size of x number of WiFi access points.
+#define WIFI_AP_BUFF_SIZE       ((WIFI_AP_SIZE * MAX_NUM_APS) + 1)
+
 //*****************************************************************************
 //
 //! @brief Google Geolocation class.
@@ -8,36 +17,63 @@
 //! This class uses the Google Geolocation API to locate a Particle Argon 
 //! through nearby WiFi access points.
 //!
+//! The webhook bookkeeping is shared with the other Google API classes
+//! through the webhook client base class.
+//!
 //! Source: https://developers.google.com/maps/documentation/geolocation/intro
 //
 //*****************************************************************************
-class Google_Geolocation 
+class Google_Geolocation : public Webhook_Client<Google_Geolocation>
 {
     private:
-        //  Typedef function pointer for the user webhook reponse handler.
-        typedef void (*Event_Callback)(void);
-        Event_Callback callback;
+        //  Webhook stream class is added as a friend class,
+        //  so it can pass the response fields to the parser.
+        friend class Webhook_Stream<Google_Geolocation>;
+        //  Webhook client class is added as a friend class,
+        //  so it can pass the webhook events to the parser.
+        friend class Webhook_Client<Google_Geolocation>;
+        //  Benchmark class is added as a friend class, so it can measure
+        //  the parser and the webhook query builder.
+        friend class Benchmark;
 
         //  Particle webhook event name.
         const String WEBHOOK_EVENT_NAME = "geolocation";
 
-        //  Http status code and error response returned from webhooks.
-        String http_error;
-        uint16_t http_status_code;
-        
         //  Geolocation API data.
         float latitud;
         float longitud;
         uint16_t accuracy;
 
+        //  Webhook response schema.
+        //  i.e. data: 37.421998~-122.084000~35
+        typedef Webhook_Schema<Google_Geolocation,
+            Number_Field<Google_Geolocation, float, &Google_Geolocation::latitud, -90, 90>,
+            Number_Field<Google_Geolocation, float, &Google_Geolocation::longitud, -180, 180>,
+            Number_Field<Google_Geolocation, uint16_t, &Google_Geolocation::accuracy, 0, 65535>
+        > Response_Schema;
+
+        //  Webhook response stream.
+        Webhook_Stream<Google_Geolocation> stream;
+
+        //  WiFi scan data, each object runs its own scan.
+        //  Pointer to the access point memory location.
+        char *wifi_ap_ptr;
+        //  Total number of bytes available in the buffer.
+        size_t buff_size;
+        //  Current number of access points registered.
+        uint8_t wifi_ap_cnt;
+        //  Space in memory to store the access points.
+        char wifi_ap_buff[WIFI_AP_BUFF_SIZE];
+
         //  Private member functions.
+        static void wifi_scan_callback(WiFiAccessPoint *wap, void *data);
+        void add_access_point(const WiFiAccessPoint &ap);
         void scan_access_points(void);
-        void parser(const char *event, const char *data);
-
-    protected:
-        //  Particle webhook event handlers.
-        void response_handler(const char *event, const char *data);
-        void error_handler(const char *event, const char *data);
+        void clear_access_points(void);
+        String payload(void);
+        bool parser(const char *event, const char *data);
+        Schema_Error parse_field(uint8_t field, const char *value);
+        void on_error(void);
 
     public:
         //  Class constructor.
@@ -50,7 +86,6 @@ class Google_Geolocation
         float get_lat(void);
         float get_lng(void);
         uint16_t get_accuracy(void);
-        void print_error(void);
 };
 
 #endif  //  __GEOLOCATION_H__
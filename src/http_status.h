@@ -2,10 +2,14 @@
 #define __HTTP_STATUS_H__
 
 #define HTTP_OK                              200
+#define HTTP_NOT_MODIFIED                    304
 #define HTTP_BAD_REQUEST                     400
 #define HTTP_UNAUTHORIZED                    401
 #define HTTP_FORBIDDEN                       403
 #define HTTP_NOT_FOUND                       404
+#define HTTP_PAYLOAD_TOO_LARGE               413
 #define HTTP_PRECONDITION_REQUIRED           428
+#define HTTP_TOO_MANY_REQUESTS               429
+#define HTTP_BAD_GATEWAY                     502
 
 #endif  //  __HTTP_STATUS_H__
\ No newline at end of file
@@ -1,12 +1,25 @@
 #include "Particle.h"
 #include "mp3.h"
+#include "trace.h"
+
+//  Serial packets of the commands without data, formed at compile time.
+static constexpr DFPlayer_MP3::Frame NEXT_FRAME = DFPlayer_MP3::make_frame(0x01, 0);
+static constexpr DFPlayer_MP3::Frame PREVIOUS_FRAME = DFPlayer_MP3::make_frame(0x02, 0);
+static constexpr DFPlayer_MP3::Frame SLEEP_FRAME = DFPlayer_MP3::make_frame(0x0A, 0);
+static constexpr DFPlayer_MP3::Frame RESET_FRAME = DFPlayer_MP3::make_frame(0x0C, 0);
+static constexpr DFPlayer_MP3::Frame PAUSE_FRAME = DFPlayer_MP3::make_frame(0x0E, 0);
+static_assert(DFPlayer_MP3::is_frame_valid(NEXT_FRAME) &&
+              DFPlayer_MP3::is_frame_valid(PREVIOUS_FRAME) &&
+              DFPlayer_MP3::is_frame_valid(SLEEP_FRAME) &&
+              DFPlayer_MP3::is_frame_valid(RESET_FRAME) &&
+              DFPlayer_MP3::is_frame_valid(PAUSE_FRAME),
+              "Invalid DFPlayer Mini serial packet.");
 
 //*****************************************************************************
 //
 //! @brief DFPlayer Mini class constructor.
 //!
-//! It initializes the transmitter buffer, and sets the busy pin and serial
-//! stream to communicate with the MP3 player.
+//! It sets the busy pin and serial stream to communicate with the MP3 player.
 //!
 //!	@param[in] stream Communication stream to control the serial interface.
 //!	@param[in] BUSY_PIN Digital pin to check the current state of the DFPlayer. 
@@ -16,17 +29,23 @@ DFPlayer_MP3::DFPlayer_MP3(Stream &stream, uint8_t BUSY_PIN)
     : stream(stream), BUSY_PIN(BUSY_PIN)
 {
     pinMode(this->BUSY_PIN, INPUT);
-    tx_buff[PACKET_HEADER] = 0x7E;
-    tx_buff[PACKET_VERSION] = 0xFF;
-    tx_buff[PACKET_LENGTH] = 0x06;
-    tx_buff[PACKET_CMD] = 0x01;
-    tx_buff[PACKET_TAIL] = 0xEF;
+    rx_index = 0;
+    rx_frames = 0;
+    rx_errors = 0;
+    ready = false;
+    playing = false;
+    play_time = 0;
+    busy_seen = false;
+    cmd_time = 0;
 }
 
 //*****************************************************************************
 //
 //! @brief Initializes the DFPlayer Mini.
 //!
+//! A reset command is sent and the DFPlayer Mini is ready as soon as it 
+//! returns its initialization parameters (0x3F), up to MP3_READY_TIMEOUT.
+//!
 //! @return false if failed, true if did not fail.
 //
 //*****************************************************************************
@@ -34,101 +53,229 @@ bool DFPlayer_MP3::begin(void)
 {
     //  Send a reset command.
     reset();
-    //  Read the receiving line (Rx) to get reply.
-    //  It must wait at least 1.5 seconds after reset.
-    wait_for_reply(2000);
-    //  Calculate the checksum from the last
-    //  packet received and check for errors.
-    uint16_t checksum_calc = calc_checksum(rx_buff);
-    uint16_t checksum_received = array_to_uint16(&rx_buff[PACKET_CHECKSUM]);
-    if (checksum_calc == checksum_received)
+    //  A ready frame received before the reset is not valid.
+    ready = false;
+    uint32_t now = millis();
+    while (!ready && (millis() - now) < MP3_READY_TIMEOUT)
     {
-        //  The commnad "0x3F" indicates that 
-        //  the MP3 player was succesffully initilized.
-        uint8_t cmd = rx_buff[PACKET_CMD];
-        if (cmd == 0x3F)
-        {
-            return true;
-        }
+        loop();
     }
+    return ready;
+}
 
-    return false;
+//*****************************************************************************
+//
+//! @brief Decodes the frames received from the DFPlayer Mini.
+//!
+//! It must be called from the application loop, it is also called while 
+//! waiting for the DFPlayer Mini.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void DFPlayer_MP3::loop(void)
+{
+    while (stream.available() > 0)
+    {
+        decode(stream.read());
+    }
 }
 
 //*****************************************************************************
 //
-//! @brief Waits for a reply from the DFPlayer Mini.
+//! @brief Decodes a byte received from the DFPlayer Mini.
 //!
-//!	@param[in] time Amount of time to poll the serial interface.
+//! The start byte, version and length are checked as they arrive, and the 
+//! checksum and end byte once the frame is complete. If any of them is not
+//! valid, the bytes received after the start byte are decoded again, so the
+//! decoder resynchronizes on the next start byte.
+//!
+//!	@param[in] byte Byte received.
 //!
 //! @return None.
 //
 //*****************************************************************************
-void DFPlayer_MP3::wait_for_reply(uint32_t time)
+void DFPlayer_MP3::decode(uint8_t byte)
 {
-    uint32_t now = millis();
-    rx_index = 0;
-    //  Poll the serial interface while there is still time left 
-    //  and the number of bytes received is less than BUFF_LENGTH.
-    while ((millis() - now) < time)
+    rx_buff[rx_index++] = byte;
+    bool valid = true;
+    if (rx_index == (PACKET_HEADER + 1))
+    {
+        valid = (byte == 0x7E);
+    }
+    else if (rx_index == (PACKET_VERSION + 1))
     {
-        if (stream.available() && rx_index < BUFF_LENGTH)
+        valid = (byte == 0xFF);
+    }
+    else if (rx_index == (PACKET_LENGTH + 1))
+    {
+        valid = (byte == 0x06);
+    }
+    else if (rx_index == BUFF_LENGTH)
+    {
+        Frame frame;
+        memcpy(frame.data, rx_buff, BUFF_LENGTH);
+        valid = is_frame_valid(frame);
+        if (valid)
         {
-            rx_buff[rx_index] = stream.read();
-            rx_index++;
+            rx_index = 0;
+            rx_frames++;
+            handle_frame();
+            return;
         }
     }
+    if (valid)
+    {
+        return;
+    }
+    //  Drop the start byte and decode the rest again.
+    rx_errors++;
+    uint8_t length = rx_index - 1;
+    uint8_t rest[10];
+    memcpy(rest, &rx_buff[1], length);
+    rx_index = 0;
+    for (uint8_t i = 0; i < length; i++)
+    {
+        decode(rest[i]);
+    }
 }
 
 //*****************************************************************************
 //
-//! @brief Calculates the checksum of a serial packet.
+//! @brief Turns the frame received into an event.
 //!
-//!	@param[in] buffer Serial receiver buffer.
-//!
-//! @return  A unsiged 16-bit number.
+//! @return None.
 //
 //*****************************************************************************
-uint16_t DFPlayer_MP3::calc_checksum(uint8_t *buffer)
+void DFPlayer_MP3::handle_frame(void)
 {
-    uint16_t sum = 0;
-    //  Start/End byte are not included in the checksum.
-    for (int i = PACKET_VERSION; i < PACKET_CHECKSUM; i++)
+    uint8_t cmd = rx_buff[PACKET_CMD];
+    uint16_t param = array_to_uint16(&rx_buff[PACKET_PARAM]);
+    Trace.record(Trace_Type::MP3_EVENT, cmd, param);
+    switch (cmd)
     {
-        sum += buffer[i];
+        case MP3_RET_READY:
+            ready = true;
+            push_event(MP3_Event_Type::READY, param);
+            break;
+
+        case MP3_RET_USB_FINISHED:
+        case MP3_RET_SD_FINISHED:
+        case MP3_RET_FLASH_FINISHED:
+            //  The frame is sent twice, the second one can arrive
+            //  after the next play command.
+            if (playing && (millis() - play_time) < MP3_FINISH_GUARD)
+            {
+                break;
+            }
+            playing = false;
+            push_event(MP3_Event_Type::TRACK_FINISHED, param);
+            break;
+
+        case MP3_RET_ERROR:
+            playing = false;
+            push_event(MP3_Event_Type::ERROR, param);
+            break;
+
+        case MP3_RET_ACK:
+            push_event(MP3_Event_Type::ACK, param);
+            break;
+
+        default:
+            push_event(MP3_Event_Type::REPLY, param);
+            break;
     }
-    return -sum;
 }
 
 //*****************************************************************************
 //
-//! @brief Sends a serial packet to the DFPlayer Mini.
+//! @brief Adds an event to the events not read yet.
+//!
+//! The event is dropped if the events are not read.
+//!
+//!	@param[in] type Event type.
+//!	@param[in] param Returned data of the frame.
 //!
 //! @return None.
 //
 //*****************************************************************************
-void DFPlayer_MP3::send_packet(void)
+void DFPlayer_MP3::push_event(MP3_Event_Type type, uint16_t param)
 {
-    //  Transmit the packet.
-    stream.write(tx_buff, BUFF_LENGTH);
-    //  Read the receiving line (Rx) to get reply.
-    //  It should wait at least 75 ms to let 
-    //  the DFPlayer Mini process the packet.
-    wait_for_reply(75);
+    MP3_Event *event = events.claim();
+    if (event == nullptr)
+    {
+        return;
+    }
+    event->type = type;
+    event->param = param;
+    events.commit();
 }
 
 //*****************************************************************************
 //
-//! @brief Sends a command without data.
+//! @brief Gets the oldest event not read yet.
 //!
-//! @param[in] cmd DFPlayer Mini command to be executed.
+//!	@param[out] event Event read.
+//!
+//! @return false if there is no event, true if read.
+//
+//*****************************************************************************
+bool DFPlayer_MP3::get_event(MP3_Event &event)
+{
+    MP3_Event *oldest = events.front();
+    if (oldest == nullptr)
+    {
+        return false;
+    }
+    event = *oldest;
+    events.pop();
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of bytes dropped by the frame decoder.
+//!
+//! @return The number of bytes dropped since the class was constructed.
+//
+//*****************************************************************************
+uint16_t DFPlayer_MP3::get_rx_errors(void)
+{
+    return rx_errors;
+}
+
+//*****************************************************************************
+//
+//! @brief Sends a serial packet to the DFPlayer Mini.
+//!
+//! The packet is transmitted with a single write. The DFPlayer Mini needs 
+//! MP3_CMD_INTERVAL to process a packet, so the transmission waits only 
+//! if the last packet was sent less than that ago.
+//!
+//!	@param[in] frame Serial packet to be sent.
 //!
 //! @return None.
 //
 //*****************************************************************************
-void DFPlayer_MP3::send_cmd(uint8_t cmd)
+void DFPlayer_MP3::send_frame(const Frame &frame)
 {
-    send_cmd(cmd, 0);
+    while ((millis() - cmd_time) < MP3_CMD_INTERVAL)
+    {
+        loop();
+    }
+    uint8_t cmd = frame.data[PACKET_CMD];
+    Trace.record(Trace_Type::MP3_COMMAND, cmd, 
+                 (frame.data[PACKET_PARAM] << 8) | frame.data[PACKET_PARAM + 1]);
+    //  Transmit the packet.
+    stream.write(frame.data, BUFF_LENGTH);
+    cmd_time = millis();
+    //  Next, previous, play file and play folder start a play.
+    if (cmd == 0x01 || cmd == 0x02 || cmd == 0x03 || cmd == 0x0F)
+    {
+        playing = true;
+        play_time = cmd_time;
+        busy_seen = false;
+    }
 }
 
 //*****************************************************************************
@@ -143,13 +290,7 @@ void DFPlayer_MP3::send_cmd(uint8_t cmd)
 //*****************************************************************************
 void DFPlayer_MP3::send_cmd(uint8_t cmd, uint16_t data)
 {
-    //  Add the serial command.
-    tx_buff[PACKET_CMD] = cmd;
-    //  Convert the serial data into an array 
-    //  and add the checksum to the packet.
-    uint16_to_array(data, &tx_buff[PACKET_PARAM]);
-    uint16_to_array(calc_checksum(tx_buff), &tx_buff[PACKET_CHECKSUM]);
-    send_packet();
+    send_frame(make_frame(cmd, data));
 }
 
 //*****************************************************************************
@@ -187,33 +328,34 @@ uint16_t DFPlayer_MP3::array_to_uint16(uint8_t *array)
     return value;
 }
 
-//*****************************************************************************
-//
-//! @brief Convert an unsigned 16-bit number into an unsigned 8-bit array 
-//!        element. 
-//!
-//!	@param[in] value Unsigned 16-bit number to be converted.
-//!	@param[in] array Pointer to an array where the value will be added.
-//!
-//! @return None.
-//
-//*****************************************************************************
-void DFPlayer_MP3::uint16_to_array(uint16_t value, uint8_t *array)
-{
-    *array = (uint8_t)(value >> 8);
-    *(array + 1) = (uint8_t)(value);
-}
-
 //*****************************************************************************
 //
 //! @brief Returns the current state of the DFPlayer Mini.
 //!
+//! A play ends with its track finished or error frame. If the frame was 
+//! lost, it ends once the BUSY_PIN goes back high, or after 
+//! MP3_PLAY_TIMEOUT if the play never started.
+//!
 //! @return false if busy, true if free.
 //
 //*****************************************************************************
 bool DFPlayer_MP3::free(void)
 {
-    return digitalRead(BUSY_PIN);
+    loop();
+    if (!playing)
+    {
+        return true;
+    }
+    //  The BUSY_PIN is low while playing.
+    if (!digitalRead(BUSY_PIN))
+    {
+        busy_seen = true;
+    }
+    else if (busy_seen || (millis() - play_time) >= MP3_PLAY_TIMEOUT)
+    {
+        playing = false;
+    }
+    return !playing;
 }
 
 //*****************************************************************************
@@ -225,7 +367,7 @@ bool DFPlayer_MP3::free(void)
 //*****************************************************************************
 void DFPlayer_MP3::next(void)
 {
-    send_cmd(0x01);
+    send_frame(NEXT_FRAME);
 }
 
 //*****************************************************************************
@@ -237,7 +379,7 @@ void DFPlayer_MP3::next(void)
 //*****************************************************************************
 void DFPlayer_MP3::previous(void)
 {
-    send_cmd(0x02);
+    send_frame(PREVIOUS_FRAME);
 }
 
 //*****************************************************************************
@@ -273,7 +415,7 @@ void DFPlayer_MP3::volume(uint8_t volume)
 //*****************************************************************************
 void DFPlayer_MP3::sleep(void)
 {
-    send_cmd(0x0A);
+    send_frame(SLEEP_FRAME);
 }
 
 //*****************************************************************************
@@ -285,7 +427,7 @@ void DFPlayer_MP3::sleep(void)
 //*****************************************************************************
 void DFPlayer_MP3::reset(void)
 {
-    send_cmd(0x0C);
+    send_frame(RESET_FRAME);
 }
 
 //*****************************************************************************
@@ -297,7 +439,7 @@ void DFPlayer_MP3::reset(void)
 //*****************************************************************************
 void DFPlayer_MP3::pause(void)
 {
-    send_cmd(0x0E);
+    send_frame(PAUSE_FRAME);
 }
 
 //*****************************************************************************
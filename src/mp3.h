@@ -1,6 +1,52 @@
 #ifndef __MP3_H__
 #define __MP3_H__
 
+#include "spsc_ring.h"
+
+//  Max. time in milliseconds to wait for the DFPlayer Mini to be ready after
+//  a reset, it needs about 1.5 seconds.
+#define MP3_READY_TIMEOUT       3000
+//  Min. time in milliseconds between two commands, so the DFPlayer Mini can
+//  process them.
+#define MP3_CMD_INTERVAL        75
+//  Max. time in milliseconds for a play to start (BUSY_PIN low) or fail 
+//  (error frame), and time after a play command in which a track finished 
+//  frame still belongs to the previous play (it is sent twice).
+#define MP3_PLAY_TIMEOUT        1000
+#define MP3_FINISH_GUARD        200
+//  Number of DFPlayer Mini events that can be held, a power of two.
+#define MP3_EVENT_QUEUE_SIZE    8
+
+//  DFPlayer Mini commands sent on its own (returned data).
+#define MP3_RET_USB_FINISHED    0x3C
+#define MP3_RET_SD_FINISHED     0x3D
+#define MP3_RET_FLASH_FINISHED  0x3E
+#define MP3_RET_READY           0x3F
+#define MP3_RET_ERROR           0x40
+#define MP3_RET_ACK             0x41
+
+//*****************************************************************************
+//
+//	Enumeration class for the DFPlayer Mini events.
+//
+//*****************************************************************************
+
+enum class MP3_Event_Type : uint8_t
+{
+    READY,              //  param: storage devices online.
+    TRACK_FINISHED,     //  param: track number.
+    ERROR,              //  param: error code.
+    ACK,                //  param: none.
+    REPLY               //  param: returned data of a query.
+};
+
+//  DFPlayer Mini event structure.
+typedef struct mp3_event
+{
+    MP3_Event_Type type;
+    uint16_t param;
+} MP3_Event;
+
 //*****************************************************************************
 //
 //! @brief DFPlayer Mini class.
@@ -8,12 +54,24 @@
 //! This class provides basic functionality of the DFPlayer Mini module to
 //! play MP3 files.
 //!
+//! The frames sent by the DFPlayer Mini are decoded byte by byte as they are
+//! received (the UART receiver is interrupt driven and buffered by the OS).
+//! The header, version, length, checksum and tail of every frame are checked,
+//! and the decoder resynchronizes on the next start byte after a corrupt one.
+//! Valid frames are turned into events, so the end of a reset (ready) and of
+//! a play (track finished or error) are known as soon as they happen. The
+//! BUSY_PIN is only used if a track finished frame was lost.
+//!
 //! Source: http://www.picaxe.com/docs/spe033.pdf
 //
 //*****************************************************************************
 class DFPlayer_MP3
 {
     private:
+        //  Benchmark class is added as a friend class, so it can measure
+        //  the frame decoder.
+        friend class Benchmark;
+
         //  Serial communication packet format
         enum Packet_Format
         {
@@ -38,11 +96,26 @@ class DFPlayer_MP3
         //  Size of a packet
         const uint8_t BUFF_LENGTH = 10;
         
-        //  Serial transmiter and receiver buffers.
+        //  Serial receiver buffer.
         uint8_t rx_buff[10];
-        uint8_t tx_buff[10];
         //  Serial receiver buffer index.
         uint8_t rx_index;
+        //  Valid frames received, and bytes dropped by the decoder.
+        uint16_t rx_frames;
+        uint16_t rx_errors;
+
+        //  Set once the DFPlayer Mini is ready after a reset.
+        bool ready;
+        //  Set while a play is in progress, time at which it was sent, and
+        //  set once the BUSY_PIN showed it started.
+        bool playing;
+        uint32_t play_time;
+        bool busy_seen;
+        //  Time at which the last command was sent.
+        uint32_t cmd_time;
+
+        //  Events decoded and not read yet.
+        SPSC_Ring<MP3_Event, MP3_EVENT_QUEUE_SIZE> events;
 
         //  Communication stream to control the serial interface.
         Stream &stream;
@@ -51,21 +124,33 @@ class DFPlayer_MP3
         const uint8_t BUSY_PIN;
         
         //  Private member functions.
-        void send_packet(void);
-        void send_cmd(uint8_t cmd);
         void send_cmd(uint8_t cmd, uint16_t data);
         void send_cmd(uint8_t cmd, uint8_t high_data, uint8_t low_data);
-        void uint16_to_array(uint16_t value, uint8_t *array);
         uint16_t array_to_uint16(uint8_t *array);
-        uint16_t calc_checksum(uint8_t *buffer);
-        void wait_for_reply(uint32_t time);
+        void decode(uint8_t byte);
+        void handle_frame(void);
+        void push_event(MP3_Event_Type type, uint16_t param);
 
     public:
+        //  Serial communication packet (frame).
+        typedef struct frame
+        {
+            uint8_t data[10];
+        } Frame;
+
         //  Class constructor.
         DFPlayer_MP3(Stream &stream, uint8_t busy_pin);
+
+        //  Compile-time frame functions.
+        static constexpr uint16_t calc_checksum(const uint8_t *buffer);
+        static constexpr Frame make_frame(uint8_t cmd, uint16_t data);
+        static constexpr bool is_frame_valid(const Frame &frame);
         
         //  Public member functions.
         bool begin(void);
+        void loop(void);
+        bool get_event(MP3_Event &event);
+        uint16_t get_rx_errors(void);
         void reset(void);
         void pause(void);
         void sleep(void);
@@ -75,6 +160,69 @@ class DFPlayer_MP3
         void volume(uint8_t volume);
         void play_file(uint8_t file_num);
         void play_folder(uint8_t folder_num, uint8_t file_num);
+        void send_frame(const Frame &frame);
 };
 
+//*****************************************************************************
+//
+//! @brief Calculates the checksum of a serial packet.
+//!
+//!	@param[in] buffer Serial transmitter/receiver buffer.
+//!
+//! @return  A unsiged 16-bit number.
+//
+//*****************************************************************************
+constexpr uint16_t DFPlayer_MP3::calc_checksum(const uint8_t *buffer)
+{
+    uint16_t sum = 0;
+    //  Start/End byte are not included in the checksum.
+    for (int i = PACKET_VERSION; i < PACKET_CHECKSUM; i++)
+    {
+        sum += buffer[i];
+    }
+    return -sum;
+}
+
+//*****************************************************************************
+//
+//! @brief Forms a serial packet.
+//!
+//! It can be evaluated at compile time, so packets with constant commands and
+//! data are stored in flash ready to be sent.
+//!
+//!	@param[in] cmd DFPlayer Mini command to be executed.
+//!	@param[in] data Serial data to be sent to the DFPlayer Mini.
+//!
+//! @return A complete serial packet.
+//
+//*****************************************************************************
+constexpr DFPlayer_MP3::Frame DFPlayer_MP3::make_frame(uint8_t cmd, uint16_t data)
+{
+    Frame frame = {{0x7E, 0xFF, 0x06, cmd, 0x00, 
+                    (uint8_t)(data >> 8), (uint8_t)(data), 0x00, 0x00, 0xEF}};
+    uint16_t checksum = calc_checksum(frame.data);
+    frame.data[PACKET_CHECKSUM] = (uint8_t)(checksum >> 8);
+    frame.data[PACKET_CHECKSUM + 1] = (uint8_t)(checksum);
+    return frame;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks the header, length, checksum and tail of a serial packet.
+//!
+//!	@param[in] frame Serial packet to be checked.
+//!
+//! @return false if not valid, true if valid.
+//
+//*****************************************************************************
+constexpr bool DFPlayer_MP3::is_frame_valid(const Frame &frame)
+{
+    uint16_t checksum = frame.data[PACKET_CHECKSUM];
+    checksum = (checksum << 8) | frame.data[PACKET_CHECKSUM + 1];
+    return (frame.data[PACKET_HEADER] == 0x7E) &&
+           (frame.data[PACKET_LENGTH] == 0x06) &&
+           (frame.data[PACKET_TAIL] == 0xEF) &&
+           (checksum == calc_checksum(frame.data));
+}
+
 #endif // __MP3_H__
\ No newline at end of file
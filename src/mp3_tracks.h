@@ -0,0 +1,216 @@
+#ifndef __MP3_TRACKS_H__
+#define __MP3_TRACKS_H__
+
+#include "mp3.h"
+
+//*****************************************************************************
+//
+//	The following are enumeration classes for the DFPlayer Mini.
+//
+//*****************************************************************************
+
+//  MP3 folders from 01 to 03.
+//  Folder order must be the same in the SD card.
+enum class MP3_Folder : uint8_t
+{
+    STATUS_INFO = 1,
+    HOURS,
+    MINUTES
+};
+
+//  MP3 files for folder 01 (STATUS_INFO) from 001 to 011.
+//  File order must be the same in the SD card.
+enum class MP3_File : uint8_t
+{
+    // Hi, your device is being updated, please wait.
+    UPDATE_DEVICE = 1,
+    // Your device is ready. You might now ask Google for your next activity.
+    DEVICE_READY,
+    // Hi, your device has not been authenticated yet. 
+    // Please open a terminal and follow the steps indicated.
+    OPEN_TERMINAL,
+    // Your request has been received, I am now locating your next event.
+    REQ_RECEIVED,
+    // Location and time found, please wait while I estimate the 
+    // ideal departure time. 
+    ESTIMATING_DT,
+    // There are no events scheduled on your calendar for the next three hours.
+    NO_EVENTS,
+    // An error has occurred. Please open a terminal to see what caused 
+    // the error and fix it before rebooting your device.
+    APP_FAILED,
+    // Based on your current location, you would be on time for your 
+    // upcoming event by leaving in
+    TIME_LEFT,
+    // The results showed that you have to leave now to be on time 
+    // for your upcoming event.
+    NO_TIME_LEFT,
+    // Based on your current location, if you leave now, you would be late for
+    // your upcoming event by 
+    LATE,
+    // An error has occurred.
+    // (First sentence of 007, it precedes the answers given offline.)
+    OFFLINE_ANSWER,
+};
+
+//  Number of MP3 files in each folder.
+#define MP3_STATUS_INFO_FILES       11
+#define MP3_HOURS_FILES             3
+#define MP3_MINUTES_FILES           59
+
+//  DFPlayer Mini command to play an MP3 file stored in a specific folder.
+#define MP3_CMD_PLAY_FOLDER         0x0F
+
+//*****************************************************************************
+//
+//	The following are compile-time tables with the complete serial packets
+//  (frames) to play every MP3 file. Each table entry is ready to be sent.
+//
+//*****************************************************************************
+
+//  Frame table of an MP3 folder.
+template <uint8_t N>
+struct MP3_Frame_Table
+{
+    DFPlayer_MP3::Frame frame[N];
+};
+
+//*****************************************************************************
+//
+//! @brief Forms the serial packets to play every file in an MP3 folder.
+//!
+//!	@param[in] folder MP3 folder where the files are located.
+//!
+//! @return A frame table where entry i plays file i + 1.
+//
+//*****************************************************************************
+template <uint8_t N>
+constexpr MP3_Frame_Table<N> make_frame_table(MP3_Folder folder)
+{
+    MP3_Frame_Table<N> table = {};
+    for (uint8_t i = 0; i < N; i++)
+    {
+        uint16_t data = static_cast<uint8_t>(folder);
+        data = (data << 8) | (i + 1);
+        table.frame[i] = DFPlayer_MP3::make_frame(MP3_CMD_PLAY_FOLDER, data);
+    }
+    return table;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks every serial packet in a frame table.
+//!
+//!	@param[in] table Frame table to be checked.
+//!
+//! @return false if any frame is not valid, true if all frames are valid.
+//
+//*****************************************************************************
+template <uint8_t N>
+constexpr bool is_frame_table_valid(const MP3_Frame_Table<N> &table)
+{
+    for (uint8_t i = 0; i < N; i++)
+    {
+        if (!DFPlayer_MP3::is_frame_valid(table.frame[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+constexpr MP3_Frame_Table<MP3_STATUS_INFO_FILES> STATUS_INFO_FRAMES = 
+    make_frame_table<MP3_STATUS_INFO_FILES>(MP3_Folder::STATUS_INFO);
+constexpr MP3_Frame_Table<MP3_HOURS_FILES> HOURS_FRAMES = 
+    make_frame_table<MP3_HOURS_FILES>(MP3_Folder::HOURS);
+constexpr MP3_Frame_Table<MP3_MINUTES_FILES> MINUTES_FRAMES = 
+    make_frame_table<MP3_MINUTES_FILES>(MP3_Folder::MINUTES);
+
+static_assert(is_frame_table_valid(STATUS_INFO_FRAMES), "Invalid frame in folder 01 (status info).");
+static_assert(is_frame_table_valid(HOURS_FRAMES), "Invalid frame in folder 02 (hours).");
+static_assert(is_frame_table_valid(MINUTES_FRAMES), "Invalid frame in folder 03 (minutes).");
+
+//*****************************************************************************
+//
+//! @brief Gets the frame to play an MP3 file from the STATUS_INFO folder.
+//!
+//!	@param[in] mp3_file MP3 file to be played by the DFPlayer Mini.
+//!
+//! @return A complete serial packet.
+//
+//*****************************************************************************
+constexpr const DFPlayer_MP3::Frame &status_info_frame(MP3_File mp3_file)
+{
+    return STATUS_INFO_FRAMES.frame[static_cast<uint8_t>(mp3_file) - 1];
+}
+
+//*****************************************************************************
+//
+//	The following are the phrase programs. A phrase is the sequence of frames
+//  played to answer a user request, i.e. "you would be on time for your
+//  upcoming event by leaving in" + "one hour and" + "five minutes".
+//
+//*****************************************************************************
+
+//  Result of the departure time calculation.
+enum class MP3_Phrase_State : uint8_t
+{
+    NO_TIME_LEFT,
+    TIME_LEFT,
+    LATE
+};
+
+//  Max. number of frames in a phrase: status info, hours and minutes.
+#define MP3_PHRASE_LENGTH           3
+
+//  Phrase program structure.
+struct MP3_Phrase
+{
+    uint8_t length;
+    const DFPlayer_MP3::Frame *frame[MP3_PHRASE_LENGTH];
+};
+
+//*****************************************************************************
+//
+//! @brief Turns a departure time result into a phrase program.
+//!
+//! No frame is formed, the phrase only points to the frame tables.
+//!
+//!	@param[in] state Result of the departure time calculation.
+//!	@param[in] hours Hours left/late (omitted if zero, max. MP3_HOURS_FILES).
+//!	@param[in] minutes Minutes left/late (from 1 to MP3_MINUTES_FILES).
+//!
+//! @return A phrase program.
+//
+//*****************************************************************************
+constexpr MP3_Phrase make_phrase(MP3_Phrase_State state, uint8_t hours, uint8_t minutes)
+{
+    MP3_Phrase phrase = {};
+    if (state == MP3_Phrase_State::NO_TIME_LEFT)
+    {
+        phrase.frame[phrase.length++] = &status_info_frame(MP3_File::NO_TIME_LEFT);
+        return phrase;
+    }
+    if (state == MP3_Phrase_State::TIME_LEFT)
+    {
+        phrase.frame[phrase.length++] = &status_info_frame(MP3_File::TIME_LEFT);
+    }
+    else
+    {
+        phrase.frame[phrase.length++] = &status_info_frame(MP3_File::LATE);
+    }
+    if (hours > 0)
+    {
+        hours = (hours > MP3_HOURS_FILES) ? MP3_HOURS_FILES : hours;
+        phrase.frame[phrase.length++] = &HOURS_FRAMES.frame[hours - 1];
+    }
+    minutes = (minutes == 0) ? 1 : minutes;
+    minutes = (minutes > MP3_MINUTES_FILES) ? MP3_MINUTES_FILES : minutes;
+    phrase.frame[phrase.length++] = &MINUTES_FRAMES.frame[minutes - 1];
+    return phrase;
+}
+
+static_assert(make_phrase(MP3_Phrase_State::NO_TIME_LEFT, 0, 0).length == 1, "Invalid phrase program.");
+static_assert(make_phrase(MP3_Phrase_State::LATE, 1, 5).length == 3, "Invalid phrase program.");
+
+#endif  //  __MP3_TRACKS_H__
@@ -2,6 +2,12 @@
 #include "oauth2.h"
 #include "utility.h"
 #include "http_status.h"
+#include "cloud.h"
+#include "trace.h"
+#include "binlog.h"
+
+//  OAuth2.0 protocol transition table.
+constexpr SM_Table<OAuth2_State, OAuth2_Event, 6, 6> OAuth2_Machine::TABLE;
 
 //*****************************************************************************
 //
@@ -12,10 +18,15 @@
 //!
 //!	@param[in] client_id OAuth2.0 client ID used to request user consent.
 //!	@param[in] client_secret OAuth2.0 client secret used to request user consent. 
+//!	@param[in] slot Token slot, one per user. It sets the EEPROM address of the
+//!                 refresh token and tags the webhook event names.
 //
 //*****************************************************************************
-Google_OAuth2::Google_OAuth2(const String &client_id, const String &client_secret)
-    : CLIENT_ID(client_id), CLIENT_SECRET(client_secret)
+Google_OAuth2::Google_OAuth2(const String &client_id, const String &client_secret, uint8_t slot)
+    : SLOT(slot), TOKEN_ADDRESS(slot * sizeof(OAuth2_Token)), USER_TAG(Webhook_Cloud::user_tag(slot)),
+      TAGGED_REQ_USER_CODE(EVENT_REQ_USER_CODE + USER_TAG), TAGGED_POLL_AUTH(EVENT_POLL_AUTH + USER_TAG),
+      TAGGED_REFRESH_TOKEN(EVENT_REFRESH_TOKEN + USER_TAG), CLIENT_ID(client_id), CLIENT_SECRET(client_secret),
+      state(OAuth2_State::REQ_USER_CODE, Trace_Type::OAUTH2_STATE, slot), stream(*this), webhook_event(nullptr)
 {
     //  If the device has not been authenticated yet (no refresh token available),
     //  then a user code will be requested to the Google servers so the user can
@@ -23,14 +34,14 @@ Google_OAuth2::Google_OAuth2(const String &client_id, const String &client_secre
     //  token granted).
     if (read_token())
     {
-        state = OAuth2_State::REFRESH_TOKEN;
+        state.reset(OAuth2_State::REFRESH_TOKEN);
     } 
     else
     {
-        state = OAuth2_State::REQ_USER_CODE;
+        state.reset(OAuth2_State::REQ_USER_CODE);
     } 
     polling_time = 0;
-    is_device_subscribed = false;
+    wait_time = 0;
 }
 
 //*****************************************************************************
@@ -40,56 +51,151 @@ Google_OAuth2::Google_OAuth2(const String &client_id, const String &client_secre
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
 //!	@param[in] data Pointer to a char array holding the webhook reponse.
 //!
-//!	@return None.
+//!	@return false if the response is not complete yet, true if completed.
 //
 //*****************************************************************************
-void Google_OAuth2::parser(const char *event, const char *data)
+bool Google_OAuth2::parser(const char *event, const char *data)
 {
-    int16_t index = 0, last_index = 0;
-    String str_data = String(data);
-    String str_event = String(event);
-    //  Get the hook type and webhook event name.
-    //  i.e. event: deviceID/hook-response/oauth_usr_code/0
-    //  hook: hook-response.
-    //  webhook_event_name: oauth_usr_code.
-    split_string(str_event, '/', index, last_index); // skip deviceID.
-    String hook = split_string(str_event, '/', index, last_index);
-    String webhook_event_name = split_string(str_event, '/', index, last_index);
-    //  Reset the split string indexes.
-    index = 0, last_index = 0;
+    //  Get the webhook event name, with the user tag.
+    //  i.e. event: deviceID/hook-response/oauth_usr_code/1/0
+    //  webhook_event: oauth_usr_code/1.
+    webhook_event = find_event(event);
+    if (webhook_event == nullptr)
+    {
+        return false;
+    }
     //  For "hook-response", the returned data is divided by '~' and varies
-    //  depending on the webhook event. Integer values are  given in seconds
-    //  by the Google servers and are converted to milliseconds for convenience.
-    if (hook.equals("hook-response"))
+    //  depending on the webhook event. The fields are passed to parse_field()
+    //  as the response chunks arrive.
+    if (hook_type(event) == Hook_Type::RESPONSE)
     {
-        if (webhook_event_name.equals(EVENT_REQ_USER_CODE))
-        {
-            device_code = split_string(str_data, '~', index, last_index);
-            user_code = split_string(str_data, '~', index, last_index);
-            auth_url = split_string(str_data, '~', index, last_index);
-            life_time = split_string(str_data, '~', index, last_index).toInt() * 1000;
-            polling_rate = split_string(str_data, '\0', index, last_index).toInt() * 1000;
-        }
-        else if (webhook_event_name.equals(EVENT_POLL_AUTH))
+        if (!stream.feed(event, data))
         {
-            access_token = split_string(str_data, '~', index, last_index);
-            refresh_token = split_string(str_data, '~', index, last_index);
-            life_time = split_string(str_data, '\0', index, last_index).toInt() * 1000;
-        }
-        else if (webhook_event_name.equals(EVENT_REFRESH_TOKEN))
-        {
-            access_token = split_string(str_data, '~', index, last_index);
-            life_time = split_string(str_data, '\0', index, last_index).toInt() * 1000;
+            return false;
         }
+        check_stream(stream, validate_response());
     }
     //  For "hook-error", the returned data is an error message generated by   
     //  the Particle Cloud. From this message only the HTTP status code is taken.
     //  i.e. error status 404 from www.googleapis.com
     //  HTTP status code: 404.
-    else if (hook.equals("hook-error"))
+    //  Only the first chunk holds the HTTP status code.
+    else
+    {
+        if (stream.chunk_index(event) != 0)
+        {
+            return false;
+        }
+        http_status_code = error_status(data);
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Parses a field of the webhook response.
+//!
+//! The field is decoded as described by the response schema of the webhook
+//! event.
+//!
+//!	@param[in] field Field position in the response template.
+//!	@param[in] value Pointer to a char array holding the field value.
+//!
+//!	@return Schema_Error::NONE if decoded, the decoding error otherwise.
+//
+//*****************************************************************************
+Schema_Error Google_OAuth2::parse_field(uint8_t field, const char *value)
+{
+    if (webhook_event == &TAGGED_REQ_USER_CODE)
+    {
+        return User_Code_Schema::decode(*this, field, value);
+    }
+    else if (webhook_event == &TAGGED_POLL_AUTH)
+    {
+        return Poll_Auth_Schema::decode(*this, field, value);
+    }
+    else if (webhook_event == &TAGGED_REFRESH_TOKEN)
     {
-        http_status_code = str_data.substring(13, 16).toInt();
+        return Refresh_Token_Schema::decode(*this, field, value);
     }
+    return Schema_Error::NONE;
+}
+
+//*****************************************************************************
+//
+//! @brief Validates the webhook response against the response schema of the
+//!        webhook event.
+//!
+//! @return Schema_Error::NONE if valid, the decoding error otherwise.
+//
+//*****************************************************************************
+Schema_Error Google_OAuth2::validate_response(void)
+{
+    if (webhook_event == &TAGGED_REQ_USER_CODE)
+    {
+        return stream.validate<User_Code_Schema>();
+    }
+    else if (webhook_event == &TAGGED_POLL_AUTH)
+    {
+        return stream.validate<Poll_Auth_Schema>();
+    }
+    else if (webhook_event == &TAGGED_REFRESH_TOKEN)
+    {
+        return stream.validate<Refresh_Token_Schema>();
+    }
+    return Schema_Error::NONE;
+}
+
+//*****************************************************************************
+//
+//! @brief Finds the webhook event a response belongs to.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/oauth_usr_code/1/0
+//!
+//! @return A pointer to the event name with the user tag, nullptr if not 
+//!         found.
+//
+//*****************************************************************************
+const String *Google_OAuth2::find_event(const char *event)
+{
+    char name[CLOUD_EVENT_NAME_SIZE];
+    if (Webhook_Cloud::event_name(event, name) == nullptr)
+    {
+        return nullptr;
+    }
+    if (TAGGED_REQ_USER_CODE.equals(name))
+    {
+        return &TAGGED_REQ_USER_CODE;
+    }
+    else if (TAGGED_POLL_AUTH.equals(name))
+    {
+        return &TAGGED_POLL_AUTH;
+    }
+    else if (TAGGED_REFRESH_TOKEN.equals(name))
+    {
+        return &TAGGED_REFRESH_TOKEN;
+    }
+    return nullptr;
+}
+
+//*****************************************************************************
+//
+//! @brief Subscribes the device to the OAuth2.0 webhook events.
+//!
+//! This method attaches the response and error response handlers of the 
+//! three webhook events to the webhook cloud, which receives the customized
+//! response event names. The device ID is included in the customized event
+//! name so only THIS device will get the response.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_OAuth2::subscribe(void)
+{
+    attach(TAGGED_REQ_USER_CODE);
+    attach(TAGGED_POLL_AUTH);
+    attach(TAGGED_REFRESH_TOKEN);
 }
 
 //*****************************************************************************
@@ -106,15 +212,16 @@ void Google_OAuth2::parser(const char *event, const char *data)
 void Google_OAuth2::loop(void)
 {
     String data;
-    switch (state)
+    switch (state.current())
     {
         case OAuth2_State::REQ_USER_CODE:
             //  1. A user code is requested from the Google Servers.
-            subscribe_device_to(EVENT_REQ_USER_CODE);
-            data = String::format("{\"client_id\":\"%s\"}", CLIENT_ID.c_str());
-            Particle.publish(EVENT_REQ_USER_CODE, data, PRIVATE);
+            data = payload(EVENT_REQ_USER_CODE);
+            stream.reset();
+            begin_request();
+            Cloud.publish(TAGGED_REQ_USER_CODE, data);
             Serial.println("User code request sent!");
-            change_state_to(OAuth2_State::WAIT_FOR_RESPONSE);
+            state.dispatch<OAuth2_State::REQ_USER_CODE, OAuth2_Event::PUBLISHED>();
             break;
 
         case OAuth2_State::POLLING_AUTH:
@@ -126,22 +233,23 @@ void Google_OAuth2::loop(void)
             if (millis() > (polling_time + polling_rate * 2))
             {
                 polling_time = millis();
+                Trace.record(Trace_Type::TIMER, static_cast<uint8_t>(Trace_Timer::POLL_AUTH), SLOT);
                 //  If the user code expires and the user has not responded 
                 //  to the access request, then the OAuth2.0 authorization 
                 //  will fail.
                 if (time_left())
                 {
-                    subscribe_device_to(EVENT_POLL_AUTH);
-                    data = String::format("{\"client_id\":\"%s\",\"client_secret\":\"%s\",\"code\":\"%s\"}",
-                                        CLIENT_ID.c_str(), CLIENT_SECRET.c_str(), device_code.c_str());
-                    Particle.publish(EVENT_POLL_AUTH, data, PRIVATE);
-                    //  Must be called to save last state.
-                    change_state_to(OAuth2_State::POLLING_AUTH);
+                    data = payload(EVENT_POLL_AUTH);
+                    stream.reset();
+                    begin_request();
+                    Cloud.publish(TAGGED_POLL_AUTH, data);
+                    //  Must be dispatched to save the previous state.
+                    state.dispatch<OAuth2_State::POLLING_AUTH, OAuth2_Event::PUBLISHED>();
                 }
                 else
                 {
                     Serial.println("Error: User code has expired.");
-                    change_state_to(OAuth2_State::FAILED);
+                    state.dispatch<OAuth2_State::POLLING_AUTH, OAuth2_Event::FAIL>();
                 }
             }
             break;
@@ -149,17 +257,22 @@ void Google_OAuth2::loop(void)
         case OAuth2_State::REFRESH_TOKEN:
             //  3. Once the access token has expired, a request is sent
             //     to refresh it. 
-            subscribe_device_to(EVENT_REFRESH_TOKEN);
-            data = String::format("{\"refresh_token\":\"%s\",\"client_id\":\"%s\",\"client_secret\":\"%s\"}",
-                                refresh_token.c_str(), CLIENT_ID.c_str(), CLIENT_SECRET.c_str());
-            Particle.publish(EVENT_REFRESH_TOKEN, data, PRIVATE);
-            Serial.println("Refresh token request sent!");
-            change_state_to(OAuth2_State::WAIT_FOR_RESPONSE);
+            data = payload(EVENT_REFRESH_TOKEN);
+            stream.reset();
+            begin_request();
+            Cloud.publish(TAGGED_REFRESH_TOKEN, data);
+            BINLOG_INFO("Refresh token request sent!");
+            state.dispatch<OAuth2_State::REFRESH_TOKEN, OAuth2_Event::PUBLISHED>();
             break;
 
         case OAuth2_State::WAIT_FOR_RESPONSE:
-            Serial.println("waiting for a response...");
-            delay(1000);
+            //  The loop is not blocked while waiting, so the requests
+            //  of other users can go on.
+            if ((millis() - wait_time) >= 1000)
+            {
+                wait_time = millis();
+                BINLOG_DEBUG("waiting for a response...");
+            }
             break;
 
         default:
@@ -169,20 +282,48 @@ void Google_OAuth2::loop(void)
 
 //*****************************************************************************
 //
-//! @brief OAuth2.0 webhook response handler.
+//! @brief Builds the webhook query of an OAuth2.0 webhook event.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is EQUAL TO 200.
+//!	@param[in] event Webhook event name.
 //!
-//!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!	@return A string object with the JSON webhook data.
 //
 //*****************************************************************************
-void Google_OAuth2::response_handler(const char *event, const char *data)
+String Google_OAuth2::payload(const String &event)
 {
-    //  Parse the webhook reponse.
-    parser(event, data);
-    switch (last_state)
+    if (event.equals(EVENT_REQ_USER_CODE))
+    {
+        return String::format("{\"client_id\":\"%s\"}", CLIENT_ID.c_str());
+    }
+    else if (event.equals(EVENT_POLL_AUTH))
+    {
+        return String::format("{\"client_id\":\"%s\",\"client_secret\":\"%s\",\"code\":\"%s\"}",
+                              CLIENT_ID.c_str(), CLIENT_SECRET.c_str(), device_code.c_str());
+    }
+    return String::format("{\"refresh_token\":\"%s\",\"client_id\":\"%s\",\"client_secret\":\"%s\"}",
+                          refresh_token.c_str(), CLIENT_ID.c_str(), CLIENT_SECRET.c_str());
+}
+
+//*****************************************************************************
+//
+//! @brief Moves the OAuth2.0 protocol on with a webhook response.
+//!
+//! This method is called by the webhook client once the response is parsed.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Google_OAuth2::on_response(void)
+{
+    //  A response dropped by the stream or malformed is handled as an error
+    //  response.
+    if (http_status_code != HTTP_OK)
+    {
+        Serial.println(http_error);
+        change_state(OAuth2_Event::FAIL);
+        return;
+    }
+    switch (state.previous())
     {
         case OAuth2_State::REQ_USER_CODE:
         {
@@ -190,20 +331,20 @@ void Google_OAuth2::response_handler(const char *event, const char *data)
             msg += "\r\nPlease, go to: " + auth_url;
             msg += ", and enter the following code: " + user_code + "\r\n";
             Serial.println(msg);
-            change_state_to(OAuth2_State::POLLING_AUTH);
+            change_state(OAuth2_Event::USER_CODE);
         }
         break;
 
         case OAuth2_State::POLLING_AUTH:
             Serial.println("\r\nDevice authorized!\r\n");
-            change_state_to(OAuth2_State::AUTHORIZED);
+            change_state(OAuth2_Event::TOKEN);
             //  Write refresh token in memory.
             write_token();
             break;
 
         case OAuth2_State::REFRESH_TOKEN:
-            Serial.println("\r\nAccess token refreshed!\r\n");
-            change_state_to(OAuth2_State::AUTHORIZED);
+            BINLOG_INFO("\r\nAccess token refreshed!\r\n");
+            change_state(OAuth2_Event::TOKEN);
             break;
 
         default:
@@ -212,31 +353,24 @@ void Google_OAuth2::response_handler(const char *event, const char *data)
     //  Update time to maintain the remaining lifetime  
     //  of the user code and access token consistent.
     time = millis();
-    is_device_subscribed = false;
-    //  Unsubscribe all subscritptions handlers to make sure that
-    //  unnecessary events are removed after the device has been authorized.
-    Particle.unsubscribe();
 }
 
 //*****************************************************************************
 //
-//! @brief OAuth2.0 webhook error response handler.
+//! @brief Moves the OAuth2.0 protocol on with a webhook error response.
 //!
-//! This method is called by the OS whenever the HTTP status code received 
-//! in the response is DIFFERENT THAN 200.
+//! This method is called by the webhook client once the error response is
+//! parsed.
 //!
-//!	@param[in] event Pointer to a char array holidng the webhook event info.
-//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!	@return None.
 //
 //*****************************************************************************
-void Google_OAuth2::error_handler(const char *event, const char *data)
+void Google_OAuth2::on_error(void)
 {
-    //  Parse the webhook error reponse.
-    parser(event, data);
     //  A string object is built with the HTTP status code 
     //  and an error message to infrom the user.
     http_error = String::format("\r\nHTTP ERROR - %d", http_status_code);
-    switch (last_state)
+    switch (state.previous())
     {
         case OAuth2_State::REQ_USER_CODE:
             http_error = "\r\nError: Invalid client id.";
@@ -268,10 +402,19 @@ void Google_OAuth2::error_handler(const char *event, const char *data)
             break;
 
         case OAuth2_State::REFRESH_TOKEN:
-            //  Refresh token is erased from memory  
-            //  if the device fails to refresh the access token.  
-            erase_token();
-            http_error += "\r\nError: Invalid request.";
+            //  Refresh token is erased from memory only if Google rejects it
+            //  (revoked or expired). Any other error, i.e. the device publish
+            //  queue full (429) or a response chunk lost (413), is temporary:
+            //  the request fails and the token is kept for the next refresh.
+            if (http_status_code == HTTP_BAD_REQUEST || http_status_code == HTTP_UNAUTHORIZED)
+            {
+                erase_token();
+                http_error += "\r\nError: Invalid request.";
+            }
+            else if (http_status_code > 0)
+            {
+                http_error += "\r\nError: Temporary failure, token kept.";
+            }
             break;
 
         default:
@@ -284,7 +427,7 @@ void Google_OAuth2::error_handler(const char *event, const char *data)
     if (http_status_code > 0 && http_status_code != HTTP_PRECONDITION_REQUIRED)
     {
         Serial.println(http_error);
-        change_state_to(OAuth2_State::FAILED);
+        change_state(OAuth2_Event::FAIL);
     }
 }
 
@@ -292,49 +435,18 @@ void Google_OAuth2::error_handler(const char *event, const char *data)
 //
 //! @brief Change the current OAuth2.0 state.
 //!
-//! This method changes the current OAuth2.0 state and saves the last one
-//! to handle webhook reponses from past states.
+//! This method moves the OAuth2.0 state machine to the next state of an
+//! event, the previous state is kept to handle webhook reponses from past
+//! states. An event not accepted in the current state is ignored.
 //!
-//!	@param[in] new_state OAuth2.0 state assigned to the current state.
+//!	@param[in] event OAuth2.0 event received in the current state.
 //!
 //!	@return None.
 //
 //*****************************************************************************
-void Google_OAuth2::change_state_to(OAuth2_State new_state)
+void Google_OAuth2::change_state(OAuth2_Event event)
 {
-    last_state = state;
-    state = new_state;
-}
-
-//*****************************************************************************
-//
-//! @brief Subscribes the device to a Particle webhook event.
-//!
-//! This method subscribes the device to a customized webhook response and 
-//! error response event name. The device ID is included in the customized
-//! event name so only THIS device will get the response.
-//!
-//!	@param[in] event Webhook event name used to subscribe the device.
-//!
-//!	@return None.
-//
-//*****************************************************************************
-void Google_OAuth2::subscribe_device_to(const String &event)
-{
-    if (!is_device_subscribed)
-    {
-        //  According to the Argon device OS API, a max of 4 handlers
-        //  are supported per device. For OAuth2.0 there are 3 webhooks,
-        //  each with 2 handlers; in total, 6 handler are required.
-        //  Because of this, before calling Particle.subscribe(), ALL previous
-        //  subscriptions are removed by calling Particle.unsubscribe().
-        Particle.unsubscribe();
-        String hook_reponse = System.deviceID() + "/hook-response/" + event;
-        String hook_error = System.deviceID() + "/hook-error/" + event;
-        Particle.subscribe(hook_reponse, &Google_OAuth2::response_handler, this, MY_DEVICES);
-        Particle.subscribe(hook_error, &Google_OAuth2::error_handler, this, MY_DEVICES);
-        is_device_subscribed = true;
-    }
+    state.dispatch(event);
 }
 
 //*****************************************************************************
@@ -364,7 +476,7 @@ bool Google_OAuth2::time_left(void)
 //*****************************************************************************
 bool Google_OAuth2::authenticated(void)
 {
-    return state == OAuth2_State::REFRESH_TOKEN;
+    return state.current() == OAuth2_State::REFRESH_TOKEN;
 }
 
 //*****************************************************************************
@@ -381,7 +493,8 @@ bool Google_OAuth2::is_token_valid(void)
         return true;   
     }
     //  Current state is changed to refresh the access token.
-    state = OAuth2_State::REFRESH_TOKEN;
+    Trace.record(Trace_Type::TIMER, static_cast<uint8_t>(Trace_Timer::TOKEN_EXPIRED), SLOT);
+    change_state(OAuth2_Event::TOKEN_EXPIRED);
     return false;
 }
 
@@ -394,7 +507,7 @@ bool Google_OAuth2::is_token_valid(void)
 //*****************************************************************************
 bool Google_OAuth2::authorized(void)
 {
-    return state == OAuth2_State::AUTHORIZED;
+    return state.current() == OAuth2_State::AUTHORIZED;
 }
 
 //*****************************************************************************
@@ -406,19 +519,20 @@ bool Google_OAuth2::authorized(void)
 //*****************************************************************************
 bool Google_OAuth2::failed(void)
 {
-    return state == OAuth2_State::FAILED;
+    return state.current() == OAuth2_State::FAILED;
 }
 
 //*****************************************************************************
 //
-//! @brief Print the HTTP error response returned by the last event published.
+//! @brief Gets the dwell time statistics of the OAuth2.0 states.
 //!
-//! @return None.
+//! @return A string object with the entries, average and max. time in
+//!         milliseconds of each state (see State_Machine::get_stats()).
 //
 //*****************************************************************************
-void Google_OAuth2::print_error(void)
+String Google_OAuth2::get_state_stats(void)
 {
-    Serial.println(http_error);
+    return state.get_stats();
 }
 
 //*****************************************************************************
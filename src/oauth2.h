@@ -1,12 +1,16 @@
 #ifndef __OAUTH2_H__
 #define __OAUTH2_H__
 
+#include "webhook_client.h"
+#include "state_machine.h"
+
 //  Foward declaration.
 class Google_Calendar;
+class Boot_Cache;
 
 //*****************************************************************************
 //
-//	Enumeration classes for the OAuth2.0 states.
+//	Enumeration classes for the OAuth2.0 states and events.
 //
 //*****************************************************************************
 
@@ -20,6 +24,35 @@ enum class OAuth2_State : uint8_t
     FAILED
 };
 
+enum class OAuth2_Event : uint8_t
+{
+    PUBLISHED,
+    USER_CODE,
+    TOKEN,
+    FAIL,
+    TOKEN_EXPIRED,
+    RESTORED
+};
+
+//  OAuth2.0 protocol transitions, the access token can be refreshed
+//  again after a failure.
+struct OAuth2_Machine
+{
+    static constexpr SM_Table<OAuth2_State, OAuth2_Event, 6, 6> TABLE = make_sm_table<OAuth2_State, OAuth2_Event, 6, 6>({
+        {OAuth2_State::REQ_USER_CODE, OAuth2_Event::PUBLISHED, OAuth2_State::WAIT_FOR_RESPONSE},
+        {OAuth2_State::POLLING_AUTH, OAuth2_Event::PUBLISHED, OAuth2_State::POLLING_AUTH},
+        {OAuth2_State::POLLING_AUTH, OAuth2_Event::TOKEN, OAuth2_State::AUTHORIZED},
+        {OAuth2_State::POLLING_AUTH, OAuth2_Event::FAIL, OAuth2_State::FAILED},
+        {OAuth2_State::REFRESH_TOKEN, OAuth2_Event::PUBLISHED, OAuth2_State::WAIT_FOR_RESPONSE},
+        {OAuth2_State::REFRESH_TOKEN, OAuth2_Event::RESTORED, OAuth2_State::AUTHORIZED},
+        {OAuth2_State::WAIT_FOR_RESPONSE, OAuth2_Event::USER_CODE, OAuth2_State::POLLING_AUTH},
+        {OAuth2_State::WAIT_FOR_RESPONSE, OAuth2_Event::TOKEN, OAuth2_State::AUTHORIZED},
+        {OAuth2_State::WAIT_FOR_RESPONSE, OAuth2_Event::FAIL, OAuth2_State::FAILED},
+        {OAuth2_State::AUTHORIZED, OAuth2_Event::TOKEN_EXPIRED, OAuth2_State::REFRESH_TOKEN},
+        {OAuth2_State::FAILED, OAuth2_Event::TOKEN_EXPIRED, OAuth2_State::REFRESH_TOKEN}
+    });
+};
+
 //*****************************************************************************
 //
 //! @brief Google OAuth2.0 class for TV and limited-input device applications.
@@ -34,14 +67,28 @@ enum class OAuth2_State : uint8_t
 //! Google_OAuth2::loop() member function, a new access token will be requested
 //! without user intervention.
 //!
+//! The webhook bookkeeping is shared with the other Google API classes
+//! through the webhook client base class.
 //
 //*****************************************************************************
-class Google_OAuth2
+class Google_OAuth2 : public Webhook_Client<Google_OAuth2>
 {
     private:
         //  Google Calendar class is added as a friend class, 
         //  so it can access the private members, such as the access token. 
         friend class Google_Calendar;
+        //  Boot cache class is added as a friend class, so it can persist
+        //  and restore the access token across resets.
+        friend class Boot_Cache;
+        //  Webhook stream class is added as a friend class,
+        //  so it can pass the response fields to the parser.
+        friend class Webhook_Stream<Google_OAuth2>;
+        //  Webhook client class is added as a friend class,
+        //  so it can pass the webhook events to the parser.
+        friend class Webhook_Client<Google_OAuth2>;
+        //  Benchmark class is added as a friend class, so it can measure
+        //  the parser and the webhook query builder.
+        friend class Benchmark;
         
         //  OAuth2.0 token structure.
         typedef struct oauth2_token
@@ -58,16 +105,23 @@ class Google_OAuth2
         } OAuth2_Token;
         
         //  OAuth2.0 Refresh Token struct to store in memory.
+        //  SLOT: Token slot, one per user.
         //  TOKEN_ADDRESS: Start address in EEPROM to write the token.
         //  TOKEN_LENGTH: Max number of characters to write.
-        const uint8_t TOKEN_ADDRESS = 0;
+        const uint8_t SLOT;
+        const uint16_t TOKEN_ADDRESS;
         const uint8_t TOKEN_LENGTH = 60;
         OAuth2_Token Refresh_Token;
         
-        //  Particle webhooks event name.
+        //  Particle webhooks event name and user tag, and the event names
+        //  with the user tag, built once.
         const String EVENT_REQ_USER_CODE = "oauth_usr_code";
         const String EVENT_POLL_AUTH = "oauth_poll_auth";
         const String EVENT_REFRESH_TOKEN = "oauth_ref_token";
+        const String USER_TAG;
+        const String TAGGED_REQ_USER_CODE;
+        const String TAGGED_POLL_AUTH;
+        const String TAGGED_REFRESH_TOKEN;
         
         //  OAuth2.0 client credentials.
         const String CLIENT_ID;
@@ -89,43 +143,67 @@ class Google_OAuth2
         //  Google's authorization server polling param.
         uint32_t polling_time;
         uint16_t polling_rate;
+
+        //  Last time the waiting message was printed.
+        uint32_t wait_time;
         
-        //  OAuth2.0 protocol states.
-        OAuth2_State state;
-        OAuth2_State last_state;
-        
-        //  Webhooks subscription status.
-        bool is_device_subscribed;
+        //  OAuth2.0 protocol state machine, the previous state is used
+        //  to handle the webhook responses.
+        State_Machine<OAuth2_Machine> state;
         
-        //  Http status code and error response returned from webhooks.
-        String http_error;
-        uint16_t http_status_code;
+        //  Webhook response schemas, one per webhook event.
+        //  Integer values are given in seconds by the Google servers and are
+        //  converted to milliseconds for convenience.
+        //  i.e. data: device_code~user_code~auth_url~1800~5
+        typedef Webhook_Schema<Google_OAuth2,
+            Text_Field<Google_OAuth2, &Google_OAuth2::device_code, WEBHOOK_FIELD_SIZE - 1>,
+            Text_Field<Google_OAuth2, &Google_OAuth2::user_code, WEBHOOK_FIELD_SIZE - 1>,
+            Text_Field<Google_OAuth2, &Google_OAuth2::auth_url, WEBHOOK_FIELD_SIZE - 1>,
+            Number_Field<Google_OAuth2, int32_t, &Google_OAuth2::life_time, 1, 86400, 1000>,
+            Number_Field<Google_OAuth2, uint16_t, &Google_OAuth2::polling_rate, 1, 60, 1000>
+        > User_Code_Schema;
+        //  i.e. data: access_token~refresh_token~3600
+        typedef Webhook_Schema<Google_OAuth2,
+            Text_Field<Google_OAuth2, &Google_OAuth2::access_token, WEBHOOK_FIELD_SIZE - 1>,
+            Text_Field<Google_OAuth2, &Google_OAuth2::refresh_token, WEBHOOK_FIELD_SIZE - 1>,
+            Number_Field<Google_OAuth2, int32_t, &Google_OAuth2::life_time, 1, 86400, 1000>
+        > Poll_Auth_Schema;
+        //  i.e. data: access_token~3600
+        typedef Webhook_Schema<Google_OAuth2,
+            Text_Field<Google_OAuth2, &Google_OAuth2::access_token, WEBHOOK_FIELD_SIZE - 1>,
+            Number_Field<Google_OAuth2, int32_t, &Google_OAuth2::life_time, 1, 86400, 1000>
+        > Refresh_Token_Schema;
+
+        //  Webhook response stream and the tagged event name it belongs to.
+        Webhook_Stream<Google_OAuth2> stream;
+        const String *webhook_event;
 
         //  Private member functions.
-        void subscribe_device_to(const String &event);
-        void parser(const char *event, const char *data);
-        void change_state_to(OAuth2_State new_state);
+        String payload(const String &event);
+        bool parser(const char *event, const char *data);
+        Schema_Error parse_field(uint8_t field, const char *value);
+        Schema_Error validate_response(void);
+        const String *find_event(const char *event);
+        void on_response(void);
+        void on_error(void);
+        void change_state(OAuth2_Event event);
         bool time_left(void);
         void write_token(void);
         bool read_token(void);
         void erase_token(void);
 
-    protected:
-        //  Particle webhooks event handlers.
-        void response_handler(const char *event, const char *data);
-        void error_handler(const char *event, const char *data);
-        
     public:
         //  Class constructor.
-        Google_OAuth2(const String &client_id, const String &client_secret);
+        Google_OAuth2(const String &client_id, const String &client_secret, uint8_t slot = 0);
 
         //  Public member functions.
+        void subscribe(void);
         void loop(void);
-        void print_error(void);
         bool failed(void);
         bool authorized(void);
         bool authenticated(void);
         bool is_token_valid(void);
+        String get_state_stats(void);
 };
 
 #endif  //  __OAUTH2_H__
\ No newline at end of file
@@ -0,0 +1,407 @@
+#include "Particle.h"
+#include "recorder.h"
+#include "webhook_stream.h"
+
+//  Webhook recorder shared by the Google classes.
+Webhook_Recorder Recorder;
+
+#ifdef RECORDER_ENABLED
+
+//  Size of the fixed part of a record (name excluded) in bytes.
+#define RECORDER_HEADER_SIZE        9
+//  Number of log bytes printed per line in the serial dump.
+#define RECORDER_DUMP_LINE          32
+
+//  Buffer holding the payload of the record being replayed,
+//  the webhook handlers expect a null-terminated string.
+static char replay_data[WEBHOOK_CHUNK_SIZE + 1];
+
+//*****************************************************************************
+//
+//! @brief Webhook recorder class constructor.
+//
+//*****************************************************************************
+Webhook_Recorder::Webhook_Recorder()
+{
+    log_length = 0;
+    dropped = 0;
+    num_events = 0;
+    replay = false;
+    replay_scale = 100;
+    replay_remaining = 0;
+    replay_dropped = 0;
+    num_pending = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Informs the recorder that a webhook event was published.
+//!
+//! The publish time is used to calculate the response latency. While
+//! replaying, the next recorded response of the webhook is scheduled.
+//!
+//!	@param[in] event Webhook event name, without the generation tag.
+//!	@param[in] generation Generation of the request, the replayed responses
+//!                       are delivered with it.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::published(const String &event, uint8_t generation)
+{
+    Webhook_Event *webhook_event = find_event(event.c_str(), true);
+    if (webhook_event == nullptr)
+    {
+        return;
+    }
+    webhook_event->publish_time = millis();
+    webhook_event->generation = generation;
+    if (!replay)
+    {
+        return;
+    }
+    //  Schedule all the chunks of the next recorded response of this webhook,
+    //  from its own cursor. The records of other webhooks are left for their
+    //  cursors. The response ends when an already scheduled chunk index of
+    //  this webhook shows up.
+    Record record;
+    uint32_t chunks = 0;
+    uint16_t offset = webhook_event->replay_offset;
+    while (offset < log_length)
+    {
+        uint16_t next_offset = read_record(offset, record);
+        if (strcmp(record.name, webhook_event->name) == 0)
+        {
+            uint32_t chunk_mask = 1UL << (record.chunk % 32);
+            if (chunks & chunk_mask)
+            {
+                break;
+            }
+            chunks |= chunk_mask;
+            schedule(offset, webhook_event->publish_time + (record.latency * replay_scale) / 100);
+        }
+        offset = next_offset;
+    }
+    webhook_event->replay_offset = offset;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if the recorder is replaying.
+//!
+//! While replaying, the webhook events must not be published.
+//!
+//! @return false if not replaying, true if replaying.
+//
+//*****************************************************************************
+bool Webhook_Recorder::replaying(void)
+{
+    return replay;
+}
+
+//*****************************************************************************
+//
+//! @brief Records a webhook response or error response chunk.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/calendar_event/1
+//!	@param[in] data Pointer to a char array holding the webhook reponse chunk.
+//!	@param[in] hook_type Webhook hook type.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::record(const char *event, const char *data, Hook_Type hook_type)
+{
+    //  The replayed responses are already in the log.
+    if (replay)
+    {
+        return;
+    }
+    char event_name[CLOUD_EVENT_NAME_SIZE];
+    const char *chunk_index = Webhook_Cloud::event_name(event, event_name);
+    if (chunk_index == nullptr)
+    {
+        return;
+    }
+    uint8_t name_length = strlen(event_name);
+    //  The latency is measured from the last publish of this webhook.
+    uint32_t latency = 0;
+    Webhook_Event *webhook_event = find_event(event_name, false);
+    if (webhook_event != nullptr)
+    {
+        latency = millis() - webhook_event->publish_time;
+    }
+    uint16_t data_length = strnlen(data, WEBHOOK_CHUNK_SIZE);
+    uint8_t chunk = (*chunk_index == '/') ? atoi(chunk_index + 1) : 0;
+    //  Drop the record if the log is full.
+    if ((log_length + 1 + name_length + RECORDER_HEADER_SIZE + data_length) > RECORDER_LOG_SIZE)
+    {
+        dropped++;
+        return;
+    }
+    uint8_t *ptr = &log[log_length];
+    *ptr++ = name_length;
+    memcpy(ptr, event_name, name_length);
+    ptr += name_length;
+    *ptr++ = (uint8_t) hook_type;
+    *ptr++ = chunk;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        *ptr++ = (latency >> (8 * i)) & 0xFF;
+    }
+    *ptr++ = data_length & 0xFF;
+    *ptr++ = data_length >> 8;
+    memcpy(ptr, data, data_length);
+    ptr += data_length;
+    log_length = ptr - log;
+}
+
+//*****************************************************************************
+//
+//! @brief Dumps the log to the serial port.
+//!
+//! A summary line is printed per record, followed by the binary log in
+//! hexadecimal so it can be captured from a serial monitor.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::dump(void)
+{
+    Serial.printlnf("Recorder log: %u bytes, %u records dropped, %u replayed records dropped.", 
+                    log_length, dropped, replay_dropped);
+    Record record;
+    uint16_t offset = 0;
+    while (offset < log_length)
+    {
+        offset = read_record(offset, record);
+        Serial.printlnf("%s/%s/%u: %u bytes after %lu ms.",
+                        (record.hook_type == Hook_Type::RESPONSE) ? "hook-response" : "hook-error",
+                        record.name, record.chunk, record.length, (unsigned long) record.latency);
+    }
+    for (uint16_t i = 0; i < log_length; i++)
+    {
+        Serial.printf("%02X", log[i]);
+        if ((i % RECORDER_DUMP_LINE) == (RECORDER_DUMP_LINE - 1) || i == (log_length - 1))
+        {
+            Serial.println();
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Clears the log.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::clear(void)
+{
+    stop_replay();
+    log_length = 0;
+    dropped = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Starts replaying the log.
+//!
+//!	@param[in] scale Latency scale in percent, 100 replays the responses with
+//!                  the recorded latency, 0 as fast as possible.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::start_replay(uint16_t scale)
+{
+    replay = (log_length > 0);
+    replay_scale = scale;
+    replay_dropped = 0;
+    num_pending = 0;
+    //  Every webhook replays from the start of the log.
+    for (uint8_t i = 0; i < num_events; i++)
+    {
+        events[i].replay_offset = 0;
+    }
+    //  Records not scheduled yet, the replay completes once all of them
+    //  are delivered (or dropped).
+    Record record;
+    replay_remaining = 0;
+    for (uint16_t offset = 0; offset < log_length; offset = read_record(offset, record))
+    {
+        replay_remaining++;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Stops replaying the log.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::stop_replay(void)
+{
+    replay = false;
+    num_pending = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Passes the scheduled responses to the webhook handlers when due.
+//!
+//! It must be called from the application loop.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::loop(void)
+{
+    if (!replay)
+    {
+        return;
+    }
+    if (num_pending > 0 && (int32_t)(millis() - pending[0].due_time) >= 0)
+    {
+        //  Remove the chunk before delivering it,
+        //  as the handlers might publish again.
+        uint16_t offset = pending[0].offset;
+        num_pending--;
+        memmove(&pending[0], &pending[1], num_pending * sizeof(Pending_Record));
+        Record record;
+        read_record(offset, record);
+        deliver(record);
+    }
+    else if (num_pending == 0 && replay_remaining == 0)
+    {
+        Serial.printlnf("Replay completed, %u records dropped.", replay_dropped);
+        stop_replay();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Finds a webhook event by name.
+//!
+//!	@param[in] name Webhook event name.
+//!	@param[in] add If set, the event is added when not found.
+//!
+//! @return A pointer to the webhook event, nullptr if not found.
+//
+//*****************************************************************************
+Webhook_Recorder::Webhook_Event *Webhook_Recorder::find_event(const char *name, bool add)
+{
+    for (uint8_t i = 0; i < num_events; i++)
+    {
+        if (strcmp(events[i].name, name) == 0)
+        {
+            return &events[i];
+        }
+    }
+    if (!add || num_events >= RECORDER_MAX_EVENTS)
+    {
+        return nullptr;
+    }
+    Webhook_Event *webhook_event = &events[num_events++];
+    strncpy(webhook_event->name, name, CLOUD_EVENT_NAME_SIZE - 1);
+    webhook_event->name[CLOUD_EVENT_NAME_SIZE - 1] = '\0';
+    webhook_event->publish_time = millis();
+    webhook_event->replay_offset = 0;
+    webhook_event->generation = 0;
+    return webhook_event;
+}
+
+//*****************************************************************************
+//
+//! @brief Schedules a recorded chunk, keeping the pending list ordered by
+//!        due time.
+//!
+//! The chunk is dropped, and counted, if the pending list is full.
+//!
+//!	@param[in] offset Log offset of the record.
+//!	@param[in] due_time Time at which the chunk is delivered, in milliseconds.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::schedule(uint16_t offset, uint32_t due_time)
+{
+    replay_remaining--;
+    if (num_pending >= RECORDER_MAX_PENDING)
+    {
+        replay_dropped++;
+        return;
+    }
+    //  Chunks due at the same time keep the recorded order.
+    uint8_t index = num_pending;
+    while (index > 0 && (int32_t)(pending[index - 1].due_time - due_time) > 0)
+    {
+        pending[index] = pending[index - 1];
+        index--;
+    }
+    pending[index].offset = offset;
+    pending[index].due_time = due_time;
+    num_pending++;
+}
+
+//*****************************************************************************
+//
+//! @brief Decodes a record from the log.
+//!
+//!	@param[in] offset Log offset of the record.
+//!	@param[out] record Decoded record, the data points into the log.
+//!
+//! @return The log offset of the next record.
+//
+//*****************************************************************************
+uint16_t Webhook_Recorder::read_record(uint16_t offset, Record &record)
+{
+    const uint8_t *ptr = &log[offset];
+    uint8_t name_length = *ptr++;
+    memcpy(record.name, ptr, name_length);
+    record.name[name_length] = '\0';
+    ptr += name_length;
+    record.hook_type = (Hook_Type) *ptr++;
+    record.chunk = *ptr++;
+    record.latency = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+        record.latency |= (uint32_t) *ptr++ << (8 * i);
+    }
+    record.length = ptr[0] | (ptr[1] << 8);
+    ptr += 2;
+    record.data = ptr;
+    ptr += record.length;
+    return ptr - log;
+}
+
+//*****************************************************************************
+//
+//! @brief Passes a recorded response to the webhook handler.
+//!
+//!	@param[in] record Decoded record.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Webhook_Recorder::deliver(const Record &record)
+{
+    //  Rebuild the event name as received from the Particle Cloud,
+    //  tagged with the generation of the last publish.
+    String event = System.deviceID();
+    event += (record.hook_type == Hook_Type::RESPONSE) ? "/hook-response/" : "/hook-error/";
+    event += String(record.name);
+    Webhook_Event *webhook_event = find_event(record.name, false);
+    if (webhook_event != nullptr)
+    {
+        event += Webhook_Cloud::generation_tag(webhook_event->generation);
+    }
+    event += "/" + String(record.chunk);
+    memcpy(replay_data, record.data, record.length);
+    replay_data[record.length] = '\0';
+    Cloud.dispatch(event.c_str(), replay_data);
+}
+
+#endif  //  RECORDER_ENABLED
@@ -0,0 +1,148 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include "cloud.h"
+
+//  Uncomment this line to enable the webhook recorder.
+//  If disabled, the recorder calls are removed by the compiler.
+//#define RECORDER_ENABLED
+
+//  Size of the recorder log in bytes.
+#define RECORDER_LOG_SIZE           4096
+//  Max. number of webhook events known by the recorder.
+#define RECORDER_MAX_EVENTS         24
+//  Max. number of recorded chunks waiting to be replayed. Like the receive
+//  queue, it must hold the chunks of a burst of responses (RECEIVE_BURST,
+//  see app.h).
+#define RECORDER_MAX_PENDING        CLOUD_RECEIVE_QUEUE_SIZE
+
+//*****************************************************************************
+//
+//	Enumeration classes for the webhook hook types.
+//
+//*****************************************************************************
+
+enum class Hook_Type : uint8_t
+{
+    RESPONSE,
+    ERROR
+};
+
+#ifdef RECORDER_ENABLED
+
+//*****************************************************************************
+//
+//! @brief Webhook recorder class.
+//!
+//! This class records the webhook traffic received by the Google classes in a
+//! compact binary log: webhook event name, hook type, chunk index, payload,
+//! and the latency between the publish and the response. The log can be
+//! dumped over the serial port.
+//!
+//! The log can also be replayed. While replaying, events are not published to
+//! the cloud; instead, each publish schedules the next recorded response of
+//! that webhook, which is passed to the same handlers (through the webhook
+//! cloud) after the recorded latency, optionally scaled. Every webhook keeps
+//! its own replay cursor, as the responses of parallel requests (calendar
+//! sources, departure candidates, users) are recorded interleaved.
+//!
+//! Record format (little-endian):
+//!     u8 name_length, name, u8 hook_type, u8 chunk, u32 latency_ms,
+//!     u16 data_length, data
+//
+//*****************************************************************************
+class Webhook_Recorder
+{
+    private:
+        //  Decoded record structure.
+        typedef struct record
+        {
+            char name[CLOUD_EVENT_NAME_SIZE];
+            Hook_Type hook_type;
+            uint8_t chunk;
+            uint32_t latency;
+            uint16_t length;
+            const uint8_t *data;
+        } Record;
+
+        //  Webhook event structure.
+        typedef struct webhook_event
+        {
+            char name[CLOUD_EVENT_NAME_SIZE];
+            uint32_t publish_time;
+            uint16_t replay_offset;
+            uint8_t generation;
+        } Webhook_Event;
+
+        //  Recorded chunk waiting to be replayed.
+        typedef struct pending_record
+        {
+            uint16_t offset;
+            uint32_t due_time;
+        } Pending_Record;
+
+        //  Binary log.
+        uint8_t log[RECORDER_LOG_SIZE];
+        uint16_t log_length;
+        uint16_t dropped;
+
+        //  Webhook events known by the recorder.
+        Webhook_Event events[RECORDER_MAX_EVENTS];
+        uint8_t num_events;
+
+        //  Replay state.
+        bool replay;
+        uint16_t replay_scale;
+        uint16_t replay_remaining;
+        uint16_t replay_dropped;
+        //  Ordered by due time.
+        Pending_Record pending[RECORDER_MAX_PENDING];
+        uint8_t num_pending;
+
+        //  Private member functions.
+        Webhook_Event *find_event(const char *name, bool add);
+        uint16_t read_record(uint16_t offset, Record &record);
+        void schedule(uint16_t offset, uint32_t due_time);
+        void deliver(const Record &record);
+
+    public:
+        //  Class constructor.
+        Webhook_Recorder();
+
+        //  Public member functions.
+        void published(const String &event, uint8_t generation);
+        bool replaying(void);
+        void record(const char *event, const char *data, Hook_Type hook_type);
+        void dump(void);
+        void clear(void);
+        void start_replay(uint16_t scale);
+        void stop_replay(void);
+        void loop(void);
+};
+
+#else
+
+//*****************************************************************************
+//
+//! @brief Webhook recorder stub, used when the recorder is disabled.
+//
+//*****************************************************************************
+class Webhook_Recorder
+{
+    public:
+        void published(const String &event, uint8_t generation) {}
+        bool replaying(void) { return false; }
+        void record(const char *event, const char *data, Hook_Type hook_type) {}
+        void dump(void) {}
+        void clear(void) {}
+        void start_replay(uint16_t scale) {}
+        void stop_replay(void) {}
+        void loop(void) {}
+};
+
+#endif  //  RECORDER_ENABLED
+
+//  Webhook recorder shared by the Google classes.
+extern Webhook_Recorder Recorder;
+
+#endif  //  __RECORDER_H__
@@ -4,22 +4,95 @@
 //
 //*****************************************************************************
 #include "mp3.h"
+#include "mp3_tracks.h"
 #include "oauth2.h"
 #include "calendar.h"
 #include "geolocation.h"
 #include "distance_matrix.h"
 #include "utility.h"
+#include "time_zone.h"
+#include "boot_cache.h"
+#include "bench.h"
+#include "cloud.h"
+#include "recorder.h"
+#include "trace.h"
+#include "binlog.h"
+#include "state_machine.h"
+#include "task.h"
 #include "app.h"
 
+//  The cloud connection runs in the system thread, if enabled. The events 
+//  received are dispatched from loop() (see Webhook_Cloud), so the 
+//  application state is only changed by the application thread.
+#ifdef CLOUD_THREAD_ENABLED
+SYSTEM_THREAD(ENABLED);
+#endif
+
 void setup()
 {
     Serial.begin();
-    Time.zone(TIME_ZONE);
-    Time.setFormat(TIME_FORMAT_ISO8601_FULL);
+    //  Record the reset, the events before it are kept.
+    Trace.begin();
+    //  Time from reset until the device is ready to answer.
+    Particle.variable("ready_ms", App.ready_time);
+    //  Throughput of the device.
+    Particle.variable("answers_min", App.answers_per_minute);
+    //  Repeated requests and responses of superseded requests.
+    Particle.variable("coalesced", App.coalesced_requests);
+    Particle.variable("superseded", App.superseded_requests);
+    Particle.variable("stale", App.stale_responses);
+    //  Distance Matrix API elements spent by the departure searches.
+    Particle.variable("dm_elements", App.distance_matrix_elements);
+    //  Answers from the Google APIs and from the cache (offline answers),
+    //  and offline answers corrected once the cloud was back.
+    Particle.variable("live_answers", App.live_answers);
+    Particle.variable("cached_answers", App.cached_answers);
+    Particle.variable("corrected", App.corrected_answers);
+    //  Publish queueing delay per priority class.
+    Particle.variable("publish_stats", publish_stats);
+    //  Calendar requests not modified, and response bytes and fields parsed.
+    Particle.variable("calendar_stats", calendar_stats);
+    //  Answer latency of the repeated requests answered from the answer memo
+    //  and of the ones computed.
+    Particle.variable("answer_latency", answer_latency);
+    //  Log records written and dropped, and cycles spent logging per request.
+    Particle.variable("log_stats", log_stats);
+    //  Time spent in each state of the application and user state machines.
+    Particle.variable("state_dwell", state_dwell);
+    //  Request task frames in use and allocated.
+    Particle.variable("task_stats", task_stats);
+    //  Requests, failures and response time of each Google API client.
+    Particle.variable("webhook_stats", webhook_stats);
+#ifdef BENCH_ENABLED
+    //  Register the "bench" cloud function.
+    Bench.begin();
+#endif
     init_mp3_player();
+    //  The travel preferences of each user are set in USER_PROFILES.
+    subscribe_handlers();
+
+#ifndef GEOLOC_ENABLED
+    //  Set the device location.
+    set_origin(0.0, 0.0);
+#endif
+    //  Reuse the data cached before the last reset, if still valid.
+    App_Event first_event = warm_boot();
+    if (first_event == App_Event::READY)
+    {
+        change_app_stage<App_Stage::GEOLOCATION, App_Event::READY>();
+        //  Inform the user without holding the program, 
+        //  so a request can be received while playing.
+        App.mp3.send_frame(status_info_frame(MP3_File::DEVICE_READY));
+        return;
+    }
     //  Play a different MP3 file depending on 
-    //  the current OAuth2.0 state. 
-    if (OAuth2.authenticated()) 
+    //  the current OAuth2.0 state of the users. 
+    bool authenticated = true;
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        authenticated = authenticated && App.users[i].oauth2.authenticated();
+    }
+    if (authenticated) 
     {   
         play_status_info(MP3_File::UPDATE_DEVICE);
     }
@@ -32,49 +105,45 @@ void setup()
             delay(1000);
         }
     }
-    //  Configure the distance matrix event.
-    //  Travel Mode: DRIVING, TRANSIT.
-    Distance_Matrix_Event.travel_mode = Distance_Matrix_Travel_Mode::TRANSIT;
-    //  Transit Mode: SUBWAY, TRAIN, TRAM, RAIL, NONE.
-    Distance_Matrix_Event.transit_mode = Distance_Matrix_Transit_Mode::BUS;
-
-#ifdef GEOLOC_ENABLED
-    change_app_stage_to(App_Stage::GEOLOCATION);
-#else
-    //  Set the device location.
-    Distance_Matrix_Event.origin_lat = 0.0;
-    Distance_Matrix_Event.origin_lng = 0.0;
-    change_app_stage_to(App_Stage::OAUTH2);
-#endif
+    change_app_stage(first_event);
 }
 
 void loop()
 {
-    switch (app_stage)
+    //  Events from the local cloud stand-in, if enabled.
+    Cloud.loop();
+    //  Heap snapshots of the flight recorder, if enabled.
+    Trace.loop();
+    //  Serial commands and replayed webhook responses.
+    serial_loop();
+    //  Frames sent by the DFPlayer Mini on its own (i.e. errors).
+    mp3_loop();
+    //  Log records, printed as fast as the serial port takes them.
+    Binlog.loop();
+    switch (App.stage.current())
     {
         case App_Stage::GEOLOCATION:
             geolocation_loop();
+            //  Keep answering requests during a background revalidation.
+            if (App.revalidating)
+            {
+                assistant_loop();
+            }
             break;
 
         case App_Stage::OAUTH2:
             oauth2_loop();
             break;
 
-        case App_Stage::CALENDAR:
-            calendar_loop();
-            break;
-
-        case App_Stage::DISTANCE_MATRIX:
-            distance_matrix_loop();
-            break;
-
         case App_Stage::ASSISTANT:
-            Serial.println("waiting for a user request...");
-            delay(1000);
-            break;
-
-        case App_Stage::DATA_PROCESSING:
-            calc_departure_time();
+            //  Revalidate the cached location in the background,
+            //  the device keeps answering requests meanwhile.
+            if (App.revalidating)
+            {
+                change_app_stage<App_Stage::ASSISTANT, App_Event::REVALIDATE>();
+                break;
+            }
+            assistant_loop();
             break;
 
         case App_Stage::FAILED:
@@ -96,42 +165,29 @@ void loop()
 //! This function uses all the data collected from the Google APIs to calcualte
 //! the ideal depature time for the user upcoming event/activity/meeting.
 //!
+//!	@param[in] departure_time Time to leave as a unix timestamp (UTC).
+//!	@param[in] arrival_time Estimated arrival time as a unix timestamp (UTC).
+//!
 //! @return None. 
 //
 //*****************************************************************************
-void calc_departure_time(void)
+void calc_departure_time(time_t departure_time, time_t arrival_time)
 {
-    int16_t index = 0, last_index = 0;
     //  The ideal depature time is calculated as the remaning time that user
-    //  has before leaving to get in time to its next event.
-    //  For this, the depature time is assumed as the current time
-    //  and therefore, the arrival time is the depature time plus the
-    //  travel time returned by the Distance Matrix API.
-    //  Both times are unix timestamps (seconds since Jan 01 1970).
-    time_t departure_time = unix_time(Time.year(), Time.month(), Time.day(),
-                                      Time.hour(), Time.minute(), Time.second());
-    time_t arrival_time = departure_time + Distance_Matrix.get_duration_to_dest();
-    //  The event start date and time is a string RFC3339 timestamp.
-    //  i.e. 2011-06-03T10:00:00-07:00.
-    //  It is splited and converted into a unix timestamp.
-    String event_date_time = Calendar.get_event_date_time();
-    int year = split_string(event_date_time, '-', index, last_index).toInt();
-    int month = split_string(event_date_time, '-', index, last_index).toInt();
-    int day = split_string(event_date_time, 'T', index, last_index).toInt();
-    int hour = split_string(event_date_time, ':', index, last_index).toInt();
-    int min = split_string(event_date_time, ':', index, last_index).toInt();
-    int sec = split_string(event_date_time, event_date_time.charAt(19), index, last_index).toInt();
-    time_t event_start_time = unix_time(year, month, day, hour, min, sec);
-    //  Change to UTC+0:00 since the unix timestamp already considers the user time zone.
-    Time.zone(+0);
-    Serial.print("\r\nIf the departure time is (current time): ");
-    Serial.println(Time.format(departure_time));
-    Serial.print("Then the estimated arrival time would be: ");
-    Serial.println(Time.format(arrival_time));
-    //  Set the user time zone back.
-    Time.zone(TIME_ZONE);
-    //  Calcualte the time left before the event start in seconds.
-    int32_t time_left = event_start_time - arrival_time;
+    //  has before leaving to get in time to its next event. Driving requests
+    //  searched the latest departure time that arrives on time, with the 
+    //  traffic expected at that time. Transit requests got the scheduled 
+    //  departure of the trip that arrives by the event start. If the time to
+    //  leave is in the past, the user is already late. Offline answers use
+    //  the cached event start and travel duration instead.
+    //  All times are unix timestamps (UTC), printed in the user time zone
+    //  with the UTC offset in effect at each of them.
+    BINLOG_DEBUG("\r\nIf the departure time is: %s",
+                 rfc3339_format(departure_time, utc_offset(TIME_ZONE, departure_time)).c_str());
+    BINLOG_DEBUG("Then the estimated arrival time would be: %s",
+                 rfc3339_format(arrival_time, utc_offset(TIME_ZONE, arrival_time)).c_str());
+    //  Calcualte the time left before the departure in seconds.
+    int32_t time_left = departure_time - Time.now();
     //  If positive, user is still on time. Otherwise, it is late.
     bool on_time = (time_left >= 0);
     time_left = abs(time_left);
@@ -145,53 +201,41 @@ void calc_departure_time(void)
         minutes = 1;
     }
 
-    Serial.print("Based on these times, ");
-    //  Inform the user about the result.
-    //  The play_time() plays time files.
-    //  The naming of these time files match the text context. 
-    //  So the hours/minutes are used directly to play them.
-    //  i.e file name: "002".
-    //      MP3 audio: "two minutes".
+    MP3_Phrase_State state;
     if (on_time)
     {
         if (time_left == 0)
         {
-            Serial.println("you have to leave now to be one time.");
-            play_status_info(MP3_File::NO_TIME_LEFT);
+            BINLOG_INFO("Based on these times, you have to leave now to be one time.\r\n");
+            state = MP3_Phrase_State::NO_TIME_LEFT;
         }
         else
         {
-            Serial.println("you still have time left before depature.");
-            play_status_info(MP3_File::TIME_LEFT);
+            BINLOG_INFO("Based on these times, you still have time left before depature.");
+            state = MP3_Phrase_State::TIME_LEFT;
             if (hours > 0)
             {
-                Serial.print("Hours left: ");
-                Serial.println(hours);
-                play_time(MP3_Folder::HOURS, hours);
+                BINLOG_INFO("Hours left: %u", hours);
             }
-            Serial.print("Minutes left: ");
-            Serial.println(minutes);
-            play_time(MP3_Folder::MINUTES, minutes);
+            BINLOG_INFO("Minutes left: %u\r\n", minutes);
         }
     }
     else
     {
-        Serial.println("you are already late.");
-        play_status_info(MP3_File::LATE);
+        BINLOG_INFO("Based on these times, you are already late.");
+        state = MP3_Phrase_State::LATE;
         if (hours > 0)
         {
-            Serial.print("Hours late: ");
-            Serial.println(hours);
-            play_time(MP3_Folder::HOURS, hours);
+            BINLOG_INFO("Hours late: %u", hours);
         }
-        Serial.print("Minutes late: ");
-        Serial.println(minutes);
-        play_time(MP3_Folder::MINUTES, minutes);
+        BINLOG_INFO("Minutes late: %u\r\n", minutes);
     }
-
-    Serial.print("\r\n");
-    //  Go back to Assitant mode and wait for a new request.
-    change_app_stage_to(App_Stage::ASSISTANT);
+    //  Inform the user about the result.
+    //  The naming of the time files match the text context. 
+    //  So the hours/minutes are used directly to select them.
+    //  i.e file name: "002".
+    //      MP3 audio: "two minutes".
+    play_phrase(make_phrase(state, hours, minutes));
 }
 
 //*****************************************************************************
@@ -208,9 +252,9 @@ void geolocation_loop(void)
 {
     //  Publish the event and wait until the
     //  application-level response handler is called.
-    if (event_state == Event_State::PUBLISHING)
+    if (App.event_state.current() == Event_State::PUBLISHING)
     {
-        Geolocation.publish();
+        App.geolocation.publish();
     }
     print_event_state();
 }
@@ -222,7 +266,22 @@ void geolocation_loop(void)
 //*****************************************************************************
 void geolocation_handler(void)
 {
-    if (!Geolocation.failed())
+    //  A failed revalidation is not an application error,
+    //  the cached location is kept instead.
+    if (App.revalidating)
+    {
+        App.revalidating = false;
+        if (!App.geolocation.failed() && App.geolocation.get_accuracy() < GEOLOC_MINIMUM_ACC)
+        {
+            BINLOG_INFO("\r\nCached location revalidated.\r\n");
+            set_origin(App.geolocation.get_lat(), App.geolocation.get_lng());
+            App.cache.save_location(App.geolocation.get_lat(), App.geolocation.get_lng(), App.geolocation.get_accuracy());
+        }
+        change_app_stage<App_Stage::GEOLOCATION, App_Event::READY>();
+        return;
+    }
+
+    if (!App.geolocation.failed())
     {
         //  The application fails if the estimated location is not
         //  accurate enough. This error can be overlook by incresing
@@ -231,31 +290,46 @@ void geolocation_handler(void)
         //  returned by the Distance Matrix API.
         //  It is better to set the device location manually in the
         //  setup() function.
-        if (Geolocation.get_accuracy() < GEOLOC_MINIMUM_ACC)
-        {
-            Serial.println("\r\nYour device has been located.");
-            Serial.print("Latitud: ");
-            Serial.println(Geolocation.get_lat());
-            Serial.print("Longitud: ");
-            Serial.println(Geolocation.get_lng());
-            Serial.print("Accuracy radius: ");
-            Serial.print(Geolocation.get_accuracy());
-            Serial.println(" meters.\r\n");
+        if (App.geolocation.get_accuracy() < GEOLOC_MINIMUM_ACC)
+        {
+            BINLOG_INFO("\r\nYour device has been located.");
+            BINLOG_INFO("Latitud: %.2f", App.geolocation.get_lat());
+            BINLOG_INFO("Longitud: %.2f", App.geolocation.get_lng());
+            BINLOG_INFO("Accuracy radius: %u meters.\r\n", App.geolocation.get_accuracy());
             //  Device location is set automatically with Geolocation.
-            Distance_Matrix_Event.origin_lat = Geolocation.get_lat();
-            Distance_Matrix_Event.origin_lng = Geolocation.get_lng();
+            set_origin(App.geolocation.get_lat(), App.geolocation.get_lng());
+            App.cache.save_location(App.geolocation.get_lat(), App.geolocation.get_lng(), App.geolocation.get_accuracy());
             //  Change to OAuth2.0 to refresh access token or request
             //  the user code, depending on the current state.
-            change_app_stage_to(App_Stage::OAUTH2);
+            change_app_stage<App_Stage::GEOLOCATION, App_Event::LOCATED>();
         }
         else
         {
-            change_app_stage_to(App_Stage::FAILED);
+            change_app_stage<App_Stage::GEOLOCATION, App_Event::FAIL>();
         } 
     }
     else
     {
-        change_app_stage_to(App_Stage::FAILED);
+        change_app_stage<App_Stage::GEOLOCATION, App_Event::FAIL>();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Sets the device location as origin of the users requests.
+//!
+//!	@param[in] lat Latitude coordinate.
+//!	@param[in] lng Longitude coordinate.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void set_origin(float lat, float lng)
+{
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        App.users[i].distance_matrix_event.origin_lat = lat;
+        App.users[i].distance_matrix_event.origin_lng = lng;
     }
 }
 
@@ -266,161 +340,276 @@ void geolocation_handler(void)
 //
 //! @brief OAuth2.0 main function.
 //!
+//! The users are authorized one after the other, so only one of them is
+//! asked for consent at a time.
+//!
 //! @return None. 
 //
 //*****************************************************************************
 void oauth2_loop(void)
 {
+    User_Context &user = App.users[App.setup_user];
     //  Execute the OAuth2.0 authorization algorithm.
-    //  OAuth2.loop() should run freely without delay
-    //  until the application has been authorized.
-    OAuth2.loop();
-    if (OAuth2.authorized())
+    //  oauth2.loop() should run freely without delay
+    //  until the user has been authorized.
+    user.oauth2.loop();
+    if (user.oauth2.authorized())
     {
-        //  In case that the access token had to be refreshed and the Calendar 
-        //  stage were interrupted, then go back and finish the user request. 
-        //  Otherwise, switch to Assitant mode and wait for a new request.
-        if (last_app_stage == App_Stage::CALENDAR)
+        //  Save the access token so it can be reused after a reset.
+        App.cache.save_token(user.oauth2);
+        App.setup_user++;
+        //  Switch to Assitant mode and wait for a new request
+        //  once all the users have been authorized.
+        if (App.setup_user >= MAX_USERS)
         {
-            change_app_stage_to(App_Stage::CALENDAR);
+            change_app_stage<App_Stage::OAUTH2, App_Event::READY>();
+            //  Only during initialization, inform the user device is ready.    
+            play_status_info(MP3_File::DEVICE_READY);
         }
         else
         {
-            change_app_stage_to(App_Stage::ASSISTANT);
-            //  Only during initialization, inform the user device is ready.    
-            play_status_info(MP3_File::DEVICE_READY);
+            Serial.printlnf("\r\nAuthorizing user: %s", USER_PROFILES[App.setup_user].name);
         }
     }
-    else if (OAuth2.failed())
+    else if (user.oauth2.failed())
     {
-        change_app_stage_to(App_Stage::FAILED);
+        change_app_stage<App_Stage::OAUTH2, App_Event::FAIL>();
     }
 }
 
 //*****************************************************************************
-//  @section Google Calendar API.
+//  @section User request task.
 //*****************************************************************************
 //*****************************************************************************
 //
-//! @brief Calendar main function.
+//! @brief Serves a user request, it is resumed by assistant_loop().
 //!
-//! @return None. 
+//! The request goes through the access token (refreshed if expired), the
+//! Google Calendar and Distance Matrix requests, and the answer, waiting for
+//! the responses without holding the loop. The spoken prompts are played 
+//! while the requests are in flight. A superseded request (new generation)
+//! starts over from the access token, and the task ends as soon as the 
+//! request is answered elsewhere (i.e. from the cache).
+//!
+//! @return DONE once the request is answered or failed, WAITING otherwise.
 //
 //*****************************************************************************
-void calendar_loop(void)
+Task_Status Request_Task::resume(void)
 {
-    //  Publish the event and wait until the
-    //  application-level response handler is called.
-    if (event_state == Event_State::PUBLISHING)
+    User_Context &context = App.users[user];
+    //  The request was answered elsewhere.
+    if (context.task != this)
+    {
+        return Task_Status::DONE;
+    }
+    TASK_BEGIN(line);
+    TASK_AWAIT(line, App.mp3.free());
+    play_request_info(context, MP3_File::REQ_RECEIVED, false);
+    do
+    {
+        generation = context.generation;
+        //  If the access token has expired, refresh the token of this user 
+        //  only, the requests of the other users go on meanwhile.
+        if (!context.oauth2.is_token_valid())
+        {
+            change_request_stage_to(context, Request_Stage::TOKEN);
+            TASK_AWAIT(line, token_refreshed(context));
+            if (context.oauth2.failed())
+            {
+                context.oauth2.print_error();
+                fail_request(context);
+                TASK_RETURN(line);
+            }
+            App.cache.save_token(context.oauth2);
+            change_request_stage_to(context, Request_Stage::CALENDAR);
+        }
+        //  OAuth2 is passed to get the access token.
+        calendar = context.calendar.fetch(context.oauth2, generation);
+        BINLOG_INFO("Calendar event published! (%s)", USER_PROFILES[user].name);
+        context.event_state.dispatch<Event_State::PUBLISHING, Event_Signal::PUBLISHED>();
+        TASK_AWAIT(line, calendar);
+        //  Superseded, the responses of this generation are dropped.
+        if (generation != context.generation)
+        {
+            continue;
+        }
+        if (context.calendar.failed())
+        {
+            context.calendar.print_error();
+            fail_request(context);
+            TASK_RETURN(line);
+        }
+        App.cache.save_calendar(context.calendar);
+        //  Check if the webhook returned any user event/activity/meeting... 
+        if (!context.calendar.is_event_pending())
+        {
+            BINLOG_INFO("\r\nNo pending events!\r\n");
+            context.memo.valid = false;
+            if (context.reconciling)
+            {
+                reconcile_answer(context);
+            }
+            else
+            {
+                count_answer(context);
+                play_status_info(MP3_File::NO_EVENTS);
+            }
+            change_request_stage_to(context, Request_Stage::IDLE);
+            TASK_RETURN(line);
+        }
+        BINLOG_INFO("\r\nThere is an event scheduled on the Google Calendar of %s.", 
+                    USER_PROFILES[user].name);
+        BINLOG_INFO("Location: %s", context.calendar.get_event_location().c_str());
+        BINLOG_INFO("Date and time: %s\r\n", context.calendar.get_event_date_time().c_str());
+        //  The next events of the calendar set, if any.
+        for (uint8_t i = 1; i < context.calendar.get_num_events(); i++)
+        {
+            BINLOG_INFO("Then: %s, %s", context.calendar.get_event_date_time(i).c_str(),
+                        context.calendar.get_event_location(i).c_str());
+        }
+        //  Set the destination (event location).
+        context.distance_matrix_event.destination = context.calendar.get_event_location();
+        //  The travel estimate of the last answer is reused if the 
+        //  next event and the origin did not change.
+        if (answer_from_memo(context, true))
+        {
+            TASK_RETURN(line);
+        }
+        //  Request the travel distance and time to the event location, the 
+        //  latest departure time is searched to arrive by the event start.
+        change_request_stage_to(context, Request_Stage::DISTANCE_MATRIX);
+        distance_matrix = context.distance_matrix.query(context.distance_matrix_event, generation,
+                                                        context.calendar.get_event_start());
+        BINLOG_INFO("Distance matrix event published! (%s)", USER_PROFILES[user].name);
+        context.event_state.dispatch<Event_State::PUBLISHING, Event_Signal::PUBLISHED>();
+        TASK_AWAIT(line, App.mp3.free());
+        play_request_info(context, MP3_File::ESTIMATING_DT, false);
+        TASK_AWAIT(line, when_all(distance_matrix, App.mp3.free()));
+    }
+    while (generation != context.generation);
+    if (context.distance_matrix.failed())
+    {
+        context.distance_matrix.print_error();
+        fail_request(context);
+        TASK_RETURN(line);
+    }
+    BINLOG_INFO("\r\nAccording to the Distance Matrix API, to get to your next event");
+    BINLOG_INFO("Travel distance is: %u miles", context.distance_matrix.get_distance_to_dest());
+    BINLOG_INFO("Travel duration is: %lu sec", (unsigned long)context.distance_matrix.get_duration_to_dest());
+    BINLOG_INFO("Departure search: %u rounds, %u elements", 
+                context.distance_matrix.get_rounds(), context.distance_matrix.get_elements());
+    App.distance_matrix_elements += context.distance_matrix.get_elements();
+    //  Keep the trip, it answers the requests made without the cloud.
+    App.cache.save_travel(user, context.distance_matrix_event.destination, 
+                          context.distance_matrix.get_duration_to_dest());
+    change_request_stage_to(context, Request_Stage::ANSWER);
     {
-        //  If the access token has not expired yet, use the API.
-        //  Otherwise, change stage to OAuth2.0 to refresh token.
-        if (OAuth2.is_token_valid())
+        time_t departure_time = context.distance_matrix.get_leave_time();
+        time_t arrival_time = departure_time + context.distance_matrix.get_duration_to_dest();
+        memo_answer(context, departure_time, arrival_time);
+        if (context.reconciling)
         {
-            //  OAuth2 is passed to get the access token.
-            Calendar.publish(OAuth2);
+            reconcile_answer(context);
         }
         else
         {
-            change_app_stage_to(App_Stage::OAUTH2);
+            count_answer(context);
+            calc_departure_time(departure_time, arrival_time);
         }
     }
-    print_event_state();
+    change_request_stage_to(context, Request_Stage::IDLE);
+    TASK_END(line);
 }
 
 //*****************************************************************************
 //
-//! @brief Calendar application-level response handler.
+//! @brief Refreshes the access token of a user, it is awaited by the request
+//!        task.
+//!
+//!	@param[in] user User whose access token is refreshed.
+//!
+//! @return false while the token is being refreshed, true once authorized or
+//!         failed.
 //
 //*****************************************************************************
-void calendar_handler(void)
+bool token_refreshed(User_Context &user)
 {
-    if (!Calendar.failed())
-    {
-        //  Check if the webhook returned any user event/activity/meeting... 
-        if (Calendar.is_event_pending())
-        {
-            Serial.println("\r\nThere is an event scheduled on your Google Calendar.");
-            Serial.print("Location: ");
-            Serial.println(Calendar.get_event_location());
-            Serial.print("Date and time: ");
-            Serial.println(Calendar.get_event_date_time() + "\r\n");
-            //  Set the destination (event location).
-            Distance_Matrix_Event.destination = Calendar.get_event_location();
-            //  Change to Distance Matrix mode to request 
-            //  the travel distance and time to the event location.
-            change_app_stage_to(App_Stage::DISTANCE_MATRIX);
-            play_status_info(MP3_File::ESTIMATING_DT);
-        }
-        else
-        {
-            Serial.println("\r\nNo pending events!\r\n");
-            //  Go back to Assitant mode and wait for a new user request.
-            change_app_stage_to(App_Stage::ASSISTANT);
-            play_status_info(MP3_File::NO_EVENTS);
-        }
-    }
-    else
-    {
-        change_app_stage_to(App_Stage::FAILED);
-    }
+    user.oauth2.loop();
+    return user.oauth2.authorized() || user.oauth2.failed();
 }
 
 //*****************************************************************************
-//  @section Google Distance Matrix API.
+//  @section Google Assistance (IFTTT event).
 //*****************************************************************************
 //*****************************************************************************
 //
-//! @brief Distance Matrix main function.
+//! @brief Assistant main function.
+//!
+//! It starts the queued requests and resumes the request tasks of all users,
+//! so the cloud round-trips of several users overlap. The answers are played
+//! one at a time, as the MP3 player is shared.
+//!
+//! If the cloud has been lost for OFFLINE_GRACE_TIME, the requests in flight
+//! are answered from the cache instead of waiting for their responses.
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void distance_matrix_loop(void)
+void assistant_loop(void)
 {
-    //  Publish the event and wait until the
-    //  application-level response handler is called.
-    if (event_state == Event_State::PUBLISHING)
+    check_connection();
+    //  The MODE button asks for the first user.
+    if (App.button_pressed.exchange(false))
     {
-        Distance_Matrix.publish(Distance_Matrix_Event);
+        BINLOG_INFO("\r\nButton pressed! (%s)\r\n", USER_PROFILES[0].name);
+        queue_request(0);
     }
-    print_event_state();
-}
-
-//*****************************************************************************
-//
-//! @brief Distance Matrix application-level response handler.
-//
-//*****************************************************************************
-void distance_matrix_handler(void)
-{
-    if (!Distance_Matrix.failed())
+    bool offline = !App.connected && (millis() - App.disconnect_time) >= OFFLINE_GRACE_TIME;
+    //  Start the queued requests of the idle users.
+    while (start_request()) {}
+    int stale = 0;
+    for (uint8_t i = 0; i < MAX_USERS; i++)
     {
-        Serial.println("\r\nAccording to the Distance Matrix API, to get to your next event");
-        Serial.print("Travel distance is: ");
-        Serial.print(Distance_Matrix.get_distance_to_dest());
-        Serial.println(" miles");
-        Serial.print("Travel duration is: ");
-        Serial.print(Distance_Matrix.get_duration_to_dest());
-        Serial.println(" sec");
-        //  Change stage to Data Processing to answer the user request.
-        change_app_stage_to(App_Stage::DATA_PROCESSING);
+        User_Context &user = App.users[i];
+        stale += user.calendar.get_stale_count() + user.distance_matrix.get_stale_count();
+        if (offline && user.stage != Request_Stage::IDLE && user.stage != Request_Stage::ANSWER)
+        {
+            answer_offline(user);
+        }
     }
-    else
+    //  Step the requests of all users.
+    App.requests.loop();
+    bool busy = false;
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        busy = busy || (App.users[i].stage != Request_Stage::IDLE);
+    }
+    //  Update the throughput, requests answered in the last minute.
+    int answers = 0;
+    for (uint8_t i = 0; i < ANSWERS_LOG_SIZE; i++)
+    {
+        if (App.answer_time[i] != 0 && (millis() - App.answer_time[i]) < ANSWERS_WINDOW)
+        {
+            answers++;
+        }
+    }
+    App.answers_per_minute = answers;
+    App.stale_responses = stale;
+    if (!busy && (millis() - App.print_time) >= 1000)
     {
-        change_app_stage_to(App_Stage::FAILED);
+        App.print_time = millis();
+        BINLOG_DEBUG("waiting for a user request...");
     }
 }
 
-//*****************************************************************************
-//  @section Google Assistance (IFTTT event).
-//*****************************************************************************
 //*****************************************************************************
 //
 //! @brief Google Assistance webhook response handler.
 //!
 //! This handler is called by the OS the whenever the user says the Google
-//! Assistance phrased configured in the IFTTT event.
+//! Assistance phrased configured in the IFTTT event. The event data holds 
+//! the name of the user profile; the first user is taken if it is empty or
+//! unknown.
 //!
 //!	@param[in] event Pointer to a char array holidng the webhook event info.
 //!	@param[in] data Pointer to a char array holding the webhook reponse. 
@@ -428,200 +617,887 @@ void distance_matrix_handler(void)
 //*****************************************************************************
 void assistant_handler(const char *event, const char *data)
 {
-    Serial.println("\r\nAssistant event published!\r\n");
-    //  Change stage to Calendar to process the user request.
-    change_app_stage_to(App_Stage::CALENDAR);
-    play_status_info(MP3_File::REQ_RECEIVED);
+    uint8_t user = find_user(data);
+    BINLOG_INFO("\r\nAssistant event published! (%s)\r\n", USER_PROFILES[user].name);
+    queue_request(user);
 }
 
 //*****************************************************************************
-//  @section DFPlayer Mini application fucntions.
+//
+//! @brief Device button handler.
+//!
+//! The MODE button asks for the next event of the first user, so the device
+//! can be asked without the cloud (i.e. the IFTTT applet cannot reach it).
+//! Only single clicks are taken, the others are used by the OS. The request
+//! is queued from assistant_loop(), as the handler can be called from the
+//! system thread.
+//!
+//!	@param[in] event System event (button_click).
+//!	@param[in] param Number of clicks, see system_button_clicks().
+//
 //*****************************************************************************
+void button_handler(system_event_t event, int param)
+{
+    if (system_button_clicks(param) == 1)
+    {
+        App.button_pressed = true;
+    }
+}
+
 //*****************************************************************************
 //
-//! @brief Plays an MP3 file from the STATUS_INFO folder.
+//! @brief Finds a user profile by name.
 //!
-//!	@param[in] mp3_file MP3 file to be played by the DFPlayer Mini.
+//!	@param[in] name Pointer to a char array holding the profile name.
 //!
-//! @return None. 
+//! @return The user index, the first user if the name is empty or unknown.
 //
 //*****************************************************************************
-void play_status_info(MP3_File mp3_file)
+uint8_t find_user(const char *name)
 {
-    //  Convert folder and file to an unsigned 8-bit number.
-    uint8_t folder = enum_to_uint8(MP3_Folder::STATUS_INFO);
-    uint8_t file = enum_to_uint8(mp3_file);
-    MP3.play_folder(folder, file);
-    //  Hold the program until the last play has finished.
-    while (!MP3.free()) {}
+    for (uint8_t i = 0; i < MAX_USERS && name != nullptr; i++)
+    {
+        if (strcmp(name, USER_PROFILES[i].name) == 0)
+        {
+            return i;
+        }
+    }
+    return 0;
 }
 
 //*****************************************************************************
 //
-//! @brief Plays an MP3 file from the HOURS/MINUTES folder.
+//! @brief Tracks the cloud connection.
 //!
-//!	@param[in] mp3_folder Folder where the MP3 file is located.
-//!	@param[in] mp3_file MP3 file to be played by the DFPlayer Mini.
+//! Once the cloud is back, the offline answers are checked against a live 
+//! request. These requests are silent, unless the live answer corrects the
+//! offline one (see reconcile_answer()).
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void play_time(MP3_Folder mp3_folder, uint8_t mp3_file)
+void check_connection(void)
 {
-    //  Convert folder to an unsigned 8-bit number.
-    uint8_t folder = enum_to_uint8(mp3_folder);
-    MP3.play_folder(folder, mp3_file);
-    //  Hold the program until the last play has finished.
-    while (!MP3.free()) {}
+    bool connected = Cloud.connected();
+    if (connected == App.connected)
+    {
+        return;
+    }
+    App.connected = connected;
+    if (!connected)
+    {
+        App.disconnect_time = millis();
+        BINLOG_INFO("\r\nCloud connection lost.");
+        return;
+    }
+    BINLOG_INFO("\r\nCloud connection restored.");
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        User_Context &user = App.users[i];
+        bool queued = false;
+        for (uint8_t j = 0; j < App.queue_length; j++)
+        {
+            queued = queued || (App.queue[j] == i);
+        }
+        if (user.offline_answer && user.stage == Request_Stage::IDLE && !queued)
+        {
+            queue_request(i);
+            user.reconciling = true;
+        }
+    }
 }
 
 //*****************************************************************************
 //
-//! @brief Initilizes the MP3 player and internal interfaces (UART1).
+//! @brief Answers a user request from the cache.
+//!
+//! The last calendar snapshot and the last known travel duration to the 
+//! event location (or the average of the last trips) are used, so no network
+//! is needed. The request in flight, if any, is cancelled and the answer is 
+//! preceded by a spoken caveat.
+//!
+//!	@param[in] user User whose request is answered.
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void init_mp3_player(void)
+void answer_offline(User_Context &user)
 {
-    //  Initialize the UART1 to 9600 bps.
-    Serial1.begin(9600);
-    //  Initialize the DFPlayer Mini. 
-    //  It checks communication and SD card status. 
-    if (!MP3.begin())
+    //  Drop the responses of the request in flight, if any.
+    next_generation(user);
+    user.calendar.cancel(user.generation);
+    user.distance_matrix.cancel(user.generation);
+    //  A live check is not answered, it is tried again once the cloud is back.
+    if (user.reconciling)
     {
-        while (1)
+        user.reconciling = false;
+        change_request_stage_to(user, Request_Stage::IDLE);
+        return;
+    }
+    BINLOG_INFO("\r\nCloud not connected, answering %s from the cache.", USER_PROFILES[user.user].name);
+    if (!App.cache.restore_calendar(user.calendar, OFFLINE_CALENDAR_MAX_AGE))
+    {
+        BINLOG_ERROR("Error: No recent calendar snapshot.");
+        fail_request(user);
+        return;
+    }
+    time_t departure_time = 0, arrival_time = 0;
+    if (user.calendar.is_event_pending())
+    {
+        uint32_t duration;
+        bool historical;
+        if (!App.cache.restore_travel(user.user, user.calendar.get_event_location(), duration, historical))
         {
-            Serial.println("\r\nError: MP3 palyer unable to begin.");
-            Serial.println("Please check your connections and make sure that the micro SD card is inserted!");
-            delay(1000);
+            BINLOG_ERROR("Error: No travel duration known.");
+            fail_request(user);
+            return;
         }
+        BINLOG_INFO("Location: %s", user.calendar.get_event_location().c_str());
+        BINLOG_INFO("Date and time: %s", user.calendar.get_event_date_time().c_str());
+        BINLOG_INFO("Travel duration is: %lu sec (%s)", (unsigned long)duration,
+                    historical ? "average trip" : "last trip");
+        arrival_time = user.calendar.get_event_start();
+        departure_time = arrival_time - duration;
+    }
+    user.offline_leave_time = departure_time;
+    count_answer(user, Answer_Source::CACHED);
+    //  Tell the user that the answer may be outdated.
+    play_status_info(MP3_File::OFFLINE_ANSWER);
+    if (departure_time != 0)
+    {
+        calc_departure_time(departure_time, arrival_time);
     }
     else
     {
-        Serial.println("\r\nMP3 player online!\r\n");
-        //  Set MP3 volume at 20 (from 0-30)
-        MP3.volume(20);
+        BINLOG_INFO("\r\nNo pending events!\r\n");
+        play_status_info(MP3_File::NO_EVENTS);
     }
+    change_request_stage_to(user, Request_Stage::IDLE);
 }
 
-//*****************************************************************************
-//  @section General application functions.
-//*****************************************************************************
 //*****************************************************************************
 //
-//! @brief Changes the current stage of the application and subscribes the 
-//!        webhook reponse handlers, if necessary.
+//! @brief Checks an offline answer against the live one.
+//!
+//! The live answer is only played if it corrects the offline one, that is,
+//! if the departure times differ by RECONCILE_TOLERANCE or more, or one of
+//! them found no pending events.
 //!
-//!	@param[in] new_stage Stage at which the application is set.
+//!	@param[in] user User whose offline answer is checked.
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void change_app_stage_to(App_Stage new_stage)
+void reconcile_answer(User_Context &user)
 {
-    //  Save the previous application stage in case of a failure.
-    last_app_stage = app_stage;
-    app_stage = new_stage;
-    //  If the application stage changes, it is assumed 
-    //  that the previous event has been completed.
-    event_state = Event_State::COMPLETED;     
-    //  Unsubsribe all passed events to make space for new ones.
-    Particle.unsubscribe();
-    //  Event handlers have to be subscribed multiple times since
-    //  they are removed between intermediate stages. This is
-    //  because the Argon OS does not support more than four
-    //  handlers subscribed at the same time.
-    //  IMPORTANT: OS handlers are the ones subscribed with the
-    //  Particle.subscribe() function which are called within 
-    //  the Google classes.
-    if (new_stage == App_Stage::ASSISTANT)
+    time_t departure_time = user.calendar.is_event_pending() ? user.distance_matrix.get_leave_time() : 0;
+    int32_t difference = departure_time - user.offline_leave_time;
+    bool corrected = ((departure_time == 0) != (user.offline_leave_time == 0)) || 
+                     (abs(difference) >= RECONCILE_TOLERANCE);
+    BINLOG_INFO("Offline answer of %s %s in %lu ms.", USER_PROFILES[user.user].name,
+                corrected ? "corrected" : "confirmed", (unsigned long)(millis() - user.request_time));
+    user.reconciling = false;
+    user.offline_answer = false;
+    if (!corrected)
+    {
+        return;
+    }
+    App.corrected_answers++;
+    if (departure_time != 0)
+    {
+        calc_departure_time(departure_time, departure_time + user.distance_matrix.get_duration_to_dest());
+    }
+    else
     {
-        Particle.subscribe("google_assistant", assistant_handler, MY_DEVICES);
+        play_status_info(MP3_File::NO_EVENTS);
     }
-    else if (new_stage == App_Stage::CALENDAR)
+}
+
+//*****************************************************************************
+//
+//! @brief Builds the answer memo key of the current state of a user.
+//!
+//!	@param[in] user User whose key is built, from the next event of its
+//!                 last calendar request.
+//!
+//! @return An answer memo with the key set, no answer.
+//
+//*****************************************************************************
+Answer_Memo memo_key(User_Context &user)
+{
+    Answer_Memo key;
+    memset(&key, 0, sizeof(key));
+    key.event_key = string_hash(user.calendar.get_event_location().c_str(),
+                                string_hash(user.calendar.get_event_date_time().c_str()));
+    key.origin_cell_lat = (int32_t)floorf(user.distance_matrix_event.origin_lat / ANSWER_MEMO_CELL);
+    key.origin_cell_lng = (int32_t)floorf(user.distance_matrix_event.origin_lng / ANSWER_MEMO_CELL);
+    key.travel_mode = user.distance_matrix_event.travel_mode;
+    key.bucket = Time.now() / ANSWER_MEMO_BUCKET;
+    return key;
+}
+
+//*****************************************************************************
+//
+//! @brief Keeps a departure answer in the answer memo of a user.
+//!
+//!	@param[in] user User whose answer is kept.
+//!	@param[in] departure_time Time to leave as a unix timestamp (UTC).
+//!	@param[in] arrival_time Estimated arrival time as a unix timestamp (UTC).
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void memo_answer(User_Context &user, time_t departure_time, time_t arrival_time)
+{
+    user.memo = memo_key(user);
+    user.memo.departure_time = departure_time;
+    user.memo.arrival_time = arrival_time;
+    user.memo.answer_time = millis();
+    user.memo.valid = true;
+}
+
+//*****************************************************************************
+//
+//! @brief Answers a user request from the answer memo.
+//!
+//! Within ANSWER_MEMO_TTL, the last answer is replayed without any request
+//! (whole answer). After it, the calendar is refreshed first and the travel
+//! estimate is reused while the key matches (same next event, origin cell,
+//! travel mode and time bucket). The time left is recomputed from the kept
+//! departure time, so the answer is always current.
+//!
+//!	@param[in] user User whose request is answered.
+//!	@param[in] refreshed Set if the calendar was just refreshed.
+//!
+//! @return false if the answer memo does not match, true if answered.
+//
+//*****************************************************************************
+bool answer_from_memo(User_Context &user, bool refreshed)
+{
+    Answer_Memo &memo = user.memo;
+    //  A live check is never answered from the memo.
+    if (!memo.valid || user.reconciling)
     {
-        Calendar.subscribe(calendar_handler);
+        return false;
     }
-    else if (new_stage == App_Stage::GEOLOCATION)
+    if (!refreshed && (millis() - memo.answer_time) >= ANSWER_MEMO_TTL)
     {
-        Geolocation.subscribe(geolocation_handler);
+        return false;
     }
-    else if (new_stage == App_Stage::DISTANCE_MATRIX)
+    Answer_Memo key = memo_key(user);
+    if (key.event_key != memo.event_key || key.origin_cell_lat != memo.origin_cell_lat ||
+        key.origin_cell_lng != memo.origin_cell_lng || key.travel_mode != memo.travel_mode ||
+        key.bucket != memo.bucket)
     {
-        Distance_Matrix.subscribe(Distance_Matrix_Event, distance_matrix_handler);
+        return false;
     }
-    else if (new_stage == App_Stage::FAILED)
+    BINLOG_INFO("\r\nAnswering %s from the answer memo (%s).", USER_PROFILES[user.user].name,
+                refreshed ? "calendar refreshed" : "whole answer");
+    //  The calendar confirmed the answer, it is replayed whole again.
+    if (refreshed)
     {
-        //  In case of failure, inform the user.
-        play_status_info(MP3_File::APP_FAILED);
+        memo.answer_time = millis();
     }
+    count_answer(user, Answer_Source::MEMO);
+    calc_departure_time(memo.departure_time, memo.arrival_time);
+    change_request_stage_to(user, Request_Stage::IDLE);
+    return true;
 }
 
 //*****************************************************************************
 //
-//! @brief Prints general information about the current state and updates it, 
-//!        if necessary.
+//! @brief Adds a user request to the request queue.
+//!
+//! A user already queued keeps its place, so repeated requests are coalesced
+//! into one. A repeated request of a user being served is coalesced onto the
+//! request in flight, unless it arrives after COALESCE_WINDOW while waiting
+//! for a Google API. Then, the request is restarted with a new generation and 
+//! the responses of the superseded one are dropped by the parsers.
+//!
+//!	@param[in] user Index of the user who made the request.
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void print_event_state(void)
+void queue_request(uint8_t user)
 {
-    if (event_state == Event_State::PUBLISHING)
+    User_Context &context = App.users[user];
+    //  A request of the user is answered aloud, even onto a live check.
+    context.reconciling = false;
+    if (context.stage != Request_Stage::IDLE)
     {
-        switch (app_stage)
+        //  Only the requests waiting for a Google API can be restarted.
+        bool in_flight = (context.stage == Request_Stage::CALENDAR ||
+                          context.stage == Request_Stage::DISTANCE_MATRIX);
+        if (!in_flight || (millis() - context.request_time) < COALESCE_WINDOW)
         {
-        case App_Stage::GEOLOCATION:
-            Serial.println("\r\nGeolocation event published!");
-            break;
-
-        case App_Stage::CALENDAR:
-            Serial.println("Calendar event published!");
-            break;
-
-        case App_Stage::DISTANCE_MATRIX:
-            Serial.println("Distance matrix event published!");
-            break;
-
-        default:
-            break;
+            App.coalesced_requests++;
+            return;
         }
-        event_state = Event_State::WAIT_FOR_RESPONSE;
+        BINLOG_INFO("Request of %s superseded.", USER_PROFILES[user].name);
+        App.superseded_requests++;
+        context.request_time = millis();
+        next_generation(context);
+        //  The request task is no longer waiting for the superseded request.
+        context.calendar.cancel(context.generation);
+        context.distance_matrix.cancel(context.generation);
+        change_request_stage_to(context, Request_Stage::CALENDAR);
+        return;
+    }
+    for (uint8_t i = 0; i < App.queue_length; i++)
+    {
+        if (App.queue[i] == user)
+        {
+            App.coalesced_requests++;
+            return;
+        }
+    }
+    App.queue[App.queue_length++] = user;
+}
+
+//*****************************************************************************
+//
+//! @brief Starts the request at the head of the request queue.
+//!
+//! @return false if the queue is empty, true if a request was started.
+//
+//*****************************************************************************
+bool start_request(void)
+{
+    if (App.queue_length == 0)
+    {
+        return false;
+    }
+    User_Context &user = App.users[App.queue[0]];
+    App.queue_length--;
+    memmove(&App.queue[0], &App.queue[1], App.queue_length);
+    user.request_time = millis();
+    user.log_cycles = Binlog.get_cycles();
+    //  A repeated request is answered right away from the answer memo.
+    if (answer_from_memo(user, false))
+    {
+        return true;
     }
-    else if (event_state == Event_State::WAIT_FOR_RESPONSE)
+    //  Without the cloud, the request is answered right away from the cache.
+    if (!App.connected)
     {
-        Serial.println("waiting for a response...");
-        delay(1000);
+        answer_offline(user);
+        return true;
     }
-    //  If event completed, switch to publishing 
-    //  to enable a new event to be published. 
-    else if (event_state == Event_State::COMPLETED)
+    next_generation(user);
+    change_request_stage_to(user, Request_Stage::CALENDAR);
+    //  The request is served by its own task (Request_Task::resume()).
+    user.task = App.requests.spawn(user.user);
+    if (user.task == nullptr)
     {
-        event_state = Event_State::PUBLISHING;
+        fail_request(user);
     }
+    return true;
 }
 
 //*****************************************************************************
 //
-//! @brief Prints the application error caused by the last stage. Most of this
-//!        errors occur when the Google APIs return an HTTP status codes 
-//!        different than 200.
+//! @brief Changes the request stage of a user.
+//!
+//!	@param[in] user User whose request changes stage.
+//!	@param[in] new_stage Stage at which the request is set.
 //!
 //! @return None. 
 //
 //*****************************************************************************
-void print_app_error(void)
+void change_request_stage_to(User_Context &user, Request_Stage new_stage)
 {
-    switch (last_app_stage)
+    Trace.record(Trace_Type::REQUEST_STAGE, user.user, static_cast<uint16_t>(new_stage));
+    //  Cycles spent logging by the request, running average with 1/4 weight 
+    //  for the last request. The records of the other users in flight are
+    //  included.
+    if (new_stage == Request_Stage::IDLE && user.stage != Request_Stage::IDLE)
     {
-        case App_Stage::GEOLOCATION:
-            //  Two actions can cause a faliure at this stage:
-            //  1. Google Geolocation API returns 
+        uint32_t cycles = Binlog.get_cycles() - user.log_cycles;
+        App.log_cycles = (App.log_cycles == 0) ? cycles : ((3 * App.log_cycles + cycles) / 4);
+    }
+    user.stage = new_stage;
+    user.event_state.dispatch(Event_Signal::START);
+    //  The request task ends once the request is answered.
+    if (new_stage == Request_Stage::IDLE)
+    {
+        user.task = nullptr;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Starts a new request generation of a user.
+//!
+//! The generation goes from 1 to 255 and wraps around, 0 is not used as it
+//! means untagged.
+//!
+//!	@param[in] user User who starts a new request.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void next_generation(User_Context &user)
+{
+    user.generation = (user.generation == 255) ? 1 : (user.generation + 1);
+}
+
+//*****************************************************************************
+//
+//! @brief Ends a user request that failed.
+//!
+//! The failure only affects the request of this user, the device keeps
+//! answering the requests of all users.
+//!
+//!	@param[in] user User whose request failed.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void fail_request(User_Context &user)
+{
+    BINLOG_ERROR("Error: Request of %s failed.", USER_PROFILES[user.user].name);
+    change_request_stage_to(user, Request_Stage::IDLE);
+    //  A failed live check is tried again once the cloud is back.
+    play_request_info(user, MP3_File::APP_FAILED);
+    user.reconciling = false;
+}
+
+//*****************************************************************************
+//
+//! @brief Counts an answered user request.
+//!
+//! The request is answered once the answer is known, before it is played.
+//! The latency of the live answers and the answer memo ones is kept in
+//! separate histograms.
+//!
+//!	@param[in] user User whose request was answered.
+//!	@param[in] source Source of the answer: the Google APIs (live), the 
+//!                   cache (offline answer) or the answer memo.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void count_answer(User_Context &user, Answer_Source source)
+{
+    uint32_t latency = millis() - user.request_time;
+    App.answer_time[App.answer_index] = millis();
+    App.answer_index = (App.answer_index + 1) % ANSWERS_LOG_SIZE;
+    if (source == Answer_Source::CACHED)
+    {
+        App.cached_answers++;
+    }
+    else
+    {
+        if (source == Answer_Source::LIVE)
+        {
+            App.live_answers++;
+        }
+        uint16_t *histogram = (source == Answer_Source::MEMO) ? App.memo_hit_latency : App.memo_miss_latency;
+        uint8_t bucket = 0;
+        for (uint32_t bound = LATENCY_FIRST_BUCKET; bucket < (LATENCY_BUCKETS - 1) && latency >= bound; bound *= 2)
+        {
+            bucket++;
+        }
+        histogram[bucket]++;
+    }
+    //  A live answer supersedes the offline one, no check is needed.
+    user.offline_answer = (source == Answer_Source::CACHED);
+    const char *source_name[] = {"live", "cached", "memo"};
+    BINLOG_INFO("Request of %s answered in %lu ms (%s).", USER_PROFILES[user.user].name,
+                (unsigned long)latency, source_name[static_cast<uint8_t>(source)]);
+}
+
+//*****************************************************************************
+//  @section DFPlayer Mini application fucntions.
+//*****************************************************************************
+//*****************************************************************************
+//
+//! @brief Decodes the frames sent by the DFPlayer Mini and prints the errors.
+//!
+//! The end of a play is waited for by play_status_info() and play_phrase().
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void mp3_loop(void)
+{
+    App.mp3.loop();
+    MP3_Event event;
+    while (App.mp3.get_event(event))
+    {
+        if (event.type == MP3_Event_Type::ERROR)
+        {
+            BINLOG_ERROR("Error: MP3 player error code %u.", event.param);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Plays an MP3 file from the STATUS_INFO folder.
+//!
+//!	@param[in] mp3_file MP3 file to be played by the DFPlayer Mini.
+//!	@param[in] wait If set, the program is held until the play has finished.
+//!                 Otherwise, the end of the play is awaited by the caller
+//!                 (see DFPlayer_MP3::free()).
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void play_status_info(MP3_File mp3_file, bool wait)
+{
+    //  A prompt of a request task might be playing.
+    while (!App.mp3.free()) {}
+    //  The frame to play the file was formed at compile time.
+    App.mp3.send_frame(status_info_frame(mp3_file));
+    //  Hold the program until the last play has finished.
+    while (wait && !App.mp3.free()) {}
+}
+
+//*****************************************************************************
+//
+//! @brief Plays an MP3 file from the STATUS_INFO folder about a user request.
+//!
+//! Nothing is played during the live check of an offline answer.
+//!
+//!	@param[in] user User whose request is being served.
+//!	@param[in] mp3_file MP3 file to be played by the DFPlayer Mini.
+//!	@param[in] wait If set, the program is held until the play has finished.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void play_request_info(User_Context &user, MP3_File mp3_file, bool wait)
+{
+    if (!user.reconciling)
+    {
+        play_status_info(mp3_file, wait);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Plays a phrase program.
+//!
+//!	@param[in] phrase Sequence of frames to be sent to the DFPlayer Mini.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void play_phrase(const MP3_Phrase &phrase)
+{
+    //  A prompt of a request task might be playing.
+    while (!App.mp3.free()) {}
+    for (uint8_t i = 0; i < phrase.length; i++)
+    {
+        App.mp3.send_frame(*phrase.frame[i]);
+        //  Hold the program until the last play has finished.
+        while (!App.mp3.free()) {}
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Initilizes the MP3 player and internal interfaces (UART1).
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void init_mp3_player(void)
+{
+    //  Initialize the UART1 to 9600 bps.
+    Serial1.begin(9600);
+    //  Initialize the DFPlayer Mini. 
+    //  It checks communication and SD card status. 
+    uint32_t start = millis();
+    if (!App.mp3.begin())
+    {
+        while (1)
+        {
+            Serial.println("\r\nError: MP3 palyer unable to begin.");
+            Serial.println("Please check your connections and make sure that the micro SD card is inserted!");
+            delay(1000);
+        }
+    }
+    else
+    {
+        Serial.printlnf("\r\nMP3 player online! (%lu ms)\r\n", (unsigned long)(millis() - start));
+        //  Set MP3 volume at 20 (from 0-30)
+        App.mp3.volume(20);
+    }
+}
+
+//*****************************************************************************
+//  @section General application functions.
+//*****************************************************************************
+//*****************************************************************************
+//
+//! @brief Changes the current stage of the application.
+//!
+//! The next stage is given by the transition table (App_Stage_Machine). The
+//! event is ignored if it is not accepted in the current stage.
+//!
+//!	@param[in] event Event that changes the stage.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void change_app_stage(App_Event event)
+{
+    if (App.stage.dispatch(event))
+    {
+        enter_app_stage();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Runs the entry actions of the application stage just entered.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void enter_app_stage(void)
+{
+    //  If the application stage changes, it is assumed 
+    //  that the previous event has been completed.
+    App.event_state.dispatch(Event_Signal::COMPLETE);
+    App_Stage new_stage = App.stage.current();
+    if (new_stage == App_Stage::ASSISTANT)
+    {
+        //  Report the time-to-ready only the first time.
+        if (App.ready_time == 0)
+        {
+            App.ready_time = millis();
+            BINLOG_INFO("\r\nTime to ready: %d ms after reset.\r\n", App.ready_time);
+        }
+    }
+    else if (new_stage == App_Stage::OAUTH2)
+    {
+        Serial.printlnf("\r\nAuthorizing user: %s", USER_PROFILES[App.setup_user].name);
+    }
+    else if (new_stage == App_Stage::FAILED)
+    {
+        //  In case of failure, inform the user.
+        play_status_info(MP3_File::APP_FAILED);
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Subscribes the application-level and webhook reponse handlers.
+//!
+//! All the webhook responses are received through a single subscription of
+//! the webhook cloud, so the handlers stay subscribed in every stage. The
+//! assistant event goes through the webhook cloud as well, so every cloud
+//! handler is called from loop().
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void subscribe_handlers(void)
+{
+    Cloud.begin();
+    Cloud.subscribe("google_assistant", assistant_handler);
+    System.on(button_click, button_handler);
+    App.geolocation.subscribe(geolocation_handler);
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        User_Context &user = App.users[i];
+        //  The responses are awaited by the request tasks.
+        user.calendar.subscribe();
+        user.distance_matrix.subscribe(user.distance_matrix_event);
+        user.oauth2.subscribe();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the publish statistics of the webhook cloud, it is called by
+//!        the OS when the "publish_stats" cloud variable is requested.
+//!
+//! @return A string object with the publish statistics.
+//
+//*****************************************************************************
+String publish_stats(void)
+{
+    return Cloud.get_publish_stats();
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the fetch statistics of the calendars of every user, it is 
+//!        called by the OS when the "calendar_stats" cloud variable is 
+//!        requested.
+//!
+//! @return A string object with the fetch statistics per user.
+//
+//*****************************************************************************
+String calendar_stats(void)
+{
+    String stats;
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        if (i > 0)
+        {
+            stats += "; ";
+        }
+        stats += String(USER_PROFILES[i].name) + ": " + App.users[i].calendar.get_fetch_stats();
+    }
+    return stats;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the answer latency histograms, it is called by the OS when the
+//!        "answer_latency" cloud variable is requested.
+//!
+//! @return A string object with the answers per latency bucket, for the 
+//!         answer memo hits and misses. i.e. hits: 3,1,0,0,0,0,0,0; ...
+//
+//*****************************************************************************
+String answer_latency(void)
+{
+    String hits = "hits: ", misses = "; misses: ";
+    for (uint8_t i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        hits += String(App.memo_hit_latency[i]) + ((i < LATENCY_BUCKETS - 1) ? "," : "");
+        misses += String(App.memo_miss_latency[i]) + ((i < LATENCY_BUCKETS - 1) ? "," : "");
+    }
+    return hits + misses;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the log statistics, it is called by the OS when the 
+//!        "log_stats" cloud variable is requested.
+//!
+//! @return A string object with the log statistics and the cycles spent
+//!         logging per request (running average).
+//
+//*****************************************************************************
+String log_stats(void)
+{
+    return Binlog.get_stats() + String::format(", cycles per request: %lu", (unsigned long)App.log_cycles);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the dwell time statistics of the state machines, it is called
+//!        by the OS when the "state_dwell" cloud variable is requested.
+//!
+//! @return A string object with the entries, average and max. time in
+//!         milliseconds of each state, for the application stages and event
+//!         states, and per user for the event and OAuth2.0 states.
+//!         i.e. app: 1/3200/3200,...; events: ...; Ronald: ... | ...
+//
+//*****************************************************************************
+String state_dwell(void)
+{
+    String dwell = "app: " + App.stage.get_stats() + "; events: " + App.event_state.get_stats();
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        User_Context &user = App.users[i];
+        dwell += String::format("; %s: ", USER_PROFILES[i].name) + user.event_state.get_stats() +
+                 " | " + user.oauth2.get_state_stats();
+    }
+    return dwell;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the request task statistics, it is called by the OS when the
+//!        "task_stats" cloud variable is requested.
+//!
+//! @return A string object with the task pool statistics.
+//
+//*****************************************************************************
+String task_stats(void)
+{
+    return App.requests.get_stats();
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the webhook client statistics, it is called by the OS when the
+//!        "webhook_stats" cloud variable is requested.
+//!
+//! @return A string object with the requests, failures and response time of
+//!         the Geolocation API, and per user of the Calendar, Distance Matrix
+//!         and OAuth2.0 APIs. i.e. geo: 1 req, 0 failed, 910/910 ms; ...
+//
+//*****************************************************************************
+String webhook_stats(void)
+{
+    String stats = "geo: " + App.geolocation.get_client_stats();
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        User_Context &user = App.users[i];
+        stats += String::format("; %s: cal: ", USER_PROFILES[i].name) + user.calendar.get_client_stats() +
+                 " | dm: " + user.distance_matrix.get_client_stats() + " | oauth: " + user.oauth2.get_client_stats();
+    }
+    return stats;
+}
+
+//*****************************************************************************
+//
+//! @brief Prints general information about the current state and updates it, 
+//!        if necessary.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void print_event_state(void)
+{
+    switch (App.event_state.current())
+    {
+        case Event_State::PUBLISHING:
+            if (App.stage.current() == App_Stage::GEOLOCATION)
+            {
+                BINLOG_INFO("\r\nGeolocation event published!");
+            }
+            App.event_state.dispatch<Event_State::PUBLISHING, Event_Signal::PUBLISHED>();
+            break;
+
+        //  The loop is not held while waiting, so the 
+        //  requests of the users can go on.
+        case Event_State::WAIT_FOR_RESPONSE:
+            if ((millis() - App.print_time) >= 1000)
+            {
+                App.print_time = millis();
+                BINLOG_DEBUG("waiting for a response...");
+            }
+            break;
+
+        //  If event completed, switch to publishing 
+        //  to enable a new event to be published. 
+        case Event_State::COMPLETED:
+            App.event_state.dispatch<Event_State::COMPLETED, Event_Signal::START>();
+            break;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Prints the application error caused by the last stage. Most of this
+//!        errors occur when the Google APIs return an HTTP status codes 
+//!        different than 200.
+//!
+//! @return None. 
+//
+//*****************************************************************************
+void print_app_error(void)
+{
+    switch (App.stage.previous())
+    {
+        case App_Stage::GEOLOCATION:
+            //  Two actions can cause a faliure at this stage:
+            //  1. Google Geolocation API returns 
             //     an unexpected HTTP status code. 
-            if (Geolocation.failed())
+            if (App.geolocation.failed())
             {
-                Geolocation.print_error();
+                App.geolocation.print_error();
             }
             //  2. An inaccurate estimated location.
             else
@@ -631,21 +1507,13 @@ void print_app_error(void)
                 Serial.print(GEOLOC_MINIMUM_ACC);
                 Serial.println(" meters.");
                 Serial.print("Resulting accuracy: ");
-                Serial.print(Geolocation.get_accuracy());
+                Serial.print(App.geolocation.get_accuracy());
                 Serial.println(" meters.");
             }
             break;
 
         case App_Stage::OAUTH2:
-            OAuth2.print_error();
-            break;
-
-        case App_Stage::CALENDAR:
-            Calendar.print_error();
-            break;
-
-        case App_Stage::DISTANCE_MATRIX:
-            Distance_Matrix.print_error();
+            App.users[App.setup_user].oauth2.print_error();
             break;
 
         default:
@@ -653,3 +1521,140 @@ void print_app_error(void)
     }
     delay(1000);
 }
+
+//*****************************************************************************
+//
+//! @brief Restores the data cached before the last reset.
+//!
+//! The last known location and access tokens are reused if they are still 
+//! valid, so the Geolocation and OAuth2.0 stages can be skipped. The cached 
+//! location is revalidated later in the background.
+//!
+//! @return The event that starts the application: START (Geolocation),
+//!         LOCATED (OAuth2.0) or READY (Assistant).
+//
+//*****************************************************************************
+App_Event warm_boot(void)
+{
+#ifdef GEOLOC_ENABLED
+    App_Event first_event = App_Event::START;
+#else
+    App_Event first_event = App_Event::LOCATED;
+#endif
+    //  Nothing can be reused after a power loss.
+    if (!App.cache.begin())
+    {
+        return first_event;
+    }
+#ifdef GEOLOC_ENABLED
+    float lat, lng;
+    if (App.cache.restore_location(lat, lng))
+    {
+        Serial.println("Cached location restored.");
+        set_origin(lat, lng);
+        App.revalidating = true;
+        first_event = App_Event::LOCATED;
+    }
+#endif
+    //  The access tokens are only reused if the location is known,
+    //  and the OAuth2.0 stage is skipped if all of them are restored.
+    if (first_event != App_Event::LOCATED)
+    {
+        return first_event;
+    }
+    bool restored = true;
+    for (uint8_t i = 0; i < MAX_USERS; i++)
+    {
+        User_Context &user = App.users[i];
+        if (App.cache.restore_token(user.oauth2))
+        {
+            Serial.printlnf("Cached access token restored. (%s)", USER_PROFILES[i].name);
+            App.cache.restore_calendar(user.calendar);
+        }
+        else
+        {
+            restored = false;
+        }
+    }
+    if (restored)
+    {
+        first_event = App_Event::READY;
+    }
+    return first_event;
+}
+
+//*****************************************************************************
+//
+//! @brief Runs the serial commands.
+//!
+//! The commands are read from the serial port, one per line:
+//!     ask [user]      Asks for the next event of a user (first by default),
+//!                     it is answered from the cache without the cloud.
+//!     dump            Prints the recorded webhook traffic.
+//!     clear           Clears the recorded webhook traffic.
+//!     replay [scale]  Replays the recorded responses instead of publishing,
+//!                     with the latency scaled in percent (100 by default).
+//!     stop            Stops the replay.
+//!     trace           Prints the flight recorder ring.
+//!     trace clear     Clears the flight recorder ring.
+//!
+//! The webhook recorder and flight recorder commands do nothing if they are
+//! disabled.
+//!
+//! @return None.
+//
+//*****************************************************************************
+void serial_loop(void)
+{
+    static String command;
+    while (Serial.available() > 0)
+    {
+        char c = Serial.read();
+        if (c != '\r' && c != '\n')
+        {
+            command += c;
+            continue;
+        }
+        command.trim();
+        if (command.startsWith("ask"))
+        {
+            String name = command.substring(3);
+            name.trim();
+            uint8_t user = find_user(name.c_str());
+            BINLOG_INFO("\r\nSerial request! (%s)\r\n", USER_PROFILES[user].name);
+            queue_request(user);
+        }
+        else if (command.equals("dump"))
+        {
+            Recorder.dump();
+        }
+        else if (command.equals("clear"))
+        {
+            Recorder.clear();
+            Serial.println("Recorder log cleared.");
+        }
+        else if (command.startsWith("replay"))
+        {
+            String scale = command.substring(6);
+            scale.trim();
+            Recorder.start_replay((scale.length() > 0) ? scale.toInt() : 100);
+            Serial.println(Recorder.replaying() ? "Replay started." : "Nothing to replay.");
+        }
+        else if (command.equals("stop"))
+        {
+            Recorder.stop_replay();
+            Serial.println("Replay stopped.");
+        }
+        else if (command.equals("trace"))
+        {
+            Trace.dump();
+        }
+        else if (command.equals("trace clear"))
+        {
+            Trace.clear();
+            Serial.println("Trace cleared.");
+        }
+        command = "";
+    }
+    Recorder.loop();
+}
@@ -0,0 +1,136 @@
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+#include <atomic>
+
+//*****************************************************************************
+//
+//! @brief Single-producer/single-consumer ring class.
+//!
+//! This class passes fixed-size records from one thread to another without
+//! locks (i.e. from the system thread to the application thread). The
+//! producer fills the next free slot in place and commits it, the consumer
+//! reads the oldest slot in place and releases it, so a record is copied
+//! only once. The head is only written by the producer and the tail by the
+//! consumer; the release/acquire pairs make the slot content visible before
+//! its index.
+//!
+//! The indexes run free and wrap around at 256, so the number of slots must
+//! be a power of two up to 128.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+class SPSC_Ring
+{
+    static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "The ring size must be a power of two up to 128.");
+
+    private:
+        //  Slots, index of the next slot to be committed (head) and index
+        //  of the oldest slot committed (tail).
+        T slots[N];
+        std::atomic<uint8_t> head;
+        std::atomic<uint8_t> tail;
+
+    public:
+        //  Class constructor.
+        SPSC_Ring();
+
+        //  Producer member functions.
+        T *claim(void);
+        void commit(void);
+
+        //  Consumer member functions.
+        T *front(void);
+        void pop(void);
+
+        //  Either side.
+        uint8_t size(void) const;
+};
+
+//*****************************************************************************
+//
+//! @brief Single-producer/single-consumer ring class constructor.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+SPSC_Ring<T, N>::SPSC_Ring()
+    : head(0), tail(0)
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the next free slot, to be filled by the producer.
+//!
+//!	@return A pointer to the slot, nullptr if the ring is full.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+T *SPSC_Ring<T, N>::claim(void)
+{
+    uint8_t index = head.load(std::memory_order_relaxed);
+    if ((uint8_t)(index - tail.load(std::memory_order_acquire)) >= N)
+    {
+        return nullptr;
+    }
+    return &slots[index % N];
+}
+
+//*****************************************************************************
+//
+//! @brief Passes the slot claimed by the producer to the consumer.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+void SPSC_Ring<T, N>::commit(void)
+{
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the oldest slot committed, to be read by the consumer.
+//!
+//!	@return A pointer to the slot, nullptr if the ring is empty.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+T *SPSC_Ring<T, N>::front(void)
+{
+    uint8_t index = tail.load(std::memory_order_relaxed);
+    if (index == head.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    return &slots[index % N];
+}
+
+//*****************************************************************************
+//
+//! @brief Gives the slot read by the consumer back to the producer.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+void SPSC_Ring<T, N>::pop(void)
+{
+    tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of slots committed and not read yet.
+//!
+//!	@return A number from 0 to N.
+//
+//*****************************************************************************
+template <typename T, uint8_t N>
+uint8_t SPSC_Ring<T, N>::size(void) const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+#endif  //  __SPSC_RING_H__
@@ -0,0 +1,335 @@
+#ifndef __STATE_MACHINE_H__
+#define __STATE_MACHINE_H__
+
+#include <initializer_list>
+#include "trace.h"
+
+//*****************************************************************************
+//
+//	The following are the compile-time transition tables of the state
+//  machines. The transitions are declared as (state, event, next state) and
+//  turned into a dense table, so a dispatch is a single table lookup.
+//
+//*****************************************************************************
+
+//  Transition structure.
+template <typename State, typename Event>
+struct SM_Transition
+{
+    State from;
+    Event event;
+    State to;
+};
+
+//  Transition table, next state per state and event (NUM_STATES if the event
+//  is not accepted in that state).
+template <typename State, typename Event, uint8_t NUM_STATES, uint8_t NUM_EVENTS>
+struct SM_Table
+{
+    typedef State State_Type;
+    typedef Event Event_Type;
+    static constexpr uint8_t STATES = NUM_STATES;
+    static constexpr uint8_t EVENTS = NUM_EVENTS;
+
+    uint8_t next[NUM_STATES][NUM_EVENTS];
+    //  Cleared if a transition is out of range or repeated.
+    bool valid;
+
+    //*************************************************************************
+    //
+    //! @brief Checks if an event is accepted in a state.
+    //!
+    //!	@param[in] from State in which the event is received.
+    //!	@param[in] event Event received.
+    //!
+    //! @return false if the transition is not declared, true otherwise.
+    //
+    //*************************************************************************
+    constexpr bool allows(State from, Event event) const
+    {
+        return next[static_cast<uint8_t>(from)][static_cast<uint8_t>(event)] < NUM_STATES;
+    }
+};
+
+//*****************************************************************************
+//
+//! @brief Turns a list of transitions into a transition table.
+//!
+//!	@param[in] transitions Transitions of the state machine.
+//!
+//! @return A transition table, not valid if a transition is out of range or
+//!         the same state and event are declared twice.
+//
+//*****************************************************************************
+template <typename State, typename Event, uint8_t NUM_STATES, uint8_t NUM_EVENTS>
+constexpr SM_Table<State, Event, NUM_STATES, NUM_EVENTS>
+make_sm_table(std::initializer_list<SM_Transition<State, Event>> transitions)
+{
+    SM_Table<State, Event, NUM_STATES, NUM_EVENTS> table = {};
+    for (uint8_t i = 0; i < NUM_STATES; i++)
+    {
+        for (uint8_t j = 0; j < NUM_EVENTS; j++)
+        {
+            table.next[i][j] = NUM_STATES;
+        }
+    }
+    table.valid = true;
+    for (const SM_Transition<State, Event> &transition : transitions)
+    {
+        uint8_t from = static_cast<uint8_t>(transition.from);
+        uint8_t event = static_cast<uint8_t>(transition.event);
+        uint8_t to = static_cast<uint8_t>(transition.to);
+        if (from >= NUM_STATES || event >= NUM_EVENTS || to >= NUM_STATES ||
+            table.next[from][event] < NUM_STATES)
+        {
+            table.valid = false;
+            continue;
+        }
+        table.next[from][event] = to;
+    }
+    return table;
+}
+
+//*****************************************************************************
+//
+//! @brief State machine class.
+//!
+//! This class drives a state through the transition table of its Spec, and
+//! timestamps every transition to keep the dwell time statistics of each
+//! state (entries, average and max. time spent in it). An event that is not
+//! accepted in the current state leaves it unchanged and is counted.
+//!
+//! The Spec class must define the transition table as:
+//!     static constexpr SM_Table<State, Event, NUM_STATES, NUM_EVENTS> TABLE;
+//!
+//! Where the current state is known at compile time, dispatch<FROM, EVENT>()
+//! turns an undeclared transition into a compile-time error.
+//!
+//! Every transition is written in the flight recorder, if a trace type is
+//! given (id: trace id, arg: new state).
+//
+//*****************************************************************************
+template <class Spec>
+class State_Machine
+{
+    private:
+        typedef typename decltype(Spec::TABLE)::State_Type State;
+        typedef typename decltype(Spec::TABLE)::Event_Type Event;
+        static constexpr uint8_t NUM_STATES = decltype(Spec::TABLE)::STATES;
+
+        static_assert(Spec::TABLE.valid, "Invalid state machine transition table.");
+
+        //  Dwell time structure, per state.
+        typedef struct sm_dwell
+        {
+            uint16_t entries;
+            uint32_t total_time;
+            uint32_t max_time;
+        } SM_Dwell;
+
+        //  Current and previous state, and time at which the current one
+        //  was entered in milliseconds.
+        State current_state;
+        State previous_state;
+        uint32_t enter_time;
+
+        //  Dwell time statistics, and events not accepted.
+        SM_Dwell dwell[NUM_STATES];
+        uint16_t rejected;
+
+        //  Flight recorder record of the transitions.
+        bool traced;
+        Trace_Type trace_type;
+        uint8_t trace_id;
+
+    public:
+        //  Class constructors.
+        State_Machine(State initial);
+        State_Machine(State initial, Trace_Type type, uint8_t id);
+
+        //  Public member functions.
+        void reset(State initial);
+        bool dispatch(Event event);
+        template <State FROM, Event EVENT>
+        bool dispatch(void);
+        State current(void) const;
+        State previous(void) const;
+        uint32_t time_in_state(void) const;
+        String get_stats(void) const;
+};
+
+//*****************************************************************************
+//
+//! @brief State machine class constructor, the transitions are not traced.
+//!
+//!	@param[in] initial Initial state.
+//
+//*****************************************************************************
+template <class Spec>
+State_Machine<Spec>::State_Machine(State initial)
+    : traced(false), trace_type(Trace_Type::BOOT), trace_id(0)
+{
+    memset(dwell, 0, sizeof(dwell));
+    rejected = 0;
+    reset(initial);
+}
+
+//*****************************************************************************
+//
+//! @brief State machine class constructor, the transitions are traced.
+//!
+//!	@param[in] initial Initial state.
+//!	@param[in] type Flight recorder record type of the transitions.
+//!	@param[in] id Flight recorder record id (i.e. token slot).
+//
+//*****************************************************************************
+template <class Spec>
+State_Machine<Spec>::State_Machine(State initial, Trace_Type type, uint8_t id)
+    : traced(true), trace_type(type), trace_id(id)
+{
+    memset(dwell, 0, sizeof(dwell));
+    rejected = 0;
+    reset(initial);
+}
+
+//*****************************************************************************
+//
+//! @brief Sets the state without a transition, i.e. at start up.
+//!
+//!	@param[in] initial State to be set.
+//!
+//! @return None.
+//
+//*****************************************************************************
+template <class Spec>
+void State_Machine<Spec>::reset(State initial)
+{
+    current_state = initial;
+    previous_state = initial;
+    enter_time = millis();
+}
+
+//*****************************************************************************
+//
+//! @brief Moves to the next state of an event, as given by the transition
+//!        table.
+//!
+//!	@param[in] event Event received in the current state.
+//!
+//! @return false if the event is not accepted in the current state, true if
+//!         the state changed (or was entered again).
+//
+//*****************************************************************************
+template <class Spec>
+bool State_Machine<Spec>::dispatch(Event event)
+{
+    uint8_t from = static_cast<uint8_t>(current_state);
+    uint8_t to = Spec::TABLE.next[from][static_cast<uint8_t>(event)];
+    if (to >= NUM_STATES)
+    {
+        rejected++;
+        return false;
+    }
+    //  The time spent in the state is known once it is left.
+    uint32_t now = millis();
+    uint32_t time = now - enter_time;
+    SM_Dwell &stats = dwell[from];
+    stats.entries++;
+    stats.total_time += time;
+    stats.max_time = (time > stats.max_time) ? time : stats.max_time;
+    previous_state = current_state;
+    current_state = static_cast<State>(to);
+    enter_time = now;
+    if (traced)
+    {
+        Trace.record(trace_type, trace_id, to);
+    }
+    return true;
+}
+
+//*****************************************************************************
+//
+//! @brief Moves to the next state of an event received in a known state.
+//!
+//! The transition must be declared in the table, it is checked at compile
+//! time. Nothing is done if the machine is not in that state.
+//!
+//! @return false if the machine is not in the FROM state, true otherwise.
+//
+//*****************************************************************************
+template <class Spec>
+template <typename State_Machine<Spec>::State FROM, typename State_Machine<Spec>::Event EVENT>
+bool State_Machine<Spec>::dispatch(void)
+{
+    static_assert(Spec::TABLE.allows(FROM, EVENT), "Transition not declared in the state machine table.");
+    if (current_state != FROM)
+    {
+        rejected++;
+        return false;
+    }
+    return dispatch(EVENT);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the current state.
+//!
+//! @return The current state.
+//
+//*****************************************************************************
+template <class Spec>
+typename State_Machine<Spec>::State State_Machine<Spec>::current(void) const
+{
+    return current_state;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the state before the last transition.
+//!
+//! @return The previous state, the initial one if none yet.
+//
+//*****************************************************************************
+template <class Spec>
+typename State_Machine<Spec>::State State_Machine<Spec>::previous(void) const
+{
+    return previous_state;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the time spent in the current state.
+//!
+//! @return A time in milliseconds.
+//
+//*****************************************************************************
+template <class Spec>
+uint32_t State_Machine<Spec>::time_in_state(void) const
+{
+    return millis() - enter_time;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the dwell time statistics.
+//!
+//! @return A string object with the entries, average and max. time in
+//!         milliseconds of each state left at least once, in state order, and
+//!         the events not accepted. i.e. 2/150/210,1/3200/3200,0/0/0 (0)
+//
+//*****************************************************************************
+template <class Spec>
+String State_Machine<Spec>::get_stats(void) const
+{
+    String stats;
+    for (uint8_t i = 0; i < NUM_STATES; i++)
+    {
+        const SM_Dwell &stats_state = dwell[i];
+        uint32_t average = (stats_state.entries > 0) ? (stats_state.total_time / stats_state.entries) : 0;
+        stats += String::format("%s%u/%lu/%lu", (i > 0) ? "," : "", stats_state.entries,
+                                (unsigned long)average, (unsigned long)stats_state.max_time);
+    }
+    return stats + String::format(" (%u)", rejected);
+}
+
+#endif  //  __STATE_MACHINE_H__
@@ -0,0 +1,318 @@
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include <new>
+#include <type_traits>
+
+//*****************************************************************************
+//
+//	The following are the resumable tasks of the application. A task is a
+//  function that can wait for a request without blocking the loop, so a flow
+//  of several requests is written top to bottom, in one place:
+//
+//      Task_Status Flow::resume(void)
+//      {
+//          TASK_BEGIN(line);
+//          calendar_request = calendar.fetch(oauth2);
+//          TASK_AWAIT(line, calendar_request);
+//          ...
+//          TASK_END(line);
+//      }
+//
+//  It is a stackless coroutine: the resume point (source line) is kept in the
+//  task frame and the function goes back to it through a switch statement, so
+//  the values kept across a wait must be members of the frame, not locals. A
+//  wait cannot be placed inside a switch statement of the task body.
+//
+//*****************************************************************************
+
+//  Task status, returned every time a task is resumed.
+enum class Task_Status : uint8_t
+{
+    WAITING,
+    DONE
+};
+
+//  Starts the task body, it goes back to the last wait.
+#define TASK_BEGIN(line)                                    \
+    switch (line)                                           \
+    {                                                       \
+        case 0:
+
+//  Waits until a condition or awaitables are ready, the task returns and it
+//  is checked again every time the task is resumed.
+#define TASK_AWAIT(line, awaitable)                         \
+    do                                                      \
+    {                                                       \
+        line = __LINE__;                                    \
+        case __LINE__:                                      \
+        if (!task_ready(awaitable))                         \
+        {                                                   \
+            return Task_Status::WAITING;                    \
+        }                                                   \
+    } while (0)
+
+//  Ends the task before the end of its body.
+#define TASK_RETURN(line)                                   \
+    do                                                      \
+    {                                                       \
+        line = 0;                                           \
+        return Task_Status::DONE;                           \
+    } while (0)
+
+//  Ends the task body.
+#define TASK_END(line)                                      \
+    }                                                       \
+    line = 0;                                               \
+    return Task_Status::DONE
+
+//*****************************************************************************
+//
+//! @brief Awaitable class.
+//!
+//! This class is returned by the requests that complete later (i.e. a
+//! webhook request). It refers to the pending flag of the request, set while
+//! the request is in flight, so it is ready once the response is completed
+//! (or failed, or the request cancelled). A default awaitable is ready.
+//
+//*****************************************************************************
+class Awaitable
+{
+    private:
+        //  Pending flag of the request, nullptr if none.
+        const bool *pending;
+
+    public:
+        //  Class constructors.
+        Awaitable();
+        explicit Awaitable(const bool &pending);
+
+        //  Public member functions.
+        bool ready(void) const;
+};
+
+//*****************************************************************************
+//
+//! @brief Awaitable class constructor, the awaitable is ready.
+//
+//*****************************************************************************
+inline Awaitable::Awaitable()
+    : pending(nullptr)
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Awaitable class constructor.
+//!
+//!	@param[in] pending Flag set while the request is in flight.
+//
+//*****************************************************************************
+inline Awaitable::Awaitable(const bool &pending)
+    : pending(&pending)
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if the request is completed.
+//!
+//! @return false if the request is in flight, true otherwise.
+//
+//*****************************************************************************
+inline bool Awaitable::ready(void) const
+{
+    return (pending == nullptr) || !*pending;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks a wait condition, awaitable or boolean.
+//!
+//! @return false if the task must keep waiting, true otherwise.
+//
+//*****************************************************************************
+inline bool task_ready(const Awaitable &awaitable)
+{
+    return awaitable.ready();
+}
+
+inline bool task_ready(bool condition)
+{
+    return condition;
+}
+
+//*****************************************************************************
+//
+//! @brief Waits for several requests in flight at the same time.
+//!
+//! All the conditions are checked every time, so the ones with side effects
+//! (i.e. DFPlayer_MP3::free()) keep being polled.
+//!
+//! @return true once all the awaitables and conditions are ready.
+//
+//*****************************************************************************
+inline bool when_all(void)
+{
+    return true;
+}
+
+template <typename T, typename... Args>
+bool when_all(const T &first, const Args &... rest)
+{
+    bool ready = task_ready(first);
+    return when_all(rest...) && ready;
+}
+
+//*****************************************************************************
+//
+//! @brief Task pool class.
+//!
+//! This class allocates the task frames from a fixed number of slots, so the
+//! memory used by the tasks is bounded and known at compile time, and resumes
+//! them from the application loop. A frame is released (destroyed) once its
+//! task is done. Spawning a task fails if all the slots are in use.
+//!
+//! The Frame class must be constructible from the spawn() arguments and
+//! define:
+//!     Task_Status resume(void);
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+class Task_Pool
+{
+    static_assert(N > 0 && N <= 32, "The task pool size must be from 1 to 32.");
+
+    private:
+        //  Frame slots, and one bit per slot in use.
+        typename std::aligned_storage<sizeof(Frame), alignof(Frame)>::type slots[N];
+        uint32_t used;
+
+        //  Max. number of frames in use at the same time, frames spawned
+        //  and spawns failed as the pool was exhausted.
+        uint8_t peak;
+        uint32_t spawned;
+        uint32_t exhausted;
+
+        //  Private member functions.
+        Frame *frame(uint8_t slot);
+
+    public:
+        //  Class constructor.
+        Task_Pool();
+
+        //  Public member functions.
+        template <typename... Args>
+        Frame *spawn(Args &&... args);
+        void loop(void);
+        uint8_t size(void) const;
+        String get_stats(void) const;
+};
+
+//*****************************************************************************
+//
+//! @brief Task pool class constructor.
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+Task_Pool<Frame, N>::Task_Pool()
+    : used(0), peak(0), spawned(0), exhausted(0)
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the frame of a slot.
+//!
+//!	@param[in] slot Slot index.
+//!
+//!	@return A pointer to the frame.
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+Frame *Task_Pool<Frame, N>::frame(uint8_t slot)
+{
+    return reinterpret_cast<Frame *>(&slots[slot]);
+}
+
+//*****************************************************************************
+//
+//! @brief Starts a task in a free slot.
+//!
+//! The task is first resumed by the next loop() call.
+//!
+//!	@param[in] args Arguments of the frame constructor.
+//!
+//!	@return A pointer to the frame, nullptr if all the slots are in use.
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+template <typename... Args>
+Frame *Task_Pool<Frame, N>::spawn(Args &&... args)
+{
+    for (uint8_t i = 0; i < N; i++)
+    {
+        if ((used & (1UL << i)) == 0)
+        {
+            used |= (1UL << i);
+            spawned++;
+            peak = (size() > peak) ? size() : peak;
+            return new (&slots[i]) Frame(std::forward<Args>(args)...);
+        }
+    }
+    exhausted++;
+    return nullptr;
+}
+
+//*****************************************************************************
+//
+//! @brief Resumes every task once, and releases the frames of the tasks done.
+//!
+//! It must be called from the application loop.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+void Task_Pool<Frame, N>::loop(void)
+{
+    for (uint8_t i = 0; i < N; i++)
+    {
+        if ((used & (1UL << i)) != 0 && frame(i)->resume() == Task_Status::DONE)
+        {
+            frame(i)->~Frame();
+            used &= ~(1UL << i);
+        }
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of frames in use.
+//!
+//!	@return A number from 0 to N.
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+uint8_t Task_Pool<Frame, N>::size(void) const
+{
+    return __builtin_popcount(used);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the pool statistics.
+//!
+//!	@return A string object with the frames in use, the max. in use at the
+//!         same time, the memory of the pool and the frames spawned and
+//!         refused. i.e. frames: 1/2 (peak 2), 336 bytes, spawned: 12, ...
+//
+//*****************************************************************************
+template <typename Frame, uint8_t N>
+String Task_Pool<Frame, N>::get_stats(void) const
+{
+    return String::format("frames: %u/%u (peak %u), %u bytes, spawned: %lu, exhausted: %lu", size(), N, peak,
+                          (unsigned)sizeof(slots), (unsigned long)spawned, (unsigned long)exhausted);
+}
+
+#endif  //  __TASK_H__
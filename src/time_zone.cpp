@@ -0,0 +1,200 @@
+#include "Particle.h"
+#include "time_zone.h"
+
+//  Seconds per day.
+#define SECONDS_PER_DAY             86400L
+
+//*****************************************************************************
+//
+//! @brief Divides rounding towards minus infinity.
+//!
+//! The timestamps before 1970 are negative, so the day of a timestamp is
+//! the floor of the division, not its truncation.
+//
+//*****************************************************************************
+static int32_t floor_div(int64_t a, int32_t b)
+{
+    return (int32_t)((a >= 0) ? (a / b) : -((-a + b - 1) / b));
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the number of days since Jan 01 1970 of a civil date.
+//!
+//! The proleptic Gregorian calendar is used, so no table nor time zone is
+//! needed (see http://howardhinnant.github.io/date_algorithms.html).
+//!
+//!	@param[in] year Year, i.e. 2020.
+//!	@param[in] month Month, 1 to 12.
+//!	@param[in] day Day of the month, 1 to 31.
+//!
+//!	@return The number of days since Jan 01 1970, negative if before.
+//
+//*****************************************************************************
+int32_t days_from_civil(int year, int month, int day)
+{
+    year -= (month <= 2) ? 1 : 0;
+    int32_t era = ((year >= 0) ? year : (year - 399)) / 400;
+    int32_t year_of_era = year - era * 400;
+    int32_t day_of_year = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+    int32_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return era * 146097 + day_of_era - 719468;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the civil date of a number of days since Jan 01 1970.
+//!
+//!	@param[in] days Number of days since Jan 01 1970.
+//!	@param[out] year Year.
+//!	@param[out] month Month, 1 to 12.
+//!	@param[out] day Day of the month, 1 to 31.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+static void civil_from_days(int32_t days, int &year, int &month, int &day)
+{
+    days += 719468;
+    int32_t era = ((days >= 0) ? days : (days - 146096)) / 146097;
+    int32_t day_of_era = days - era * 146097;
+    int32_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int32_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int32_t month_index = (5 * day_of_year + 2) / 153;
+    day = day_of_year - (153 * month_index + 2) / 5 + 1;
+    month = (month_index < 10) ? (month_index + 3) : (month_index - 9);
+    year = year_of_era + era * 400 + ((month <= 2) ? 1 : 0);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the local time of a DST transition in a given year.
+//!
+//!	@param[in] transition DST transition.
+//!	@param[in] year Year of the transition.
+//!
+//!	@return The transition as seconds since Jan 01 1970, local time.
+//
+//*****************************************************************************
+static int64_t transition_time(const Time_Zone_Transition &transition, int year)
+{
+    int32_t first_day = days_from_civil(year, transition.month, 1);
+    int32_t next_month = (transition.month == 12) ? days_from_civil(year + 1, 1, 1) :
+                                                    days_from_civil(year, transition.month + 1, 1);
+    //  Jan 01 1970 was a Thursday (4).
+    int32_t first_weekday = ((first_day % 7) + 11) % 7;
+    int32_t day = first_day + (transition.weekday - first_weekday + 7) % 7 + (transition.week - 1) * 7;
+    //  Week 5 is the last week, which can be the fourth one.
+    while (day >= next_month)
+    {
+        day -= 7;
+    }
+    return (int64_t)day * SECONDS_PER_DAY + transition.time;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the UTC offset of a time zone at a given instant.
+//!
+//!	@param[in] zone Time zone rule.
+//!	@param[in] utc Unix timestamp (UTC).
+//!
+//!	@return The UTC offset in seconds east of UTC, DST included.
+//
+//*****************************************************************************
+int32_t utc_offset(const Time_Zone_Rule &zone, time_t utc)
+{
+    if (!zone.has_dst)
+    {
+        return zone.std_offset;
+    }
+    int year, month, day;
+    civil_from_days(floor_div((int64_t)utc + zone.std_offset, SECONDS_PER_DAY), year, month, day);
+    //  DST starts at a standard local time and ends at a DST local time.
+    int64_t start = transition_time(zone.dst_start, year) - zone.std_offset;
+    int64_t end = transition_time(zone.dst_end, year) - zone.dst_offset;
+    bool dst;
+    if (start < end)
+    {
+        dst = (utc >= start) && (utc < end);
+    }
+    else
+    {
+        //  Southern hemisphere, DST spans the new year.
+        dst = (utc >= start) || (utc < end);
+    }
+    return dst ? zone.dst_offset : zone.std_offset;
+}
+
+//*****************************************************************************
+//
+//! @brief Converts a unix timestamp (UTC) into local time.
+//!
+//!	@param[in] zone Time zone rule.
+//!	@param[in] utc Unix timestamp (UTC).
+//!
+//!	@return The local time as seconds since Jan 01 1970.
+//
+//*****************************************************************************
+time_t local_time(const Time_Zone_Rule &zone, time_t utc)
+{
+    return utc + utc_offset(zone, utc);
+}
+
+//*****************************************************************************
+//
+//! @brief Converts a local time into a unix timestamp (UTC).
+//!
+//! A local time repeated when DST ends is taken as the first one (DST), and
+//! a local time skipped when DST starts is moved forward by the DST shift.
+//!
+//!	@param[in] zone Time zone rule.
+//!	@param[in] local Local time as seconds since Jan 01 1970.
+//!
+//!	@return A unix timestamp (UTC).
+//
+//*****************************************************************************
+time_t utc_time(const Time_Zone_Rule &zone, time_t local)
+{
+    time_t utc = local - zone.dst_offset;
+    if (utc_offset(zone, utc) == zone.dst_offset)
+    {
+        return utc;
+    }
+    return local - zone.std_offset;
+}
+
+//*****************************************************************************
+//
+//! @brief Formats a unix timestamp as an RFC3339 timestamp.
+//!
+//!	@param[in] utc Unix timestamp (UTC).
+//!	@param[in] offset UTC offset of the timestamp in seconds east of UTC.
+//!	                  i.e. utc_offset(zone, utc), 0 for the Zulu time zone.
+//!
+//!	@return A string object with the timestamp.
+//!         i.e. 2011-06-03T10:00:00-07:00, 2011-06-03T17:00:00Z
+//
+//*****************************************************************************
+String rfc3339_format(time_t utc, int32_t offset)
+{
+    int64_t local = (int64_t)utc + offset;
+    int32_t days = floor_div(local, SECONDS_PER_DAY);
+    int32_t seconds = (int32_t)(local - (int64_t)days * SECONDS_PER_DAY);
+    int year, month, day;
+    civil_from_days(days, year, month, day);
+    char date_time[RFC3339_SIZE];
+    int length = snprintf(date_time, sizeof(date_time), "%04d-%02d-%02dT%02d:%02d:%02d",
+                          year, month, day, (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+    if (offset == 0)
+    {
+        snprintf(date_time + length, sizeof(date_time) - length, "Z");
+    }
+    else
+    {
+        int32_t minutes = ((offset < 0) ? -offset : offset) / 60;
+        snprintf(date_time + length, sizeof(date_time) - length, "%c%02d:%02d",
+                 (offset < 0) ? '-' : '+', (int)(minutes / 60), (int)(minutes % 60));
+    }
+    return String(date_time);
+}
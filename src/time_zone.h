@@ -0,0 +1,282 @@
+#ifndef __TIME_ZONE_H__
+#define __TIME_ZONE_H__
+
+//  Number of characters of an RFC3339 timestamp, null included.
+//  i.e. 2011-06-03T10:00:00-07:00
+#define RFC3339_SIZE                26
+
+//*****************************************************************************
+//
+//! @brief Daylight saving time (DST) transition.
+//!
+//! i.e. M3.5.0/3 is the last Sunday of March at 03:00 local time.
+//
+//*****************************************************************************
+typedef struct time_zone_transition
+{
+    uint8_t month;      //  1 to 12.
+    uint8_t week;       //  1 to 5, 5 is the last week of the month.
+    uint8_t weekday;    //  0 to 6, 0 is Sunday.
+    int32_t time;       //  Seconds after midnight, local time before the transition.
+} Time_Zone_Transition;
+
+//*****************************************************************************
+//
+//! @brief Time zone rule.
+//!
+//! The rule holds the UTC offsets of a time zone and, if it observes DST,
+//! the yearly transitions between them. It is built at compile time from a
+//! POSIX TZ string (see time_zone_rule()).
+//
+//*****************************************************************************
+typedef struct time_zone_rule
+{
+    //  Time zone name, i.e. Europe/Madrid.
+    const char *name;
+    //  Standard time and DST offsets, in seconds east of UTC.
+    int32_t std_offset;
+    int32_t dst_offset;
+    //  DST transitions, if observed.
+    bool has_dst;
+    Time_Zone_Transition dst_start;
+    Time_Zone_Transition dst_end;
+    //  Set if the TZ string was parsed.
+    bool valid;
+} Time_Zone_Rule;
+
+//*****************************************************************************
+//
+//  The following are compile-time helpers to parse POSIX TZ strings.
+//  i.e. CET-1CEST,M3.5.0,M10.5.0/3
+//
+//*****************************************************************************
+
+//  Skips a time zone abbreviation (i.e. CET, <-03>).
+constexpr const char *tz_skip_name(const char *tz)
+{
+    if (*tz == '<')
+    {
+        while (*tz != '\0' && *tz != '>')
+        {
+            tz++;
+        }
+        return (*tz == '>') ? tz + 1 : tz;
+    }
+    while ((*tz >= 'A' && *tz <= 'Z') || (*tz >= 'a' && *tz <= 'z'))
+    {
+        tz++;
+    }
+    return tz;
+}
+
+//  Parses an unsigned number.
+constexpr const char *tz_parse_number(const char *tz, int32_t &value)
+{
+    value = 0;
+    while (*tz >= '0' && *tz <= '9')
+    {
+        value = value * 10 + (*tz - '0');
+        tz++;
+    }
+    return tz;
+}
+
+//  Parses a time, [+|-]hh[:mm[:ss]], in seconds.
+constexpr const char *tz_parse_time(const char *tz, int32_t &seconds)
+{
+    int32_t sign = 1;
+    if (*tz == '+' || *tz == '-')
+    {
+        sign = (*tz == '-') ? -1 : 1;
+        tz++;
+    }
+    int32_t value = 0;
+    tz = tz_parse_number(tz, value);
+    seconds = value * 3600;
+    for (int32_t scale = 60; *tz == ':' && scale > 0; scale /= 60)
+    {
+        tz = tz_parse_number(tz + 1, value);
+        seconds += value * scale;
+    }
+    seconds *= sign;
+    return tz;
+}
+
+//  Parses a transition, Mm.w.d[/time]. The time is 02:00 by default.
+constexpr const char *tz_parse_transition(const char *tz, Time_Zone_Transition &transition, bool &valid)
+{
+    int32_t month = 0, week = 0, weekday = 0, time = 7200;
+    valid = (*tz == 'M');
+    if (valid)
+    {
+        tz = tz_parse_number(tz + 1, month);
+        valid = (*tz == '.');
+    }
+    if (valid)
+    {
+        tz = tz_parse_number(tz + 1, week);
+        valid = (*tz == '.');
+    }
+    if (valid)
+    {
+        tz = tz_parse_number(tz + 1, weekday);
+        if (*tz == '/')
+        {
+            tz = tz_parse_time(tz + 1, time);
+        }
+        valid = (month >= 1 && month <= 12 && week >= 1 && week <= 5 && weekday <= 6);
+    }
+    transition.month = month;
+    transition.week = week;
+    transition.weekday = weekday;
+    transition.time = time;
+    return tz;
+}
+
+//*****************************************************************************
+//
+//! @brief Builds a time zone rule from a POSIX TZ string at compile time.
+//!
+//! The TZ string is the last line of the zoneinfo file of the zone, so the
+//! rule matches the tz database for the current and future years.
+//! i.e. Europe/Madrid: CET-1CEST,M3.5.0,M10.5.0/3
+//! The offsets of a TZ string are given west of UTC, so their sign is
+//! reversed. Only the M (month, week, weekday) transition format is used.
+//!
+//!	@param[in] name Time zone name.
+//!	@param[in] tz POSIX TZ string.
+//!
+//! @return The time zone rule, not valid if the TZ string is not supported.
+//
+//*****************************************************************************
+constexpr Time_Zone_Rule time_zone_rule(const char *name, const char *tz)
+{
+    Time_Zone_Rule rule {name, 0, 0, false, {0, 0, 0, 0}, {0, 0, 0, 0}, false};
+    int32_t offset = 0;
+    const char *next = tz_skip_name(tz);
+    if (next == tz)
+    {
+        return rule;
+    }
+    tz = tz_parse_time(next, offset);
+    rule.std_offset = -offset;
+    rule.dst_offset = -offset;
+    if (*tz == '\0')
+    {
+        rule.valid = true;
+        return rule;
+    }
+    next = tz_skip_name(tz);
+    if (next == tz)
+    {
+        return rule;
+    }
+    tz = next;
+    //  DST is one hour ahead of standard time by default.
+    rule.dst_offset = rule.std_offset + 3600;
+    if (*tz != ',')
+    {
+        tz = tz_parse_time(tz, offset);
+        rule.dst_offset = -offset;
+    }
+    bool start_valid = false, end_valid = false;
+    if (*tz == ',')
+    {
+        tz = tz_parse_transition(tz + 1, rule.dst_start, start_valid);
+    }
+    if (start_valid && *tz == ',')
+    {
+        tz = tz_parse_transition(tz + 1, rule.dst_end, end_valid);
+    }
+    rule.has_dst = true;
+    rule.valid = start_valid && end_valid && (*tz == '\0');
+    return rule;
+}
+
+//*****************************************************************************
+//
+//	Time zones the device is deployed in. Add a zone with the TZ string from
+//  its zoneinfo file (i.e. tail -n 1 /usr/share/zoneinfo/Europe/Madrid).
+//
+//*****************************************************************************
+
+static constexpr Time_Zone_Rule TIME_ZONE_RULES[] =
+{
+    time_zone_rule("UTC", "UTC0"),
+    time_zone_rule("Europe/London", "GMT0BST,M3.5.0/1,M10.5.0"),
+    time_zone_rule("Europe/Lisbon", "WET0WEST,M3.5.0/1,M10.5.0"),
+    time_zone_rule("Europe/Madrid", "CET-1CEST,M3.5.0,M10.5.0/3"),
+    time_zone_rule("Europe/Berlin", "CET-1CEST,M3.5.0,M10.5.0/3"),
+    time_zone_rule("Europe/Athens", "EET-2EEST,M3.5.0/3,M10.5.0/4"),
+    time_zone_rule("America/New_York", "EST5EDT,M3.2.0,M11.1.0"),
+    time_zone_rule("America/Chicago", "CST6CDT,M3.2.0,M11.1.0"),
+    time_zone_rule("America/Denver", "MST7MDT,M3.2.0,M11.1.0"),
+    time_zone_rule("America/Phoenix", "MST7"),
+    time_zone_rule("America/Los_Angeles", "PST8PDT,M3.2.0,M11.1.0"),
+    time_zone_rule("America/Sao_Paulo", "<-03>3"),
+    time_zone_rule("Asia/Kolkata", "IST-5:30"),
+    time_zone_rule("Asia/Tokyo", "JST-9"),
+    time_zone_rule("Australia/Sydney", "AEST-10AEDT,M10.1.0,M4.1.0/3"),
+    time_zone_rule("Pacific/Auckland", "NZST-12NZDT,M9.5.0,M4.1.0/3")
+};
+
+//  Number of time zones in the table.
+static constexpr uint8_t NUM_TIME_ZONES = sizeof(TIME_ZONE_RULES) / sizeof(TIME_ZONE_RULES[0]);
+
+//*****************************************************************************
+//
+//! @brief Finds a time zone in the table at compile time.
+//!
+//!	@param[in] name Time zone name.
+//!
+//! @return The index of the time zone, NUM_TIME_ZONES if not found.
+//
+//*****************************************************************************
+constexpr uint8_t find_time_zone(const char *name)
+{
+    for (uint8_t i = 0; i < NUM_TIME_ZONES; i++)
+    {
+        const char *a = TIME_ZONE_RULES[i].name;
+        const char *b = name;
+        while (*a != '\0' && *a == *b)
+        {
+            a++;
+            b++;
+        }
+        if (*a == *b)
+        {
+            return i;
+        }
+    }
+    return NUM_TIME_ZONES;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks at compile time that every TZ string of the table was parsed.
+//!
+//! @return false if a rule is not valid, true if all of them are valid.
+//
+//*****************************************************************************
+constexpr bool time_zone_rules_valid(void)
+{
+    for (uint8_t i = 0; i < NUM_TIME_ZONES; i++)
+    {
+        if (!TIME_ZONE_RULES[i].valid)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(time_zone_rules_valid(), "A TZ string of TIME_ZONE_RULES is not supported.");
+
+//  Time zone functions. They only depend on their arguments.
+extern int32_t days_from_civil(int year, int month, int day);
+extern int32_t utc_offset(const Time_Zone_Rule &zone, time_t utc);
+extern time_t local_time(const Time_Zone_Rule &zone, time_t utc);
+extern time_t utc_time(const Time_Zone_Rule &zone, time_t local);
+extern String rfc3339_format(time_t utc, int32_t offset = 0);
+
+#endif  //  __TIME_ZONE_H__
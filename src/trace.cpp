@@ -0,0 +1,176 @@
+#include "Particle.h"
+#include "trace.h"
+#include "cloud.h"
+
+//  Flight recorder shared by the application and the Google classes.
+Flight_Recorder Trace;
+
+#ifdef TRACE_ENABLED
+
+//  Magic number to identify the trace ring in retained memory.
+//  It must be changed whenever the record layout changes.
+#define TRACE_MAGIC             0x54524331
+
+static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0,
+              "TRACE_RING_SIZE must be a power of two.");
+
+//  Trace record structure.
+typedef struct trace_record
+{
+    uint32_t time;
+    uint8_t type;
+    uint8_t id;
+    uint16_t arg;
+} Trace_Record;
+
+//  Trace ring structure.
+typedef struct trace_ring
+{
+    uint32_t magic;
+    //  Number of resets recorded since the ring was cleared.
+    uint32_t boots;
+    //  Next record to write and number of records written.
+    uint16_t head;
+    uint16_t count;
+    Trace_Record records[TRACE_RING_SIZE];
+} Trace_Ring;
+
+//  Trace ring stored in retained memory. It is not initialized on purpose,
+//  so the records written before the last reset are preserved.
+retained static Trace_Ring trace_ring;
+
+//*****************************************************************************
+//
+//! @brief Flight recorder class constructor.
+//
+//*****************************************************************************
+Flight_Recorder::Flight_Recorder()
+{
+    heap_time = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Validates the trace ring found in retained memory and records the
+//!        reset.
+//!
+//! If the ring is not valid (first power up or layout change), it is cleared.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::begin(void)
+{
+    if (trace_ring.magic != TRACE_MAGIC || trace_ring.count > TRACE_RING_SIZE)
+    {
+        clear();
+    }
+    trace_ring.boots++;
+    record(Trace_Type::BOOT, 0, System.resetReason());
+    record_heap();
+}
+
+//*****************************************************************************
+//
+//! @brief Writes a record in the trace ring, overwriting the oldest one if
+//!        the ring is full.
+//!
+//!	@param[in] type Record type.
+//!	@param[in] id Record id, its meaning depends on the type (see Trace_Type).
+//!	@param[in] arg Record argument, its meaning depends on the type.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::record(Trace_Type type, uint8_t id, uint16_t arg)
+{
+    //  The head is masked, so a record written before begin() cannot
+    //  write out of the ring.
+    uint16_t head = trace_ring.head & (TRACE_RING_SIZE - 1);
+    Trace_Record &record = trace_ring.records[head];
+    record.time = micros();
+    record.type = static_cast<uint8_t>(type);
+    record.id = id;
+    record.arg = arg;
+    trace_ring.head = (head + 1) & (TRACE_RING_SIZE - 1);
+    if (trace_ring.count < TRACE_RING_SIZE)
+    {
+        trace_ring.count++;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Writes a heap snapshot (free memory) in the trace ring.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::record_heap(void)
+{
+    uint32_t free_memory = System.freeMemory();
+    record(Trace_Type::HEAP, free_memory >> 16, free_memory & 0xFFFF);
+}
+
+//*****************************************************************************
+//
+//! @brief Writes a heap snapshot every TRACE_HEAP_PERIOD.
+//!
+//! It must be called from the application loop. The snapshots also keep the
+//! time between records far below the micros() wrap around (71 minutes).
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::loop(void)
+{
+    if ((millis() - heap_time) >= TRACE_HEAP_PERIOD)
+    {
+        heap_time = millis();
+        record_heap();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Dumps the trace ring over the serial port, oldest record first.
+//!
+//! The names of the webhooks attached to the cloud are dumped as well, the
+//! records refer to them by index.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::dump(void)
+{
+    Serial.printlnf("trace begin %lx %x", (unsigned long)trace_ring.boots, trace_ring.count);
+    const char *name;
+    for (uint8_t i = 0; (name = Cloud.get_webhook_name(i)) != nullptr; i++)
+    {
+        Serial.printlnf("trace name %x %s", i, name);
+    }
+    uint16_t index = (trace_ring.head - trace_ring.count) & (TRACE_RING_SIZE - 1);
+    for (uint16_t i = 0; i < trace_ring.count; i++)
+    {
+        const Trace_Record &record = trace_ring.records[index];
+        Serial.printlnf("trace %08lx %x %x %x", (unsigned long)record.time,
+                        record.type, record.id, record.arg);
+        index = (index + 1) & (TRACE_RING_SIZE - 1);
+    }
+    Serial.println("trace end");
+}
+
+//*****************************************************************************
+//
+//! @brief Clears the trace ring.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+void Flight_Recorder::clear(void)
+{
+    memset(&trace_ring, 0, sizeof(trace_ring));
+    trace_ring.magic = TRACE_MAGIC;
+}
+
+#endif  //  TRACE_ENABLED
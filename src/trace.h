@@ -0,0 +1,106 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+//  Uncomment this line to enable the flight recorder.
+//  If disabled, the trace calls are removed by the compiler.
+//#define TRACE_ENABLED
+
+//  Number of records of the trace ring, 8 bytes each. It must be a power of
+//  two. The ring shares the retained memory (3068 bytes on Gen 3 devices)
+//  with the boot cache.
+#define TRACE_RING_SIZE         128
+//  Time between heap snapshots in milliseconds.
+#define TRACE_HEAP_PERIOD       10000
+
+//*****************************************************************************
+//
+//	Enumeration classes for the trace record types and timers.
+//
+//*****************************************************************************
+
+enum class Trace_Type : uint8_t
+{
+    BOOT,               //  id: 0, arg: reset reason.
+    APP_STAGE,          //  id: 0, arg: App_Stage.
+    REQUEST_STAGE,      //  id: user, arg: Request_Stage.
+    OAUTH2_STATE,       //  id: token slot, arg: OAuth2_State.
+    PUBLISH,            //  id: webhook index, arg: generation.
+    RESPONSE,           //  id: webhook index, arg: generation << 8 | chunk.
+    ERROR,              //  id: webhook index, arg: generation << 8 | chunk.
+    MP3_COMMAND,        //  id: command, arg: parameter.
+    HEAP,               //  id: free bytes >> 16, arg: free bytes & 0xFFFF.
+    TIMER,              //  id: Trace_Timer, arg: token slot.
+    MP3_EVENT           //  id: returned command, arg: returned data.
+};
+
+enum class Trace_Timer : uint8_t
+{
+    POLL_AUTH,          //  OAuth2.0 polling interval elapsed.
+    TOKEN_EXPIRED       //  Access token lifetime elapsed.
+};
+
+#ifdef TRACE_ENABLED
+
+//*****************************************************************************
+//
+//! @brief Flight recorder class.
+//!
+//! This class keeps the last TRACE_RING_SIZE events of the device in a binary
+//! ring stored in retained memory, so the events that led to a reset or a
+//! hang survive it. Each record holds a microsecond timestamp (micros()), the
+//! record type, an id and an argument, and takes a few stores to write.
+//!
+//! The ring is dumped over the serial port with the "trace" command, and
+//! tools/trace_export.py converts the dump into the Chrome trace-event format
+//! (chrome://tracing, ui.perfetto.dev) to show the time spent per stage.
+//!
+//! Dump format (hexadecimal numbers):
+//!     trace begin <boots> <count>
+//!     trace name <webhook_index> <webhook_event_name>
+//!     trace <time_us> <type> <id> <arg>     One line per record, oldest first.
+//!     trace end
+//
+//*****************************************************************************
+class Flight_Recorder
+{
+    private:
+        //  Last heap snapshot time.
+        uint32_t heap_time;
+
+    public:
+        //  Class constructor.
+        Flight_Recorder();
+
+        //  Public member functions.
+        void begin(void);
+        void record(Trace_Type type, uint8_t id, uint16_t arg);
+        void record_heap(void);
+        void loop(void);
+        void dump(void);
+        void clear(void);
+};
+
+#else
+
+//*****************************************************************************
+//
+//! @brief Flight recorder stub, used when the flight recorder is disabled.
+//
+//*****************************************************************************
+class Flight_Recorder
+{
+    public:
+        void begin(void) {}
+        void record(Trace_Type type, uint8_t id, uint16_t arg) {}
+        void record_heap(void) {}
+        void loop(void) {}
+        void dump(void) {}
+        void clear(void) {}
+};
+
+#endif  //  TRACE_ENABLED
+
+//  Flight recorder shared by the application and the Google classes.
+extern Flight_Recorder Trace;
+
+#endif  //  __TRACE_H__
@@ -1,5 +1,6 @@
 #include "Particle.h"
 #include "utility.h"
+#include "time_zone.h"
 
 //*****************************************************************************
 //
@@ -27,6 +28,8 @@ String split_string(String &str, char delimiter, int16_t &index, int16_t &last_i
 //
 //! @brief Converts the given time into a unix timestamp (since Jan 01 1970).
 //!
+//! The time is taken as UTC, no time zone is applied (see utc_time()).
+//!
 //!	@param[in] year Number representation of the years to be converted.
 //!	@param[in] month Number representation of the months to be converted.
 //!	@param[in] day Number representation of the days to be converted.
@@ -39,13 +42,64 @@ String split_string(String &str, char delimiter, int16_t &index, int16_t &last_i
 //*****************************************************************************
 time_t unix_time(int year, int month, int day, int hour, int min, int sec)
 {
-  struct tm t;
-  t.tm_year = year - 1900;
-  t.tm_mon = month - 1;
-  t.tm_mday = day;
-  t.tm_hour = hour;
-  t.tm_min = min;
-  t.tm_sec = sec;
-  t.tm_isdst = 0;
-  return mktime(&t);
-}
\ No newline at end of file
+    return (time_t)days_from_civil(year, month, day) * 86400L + hour * 3600L + min * 60L + sec;
+}
+
+//*****************************************************************************
+//
+//! @brief Converts an RFC3339 timestamp into a unix timestamp (UTC).
+//!
+//! The UTC offset of the timestamp is applied, so timestamps given in 
+//! different time zones can be compared.
+//!
+//!	@param[in] date_time Pointer to a char array holding the timestamp.
+//!                      i.e. 2011-06-03T10:00:00-07:00, 2011-06-03T17:00:00Z
+//!
+//!	@return A unix timestamp, 0 if the timestamp is not valid.
+//
+//*****************************************************************************
+time_t rfc3339_time(const char *date_time)
+{
+    int year, month, day, hour, min, sec;
+    if (sscanf(date_time, "%4d-%2d-%2dT%2d:%2d:%2d", &year, &month, &day, &hour, &min, &sec) != 6)
+    {
+        return 0;
+    }
+    time_t time = unix_time(year, month, day, hour, min, sec);
+    //  Skip the fractional seconds, if any.
+    const char *offset = date_time + 19;
+    while (*offset == '.' || isdigit(*offset))
+    {
+        offset++;
+    }
+    //  i.e. offset: -07:00, the UTC time is 7 hours later.
+    int offset_hour, offset_min;
+    if ((*offset == '+' || *offset == '-') && 
+        sscanf(offset + 1, "%2d:%2d", &offset_hour, &offset_min) == 2)
+    {
+        int32_t offset_sec = offset_hour * 3600L + offset_min * 60L;
+        time += (*offset == '+') ? -offset_sec : offset_sec;
+    }
+    return time;
+}
+
+//*****************************************************************************
+//
+//! @brief Calculates the hash of a string (FNV-1a).
+//!
+//!	@param[in] str Pointer to a char array holding the string.
+//!	@param[in] hash Hash of the previous strings, to hash several strings
+//!                 as one. The FNV offset basis by default.
+//!
+//!	@return An unsigned 32-bit number.
+//
+//*****************************************************************************
+uint32_t string_hash(const char *str, uint32_t hash)
+{
+    while (*str != '\0')
+    {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
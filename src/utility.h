@@ -1,6 +1,8 @@
 #ifndef __UTILITY_H__
 #define __UTILITY_H__
 
+#include <utility>
+
 //  Application template to convert 
 //  enumeration classes into unsigned 8-bit numbers.
 template <typename enum_class>
@@ -9,9 +11,21 @@ uint8_t enum_to_uint8(enum_class ec)
     return static_cast<uint8_t>(ec);
 }
 
+//  Application template to repeat a constructor argument once per index of
+//  a pack expansion. Arrays of objects without a default constructor are 
+//  then sized by their define only, i.e. sources{{repeat_for<SOURCE>(*this)}...}
+//  with SOURCE from std::make_index_sequence<CALENDAR_MAX_IDS>.
+template <size_t index, typename type>
+type &repeat_for(type &value)
+{
+    return value;
+}
+
 //  Utility functions.
 extern String split_string(String &str, char delimiter, int16_t &index, int16_t &last_index);
 extern time_t unix_time(int year, int month, int day, int hour, int min, int sec);
+extern time_t rfc3339_time(const char *date_time);
+extern uint32_t string_hash(const char *str, uint32_t hash = 2166136261UL);
 
 
 #endif // __UTILITY_H__
\ No newline at end of file
@@ -0,0 +1,357 @@
+#ifndef __WEBHOOK_CLIENT_H__
+#define __WEBHOOK_CLIENT_H__
+
+#include "webhook_stream.h"
+#include "task.h"
+#include "cloud.h"
+#include "recorder.h"
+#include "http_status.h"
+
+//*****************************************************************************
+//
+//! @brief Webhook client class.
+//!
+//! This class is the base of the Google API classes (CRTP). It attaches the
+//! webhook handlers, keeps the HTTP status code and error response, and
+//! tracks the request in flight, so every API gets the same bookkeeping and
+//! instrumentation: requests published, responses with an HTTP status code
+//! other than 200 (failures), and response time (publish to response
+//! completed).
+//!
+//! The handlers record the chunk and pass it to the derived class, with no
+//! virtual call. The derived class must implement the following member
+//! function, and make this class a friend:
+//!     bool parser(const char *event, const char *data);
+//!
+//! It returns true once the response is completed. Then, the derived class
+//! hooks are called, if any, before the request is completed:
+//!     void on_response(void);
+//!     void on_error(void);
+//!
+//! The derived class calls begin_request() every time a request is published.
+//
+//*****************************************************************************
+template <class Derived>
+class Webhook_Client
+{
+    protected:
+        //  Typedef function for the user webhook reponse handler.
+        typedef std::function<void(void)> Event_Callback;
+        Event_Callback callback;
+
+        //  Http status code and error response returned from webhooks.
+        String http_error;
+        uint16_t http_status_code;
+
+        //  Set while the last request is in flight, and time at which it was
+        //  published in milliseconds.
+        bool pending;
+        uint32_t request_start;
+
+        //  Requests published, responses completed and failures.
+        uint16_t requests;
+        uint16_t responses;
+        uint16_t failures;
+        //  Response time of the completed requests in milliseconds.
+        uint32_t total_time;
+        uint32_t max_time;
+
+        //  Class constructor.
+        Webhook_Client();
+
+        //  Protected member functions.
+        void attach(const String &event, bool errors = true);
+        void begin_request(void);
+        void complete_request(void);
+        void check_stream(Webhook_Stream<Derived> &stream, Schema_Error error);
+        void on_response(void) {}
+        void on_error(void) {}
+        static Hook_Type hook_type(const char *event);
+        static uint16_t error_status(const char *data);
+
+        //  Particle webhook event handlers.
+        void response_handler(const char *event, const char *data);
+        void error_handler(const char *event, const char *data);
+
+    public:
+        //  Public member functions.
+        Awaitable completion(void) const;
+        bool in_flight(void) const;
+        void print_error(void);
+        String get_client_stats(void);
+};
+
+//*****************************************************************************
+//
+//! @brief Webhook client class constructor.
+//
+//*****************************************************************************
+template <class Derived>
+Webhook_Client<Derived>::Webhook_Client()
+    : callback(nullptr), http_status_code(0), pending(false), request_start(0), requests(0),
+      responses(0), failures(0), total_time(0), max_time(0)
+{
+}
+
+//*****************************************************************************
+//
+//! @brief Attaches the handlers of a Particle webhook event.
+//!
+//! The webhook cloud receives the customized response event names, which
+//! include the device ID so only THIS device will get the response. The
+//! event name must be built once, it is kept by the webhook cloud.
+//!
+//!	@param[in] event Webhook event name, with its tags.
+//!	@param[in] errors Set if the error responses are handled.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::attach(const String &event, bool errors)
+{
+    Webhook_Handler error = nullptr;
+    if (errors)
+    {
+        error = [this](const char *event, const char *data) { error_handler(event, data); };
+    }
+    Cloud.attach(event, [this](const char *event, const char *data) { response_handler(event, data); }, error);
+}
+
+//*****************************************************************************
+//
+//! @brief Starts tracking a request, it is called when it is published.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::begin_request(void)
+{
+    pending = true;
+    request_start = millis();
+    requests++;
+}
+
+//*****************************************************************************
+//
+//! @brief Completes the request in flight, and invokes the user subscribed
+//!        response handler, if any.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::complete_request(void)
+{
+    uint32_t time = millis() - request_start;
+    pending = false;
+    responses++;
+    failures += (http_status_code != HTTP_OK) ? 1 : 0;
+    total_time += time;
+    max_time = (time > max_time) ? time : max_time;
+    if (callback)
+    {
+        callback();
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Sets the HTTP status of a response completed by a stream.
+//!
+//! A response dropped by the stream or malformed is handled as an error
+//! response.
+//!
+//!	@param[in] stream Webhook stream that received the response.
+//!	@param[in] error First decoding error of the response fields.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::check_stream(Webhook_Stream<Derived> &stream, Schema_Error error)
+{
+    if (stream.failed())
+    {
+        http_status_code = HTTP_PAYLOAD_TOO_LARGE;
+        http_error = "\r\nError: Response chunks received out of order.";
+    }
+    else if (error != Schema_Error::NONE)
+    {
+        http_status_code = HTTP_BAD_GATEWAY;
+        http_error = schema_error_message(error, stream.get_error_field());
+    }
+    else
+    {
+        http_status_code = HTTP_OK;
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the hook type of a webhook event.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-error/calendar_event/0
+//!
+//! @return ERROR for "hook-error", RESPONSE otherwise.
+//
+//*****************************************************************************
+template <class Derived>
+Hook_Type Webhook_Client<Derived>::hook_type(const char *event)
+{
+    //  Skip deviceID.
+    const char *hook = strchr(event, '/');
+    if (hook != nullptr && strncmp(hook + 1, "hook-error/", 11) == 0)
+    {
+        return Hook_Type::ERROR;
+    }
+    return Hook_Type::RESPONSE;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the HTTP status code of a "hook-error" response.
+//!
+//! The returned data is an error message generated by the Particle Cloud.
+//! From this message only the HTTP status code is taken.
+//!
+//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//!                 i.e. error status 404 from www.googleapis.com
+//!
+//! @return The HTTP status code, 0 if not found.
+//
+//*****************************************************************************
+template <class Derived>
+uint16_t Webhook_Client<Derived>::error_status(const char *data)
+{
+    char status[4] = {0};
+    if (strlen(data) > 13)
+    {
+        strncpy(status, &data[13], 3);
+    }
+    return atoi(status);
+}
+
+//*****************************************************************************
+//
+//! @brief Webhook response handler.
+//!
+//! This method is called by the OS whenever the HTTP status code received
+//! in the response is EQUAL TO 200.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::response_handler(const char *event, const char *data)
+{
+    Derived &client = static_cast<Derived &>(*this);
+    //  Record the chunk before parsing it.
+    Recorder.record(event, data, Hook_Type::RESPONSE);
+    //  Drop the chunks of a request already completed (i.e. failed by the
+    //  webhook cloud as a chunk was lost).
+    if (!pending)
+    {
+        return;
+    }
+    //  Parse the webhook reponse.
+    if (!client.parser(event, data))
+    {
+        return;
+    }
+    client.on_response();
+    complete_request();
+}
+
+//*****************************************************************************
+//
+//! @brief Webhook error response handler.
+//!
+//! This method is called by the OS whenever the HTTP status code received
+//! in the response is DIFFERENT THAN 200.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!	@param[in] data Pointer to a char array holding the webhook reponse.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::error_handler(const char *event, const char *data)
+{
+    Derived &client = static_cast<Derived &>(*this);
+    //  Record the chunk before parsing it.
+    Recorder.record(event, data, Hook_Type::ERROR);
+    //  Drop the chunks of a request already completed (i.e. failed by the
+    //  webhook cloud as a chunk was lost).
+    if (!pending)
+    {
+        return;
+    }
+    //  Parse the webhook error reponse.
+    if (!client.parser(event, data))
+    {
+        return;
+    }
+    client.on_error();
+    complete_request();
+}
+
+//*****************************************************************************
+//
+//! @brief Gets an awaitable of the last request.
+//!
+//! @return An awaitable, ready once the request is completed.
+//
+//*****************************************************************************
+template <class Derived>
+Awaitable Webhook_Client<Derived>::completion(void) const
+{
+    return Awaitable(pending);
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if a request is in flight.
+//!
+//! @return false if no request is in flight, true otherwise.
+//
+//*****************************************************************************
+template <class Derived>
+bool Webhook_Client<Derived>::in_flight(void) const
+{
+    return pending;
+}
+
+//*****************************************************************************
+//
+//! @brief Prints the HTTP error response returned by the last event published.
+//!
+//! @return None.
+//
+//*****************************************************************************
+template <class Derived>
+void Webhook_Client<Derived>::print_error(void)
+{
+    Serial.println(http_error);
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the request statistics.
+//!
+//! @return A string object with the requests published, the failures and the
+//!         average and max. response time in milliseconds. A "*" is added
+//!         while a request is in flight. i.e. 12 req, 1 failed, 820/1430 ms
+//
+//*****************************************************************************
+template <class Derived>
+String Webhook_Client<Derived>::get_client_stats(void)
+{
+    uint32_t average = (responses > 0) ? (total_time / responses) : 0;
+    return String::format("%u req, %u failed, %lu/%lu ms%s", requests, failures, (unsigned long)average,
+                          (unsigned long)max_time, pending ? "*" : "");
+}
+
+#endif  //  __WEBHOOK_CLIENT_H__
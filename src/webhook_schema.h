@@ -0,0 +1,346 @@
+#ifndef __WEBHOOK_SCHEMA_H__
+#define __WEBHOOK_SCHEMA_H__
+
+#include <type_traits>
+
+//  Max. number of decimals of a number field, more fractional digits are 
+//  ignored. A number is out of range if its integer part does not fit in 32
+//  bits (i.e. unix timestamps fit).
+#define SCHEMA_MAX_DECIMALS         9
+
+//*****************************************************************************
+//
+//	Enumeration class for the webhook response decoding errors.
+//
+//*****************************************************************************
+
+enum class Schema_Error : uint8_t
+{
+    NONE,
+    MISSING_FIELD,      //  Required field empty or not received.
+    EXTRA_FIELD,        //  More fields than described by the schema.
+    NOT_A_NUMBER,       //  Number field with unexpected characters.
+    OUT_OF_RANGE,       //  Number field out of its range.
+    TOO_LONG            //  Text field longer than its max. length.
+};
+
+//*****************************************************************************
+//
+//! @brief Number decoded from a response field.
+//!
+//! The number is kept as a decimal mantissa and a number of decimals, so
+//! integer fields are decoded exactly and no floating-point operation is
+//! needed until the value is assigned.
+//
+//*****************************************************************************
+typedef struct schema_number
+{
+    bool negative;
+    uint32_t mantissa;
+    uint8_t decimals;
+} Schema_Number;
+
+//  Powers of ten used to scale the mantissa.
+static const uint32_t SCHEMA_POW10[SCHEMA_MAX_DECIMALS + 1] =
+{
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+//*****************************************************************************
+//
+//! @brief Decodes a decimal number in a single pass.
+//!
+//! The number can have a sign, a fractional part and ',' group separators
+//! (i.e. -1,234.5). It must be followed by the end of the field or by the
+//! end character, the rest of the field is ignored (i.e. the unit in "12.3
+//! mi" with end ' ').
+//!
+//!	@param[in] value Pointer to a char array holding the field value.
+//!	@param[in] end Character ending the number, '\0' if none.
+//!	@param[out] number Decoded number.
+//!
+//! @return Schema_Error::NONE if decoded, the decoding error otherwise.
+//
+//*****************************************************************************
+inline Schema_Error decode_number(const char *value, char end, Schema_Number &number)
+{
+    number.negative = (*value == '-');
+    if (*value == '-' || *value == '+')
+    {
+        value++;
+    }
+    number.mantissa = 0;
+    number.decimals = 0;
+    bool digits = false;
+    bool overflow = false;
+    bool fraction = false;
+    for (; *value != '\0' && *value != end; value++)
+    {
+        char c = *value;
+        if (c >= '0' && c <= '9')
+        {
+            digits = true;
+            uint8_t digit = c - '0';
+            //  The digits that do not fit are dropped, which is an overflow
+            //  for the integer part.
+            if (number.mantissa > (UINT32_MAX - digit) / 10 || 
+                number.decimals >= SCHEMA_MAX_DECIMALS)
+            {
+                overflow = overflow || !fraction;
+                continue;
+            }
+            number.mantissa = number.mantissa * 10 + digit;
+            number.decimals += fraction ? 1 : 0;
+        }
+        else if (c == '.' && !fraction)
+        {
+            fraction = true;
+        }
+        else if (c != ',' || fraction)
+        {
+            return Schema_Error::NOT_A_NUMBER;
+        }
+    }
+    if (!digits)
+    {
+        return fraction ? Schema_Error::NOT_A_NUMBER : Schema_Error::MISSING_FIELD;
+    }
+    return overflow ? Schema_Error::OUT_OF_RANGE : Schema_Error::NONE;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if a decoded number is within a range.
+//!
+//!	@param[in] number Decoded number.
+//!	@param[in] min Min. value allowed.
+//!	@param[in] max Max. value allowed.
+//!
+//! @return false if out of range, true if within the range.
+//
+//*****************************************************************************
+inline bool number_in_range(const Schema_Number &number, long min, long max)
+{
+    //  The integer part is compared, and a fractional part counts as
+    //  exceeding the bound it is next to.
+    uint32_t scale = SCHEMA_POW10[number.decimals];
+    int64_t integer = number.mantissa / scale;
+    bool fraction = (number.mantissa % scale) != 0;
+    if (number.negative)
+    {
+        integer = -integer;
+    }
+    return (integer > min || (integer == min && !(fraction && number.negative))) &&
+           (integer < max || (integer == max && !(fraction && !number.negative)));
+}
+
+//*****************************************************************************
+//
+//! @brief Converts a decoded number into the type of a member.
+//!
+//! Integer members get the number truncated, scaled by an integer factor
+//! (i.e. seconds to milliseconds).
+//!
+//!	@param[in] number Decoded number.
+//!	@param[in] scale Scale factor.
+//!
+//! @return The number converted into the member type.
+//
+//*****************************************************************************
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value, T>::type
+number_value(const Schema_Number &number, long scale)
+{
+    T value = (T)number.mantissa / SCHEMA_POW10[number.decimals] * scale;
+    return number.negative ? -value : value;
+}
+
+template <typename T>
+inline typename std::enable_if<!std::is_floating_point<T>::value, T>::type
+number_value(const Schema_Number &number, long scale)
+{
+    int64_t value = (int64_t)(number.mantissa / SCHEMA_POW10[number.decimals]) * scale;
+    return (T)(number.negative ? -value : value);
+}
+
+//*****************************************************************************
+//
+//! @brief Number field of a webhook response schema.
+//!
+//!	@tparam Owner Class receiving the field.
+//!	@tparam T Type of the member receiving the field.
+//!	@tparam Member Member receiving the field.
+//!	@tparam Min, Max Range allowed for the field value, before scaling.
+//!	@tparam Scale Scale factor applied to the field value.
+//!	@tparam End Character ending the number, the rest of the field is ignored.
+//!	@tparam Required If false, the field can be empty and the member is kept.
+//
+//*****************************************************************************
+template <class Owner, typename T, T Owner::*Member, long Min, long Max, long Scale = 1, char End = '\0',
+          bool Required = true>
+struct Number_Field
+{
+    static Schema_Error decode(Owner &owner, const char *value)
+    {
+        Schema_Number number;
+        Schema_Error error = decode_number(value, End, number);
+        if (error == Schema_Error::MISSING_FIELD && !Required)
+        {
+            return Schema_Error::NONE;
+        }
+        if (error != Schema_Error::NONE)
+        {
+            return error;
+        }
+        if (!number_in_range(number, Min, Max))
+        {
+            return Schema_Error::OUT_OF_RANGE;
+        }
+        owner.*Member = number_value<T>(number, Scale);
+        return Schema_Error::NONE;
+    }
+};
+
+//*****************************************************************************
+//
+//! @brief Text field of a webhook response schema.
+//!
+//!	@tparam Owner Class receiving the field.
+//!	@tparam Member String member receiving the field.
+//!	@tparam Max_Length Max. number of characters of the field.
+//!	@tparam Required If true, the field cannot be empty.
+//
+//*****************************************************************************
+template <class Owner, String Owner::*Member, uint16_t Max_Length, bool Required = true>
+struct Text_Field
+{
+    static Schema_Error decode(Owner &owner, const char *value)
+    {
+        size_t length = strnlen(value, Max_Length + 1);
+        if (length == 0 && Required)
+        {
+            return Schema_Error::MISSING_FIELD;
+        }
+        if (length > Max_Length)
+        {
+            return Schema_Error::TOO_LONG;
+        }
+        owner.*Member = value;
+        return Schema_Error::NONE;
+    }
+};
+
+//*****************************************************************************
+//
+//! @brief Webhook response schema.
+//!
+//! The schema describes the '~' separated fields of a webhook response
+//! template, in order, as a list of field types (Number_Field, Text_Field).
+//! The decoder of each field is generated at compile time and the schema
+//! keeps a table of them, so each field is decoded in a single pass as soon
+//! as it is complete, straight into the member receiving it. Adding a field
+//! to a response only changes its schema.
+//!
+//! i.e. for data: 37.421998~-122.084000~35
+//!     typedef Webhook_Schema<Google_Geolocation,
+//!         Number_Field<Google_Geolocation, float, &Google_Geolocation::latitud, -90, 90>,
+//!         Number_Field<Google_Geolocation, float, &Google_Geolocation::longitud, -180, 180>,
+//!         Number_Field<Google_Geolocation, uint16_t, &Google_Geolocation::accuracy, 0, 65535>
+//!     > Response_Schema;
+//
+//*****************************************************************************
+template <class Owner, class... Fields>
+class Webhook_Schema
+{
+    private:
+        //  Typedef function pointer for a field decoder.
+        typedef Schema_Error (*Field_Decoder)(Owner &owner, const char *value);
+
+        //  Field decoders, in field order.
+        static constexpr Field_Decoder DECODERS[sizeof...(Fields)] = {&Fields::decode...};
+
+    public:
+        //  Number of fields of the response.
+        static constexpr uint8_t NUM_FIELDS = sizeof...(Fields);
+
+        //*********************************************************************
+        //
+        //! @brief Decodes a field of the webhook response.
+        //!
+        //!	@param[in] owner Object receiving the field.
+        //!	@param[in] field Field position in the response template.
+        //!	@param[in] value Pointer to a char array holding the field value.
+        //!
+        //! @return Schema_Error::NONE if decoded, the decoding error otherwise.
+        //
+        //*********************************************************************
+        static Schema_Error decode(Owner &owner, uint8_t field, const char *value)
+        {
+            if (field >= NUM_FIELDS)
+            {
+                return Schema_Error::EXTRA_FIELD;
+            }
+            return DECODERS[field](owner, value);
+        }
+
+        //*********************************************************************
+        //
+        //! @brief Checks that all the fields of the response were received.
+        //!
+        //!	@param[in] num_fields Number of fields received.
+        //!
+        //! @return Schema_Error::NONE if complete, MISSING_FIELD otherwise.
+        //
+        //*********************************************************************
+        static Schema_Error check_fields(uint8_t num_fields)
+        {
+            return (num_fields < NUM_FIELDS) ? Schema_Error::MISSING_FIELD : Schema_Error::NONE;
+        }
+};
+
+template <class Owner, class... Fields>
+constexpr typename Webhook_Schema<Owner, Fields...>::Field_Decoder
+Webhook_Schema<Owner, Fields...>::DECODERS[sizeof...(Fields)];
+
+template <class Owner, class... Fields>
+constexpr uint8_t Webhook_Schema<Owner, Fields...>::NUM_FIELDS;
+
+//*****************************************************************************
+//
+//! @brief Gets a description of a decoding error.
+//!
+//!	@param[in] error Decoding error.
+//!
+//! @return A pointer to a char array holding the description.
+//
+//*****************************************************************************
+inline const char *schema_error_text(Schema_Error error)
+{
+    switch (error)
+    {
+        case Schema_Error::NONE:            return "none";
+        case Schema_Error::MISSING_FIELD:   return "missing field";
+        case Schema_Error::EXTRA_FIELD:     return "extra field";
+        case Schema_Error::NOT_A_NUMBER:    return "not a number";
+        case Schema_Error::OUT_OF_RANGE:    return "out of range";
+        case Schema_Error::TOO_LONG:        return "too long";
+        default:                            return "unknown";
+    }
+}
+
+//*****************************************************************************
+//
+//! @brief Builds the error message of a malformed response.
+//!
+//!	@param[in] error Decoding error.
+//!	@param[in] field Field position in the response template.
+//!
+//! @return A string object with the error message.
+//
+//*****************************************************************************
+inline String schema_error_message(Schema_Error error, uint8_t field)
+{
+    return String::format("\r\nError: Malformed response, field %u: %s.", field, schema_error_text(error));
+}
+
+#endif  //  __WEBHOOK_SCHEMA_H__
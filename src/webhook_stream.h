@@ -0,0 +1,318 @@
+#ifndef __WEBHOOK_STREAM_H__
+#define __WEBHOOK_STREAM_H__
+
+#include "webhook_schema.h"
+
+//  Max. size of a webhook response chunk in bytes. Responses larger than this
+//  are split by the Particle Cloud into chunks delivered as
+//  deviceID/hook-response/<event>/0, deviceID/hook-response/<event>/1, ...
+#define WEBHOOK_CHUNK_SIZE          512
+//  Max. number of out-of-order chunks held while waiting for a missing one.
+#define WEBHOOK_MAX_PENDING         2
+//  Max. number of characters of a single response field (longer are truncated).
+#define WEBHOOK_FIELD_SIZE          256
+//  Character used by the webhook response templates to divide the fields.
+#define WEBHOOK_FIELD_DELIMITER     '~'
+//  Character every webhook response template ends with (ETX, "\u0003" in the
+//  templates). It never shows up in the Google API responses.
+#define WEBHOOK_END_MARKER          '\x03'
+
+//*****************************************************************************
+//
+//! @brief Webhook response stream class.
+//!
+//! This class reassembles a chunked webhook response and splits it into the
+//! '~' separated fields defined by the webhook response template. Chunks can
+//! arrive in any order; the ones received ahead of time are held until the
+//! missing chunks arrive. Fields are passed to the parser as soon as they are
+//! complete, so the full response is never buffered.
+//!
+//! The parser class must implement the following member function:
+//!     Schema_Error parse_field(uint8_t field, const char *value);
+//!
+//! The first decoding error returned by the parser is kept with the field
+//! it belongs to, the next fields are still passed to the parser.
+//!
+//! The response is completed by WEBHOOK_END_MARKER, whatever the length of
+//! the chunk it arrives in (a response can fill its last chunk).
+//
+//*****************************************************************************
+template <class Parser>
+class Webhook_Stream
+{
+    private:
+        //  Chunk received ahead of time.
+        struct pending_chunk
+        {
+            bool used;
+            uint8_t index;
+            uint16_t length;
+            char data[WEBHOOK_CHUNK_SIZE];
+        };
+
+        //  Parser object receiving the response fields.
+        Parser &parser;
+
+        //  Chunks waiting for a missing one.
+        struct pending_chunk pending[WEBHOOK_MAX_PENDING];
+        //  Index of the next chunk to be consumed.
+        uint8_t next_chunk;
+
+        //  Field being assembled, it might span several chunks.
+        char field[WEBHOOK_FIELD_SIZE];
+        uint16_t field_length;
+        uint8_t field_index;
+
+        //  Stream status.
+        bool completed;
+        bool overflow;
+
+        //  First decoding error and the field it belongs to.
+        Schema_Error error;
+        uint8_t error_field;
+
+        //  Private member functions.
+        void consume(const char *data, uint16_t length);
+        void emit_field(void);
+
+    public:
+        //  Class constructor.
+        Webhook_Stream(Parser &parser);
+
+        //  Public member functions.
+        void reset(void);
+        bool feed(const char *event, const char *data);
+        bool failed(void);
+        template <class Schema> Schema_Error validate(void);
+        uint8_t get_error_field(void);
+        static uint8_t chunk_index(const char *event);
+};
+
+//*****************************************************************************
+//
+//! @brief Webhook response stream class constructor.
+//!
+//!	@param[in] parser Object receiving the response fields.
+//
+//*****************************************************************************
+template <class Parser>
+Webhook_Stream<Parser>::Webhook_Stream(Parser &parser)
+    : parser(parser)
+{
+    reset();
+}
+
+//*****************************************************************************
+//
+//! @brief Prepares the stream for a new response.
+//!
+//! It must be called before publishing the webhook event.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Parser>
+void Webhook_Stream<Parser>::reset(void)
+{
+    for (uint8_t i = 0; i < WEBHOOK_MAX_PENDING; i++)
+    {
+        pending[i].used = false;
+    }
+    next_chunk = 0;
+    field_length = 0;
+    field_index = 0;
+    completed = false;
+    overflow = false;
+    error = Schema_Error::NONE;
+    error_field = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Feeds a response chunk into the stream.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!	@param[in] data Pointer to a char array holding the webhook reponse chunk.
+//!
+//!	@return false if the response is not complete yet, true if completed.
+//
+//*****************************************************************************
+template <class Parser>
+bool Webhook_Stream<Parser>::feed(const char *event, const char *data)
+{
+    uint8_t index = chunk_index(event);
+    //  Ignore chunks from a completed response and duplicated chunks already
+    //  consumed.
+    if (completed || index < next_chunk)
+    {
+        return false;
+    }
+    uint16_t length = strnlen(data, WEBHOOK_CHUNK_SIZE);
+    //  Hold a chunk received ahead of time, unless it is already held.
+    if (index > next_chunk)
+    {
+        for (uint8_t i = 0; i < WEBHOOK_MAX_PENDING; i++)
+        {
+            if (pending[i].used && pending[i].index == index)
+            {
+                return false;
+            }
+        }
+        for (uint8_t i = 0; i < WEBHOOK_MAX_PENDING; i++)
+        {
+            if (!pending[i].used)
+            {
+                pending[i].used = true;
+                pending[i].index = index;
+                pending[i].length = length;
+                memcpy(pending[i].data, data, length);
+                return false;
+            }
+        }
+        //  Too many chunks out of order, the response is dropped.
+        overflow = true;
+        completed = true;
+        return true;
+    }
+    //  Consume the chunk and the ones held after it, in order.
+    consume(data, length);
+    bool found = true;
+    while (!completed && found)
+    {
+        found = false;
+        for (uint8_t i = 0; i < WEBHOOK_MAX_PENDING; i++)
+        {
+            if (pending[i].used && pending[i].index == next_chunk)
+            {
+                pending[i].used = false;
+                consume(pending[i].data, pending[i].length);
+                found = true;
+                break;
+            }
+        }
+    }
+    return completed;
+}
+
+//*****************************************************************************
+//
+//! @brief Splits a chunk into fields.
+//!
+//!	@param[in] data Pointer to the chunk data.
+//!	@param[in] length Number of bytes in the chunk.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Parser>
+void Webhook_Stream<Parser>::consume(const char *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length && !completed; i++)
+    {
+        //  The last field does not have a delimiter.
+        if (data[i] == WEBHOOK_END_MARKER)
+        {
+            emit_field();
+            completed = true;
+        }
+        else if (data[i] == WEBHOOK_FIELD_DELIMITER)
+        {
+            emit_field();
+        }
+        else if (field_length < (WEBHOOK_FIELD_SIZE - 1))
+        {
+            field[field_length++] = data[i];
+        }
+    }
+    next_chunk++;
+}
+
+//*****************************************************************************
+//
+//! @brief Passes the current field to the parser.
+//!
+//!	@return None.
+//
+//*****************************************************************************
+template <class Parser>
+void Webhook_Stream<Parser>::emit_field(void)
+{
+    field[field_length] = '\0';
+    Schema_Error field_error = parser.parse_field(field_index, field);
+    if (field_error != Schema_Error::NONE && error == Schema_Error::NONE)
+    {
+        error = field_error;
+        error_field = field_index;
+    }
+    field_index++;
+    field_length = 0;
+}
+
+//*****************************************************************************
+//
+//! @brief Checks if the response was dropped.
+//!
+//! @return false if did not fail, true if failed.
+//
+//*****************************************************************************
+template <class Parser>
+bool Webhook_Stream<Parser>::failed(void)
+{
+    return overflow;
+}
+
+//*****************************************************************************
+//
+//! @brief Validates the decoded response against its schema.
+//!
+//! It must be called once the response is completed.
+//!
+//!	@tparam Schema Webhook_Schema of the response.
+//!
+//! @return Schema_Error::NONE if valid, otherwise the first error returned
+//!         by the parser or MISSING_FIELD if fields were not received.
+//
+//*****************************************************************************
+template <class Parser>
+template <class Schema>
+Schema_Error Webhook_Stream<Parser>::validate(void)
+{
+    if (error == Schema_Error::NONE && Schema::check_fields(field_index) != Schema_Error::NONE)
+    {
+        error = Schema_Error::MISSING_FIELD;
+        error_field = field_index;
+    }
+    return error;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the field of the first decoding error.
+//!
+//! @return The field position in the response template.
+//
+//*****************************************************************************
+template <class Parser>
+uint8_t Webhook_Stream<Parser>::get_error_field(void)
+{
+    return error_field;
+}
+
+//*****************************************************************************
+//
+//! @brief Gets the chunk index from the webhook event name.
+//!
+//!	@param[in] event Pointer to a char array holidng the webhook event info.
+//!                  i.e. deviceID/hook-response/calendar_event/1
+//!
+//! @return The chunk index, 1 for the example above.
+//
+//*****************************************************************************
+template <class Parser>
+uint8_t Webhook_Stream<Parser>::chunk_index(const char *event)
+{
+    const char *index = strrchr(event, '/');
+    return (index != nullptr) ? atoi(index + 1) : 0;
+}
+
+#endif  //  __WEBHOOK_STREAM_H__
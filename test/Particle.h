@@ -0,0 +1,2 @@
+//  Device OS header of the firmware translation units, on the host.
+#include "host.h"
@@ -0,0 +1,97 @@
+//  Host run of the firmware benchmarks (src/bench.cpp). Every heap allocation
+//  goes through the wrappers below, which count the allocations and the bytes
+//  requested: malloc(), calloc() and realloc() (the Wiring String grows its
+//  buffer with realloc()), and operator new on top of malloc().
+//  Usage: bench [case name, default all]
+
+#include <new>
+
+#include "Particle.h"
+#include "bench.h"
+
+//  Device OS objects used by the firmware modules.
+USBSerial Serial;
+USARTSerial Serial1;
+CloudClass Particle;
+SystemClass System;
+TimeClass Time;
+EEPROMClass EEPROM;
+WiFiClass WiFi;
+
+//  Allocations and bytes requested since the start.
+uint32_t bench_allocs = 0;
+uint32_t bench_alloc_bytes = 0;
+
+//  glibc allocator, wrapped below.
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+extern "C" void *malloc(size_t size)
+{
+    bench_allocs++;
+    bench_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    bench_allocs++;
+    bench_alloc_bytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    bench_allocs++;
+    bench_alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+    Benchmark bench;
+    bench.begin();
+    int cases = bench.command(String((argc > 1) ? argv[1] : "all"));
+    if (cases < 0)
+    {
+        printf("Unknown benchmark case.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,443 @@
+//  Host stand-in for the Device OS definitions used by the firmware modules
+//  built on the host. It is force-included by test/Makefile, so the firmware
+//  headers and translation units build on the host unchanged (test/Particle.h
+//  only includes this file).
+#ifndef __HOST_H__
+#define __HOST_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <chrono>
+#include <functional>
+#include <string>
+
+//*****************************************************************************
+//
+//	Wiring String. It allocates as the Device OS one does: one heap buffer
+//  per string, grown with realloc() to the exact length, so the allocations
+//  counted by the host benchmarks are those of the device.
+//
+//*****************************************************************************
+class String
+{
+    private:
+        char *buffer;
+        unsigned capacity;
+        unsigned len;
+
+        bool reserve_buffer(unsigned size)
+        {
+            if (buffer != nullptr && capacity >= size)
+            {
+                return true;
+            }
+            char *new_buffer = (char *) realloc(buffer, size + 1);
+            if (new_buffer == nullptr)
+            {
+                return false;
+            }
+            if (buffer == nullptr || len == 0)
+            {
+                new_buffer[0] = '\0';
+            }
+            buffer = new_buffer;
+            capacity = size;
+            return true;
+        }
+
+        String &copy(const char *value, unsigned length)
+        {
+            if (reserve_buffer(length))
+            {
+                memcpy(buffer, value, length);
+                buffer[length] = '\0';
+                len = length;
+            }
+            return *this;
+        }
+
+        static String number(const char *format, ...)
+        {
+            char text[40];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(text, sizeof(text), format, args);
+            va_end(args);
+            return String(text);
+        }
+
+    public:
+        String(const char *value = "") : buffer(nullptr), capacity(0), len(0)
+        {
+            copy((value != nullptr) ? value : "", (value != nullptr) ? strlen(value) : 0);
+        }
+        String(const String &value) : buffer(nullptr), capacity(0), len(0) { copy(value.c_str(), value.len); }
+        String(String &&value) : buffer(value.buffer), capacity(value.capacity), len(value.len)
+        {
+            value.buffer = nullptr;
+            value.capacity = 0;
+            value.len = 0;
+        }
+        explicit String(char value) : String() { concat(&value, 1); }
+        explicit String(int value) : String(number("%d", value)) {}
+        explicit String(unsigned value) : String(number("%u", value)) {}
+        explicit String(long value) : String(number("%ld", value)) {}
+        explicit String(unsigned long value) : String(number("%lu", value)) {}
+        explicit String(long long value) : String(number("%lld", value)) {}
+        explicit String(float value, int decimals = 6) : String(number("%.*f", decimals, value)) {}
+        explicit String(double value, int decimals = 6) : String(number("%.*f", decimals, value)) {}
+        ~String() { free(buffer); }
+
+        String &operator=(const String &value) { return (this == &value) ? *this : copy(value.c_str(), value.len); }
+        String &operator=(String &&value)
+        {
+            if (this != &value)
+            {
+                free(buffer);
+                buffer = value.buffer;
+                capacity = value.capacity;
+                len = value.len;
+                value.buffer = nullptr;
+                value.capacity = 0;
+                value.len = 0;
+            }
+            return *this;
+        }
+        String &operator=(const char *value) { return copy(value, strlen(value)); }
+
+        const char *c_str(void) const { return (buffer != nullptr) ? buffer : ""; }
+        unsigned length(void) const { return len; }
+        bool reserve(unsigned size) { return reserve_buffer(size); }
+        char charAt(unsigned index) const { return (index < len) ? buffer[index] : '\0'; }
+        char operator[](unsigned index) const { return charAt(index); }
+
+        bool concat(const char *value, unsigned length)
+        {
+            if (length == 0)
+            {
+                return true;
+            }
+            if (!reserve_buffer(len + length))
+            {
+                return false;
+            }
+            memcpy(buffer + len, value, length);
+            len += length;
+            buffer[len] = '\0';
+            return true;
+        }
+        bool concat(const String &value) { return concat(value.c_str(), value.len); }
+        bool concat(const char *value) { return concat(value, strlen(value)); }
+        bool concat(char value) { return concat(&value, 1); }
+        String &operator+=(const String &value) { concat(value); return *this; }
+        String &operator+=(const char *value) { concat(value); return *this; }
+        String &operator+=(char value) { concat(value); return *this; }
+        friend String operator+(const String &left, const String &right) { String sum(left); sum.concat(right); return sum; }
+        friend String operator+(const String &left, const char *right) { String sum(left); sum.concat(right); return sum; }
+        friend String operator+(const char *left, const String &right) { String sum(left); sum.concat(right); return sum; }
+
+        bool equals(const char *value) const { return strcmp(c_str(), value) == 0; }
+        bool equals(const String &value) const { return (len == value.len) && equals(value.c_str()); }
+        bool operator==(const char *value) const { return equals(value); }
+        bool operator==(const String &value) const { return equals(value); }
+        bool operator!=(const char *value) const { return !equals(value); }
+        bool operator!=(const String &value) const { return !equals(value); }
+        bool startsWith(const String &prefix) const { return (len >= prefix.len) && strncmp(c_str(), prefix.c_str(), prefix.len) == 0; }
+        bool endsWith(const String &suffix) const { return (len >= suffix.len) && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0; }
+
+        int indexOf(char value, unsigned from = 0) const
+        {
+            const char *found = (from < len) ? strchr(buffer + from, value) : nullptr;
+            return (found != nullptr) ? (int)(found - buffer) : -1;
+        }
+        int indexOf(const String &value, unsigned from = 0) const
+        {
+            const char *found = (from < len) ? strstr(buffer + from, value.c_str()) : nullptr;
+            return (found != nullptr) ? (int)(found - buffer) : -1;
+        }
+        int lastIndexOf(char value) const
+        {
+            const char *found = strrchr(c_str(), value);
+            return (found != nullptr) ? (int)(found - buffer) : -1;
+        }
+        String substring(unsigned left) const { return substring(left, len); }
+        String substring(unsigned left, unsigned right) const
+        {
+            String out;
+            if (left > right)
+            {
+                unsigned swap = left;
+                left = right;
+                right = swap;
+            }
+            if (left < len)
+            {
+                right = (right > len) ? len : right;
+                out.copy(buffer + left, right - left);
+            }
+            return out;
+        }
+        String &remove(unsigned index) { return remove(index, (unsigned) -1); }
+        String &remove(unsigned index, unsigned count)
+        {
+            if (index < len)
+            {
+                count = (count > len - index) ? (len - index) : count;
+                memmove(buffer + index, buffer + index + count, len - index - count + 1);
+                len -= count;
+            }
+            return *this;
+        }
+        void replace(const String &find, const String &with)
+        {
+            if (find.len == 0)
+            {
+                return;
+            }
+            String out;
+            int start = 0;
+            int index;
+            while ((index = indexOf(find, start)) >= 0)
+            {
+                out.concat(buffer + start, index - start);
+                out.concat(with);
+                start = index + find.len;
+            }
+            out.concat(c_str() + start);
+            *this = out;
+        }
+        void trim(void)
+        {
+            unsigned begin = 0;
+            while (begin < len && strchr(" \t\r\n", buffer[begin]) != nullptr)
+            {
+                begin++;
+            }
+            unsigned end = len;
+            while (end > begin && strchr(" \t\r\n", buffer[end - 1]) != nullptr)
+            {
+                end--;
+            }
+            remove(end);
+            remove(0, begin);
+        }
+        void toCharArray(char *text, unsigned size) const
+        {
+            if (size > 0)
+            {
+                strncpy(text, c_str(), size - 1);
+                text[size - 1] = '\0';
+            }
+        }
+        long toInt(void) const { return atol(c_str()); }
+        float toFloat(void) const { return atof(c_str()); }
+
+        static String format(const char *format, ...) __attribute__((format(printf, 1, 2)))
+        {
+            va_list args;
+            va_start(args, format);
+            int length = vsnprintf(nullptr, 0, format, args);
+            va_end(args);
+            String out;
+            if (length > 0 && out.reserve(length))
+            {
+                va_start(args, format);
+                vsnprintf(out.buffer, length + 1, format, args);
+                va_end(args);
+                out.len = length;
+            }
+            return out;
+        }
+};
+
+//*****************************************************************************
+//
+//	Serial ports. The USB serial port prints to the standard output, the
+//  hardware serial ports read and write nothing.
+//
+//*****************************************************************************
+class Print
+{
+    public:
+        virtual ~Print() {}
+        virtual size_t write(const uint8_t *data, size_t size) { return fwrite(data, 1, size, stdout); }
+        size_t write(uint8_t value) { return write(&value, 1); }
+        size_t print(const char *text) { return write((const uint8_t *) text, strlen(text)); }
+        size_t print(const String &text) { return print(text.c_str()); }
+        size_t println(void) { return print("\r\n"); }
+        size_t println(const char *text) { return print(text) + println(); }
+        size_t println(const String &text) { return println(text.c_str()); }
+        size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            char text[512];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(text, sizeof(text), format, args);
+            va_end(args);
+            return print(text);
+        }
+        size_t printlnf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            char text[512];
+            va_list args;
+            va_start(args, format);
+            vsnprintf(text, sizeof(text), format, args);
+            va_end(args);
+            return println(text);
+        }
+        void flush(void) { fflush(stdout); }
+};
+
+class Stream : public Print
+{
+    public:
+        int available(void) { return 0; }
+        int read(void) { return -1; }
+        int peek(void) { return -1; }
+        void setTimeout(unsigned long) {}
+};
+
+class USBSerial : public Stream
+{
+    public:
+        void begin(long = 9600) {}
+        bool isConnected(void) { return true; }
+        int availableForWrite(void) { return 64; }
+};
+
+class USARTSerial : public Stream
+{
+    public:
+        void begin(long) {}
+        size_t write(const uint8_t *, size_t size) override { return size; }
+};
+
+extern USBSerial Serial;
+extern USARTSerial Serial1;
+
+//*****************************************************************************
+//
+//	Particle Cloud. Nothing is published or received.
+//
+//*****************************************************************************
+enum PublishFlag { PUBLIC, PRIVATE, NO_ACK, WITH_ACK };
+enum Spark_Subscription_Scope_TypeDef { MY_DEVICES, ALL_DEVICES };
+
+class CloudClass
+{
+    public:
+        bool publish(const String &, const String &, PublishFlag = PRIVATE) { return true; }
+        template <typename T>
+        bool subscribe(const String &, void (T::*)(const char *, const char *), T *,
+                       Spark_Subscription_Scope_TypeDef = MY_DEVICES) { return true; }
+        template <typename T>
+        bool function(const char *, int (T::*)(String), T *) { return true; }
+        template <typename T>
+        bool variable(const char *, const T &) { return true; }
+        bool connected(void) { return true; }
+};
+
+extern CloudClass Particle;
+
+//*****************************************************************************
+//
+//	Device OS system, time and storage.
+//
+//*****************************************************************************
+class SystemClass
+{
+    public:
+        String deviceID(void) { return String("e00fce681f2a3b4c5d6e7f80"); }
+        uint32_t ticks(void)
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+        uint32_t ticksPerMicrosecond(void) { return 1000; }
+        uint32_t freeMemory(void) { return 0; }
+        int resetReason(void) { return 0; }
+};
+
+extern SystemClass System;
+
+class TimeClass
+{
+    public:
+        time_t now(void) { return time(nullptr); }
+        bool isValid(void) { return true; }
+};
+
+extern TimeClass Time;
+
+class EEPROMClass
+{
+    public:
+        template <typename T> T &get(int, T &value) { return value; }
+        template <typename T> const T &put(int, const T &value) { return value; }
+};
+
+extern EEPROMClass EEPROM;
+
+struct WiFiAccessPoint
+{
+    uint8_t ssid[33];
+    uint8_t ssidLength;
+    uint8_t bssid[6];
+    int security;
+    int cipher;
+    uint8_t channel;
+    int maxDataRate;
+    int rssi;
+};
+
+class WiFiClass
+{
+    public:
+        int scan(void (*)(WiFiAccessPoint *, void *), void * = nullptr) { return 0; }
+};
+
+extern WiFiClass WiFi;
+
+class TCPClient : public Stream
+{
+    public:
+        int connect(const char *, uint16_t) { return 0; }
+        bool connected(void) { return false; }
+        void stop(void) {}
+};
+
+inline uint32_t millis(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+inline uint32_t micros(void) { return millis() * 1000; }
+inline void delay(uint32_t) {}
+inline void pinMode(uint16_t, int) {}
+inline int digitalRead(uint16_t) { return 1; }
+
+#define INPUT       0
+#define OUTPUT      1
+#define LOW         0
+#define HIGH        1
+#define D2          2
+#define retained
+
+#if !defined(__GLIBC__) || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char *destination, const char *source, size_t size)
+{
+    if (size > 0)
+    {
+        strncpy(destination, source, size - 1);
+        destination[size - 1] = '\0';
+    }
+    return strlen(source);
+}
+#endif
+#define strlcpy_P   strlcpy
+
+#endif  //  __HOST_H__
@@ -0,0 +1,96 @@
+//  Host tests of the time zone rules: the UTC offset of every zone of
+//  TIME_ZONE_RULES is checked against glibc localtime_r with the zoneinfo
+//  file of the zone, from 2020 to 2040, as well as the conversions back to
+//  UTC and the RFC3339 format.
+//  Usage: time_zone_test
+
+#include <string>
+#include <unistd.h>
+
+#include "time_zone.h"
+
+//  Range checked, and step between the instants checked in seconds. The DST
+//  transitions of the zones in the table happen on the hour or half hour.
+#define TEST_START_YEAR     2020
+#define TEST_END_YEAR       2040
+#define TEST_STEP           1800
+
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);       \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+//  Checks a zone against its zoneinfo file, stopping at the first mismatches.
+static void check_zone(const Time_Zone_Rule &zone)
+{
+    printf("%s\n", zone.name);
+    std::string path = std::string("/usr/share/zoneinfo/") + zone.name;
+    if (access(path.c_str(), R_OK) != 0)
+    {
+        printf("  FAIL cannot open %s\n", path.c_str());
+        failures++;
+        return;
+    }
+    setenv("TZ", (std::string(":") + zone.name).c_str(), 1);
+    tzset();
+    time_t start = (time_t) days_from_civil(TEST_START_YEAR, 1, 1) * 86400;
+    time_t end = (time_t) days_from_civil(TEST_END_YEAR + 1, 1, 1) * 86400;
+    int mismatches = 0;
+    for (time_t utc = start; utc < end && mismatches < 5; utc += TEST_STEP)
+    {
+        struct tm tm;
+        localtime_r(&utc, &tm);
+        int32_t offset = utc_offset(zone, utc);
+        if (offset != tm.tm_gmtoff)
+        {
+            printf("  FAIL %s: offset %ld, zoneinfo %ld\n",
+                   rfc3339_format(utc).c_str(), (long) offset, (long) tm.tm_gmtoff);
+            mismatches++;
+            continue;
+        }
+        //  A local time maps back to the same instant, or to the first one
+        //  if it is repeated when DST ends.
+        time_t local = local_time(zone, utc);
+        time_t back = utc_time(zone, local);
+        if (back != utc && !(back < utc && local_time(zone, back) == local))
+        {
+            printf("  FAIL %s: back to UTC %s\n", rfc3339_format(utc).c_str(), rfc3339_format(back).c_str());
+            mismatches++;
+            continue;
+        }
+        //  The timestamp is the local time of the zoneinfo file.
+        char expected[RFC3339_SIZE];
+        strftime(expected, sizeof(expected), "%Y-%m-%dT%H:%M:%S", &tm);
+        if (strncmp(rfc3339_format(utc, offset).c_str(), expected, strlen(expected)) != 0)
+        {
+            printf("  FAIL %s: local time %s\n", rfc3339_format(utc, offset).c_str(), expected);
+            mismatches++;
+        }
+    }
+    failures += mismatches;
+}
+
+int main(void)
+{
+    for (uint8_t i = 0; i < NUM_TIME_ZONES; i++)
+    {
+        check_zone(TIME_ZONE_RULES[i]);
+    }
+
+    //  Offset format, east and west of UTC, and the Zulu time zone.
+    printf("RFC3339 format\n");
+    time_t utc = (time_t) days_from_civil(2011, 6, 3) * 86400 + 17 * 3600;
+    CHECK(rfc3339_format(utc) == "2011-06-03T17:00:00Z");
+    CHECK(rfc3339_format(utc, -7 * 3600) == "2011-06-03T10:00:00-07:00");
+    CHECK(rfc3339_format(utc, 5 * 3600 + 1800) == "2011-06-03T22:30:00+05:30");
+
+    printf("%s\n", (failures == 0) ? "PASS" : "FAILED");
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+//  Host tests of the webhook response schema: the number decoder, the range
+//  check and the typed fields, alone and fed through a response stream.
+//  Usage: webhook_schema_test
+
+#include <cmath>
+#include <string>
+
+#include "webhook_stream.h"
+
+//  Topic of the test responses, single chunk.
+#define TEST_TOPIC  "e00fce68c3f5d2a6b1c2d3e4/hook-response/geolocation_event/0"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);       \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+//  Object receiving the fields, i.e. data: 37.421998~-122.084000~35~ROOFTOP~1520
+struct Location
+{
+    float latitude = 0;
+    float longitude = 0;
+    uint16_t accuracy = 0;
+    String type;
+    uint32_t duration_ms = 7;
+
+    typedef Webhook_Schema<Location,
+        Number_Field<Location, float, &Location::latitude, -90, 90>,
+        Number_Field<Location, float, &Location::longitude, -180, 180>,
+        Number_Field<Location, uint16_t, &Location::accuracy, 0, 65535, 1, ' '>,
+        Text_Field<Location, &Location::type, 8, false>,
+        Number_Field<Location, uint32_t, &Location::duration_ms, 0, 604800, 1000, '\0', false>
+    > Schema;
+
+    Schema_Error parse_field(uint8_t field, const char *value)
+    {
+        return Schema::decode(*this, field, value);
+    }
+};
+
+//  Decodes a number and checks the error and, if decoded, the number.
+static void check_number(const char *value, char end, Schema_Error expected,
+                         bool negative = false, uint32_t mantissa = 0, uint8_t decimals = 0)
+{
+    Schema_Number number;
+    Schema_Error error = decode_number(value, end, number);
+    if (error != expected || (error == Schema_Error::NONE &&
+        (number.negative != negative || number.mantissa != mantissa || number.decimals != decimals)))
+    {
+        printf("  FAIL \"%s\": %s, %c%lu/10^%u\n", value, schema_error_text(error),
+               number.negative ? '-' : '+', (unsigned long) number.mantissa, number.decimals);
+        failures++;
+    }
+}
+
+//  Checks if a number is within a range.
+static bool in_range(const char *value, long min, long max)
+{
+    Schema_Number number;
+    CHECK(decode_number(value, '\0', number) == Schema_Error::NONE);
+    return number_in_range(number, min, max);
+}
+
+//  Feeds a single chunk response and returns the validation result.
+static Schema_Error feed(Location &location, const std::string &payload, bool &completed, uint8_t &field)
+{
+    Webhook_Stream<Location> stream(location);
+    completed = stream.feed(TEST_TOPIC, payload.c_str());
+    Schema_Error error = stream.validate<Location::Schema>();
+    field = stream.get_error_field();
+    return error;
+}
+
+int main(void)
+{
+    printf("decode_number\n");
+    check_number("1520", '\0', Schema_Error::NONE, false, 1520, 0);
+    check_number("-1,234.5", '\0', Schema_Error::NONE, true, 12345, 1);
+    check_number("+7", '\0', Schema_Error::NONE, false, 7, 0);
+    check_number("12.3 mi", ' ', Schema_Error::NONE, false, 123, 1);
+    check_number("12.3", ' ', Schema_Error::NONE, false, 123, 1);
+    check_number("4294967295", '\0', Schema_Error::NONE, false, 4294967295UL, 0);
+    //  Fractional digits beyond SCHEMA_MAX_DECIMALS are ignored.
+    check_number("1.1234567891", '\0', Schema_Error::NONE, false, 1123456789, 9);
+
+    printf("decode_number, malformed\n");
+    check_number("", '\0', Schema_Error::MISSING_FIELD);
+    check_number("-", '\0', Schema_Error::MISSING_FIELD);
+    check_number(".", '\0', Schema_Error::NOT_A_NUMBER);
+    check_number("abc", '\0', Schema_Error::NOT_A_NUMBER);
+    check_number("1.2.3", '\0', Schema_Error::NOT_A_NUMBER);
+    check_number("1.2,3", '\0', Schema_Error::NOT_A_NUMBER);
+    check_number("--1", '\0', Schema_Error::NOT_A_NUMBER);
+    //  Missing terminator, the unit follows the number without its end.
+    check_number("12.3mi", ' ', Schema_Error::NOT_A_NUMBER);
+    check_number("12.3 mi", '\0', Schema_Error::NOT_A_NUMBER);
+
+    printf("decode_number, out of range\n");
+    check_number("4294967296", '\0', Schema_Error::OUT_OF_RANGE);
+    check_number("-99999999999", '\0', Schema_Error::OUT_OF_RANGE);
+
+    printf("number_in_range\n");
+    CHECK(in_range("90", -90, 90));
+    CHECK(in_range("-90", -90, 90));
+    CHECK(in_range("89.999", -90, 90));
+    CHECK(!in_range("90.5", -90, 90));
+    CHECK(!in_range("-90.5", -90, 90));
+    CHECK(!in_range("91", -90, 90));
+    CHECK(!in_range("0.5", 0, 0));
+    CHECK(!in_range("-0.5", 0, 0));
+    CHECK(in_range("2147483647", 0, INT32_MAX));
+    CHECK(!in_range("2147483648", 0, INT32_MAX));
+
+    printf("Number_Field\n");
+    {
+        Location location;
+        typedef Number_Field<Location, float, &Location::latitude, -90, 90> Latitude;
+        CHECK(Latitude::decode(location, "37.421998") == Schema_Error::NONE);
+        CHECK(std::fabs(location.latitude - 37.421998f) < 1e-5);
+        //  The member is kept on error.
+        CHECK(Latitude::decode(location, "90.1") == Schema_Error::OUT_OF_RANGE);
+        CHECK(Latitude::decode(location, "37.4,2") == Schema_Error::NOT_A_NUMBER);
+        CHECK(Latitude::decode(location, "") == Schema_Error::MISSING_FIELD);
+        CHECK(std::fabs(location.latitude - 37.421998f) < 1e-5);
+        //  Integer members get the number truncated, then scaled.
+        typedef Number_Field<Location, uint32_t, &Location::duration_ms, 0, 604800, 1000, '\0', false> Duration;
+        CHECK(Duration::decode(location, "") == Schema_Error::NONE);
+        CHECK(location.duration_ms == 7);
+        CHECK(Duration::decode(location, "2.9") == Schema_Error::NONE);
+        CHECK(location.duration_ms == 2000);
+        CHECK(Duration::decode(location, "604801") == Schema_Error::OUT_OF_RANGE);
+        CHECK(Duration::decode(location, "-1") == Schema_Error::OUT_OF_RANGE);
+        CHECK(location.duration_ms == 2000);
+    }
+
+    printf("Text_Field\n");
+    {
+        Location location;
+        typedef Text_Field<Location, &Location::type, 8> Required_Type;
+        typedef Text_Field<Location, &Location::type, 8, false> Optional_Type;
+        CHECK(Required_Type::decode(location, "ROOFTOP") == Schema_Error::NONE);
+        CHECK(location.type == "ROOFTOP");
+        CHECK(Required_Type::decode(location, "APPROXIMA") == Schema_Error::TOO_LONG);
+        CHECK(Required_Type::decode(location, "") == Schema_Error::MISSING_FIELD);
+        CHECK(location.type == "ROOFTOP");
+        CHECK(Optional_Type::decode(location, "") == Schema_Error::NONE);
+        CHECK(location.type == "");
+        CHECK(Optional_Type::decode(location, "12345678") == Schema_Error::NONE);
+    }
+
+    printf("Webhook_Schema\n");
+    {
+        Location location;
+        CHECK(Location::Schema::NUM_FIELDS == 5);
+        CHECK(Location::Schema::decode(location, 5, "1") == Schema_Error::EXTRA_FIELD);
+        CHECK(Location::Schema::check_fields(4) == Schema_Error::MISSING_FIELD);
+        CHECK(Location::Schema::check_fields(5) == Schema_Error::NONE);
+    }
+
+    printf("response through the stream\n");
+    {
+        Location location;
+        bool completed = false;
+        uint8_t field = 0;
+        CHECK(feed(location, "37.421998~-122.084000~35 m~ROOFTOP~1520\x03", completed, field) == Schema_Error::NONE);
+        CHECK(completed);
+        CHECK(location.accuracy == 35 && location.type == "ROOFTOP" && location.duration_ms == 1520000);
+        //  The first error is kept with its field.
+        CHECK(feed(location, "37.4~-190~35m~ROOFTOP~1\x03", completed, field) == Schema_Error::OUT_OF_RANGE);
+        CHECK(completed && field == 1);
+        CHECK(feed(location, "37.4~-122.0~35~ROOFTOP~1~2\x03", completed, field) == Schema_Error::EXTRA_FIELD);
+        CHECK(completed && field == 5);
+        CHECK(feed(location, "37.4~-122.0~35\x03", completed, field) == Schema_Error::MISSING_FIELD);
+        CHECK(completed && field == 3);
+        //  Without the end marker, a short chunk does not complete the response.
+        feed(location, "37.4~-122.0~35~ROOFTOP~1", completed, field);
+        CHECK(!completed);
+    }
+
+    printf("%s\n", (failures == 0) ? "PASS" : "FAILED");
+    return (failures == 0) ? 0 : 1;
+}
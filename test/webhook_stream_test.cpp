@@ -0,0 +1,169 @@
+//  Host tests of the webhook response stream: the fixtures are fed as the
+//  Particle Cloud delivers them, split in WEBHOOK_CHUNK_SIZE chunks, in order,
+//  out of order and repeated.
+//  Usage: webhook_stream_test <fixtures directory>
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+#include "webhook_stream.h"
+
+//  Topic of the fixture responses, the chunk index is appended.
+#define TEST_TOPIC  "e00fce68c3f5d2a6b1c2d3e4/hook-response/calendar_event/1/g7/"
+
+static int failures = 0;
+
+#define CHECK(condition)                                                        \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            printf("  FAIL %s:%d: %s\n", __FILE__, __LINE__, #condition);       \
+            failures++;                                                         \
+        }                                                                       \
+    } while (0)
+
+//  Parser keeping every field received.
+struct Field_Collector
+{
+    std::vector<std::string> fields;
+
+    Schema_Error parse_field(uint8_t field, const char *value)
+    {
+        CHECK(field == fields.size());
+        fields.push_back(value);
+        return Schema_Error::NONE;
+    }
+};
+
+//  Fields expected from a payload: '~' separated, up to the end marker.
+static std::vector<std::string> split_fields(const std::string &payload)
+{
+    std::vector<std::string> fields;
+    std::string field;
+    for (char c : payload.substr(0, payload.find(WEBHOOK_END_MARKER)))
+    {
+        if (c == WEBHOOK_FIELD_DELIMITER)
+        {
+            fields.push_back(field);
+            field.clear();
+        }
+        else
+        {
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return fields;
+}
+
+static std::vector<std::string> split_chunks(const std::string &payload)
+{
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < payload.size(); i += WEBHOOK_CHUNK_SIZE)
+    {
+        chunks.push_back(payload.substr(i, WEBHOOK_CHUNK_SIZE));
+    }
+    return chunks;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        printf("  FAIL cannot open %s\n", path.c_str());
+        failures++;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+//  Feeds the chunks of a payload in the given order, and checks the response
+//  is completed exactly once with every field.
+static void check_order(const char *name, const std::string &payload, const std::vector<int> &order)
+{
+    printf("%s\n", name);
+    std::vector<std::string> chunks = split_chunks(payload);
+    Field_Collector collector;
+    Webhook_Stream<Field_Collector> stream(collector);
+    int completes = 0;
+    for (int index : order)
+    {
+        std::string event = TEST_TOPIC + std::to_string(index);
+        completes += stream.feed(event.c_str(), chunks[index].c_str()) ? 1 : 0;
+    }
+    CHECK(completes == 1);
+    CHECK(!stream.failed());
+    CHECK(collector.fields == split_fields(payload));
+}
+
+int main(int argc, char **argv)
+{
+    std::string fixtures = (argc > 1) ? argv[1] : "fixtures";
+    std::string multi = read_file(fixtures + "/calendar_multi_chunk.txt");
+    std::string exact = read_file(fixtures + "/calendar_exact_1024.txt");
+
+    //  Multi-chunk response (3 chunks, the last one short).
+    CHECK(multi.size() > 2 * WEBHOOK_CHUNK_SIZE && multi.size() < 3 * WEBHOOK_CHUNK_SIZE);
+    check_order("multi-chunk, in order", multi, {0, 1, 2});
+    check_order("multi-chunk, swapped", multi, {1, 0, 2});
+    check_order("multi-chunk, reversed", multi, {2, 1, 0});
+    check_order("multi-chunk, repeated", multi, {0, 0, 1, 0, 2, 2});
+    check_order("multi-chunk, repeated ahead of time", multi, {2, 2, 1, 1, 2, 0});
+
+    //  Response filling its last chunk, no short chunk ever arrives.
+    CHECK(exact.size() == 2 * WEBHOOK_CHUNK_SIZE);
+    check_order("exact multiple of the chunk size, in order", exact, {0, 1});
+    check_order("exact multiple of the chunk size, swapped", exact, {1, 0});
+    check_order("exact chunk size", exact.substr(0, WEBHOOK_CHUNK_SIZE - 1) + WEBHOOK_END_MARKER, {0});
+
+    //  Chunks recorded as the local cloud delivers them (--reorder).
+    printf("out-of-order fixture\n");
+    {
+        std::istringstream lines(read_file(fixtures + "/calendar_out_of_order.txt"));
+        std::string line;
+        Field_Collector collector;
+        Webhook_Stream<Field_Collector> stream(collector);
+        int completes = 0;
+        int chunks = 0;
+        while (std::getline(lines, line))
+        {
+            //  E <topic> <chunk>
+            size_t topic_end = line.find(' ', 2);
+            std::string event = line.substr(2, topic_end - 2);
+            std::string data = line.substr(topic_end + 1);
+            completes += stream.feed(event.c_str(), data.c_str()) ? 1 : 0;
+            chunks++;
+        }
+        CHECK(chunks == 3);
+        CHECK(completes == 1);
+        CHECK(!stream.failed());
+        CHECK(collector.fields == split_fields(multi));
+    }
+
+    //  More chunks ahead of time than WEBHOOK_MAX_PENDING, the response is
+    //  dropped.
+    printf("too many chunks out of order\n");
+    {
+        std::string payload = multi.substr(0, multi.size() - 1) + multi;
+        std::vector<std::string> chunks = split_chunks(payload);
+        CHECK(chunks.size() > (WEBHOOK_MAX_PENDING + 1));
+        Field_Collector collector;
+        Webhook_Stream<Field_Collector> stream(collector);
+        bool completed = false;
+        for (uint8_t index = 1; index <= (WEBHOOK_MAX_PENDING + 1); index++)
+        {
+            std::string event = TEST_TOPIC + std::to_string(index);
+            completed = stream.feed(event.c_str(), chunks[index].c_str());
+        }
+        CHECK(completed);
+        CHECK(stream.failed());
+    }
+
+    printf("%s\n", (failures == 0) ? "PASS" : "FAILED");
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,388 @@
+#!/usr/bin/env python3
+"""Webhook load model of many devices against the local cloud stand-in
+(tools/local_cloud.py).
+
+Every modelled device connects like a real one (LOCAL_CLOUD_ENABLED) and
+publishes a model of the firmware webhook sequence: geolocation and token
+refresh after boot, then a calendar request followed by a distance matrix
+request for every assistant request. A device waits for the full response
+(the end marker every response template ends with, or a hook-error) before
+going on with the request of the same user, as the firmware does. With
+several users per device, the requests of all users run at the same time,
+using the user tagged event names (i.e. calendar_event/1).
+
+The publish fan-out of a request is modelled: the calendar request publishes
+one event per calendar of the set (--calendars, calendar_event/c1, ...), and
+the distance matrix request one event per departure candidate (/d1, ...) and
+round. A transit request is a single publish; a driving request publishes
+DEPARTURE_CANDIDATES candidates for --rounds rounds, as the responses of the
+stand-in do not drive the departure search.
+
+Every publish goes through a model of the device publish path (src/cloud.cpp):
+a token bucket of PUBLISH_BURST tokens refilled every PUBLISH_PERIOD, and a
+queue of PUBLISH_QUEUE_SIZE publishes, the location refresh in the background
+class. A queued publish of the same webhook is replaced, and a publish that
+does not fit fails its request with a 429, as the firmware does.
+
+Every request is tagged with a generation (i.e. calendar_event/1/g7), and
+the responses of an older generation are counted as stale and dropped. With
+--burst, each assistant request is triggered several times, --burst-gap
+seconds apart, and the repeated triggers follow --policy:
+    coalesce    as the firmware does, a trigger within --window seconds of
+                the request in flight is coalesced onto it, a later one
+                supersedes it.
+    restart     every trigger restarts the request in flight, as the
+                firmware did before the request generations.
+
+The publish sequence, the publish path, the coalescing policy and the
+generation tags are re-implemented here; the firmware (App_Context, the
+webhook cloud and the request tasks) is not run. The figures reported are
+those of this model, not measurements of the firmware, and only hold while
+it matches src/smartCalendar.ino, src/calendar.cpp, src/distance_matrix.cpp
+and src/cloud.cpp; update it along with them.
+
+Devices are split in shards, each shard runs its devices concurrently on an
+asyncio loop and the shards run in parallel worker processes, one per core
+by default.
+
+Usage: tools/fleet_sim.py --devices 1000 --duration 60 --interval 20 --users 2
+       tools/fleet_sim.py --devices 100 --calendars 3 --mode driving --rounds 3
+       tools/fleet_sim.py --devices 100 --burst 3 --burst-gap 0.2 --policy restart
+"""
+
+import argparse
+import asyncio
+import json
+import multiprocessing
+import random
+import re
+import time
+
+# Character every webhook response template ends with (WEBHOOK_END_MARKER).
+END_MARKER = "\x03"
+
+# Publish rate limit and queue (src/cloud.h).
+PUBLISH_PERIOD = 1.0
+PUBLISH_BURST = 4
+PUBLISH_QUEUE_SIZE = 8
+# Publish priority classes (Publish_Class), a lower value goes first.
+USER, BACKGROUND = 0, 1
+
+# Calendar set and departure search limits (src/calendar.h,
+# src/distance_matrix.h).
+CALENDAR_MAX_IDS = 3
+DEPARTURE_CANDIDATES = 3
+DEPARTURE_MAX_ROUNDS = 3
+
+
+def untagged(event):
+    """Removes the request generation tag from an event name."""
+    return re.sub(r"/g\d+$", "", event)
+
+
+class Publisher:
+    """Model of the device publish path (Webhook_Cloud::publish())."""
+
+    def __init__(self, device):
+        self.device = device
+        self.tokens = PUBLISH_BURST
+        self.refill_time = time.time()
+        self.queue = []
+        self.sequence = 0
+        self.timer = None
+
+    def refill(self):
+        periods = int((time.time() - self.refill_time) / PUBLISH_PERIOD)
+        if periods:
+            self.refill_time += periods * PUBLISH_PERIOD
+            self.tokens = min(PUBLISH_BURST, self.tokens + periods)
+
+    def publish(self, event, data, priority):
+        """Queues a publish and sends what the rate limit allows."""
+        name = untagged(event)
+        for entry in self.queue:
+            # Superseded request, the publish is replaced and keeps its place.
+            if entry["name"] == name:
+                entry.update(event=event, data=data, priority=priority, queue_time=time.time())
+                return
+        if len(self.queue) >= PUBLISH_QUEUE_SIZE:
+            lower = [entry for entry in self.queue if entry["priority"] > priority]
+            if not lower:
+                self.device.dropped(event)
+                return
+            # The newest publish of the lowest priority class makes room.
+            victim = max(lower, key=lambda entry: (entry["priority"], entry["sequence"]))
+            self.queue.remove(victim)
+            self.device.dropped(victim["event"])
+        self.queue.append({"name": name, "event": event, "data": data, "priority": priority,
+                           "sequence": self.sequence, "queue_time": time.time()})
+        self.sequence += 1
+        self.flush()
+
+    def flush(self):
+        self.refill()
+        while self.queue and self.tokens > 0:
+            entry = min(self.queue, key=lambda entry: (entry["priority"], entry["sequence"]))
+            self.queue.remove(entry)
+            self.tokens -= 1
+            self.device.send(entry["event"], entry["data"], time.time() - entry["queue_time"])
+        # Rate limited, flushed again as the next token is refilled (the
+        # firmware flushes from loop()).
+        if self.queue and self.timer is None:
+            delay = max(self.refill_time + PUBLISH_PERIOD - time.time(), 0)
+            self.timer = asyncio.get_event_loop().call_later(delay, self.flushed)
+
+    def flushed(self):
+        self.timer = None
+        self.flush()
+
+
+class Device:
+    """Simulated device speaking the local cloud line protocol."""
+
+    def __init__(self, index, args, stats):
+        self.device_id = "%024x" % (0xe00fce680000000000000000 + index)
+        self.args = args
+        self.stats = stats
+        self.samples = stats["samples"]
+        self.delays = {}
+        self.responses = {}
+        self.generation = [0] * args.users
+        self.publisher = Publisher(self)
+
+    async def run(self, deadline):
+        reader, writer = await asyncio.open_connection(self.args.host, self.args.port)
+        self.writer = writer
+        receiver = asyncio.ensure_future(self.receive(reader))
+        writer.write(("D %s\n" % self.device_id).encode())
+        try:
+            await self.request("geolocation", {"a": [{"m": "AA:BB:CC:DD:EE:FF", "s": "-60", "c": "6"}]},
+                               BACKGROUND)
+            await self.request("oauth_ref_token", {"refresh_token": "1/token", "client_id": "id",
+                                                   "client_secret": "secret"})
+            # Spread the first assistant request over the interval.
+            await asyncio.sleep(random.uniform(0, self.args.interval))
+            while time.time() < deadline:
+                await asyncio.gather(*(self.assistant(user) for user in range(self.args.users)))
+                await asyncio.sleep(self.args.interval)
+        finally:
+            if self.publisher.timer is not None:
+                self.publisher.timer.cancel()
+            receiver.cancel()
+            writer.close()
+
+    async def assistant(self, user):
+        """Triggers an assistant request --burst times and waits for the answer."""
+        first = time.time()
+        request, request_time = None, 0
+        for i in range(self.args.burst):
+            if i:
+                await asyncio.sleep(self.args.burst_gap)
+            if request is not None and not request.done():
+                if self.args.policy == "coalesce" and (time.time() - request_time) < self.args.window:
+                    self.stats["coalesced"] += 1
+                    continue
+                request.cancel()
+                self.stats["superseded"] += 1
+            request_time = time.time()
+            self.generation[user] = self.generation[user] % 255 + 1
+            request = asyncio.ensure_future(self.pipeline(user, self.generation[user]))
+        try:
+            answered = await request
+        except asyncio.CancelledError:
+            answered = False
+        if answered:
+            # Latency from the first trigger to the answer.
+            self.stats["answers"].append((self.device_id, user, time.time() - first))
+
+    async def pipeline(self, user, generation):
+        # The first user does not use a tag, as in the firmware.
+        tag = "/%d" % user if user else ""
+        tag += "/g%d" % generation
+        # One publish per calendar of the set, the first one keeps the base
+        # name. One failing calendar fails the set.
+        calendar = "calendar_event" + ("/%d" % user if user else "")
+        sources = [calendar + ("/c%d" % i if i else "") + "/g%d" % generation
+                   for i in range(self.args.calendars)]
+        errors = await asyncio.gather(*(self.request(source, {"calendar_id": "id", "access_token": "token",
+                                                              "time_min": "", "time_max": "", "etag": ""})
+                                        for source in sources))
+        if any(error is not False for error in errors):
+            return False
+        # One publish per departure candidate and round. A round with every
+        # candidate failed ends the search, it only fails without a result.
+        distance = "dist_" + self.args.mode + ("/%d" % user if user else "")
+        candidates, rounds = 1, 1
+        if self.args.mode == "driving":
+            candidates, rounds = DEPARTURE_CANDIDATES, self.args.rounds
+        answered = False
+        for _ in range(rounds):
+            names = [distance + ("/d%d" % i if i else "") + "/g%d" % generation for i in range(candidates)]
+            errors = await asyncio.gather(*(self.request(name, {"origin": "0,0", "destination": "x",
+                                                                "transit_mode": "bus", "curr_time": "now"})
+                                            for name in names))
+            if all(error is not False for error in errors):
+                break
+            answered = True
+        return answered
+
+    def send(self, event, data, delay):
+        self.stats["sends"].append(time.time())
+        self.delays[event] = delay
+        self.writer.write(("P %s %s\n" % (event, json.dumps(data, separators=(",", ":")))).encode())
+
+    def dropped(self, event):
+        # The request fails with an error response from the device (429).
+        self.stats["dropped"] += 1
+        done = self.responses.get(event)
+        if done is not None and not done.done():
+            done.set_result(True)
+
+    async def request(self, event, data, priority=USER):
+        done = asyncio.get_event_loop().create_future()
+        self.responses[event] = done
+        start = time.time()
+        self.publisher.publish(event, data, priority)
+        await self.writer.drain()
+        # The samples are grouped by event name, without the generation tag.
+        name = untagged(event)
+        try:
+            error = await asyncio.wait_for(done, self.args.timeout)
+        except asyncio.TimeoutError:
+            error = None
+        except asyncio.CancelledError:
+            # Superseded, the publish was wasted.
+            self.samples.append((start, time.time() - start, name, self.device_id, "wasted",
+                                 self.delays.pop(event, None)))
+            raise
+        self.samples.append((start, time.time() - start, name, self.device_id, error,
+                             self.delays.pop(event, None)))
+        return error
+
+    async def receive(self, reader):
+        while True:
+            line = await reader.readline()
+            if not line:
+                return
+            line = line.decode("utf-8", "replace").rstrip("\n")
+            if not line.startswith("E "):
+                continue
+            topic, _, data = line[2:].partition(" ")
+            parts = topic.split("/")
+            if len(parts) < 4:
+                continue
+            # The event name keeps the user and generation tags, the last part
+            # is the chunk index.
+            hook, event = parts[1], "/".join(parts[2:-1])
+            done = self.responses.get(event)
+            if done is None or done.cancelled():
+                # Response of a superseded request.
+                self.stats["stale"] += 1
+                continue
+            if done.done():
+                continue
+            if hook == "hook-error":
+                done.set_result(True)
+            elif END_MARKER in data:
+                done.set_result(False)
+
+
+async def run_shard(first, count, args):
+    stats = {"samples": [], "answers": [], "sends": [], "coalesced": 0, "superseded": 0, "stale": 0,
+             "dropped": 0}
+    deadline = time.time() + args.duration
+    devices = [Device(first + i, args, stats) for i in range(count)]
+    results = await asyncio.gather(*(device.run(deadline) for device in devices), return_exceptions=True)
+    stats["failed"] = sum(1 for result in results if isinstance(result, Exception))
+    return stats
+
+
+def shard_main(shard):
+    first, count, args = shard
+    return asyncio.get_event_loop().run_until_complete(run_shard(first, count, args))
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=7070)
+    parser.add_argument("--devices", type=int, default=100)
+    parser.add_argument("--duration", type=float, default=60, help="seconds")
+    parser.add_argument("--interval", type=float, default=20, help="seconds between assistant requests")
+    parser.add_argument("--timeout", type=float, default=20, help="response timeout in seconds")
+    parser.add_argument("--mode", choices=("transit", "driving"), default="transit")
+    parser.add_argument("--users", type=int, default=1, help="users per device")
+    parser.add_argument("--calendars", type=int, choices=range(1, CALENDAR_MAX_IDS + 1), default=1,
+                        help="calendars per user (calendar set)")
+    parser.add_argument("--rounds", type=int, choices=range(1, DEPARTURE_MAX_ROUNDS + 1),
+                        default=DEPARTURE_MAX_ROUNDS, help="departure search rounds of a driving request")
+    parser.add_argument("--burst", type=int, default=1, help="triggers per assistant request")
+    parser.add_argument("--burst-gap", type=float, default=0.5, help="seconds between triggers")
+    parser.add_argument("--policy", choices=("coalesce", "restart"), default="coalesce")
+    parser.add_argument("--window", type=float, default=10, help="coalesce window in seconds (COALESCE_WINDOW)")
+    parser.add_argument("--workers", type=int, default=multiprocessing.cpu_count())
+    args = parser.parse_args()
+
+    workers = max(1, min(args.workers, args.devices))
+    shards = []
+    first = 0
+    for i in range(workers):
+        count = args.devices // workers + (1 if i < args.devices % workers else 0)
+        shards.append((first, count, args))
+        first += count
+    stats = {"samples": [], "answers": [], "sends": [], "coalesced": 0, "superseded": 0, "stale": 0,
+             "dropped": 0, "failed": 0}
+    with multiprocessing.Pool(workers) as pool:
+        for shard_stats in pool.imap_unordered(shard_main, shards):
+            for key, value in shard_stats.items():
+                stats[key] += value
+    samples, sends, failed = stats["samples"], stats["sends"], stats["failed"]
+
+    if not samples or not sends:
+        print("no requests completed")
+        return
+    start = min(sample[0] for sample in samples)
+    end = max(sample[0] + sample[1] for sample in samples)
+    per_second = {}
+    for send_time in sends:
+        second = int(send_time - start)
+        per_second[second] = per_second.get(second, 0) + 1
+    print("Webhook load model (tools/fleet_sim.py), not firmware measurements.")
+    print("%d modelled devices (%d failed), %d requests, %d publishes sent in %.1f s" %
+          (args.devices, failed, len(samples), len(sends), end - start))
+    print("modelled publish rate: %.1f/s average, %d/s peak, %d publishes dropped (queue full)" %
+          (len(sends) / max(end - start, 1e-3), max(per_second.values()), stats["dropped"]))
+    print("%-18s %8s %8s %8s %8s %8s %8s %8s %8s" %
+          ("event", "count", "errors", "lost", "wasted", "p50 ms", "p90 ms", "p99 ms", "queue p90"))
+    for event in sorted(set(sample[2] for sample in samples)):
+        rows = [sample for sample in samples if sample[2] == event]
+        latency = [sample[1] * 1000 for sample in rows if sample[4] in (True, False)]
+        delay = [sample[5] * 1000 for sample in rows if sample[5] is not None]
+        print("%-18s %8d %8d %8d %8d %8.0f %8.0f %8.0f %8.0f" %
+              (event, len(rows), sum(1 for sample in rows if sample[4] is True),
+               sum(1 for sample in rows if sample[4] is None), sum(1 for sample in rows if sample[4] == "wasted"),
+               percentile(latency, 50), percentile(latency, 90), percentile(latency, 99), percentile(delay, 90)))
+    wasted = sum(1 for sample in samples if sample[4] == "wasted")
+    print("triggers coalesced: %d, superseded: %d, wasted publishes: %d (%.1f%%), stale chunks dropped: %d" %
+          (stats["coalesced"], stats["superseded"], wasted, wasted * 100.0 / len(samples), stats["stale"]))
+    # Latency of a full assistant answer (first trigger to distance matrix
+    # response), averaged per device and user.
+    answers = {}
+    for device_id, user, latency in stats["answers"]:
+        answers.setdefault((device_id, user), []).append(latency * 1000)
+    device_means = [sum(latency) / len(latency) for latency in answers.values()]
+    answered = len(stats["answers"])
+    print("requests answered: %d (%.1f/min)" % (answered, answered * 60.0 / max(end - start, 1e-3)))
+    print("answer latency per device and user: p50 %.0f ms, p90 %.0f ms, p99 %.0f ms, max %.0f ms" %
+          (percentile(device_means, 50), percentile(device_means, 90), percentile(device_means, 99),
+           max(device_means) if device_means else 0))
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,320 @@
+#!/usr/bin/env python3
+"""Local stand-in for the Particle Cloud webhooks and the Google APIs.
+
+The server loads the webhook definitions from webhooks/*.json and, for every
+event published by a device, renders the webhook request (for logging) and
+the response template against a canned Google API response. The result is
+delivered back to the device as hook-response or hook-error events, split in
+512-byte chunks as the Particle Cloud does, after a configurable latency.
+
+Devices connect over TCP (see LOCAL_CLOUD_ENABLED in src/cloud.h) and use a
+line protocol:
+    D <device_id>       device to cloud, sent after connecting.
+    P <event> <data>    device to cloud, webhook event published.
+    E <topic> <data>    cloud to device, webhook response or error response.
+
+Canned responses live in tools/responses/<event>.json:
+    {"latency_ms": 800, "responses": [{"status": 200, "body": {...}}, ...]}
+The latency_ms of a file is the latency of its responses, unless --latency
+is given. Each device walks the list of responses of an event in order, the last one
+is repeated. The generation tag of the event (i.e. calendar_event/g7) is
+ignored, so a restarted request goes on with the list. The string
+"$NOW+<seconds>" inside a body is replaced by an RFC3339 timestamp (UTC), so
+calendar events are always upcoming, and "$UNIX+<seconds>" by a unix
+timestamp (i.e. transit departure times). A request whose If-None-Match
+header matches the "etag" of the body is answered with a 304 (not modified),
+as the Google APIs do for conditional requests.
+
+With --reorder, the chunks of a multi-chunk response are delivered two by
+two swapped (1, 0, 3, 2, ...), as they can arrive from the Particle Cloud.
+
+Usage: tools/local_cloud.py [--port 7070] [--latency 800] [--jitter 200] [--reorder]
+"""
+
+import argparse
+import datetime
+import html
+import json
+import os
+import random
+import re
+import socketserver
+import threading
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WEBHOOKS_DIR = os.path.join(ROOT, "webhooks")
+RESPONSES_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "responses")
+
+# Max. size of a webhook response chunk, as used by the Particle Cloud.
+CHUNK_SIZE = 512
+# Response latency in ms, when neither --latency nor latency_ms is given.
+DEFAULT_LATENCY = 800
+
+TAG_RE = re.compile(r"{{({|#|/|\^)?\s*([\w.]+)\s*}?}}")
+NOW_RE = re.compile(r"\$NOW\+(\d+)")
+UNIX_RE = re.compile(r"\$UNIX\+(\d+)")
+
+
+def lookup(context, name):
+    """Resolves a dotted mustache name (i.e. items.0.start.dateTime)."""
+    if name == ".":
+        return context[-1]
+    for scope in reversed(context):
+        value = scope
+        found = True
+        for key in name.split("."):
+            if isinstance(value, dict) and key in value:
+                value = value[key]
+            elif isinstance(value, list) and key.isdigit() and int(key) < len(value):
+                value = value[int(key)]
+            else:
+                found = False
+                break
+        if found:
+            return value
+    return None
+
+
+def render(template, context):
+    """Renders the subset of mustache used by the webhook templates."""
+    if not isinstance(context, list):
+        context = [context]
+    out = []
+    pos = 0
+    while True:
+        match = TAG_RE.search(template, pos)
+        if match is None:
+            out.append(template[pos:])
+            return "".join(out)
+        out.append(template[pos:match.start()])
+        kind, name = match.group(1), match.group(2)
+        pos = match.end()
+        if kind in ("#", "^"):
+            end = re.search(r"{{/\s*" + re.escape(name) + r"\s*}}", template[pos:])
+            inner = template[pos:pos + end.start()]
+            pos += end.end()
+            value = lookup(context, name)
+            if kind == "^":
+                if not value:
+                    out.append(render(inner, context))
+            elif isinstance(value, list):
+                for item in value:
+                    out.append(render(inner, context + [item]))
+            elif value:
+                out.append(render(inner, context + [value]))
+        else:
+            value = lookup(context, name)
+            if value is None:
+                text = ""
+            elif isinstance(value, bool):
+                text = "true" if value else "false"
+            else:
+                text = str(value)
+            out.append(text if kind == "{" else html.escape(text))
+
+
+def render_object(obj, context):
+    """Renders every string of a JSON object (query, headers, json)."""
+    if isinstance(obj, dict):
+        return {key: render_object(value, context) for key, value in obj.items()}
+    if isinstance(obj, list):
+        return [render_object(value, context) for value in obj]
+    if isinstance(obj, str):
+        return render(obj, context)
+    return obj
+
+
+def expand_now(obj):
+    """Replaces $NOW+<seconds> by an RFC3339 timestamp (UTC) and
+    $UNIX+<seconds> by a unix timestamp."""
+    if isinstance(obj, dict):
+        return {key: expand_now(value) for key, value in obj.items()}
+    if isinstance(obj, list):
+        return [expand_now(value) for value in obj]
+    if isinstance(obj, str):
+        now = datetime.datetime.now(datetime.timezone.utc).replace(microsecond=0)
+        obj = UNIX_RE.sub(lambda m: str(int(now.timestamp()) + int(m.group(1))), obj)
+        return NOW_RE.sub(lambda m: (now + datetime.timedelta(seconds=int(m.group(1))))
+                          .strftime("%Y-%m-%dT%H:%M:%S+00:00"), obj)
+    return obj
+
+
+def load_json_dir(path):
+    result = {}
+    for name in sorted(os.listdir(path)):
+        if name.endswith(".json"):
+            with open(os.path.join(path, name)) as f:
+                result[name[:-5]] = json.load(f)
+    return result
+
+
+def untagged(event):
+    """Removes the request generation tag from an event name (i.e.
+    calendar_event/1/g7 is calendar_event/1)."""
+    return re.sub(r"/g\d+$", "", event)
+
+
+def find_webhook(webhooks, event):
+    """Finds the name of the webhook triggered by an event. Webhooks match the
+    event name prefix (i.e. calendar_event/1 triggers calendar_event)."""
+    best = None
+    for name in webhooks:
+        if event.startswith(name) and (best is None or len(name) > len(best)):
+            best = name
+    return best
+
+
+class Stats:
+    """Counters printed when the server stops."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.start = time.time()
+        self.publishes = {}
+        self.chunks = 0
+        self.errors = 0
+
+    def publish(self, event):
+        with self.lock:
+            event = untagged(event)
+            self.publishes[event] = self.publishes.get(event, 0) + 1
+
+    def delivered(self, chunks, error):
+        with self.lock:
+            self.chunks += chunks
+            self.errors += 1 if error else 0
+
+    def report(self):
+        elapsed = max(time.time() - self.start, 1e-3)
+        total = sum(self.publishes.values())
+        print("\n%d publishes in %.1f s (%.2f/s), %d chunks, %d errors" %
+              (total, elapsed, total / elapsed, self.chunks, self.errors))
+        for event, count in sorted(self.publishes.items()):
+            print("  %-16s %d" % (event, count))
+
+
+class Device_Handler(socketserver.StreamRequestHandler):
+    """Serves one device connection."""
+
+    def setup(self):
+        super().setup()
+        self.device_id = "0" * 24
+        self.sequence = {}
+        self.write_lock = threading.Lock()
+
+    def handle(self):
+        for raw in self.rfile:
+            line = raw.decode("utf-8", "replace").rstrip("\r\n")
+            kind, _, rest = line.partition(" ")
+            if kind == "D":
+                self.device_id = rest.strip()
+                print("device %s connected" % self.device_id)
+            elif kind == "P":
+                event, _, data = rest.partition(" ")
+                self.publish(event, data)
+
+    def publish(self, event, data):
+        server = self.server
+        server.stats.publish(event)
+        name = find_webhook(server.webhooks, event)
+        if name is None:
+            print("%s: no webhook for event %s" % (self.device_id, event))
+            return
+        webhook = server.webhooks[name]
+        try:
+            context = json.loads(data) if data else {}
+        except ValueError:
+            context = {}
+        context.update(PARTICLE_DEVICE_ID=self.device_id, PARTICLE_EVENT_NAME=event,
+                       PARTICLE_EVENT_VALUE=data)
+        request = {key: render_object(webhook[key], context)
+                   for key in ("url", "query", "headers", "json", "body") if key in webhook}
+        if server.verbose:
+            print("%s: %s %s" % (self.device_id, event, json.dumps(request)))
+        canned = server.responses.get(name, {})
+        responses = canned.get("responses") or [{"status": 200, "body": {}}]
+        # The generations of a request walk the same list of responses.
+        index = self.sequence.get(untagged(event), 0)
+        self.sequence[untagged(event)] = index + 1
+        response = responses[min(index, len(responses) - 1)]
+        etag = response.get("body", {}).get("etag")
+        if etag and request.get("headers", {}).get("If-None-Match") == etag:
+            response = {"status": 304}
+        # The --latency flag, when given, takes precedence over the latency
+        # of the canned responses.
+        latency = server.latency if server.latency is not None else canned.get("latency_ms", DEFAULT_LATENCY)
+        latency += random.uniform(-server.jitter, server.jitter)
+        timer = threading.Timer(max(latency, 0) / 1000.0, self.respond,
+                                args=(webhook, context, response))
+        timer.daemon = True
+        timer.start()
+
+    def respond(self, webhook, context, response):
+        status = response.get("status", 200)
+        body = expand_now(response.get("body", {}))
+        if status == 200:
+            topic = render(webhook["responseTopic"], context)
+            payload = render(webhook.get("responseTemplate", ""), body)
+        else:
+            if "errorResponseTopic" not in webhook:
+                # The webhook has no error topic, the device never hears back.
+                self.server.stats.delivered(0, True)
+                return
+            host = re.sub(r"^\w+://([^/]+).*$", r"\1", webhook.get("url", ""))
+            topic = render(webhook["errorResponseTopic"], context)
+            payload = "error status %d from %s" % (status, host)
+        # A response that fills its last chunk is not followed by an empty
+        # one, as with the Particle Cloud.
+        chunks = [payload[i:i + CHUNK_SIZE] for i in range(0, len(payload), CHUNK_SIZE)] or [""]
+        order = list(range(len(chunks)))
+        if self.server.reorder:
+            for i in range(0, len(order) - 1, 2):
+                order[i], order[i + 1] = order[i + 1], order[i]
+        try:
+            with self.write_lock:
+                for index in order:
+                    chunk = chunks[index]
+                    self.wfile.write(("E %s/%d %s\n" % (topic, index, chunk)).encode("utf-8"))
+                self.wfile.flush()
+        except OSError:
+            return
+        self.server.stats.delivered(len(chunks), status != 200)
+
+
+class Local_Cloud(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+    request_queue_size = 1024
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=7070)
+    parser.add_argument("--latency", type=float, help="response latency in ms, overrides latency_ms "
+                        "(default: latency_ms of the canned responses, else %d)" % DEFAULT_LATENCY)
+    parser.add_argument("--jitter", type=float, default=200, help="latency jitter in ms")
+    parser.add_argument("--responses", default=RESPONSES_DIR, help="canned responses directory")
+    parser.add_argument("--reorder", action="store_true", help="deliver the chunks out of order")
+    parser.add_argument("--verbose", action="store_true", help="print the rendered requests")
+    args = parser.parse_args()
+
+    server = Local_Cloud(("", args.port), Device_Handler)
+    server.webhooks = load_json_dir(WEBHOOKS_DIR)
+    server.responses = load_json_dir(args.responses)
+    server.latency = args.latency
+    server.jitter = args.jitter
+    server.reorder = args.reorder
+    server.verbose = args.verbose
+    server.stats = Stats()
+    print("local cloud on port %d, webhooks: %s" % (args.port, ", ".join(server.webhooks)))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.stats.report()
+
+
+if __name__ == "__main__":
+    main()
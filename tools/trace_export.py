@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Converts a flight recorder dump into the Chrome trace-event format.
+
+The dump is printed by the device over the serial port with the "trace"
+command (see TRACE_ENABLED in src/trace.h); save the serial output to a file,
+other lines are ignored. The result can be opened in chrome://tracing or
+https://ui.perfetto.dev.
+
+Every reset found in the ring is shown as a process, with one track for the
+application stage, one per user request and one per OAuth2.0 token slot, so
+the time spent per stage is seen on a timeline. Webhook publishes are shown
+as async slices that end with the last response chunk, or at the end of the
+boot if no response arrived. MP3 commands and returned frames, timers and
+responses are instant events, and the heap snapshots a counter.
+
+Usage: tools/trace_export.py serial.log > trace.json
+"""
+
+import argparse
+import json
+import sys
+
+# Record types, as in Trace_Type (src/trace.h).
+BOOT, APP_STAGE, REQUEST_STAGE, OAUTH2_STATE, PUBLISH, RESPONSE, ERROR, MP3_COMMAND, HEAP, TIMER, MP3_EVENT = range(11)
+
+# Enumerations of the firmware, they must match src/app.h and src/oauth2.h.
+APP_STAGES = ["GEOLOCATION", "OAUTH2", "ASSISTANT", "FAILED"]
+REQUEST_STAGES = ["IDLE", "TOKEN", "CALENDAR", "DISTANCE_MATRIX", "ANSWER"]
+OAUTH2_STATES = ["REQ_USER_CODE", "POLLING_AUTH", "REFRESH_TOKEN", "AUTHORIZED", "WAIT_FOR_RESPONSE", "FAILED"]
+TIMERS = ["POLL_AUTH", "TOKEN_EXPIRED"]
+
+# Track (thread) ids.
+APP_TRACK = 1
+REQUEST_TRACK = 10
+OAUTH2_TRACK = 20
+CLOUD_TRACK = 30
+MP3_TRACK = 40
+
+
+def parse_dump(lines):
+    """Gets the webhook names and the records (time, type, id, arg) of the
+    last complete dump found in the serial output."""
+    names, records, dump = {}, [], None
+    for line in lines:
+        fields = line.split()
+        if "trace" not in fields:
+            continue
+        fields = fields[fields.index("trace") + 1:]
+        if not fields:
+            continue
+        if fields[0] == "begin":
+            dump = ({}, [])
+        elif dump is None:
+            continue
+        elif fields[0] == "name" and len(fields) >= 3:
+            dump[0][int(fields[1], 16)] = fields[2]
+        elif fields[0] == "end":
+            names, records = dump
+            dump = None
+        elif len(fields) == 4:
+            dump[1].append(tuple(int(field, 16) for field in fields))
+    return names, records
+
+
+def split_boots(records):
+    """Splits the records at every reset, and unwraps the 32-bit microsecond
+    timestamps within a boot. The records before the first reset belong to
+    a boot whose reset record was overwritten."""
+    boots, current, last, offset = [], None, None, 0
+    for time, kind, ident, arg in records:
+        if kind == BOOT or current is None:
+            current = {"reset_reason": arg if kind == BOOT else None, "records": []}
+            boots.append(current)
+            last, offset = None, 0
+        if last is not None and time + offset < last:
+            offset += 1 << 32
+        last = time + offset
+        current["records"].append((last, kind, ident, arg))
+    return boots
+
+
+def name_of(table, index):
+    return table[index] if index < len(table) else str(index)
+
+
+def export(names, records):
+    events = []
+
+    def meta(pid, tid, kind, name):
+        events.append({"ph": "M", "pid": pid, "tid": tid, "name": kind, "args": {"name": name}})
+
+    for pid, boot in enumerate(split_boots(records), 1):
+        rows = boot["records"]
+        start, end = rows[0][0], rows[-1][0]
+        label = "boot %d" % pid
+        if boot["reset_reason"] is not None:
+            label += " (reset reason %d)" % boot["reset_reason"]
+        meta(pid, 0, "process_name", label)
+        # Stage slices, open until the next stage of the same track.
+        stages = {}
+
+        def enter(tid, track, name, time):
+            if tid in stages:
+                begin, last = stages.pop(tid)
+                events.append({"ph": "X", "pid": pid, "tid": tid, "name": last, "ts": begin - start,
+                               "dur": time - begin})
+            else:
+                meta(pid, tid, "thread_name", track)
+            if name is not None:
+                stages[tid] = (time, name)
+
+        # Webhook requests, open until the next publish of the same webhook
+        # and generation.
+        requests = {}
+
+        def close(key):
+            begin, last = requests.pop(key)
+            webhook = names.get(key[0], "webhook %d" % key[0])
+            args = {"generation": key[1]}
+            if last is None:
+                last = end
+                args["response"] = "none"
+            events.append({"ph": "b", "cat": "webhook", "pid": pid, "tid": CLOUD_TRACK, "id": "%d-%d" % key,
+                           "name": webhook, "ts": begin - start, "args": args})
+            events.append({"ph": "e", "cat": "webhook", "pid": pid, "tid": CLOUD_TRACK, "id": "%d-%d" % key,
+                           "name": webhook, "ts": last - start})
+
+        meta(pid, CLOUD_TRACK, "thread_name", "cloud")
+        meta(pid, MP3_TRACK, "thread_name", "mp3")
+        for time, kind, ident, arg in rows:
+            ts = time - start
+            if kind == BOOT:
+                events.append({"ph": "i", "s": "p", "pid": pid, "tid": APP_TRACK, "name": "reset", "ts": ts,
+                               "args": {"reason": arg}})
+            elif kind == APP_STAGE:
+                enter(APP_TRACK, "app stage", name_of(APP_STAGES, arg), time)
+            elif kind == REQUEST_STAGE:
+                enter(REQUEST_TRACK + ident, "user %d request" % ident, name_of(REQUEST_STAGES, arg), time)
+            elif kind == OAUTH2_STATE:
+                enter(OAUTH2_TRACK + ident, "oauth2 slot %d" % ident, name_of(OAUTH2_STATES, arg), time)
+            elif kind == PUBLISH:
+                key = (ident, arg)
+                if key in requests:
+                    close(key)
+                requests[key] = (time, None)
+            elif kind in (RESPONSE, ERROR):
+                key = (ident, arg >> 8)
+                if key in requests:
+                    requests[key] = (requests[key][0], time)
+                events.append({"ph": "i", "s": "t", "pid": pid, "tid": CLOUD_TRACK, "ts": ts,
+                               "name": "%s %s" % ("hook-response" if kind == RESPONSE else "hook-error",
+                                                  names.get(ident, "webhook %d" % ident)),
+                               "args": {"generation": arg >> 8, "chunk": arg & 0xFF}})
+            elif kind == MP3_COMMAND:
+                events.append({"ph": "i", "s": "t", "pid": pid, "tid": MP3_TRACK, "ts": ts,
+                               "name": "cmd 0x%02X" % ident, "args": {"param": arg}})
+            elif kind == MP3_EVENT:
+                events.append({"ph": "i", "s": "t", "pid": pid, "tid": MP3_TRACK, "ts": ts,
+                               "name": "ret 0x%02X" % ident, "args": {"param": arg}})
+            elif kind == HEAP:
+                events.append({"ph": "C", "pid": pid, "name": "heap", "ts": ts,
+                               "args": {"free": (ident << 16) | arg}})
+            elif kind == TIMER:
+                events.append({"ph": "i", "s": "t", "pid": pid, "tid": OAUTH2_TRACK + arg, "ts": ts,
+                               "name": name_of(TIMERS, ident)})
+        # The stages and requests still open last until the end of the boot.
+        for tid in list(stages):
+            enter(tid, None, None, end)
+        for key in list(requests):
+            close(key)
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", nargs="?", help="serial output holding the dump (stdin by default)")
+    args = parser.parse_args()
+    with (open(args.dump, errors="replace") if args.dump else sys.stdin) as source:
+        names, records = parse_dump(source)
+    if not records:
+        sys.exit("no trace dump found")
+    json.dump(export(names, records), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()